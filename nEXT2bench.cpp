@@ -0,0 +1,790 @@
+/**
+ * Descrição: Benchmark do nEXT2shell. Gera em processo uma imagem EXT2 sintética (tamanho de bloco, número de grupos,
+ * ramificação de diretórios e distribuição de tamanhos configuráveis), executa sobre ela cenários cronometrados com
+ * as mesmas funções chamadas pelo shell e reporta os resultados em JSON na saída padrão.
+ *
+ * Uso: ./nEXT2bench [--block-size N] [--groups N] [--inodes-per-group N] [--fanout N] [--depth N] [--files N]
+ *                   [--file-size MIN:MAX] [--large N:TAMANHO] [--storm N] [--repeat N] [--seed N] [--image ARQUIVO]
+ *
+ * Com --image, apenas gera a imagem em ARQUIVO, sem executar os cenários.
+ */
+
+#include <random> // Antes do shell, cujas macros (ex.: block_size) colidem com nomes da biblioteca padrão
+#include <math.h>
+
+#define NEXT2SHELL_SEM_MAIN
+#include "nEXT2shell.cpp"
+
+// Parâmetros da imagem e dos cenários
+struct ConfigBench
+{
+	unsigned int tamBloco = 1024;			 // Tamanho do bloco
+	unsigned int grupos = 8;				 // Número de grupos de blocos
+	unsigned int inodesPorGrupo = 2048;		 // Inodes por grupo (múltiplo de 8)
+	unsigned int ramificacao = 4;			 // Subdiretórios por diretório
+	unsigned int profundidade = 2;			 // Níveis de subdiretórios abaixo da raiz
+	unsigned int arquivosPorDir = 16;		 // Arquivos regulares por diretório
+	unsigned long tamMinimo = 256;			 // Tamanho mínimo dos arquivos (distribuição log-uniforme)
+	unsigned long tamMaximo = 64 << 10;		 // Tamanho máximo dos arquivos
+	unsigned int arquivosGrandes = 4;		 // Arquivos grandes na raiz, usados pelo cenário 'rm'
+	unsigned long tamGrande = 4 << 20;		 // Tamanho de cada arquivo grande
+	unsigned int tempestade = 40;			 // Entradas criadas pelo cenário 'mkdir_touch'
+	unsigned int repeticoes = 3;			 // Repetições dos cenários somente leitura
+	unsigned int semente = 1;				 // Semente da distribuição de tamanhos
+	const char *imagem = NULL;				 // Se não for nulo, apenas gera a imagem neste arquivo
+};
+
+// Diretório gerado: caminho a partir da raiz e arquivos regulares que contém
+struct DiretorioGerado
+{
+	vector<string> caminho;
+	vector<pair<string, unsigned long>> arquivos; // (nome, tamanho)
+};
+
+// Estado do gerador: bitmaps, descritores e Tabelas de Inodes mantidos em memória até o fim da geração
+struct Gerador
+{
+	int fdImagem;
+	vector<struct ext2_group_desc> grupos;
+	vector<vector<unsigned char>> bitmapBlocos;
+	vector<vector<unsigned char>> bitmapInodes;
+	vector<vector<char>> tabelas;
+	vector<char> padrao; // Conteúdo escrito nos blocos de dados
+	unsigned int proximoGrupoDir = 0;
+	unsigned long blocosUsados = 0;
+	unsigned long inodesUsados = 0;
+};
+
+// Resultado de um cenário
+struct ResultadoCenario
+{
+	string nome;
+	vector<double> latencias; // Segundos por operação
+	double segundos = 0;
+	unsigned long long bytes = 0; // Dados de arquivos processados
+	unsigned long long contadores[NUM_CONTADORES] = {}; // Variação dos contadores do motor
+};
+
+static unsigned long inicioGrupo(unsigned int g)
+{
+	return super.s_first_data_block + (unsigned long)g * super.s_blocks_per_group;
+}
+
+// Aloca um Inode livre a partir do grupo 'g', avançando para os grupos seguintes se ele estiver cheio
+static unsigned int alocaInodeGerado(struct Gerador *ger, unsigned int g, int diretorio)
+{
+	for (unsigned int k = 0; k < ger->grupos.size(); k++)
+	{
+		unsigned int grupo = (g + k) % ger->grupos.size();
+		vector<unsigned char> &bitmap = ger->bitmapInodes[grupo];
+
+		if (ger->grupos[grupo].bg_free_inodes_count == 0)
+			continue;
+
+		for (unsigned int i = 0; i < super.s_inodes_per_group; i++)
+		{
+			if (bitmap[i / 8] & (1 << (i % 8)))
+				continue;
+
+			bitmap[i / 8] |= 1 << (i % 8);
+			ger->grupos[grupo].bg_free_inodes_count--;
+			ger->inodesUsados++;
+
+			if (diretorio)
+				ger->grupos[grupo].bg_used_dirs_count++;
+
+			return grupo * super.s_inodes_per_group + i + 1;
+		}
+	}
+
+	fprintf(stderr, "bench: out of inodes, increase --inodes-per-group or --groups.\n");
+	exit(1);
+}
+
+// Aloca 'n' blocos livres a partir do grupo 'g', contíguos sempre que possível
+static vector<unsigned int> alocaBlocosGerados(struct Gerador *ger, unsigned int g, unsigned long n)
+{
+	vector<unsigned int> blocos;
+
+	for (unsigned int k = 0; k < ger->grupos.size() && blocos.size() < n; k++)
+	{
+		unsigned int grupo = (g + k) % ger->grupos.size();
+		vector<unsigned char> &bitmap = ger->bitmapBlocos[grupo];
+
+		for (unsigned long i = 0; i < blocosNoGrupo(grupo) && blocos.size() < n; i++)
+		{
+			if (bitmap[i / 8] & (1 << (i % 8)))
+				continue;
+
+			bitmap[i / 8] |= 1 << (i % 8);
+			ger->grupos[grupo].bg_free_blocks_count--;
+			blocos.push_back(inicioGrupo(grupo) + i);
+		}
+	}
+
+	if (blocos.size() < n)
+	{
+		fprintf(stderr, "bench: out of blocks, increase --groups.\n");
+		exit(1);
+	}
+
+	ger->blocosUsados += n;
+
+	return blocos;
+}
+
+static struct ext2_inode *inodeGerado(struct Gerador *ger, unsigned int numInode)
+{
+	unsigned int g = (numInode - 1) / super.s_inodes_per_group;
+	unsigned int indice = (numInode - 1) % super.s_inodes_per_group;
+
+	return (struct ext2_inode *)(ger->tabelas[g].data() + (size_t)indice * inode_size);
+}
+
+static void iniciaInodeGerado(struct ext2_inode *inode, unsigned int modo, unsigned int links)
+{
+	unsigned int agora = time(NULL);
+
+	memset(inode, 0, sizeof(struct ext2_inode));
+	inode->i_mode = modo;
+	inode->i_links_count = links;
+	inode->i_atime = inode->i_ctime = inode->i_mtime = agora;
+}
+
+// Escreve 'blocos' com o conteúdo padrão, agrupando os blocos consecutivos em uma única escrita
+static void escreveDadosGerados(struct Gerador *ger, const vector<unsigned int> &blocos)
+{
+	unsigned long porEscrita = ger->padrao.size() / block_size;
+
+	for (size_t i = 0; i < blocos.size();)
+	{
+		size_t fim = i + 1;
+
+		while (fim < blocos.size() && fim - i < porEscrita && blocos[fim] == blocos[fim - 1] + 1)
+			fim++;
+
+		pwrite(ger->fdImagem, ger->padrao.data(), (fim - i) * block_size, BLOCK_OFFSET(blocos[i]));
+		i = fim;
+	}
+}
+
+// Cria um arquivo regular de 'tamanho' bytes no grupo 'g' e retorna seu Inode
+static unsigned int geraArquivo(struct Gerador *ger, unsigned int g, unsigned long tamanho)
+{
+	unsigned int numInode = alocaInodeGerado(ger, g, 0);
+	struct ext2_inode inode;
+	unsigned long numDados = (tamanho + block_size - 1) / block_size;
+	unsigned long total = numDados + blocosIndiretosNecessarios(numDados);
+	vector<struct BlocoPlanejado> indiretos;
+	vector<unsigned int> dados;
+
+	iniciaInodeGerado(&inode, S_IFREG | 0644, 1);
+	inode.i_size = tamanho;
+	inode.i_dir_acl = (unsigned long long)tamanho >> 32;
+
+	if (inode.i_dir_acl)
+		super.s_feature_ro_compat |= EXT2_FEATURE_RO_COMPAT_LARGE_FILE;
+	inode.i_blocks = total * (block_size / 512);
+
+	if (total > 0)
+	{
+		vector<unsigned int> blocos = alocaBlocosGerados(ger, g, total);
+
+		montaMapaBlocos(&inode, blocos, numDados, indiretos, dados);
+		escreveDadosGerados(ger, dados);
+
+		for (auto &indireto : indiretos)
+			pwrite(ger->fdImagem, indireto.dados.data(), block_size, BLOCK_OFFSET(indireto.bloco));
+	}
+
+	memcpy(inodeGerado(ger, numInode), &inode, sizeof(struct ext2_inode));
+
+	return numInode;
+}
+
+// Escreve o diretório 'numInode' com as entradas 'entradas' nos blocos 'blocos'
+static void escreveDiretorioGerado(struct Gerador *ger, unsigned int numInode, const vector<struct EntradaDir> &entradas,
+								   const vector<unsigned int> &blocos, unsigned int links)
+{
+	struct ext2_inode *inode = inodeGerado(ger, numInode);
+	vector<char> conteudo;
+
+	empacotaEntradas(entradas, &conteudo);
+
+	iniciaInodeGerado(inode, S_IFDIR | 0755, links);
+	inode->i_size = blocos.size() * block_size;
+	inode->i_blocks = blocos.size() * (block_size / 512);
+
+	for (size_t i = 0; i < blocos.size(); i++)
+	{
+		inode->i_block[i] = blocos[i];
+		pwrite(ger->fdImagem, conteudo.data() + i * block_size, block_size, BLOCK_OFFSET(blocos[i]));
+	}
+}
+
+// Sorteia o tamanho de um arquivo com distribuição log-uniforme entre os limites da configuração
+static unsigned long sorteiaTamanho(const struct ConfigBench &cfg, mt19937_64 &gerador)
+{
+	uniform_real_distribution<double> expoente(log((double)cfg.tamMinimo), log((double)cfg.tamMaximo));
+
+	return (unsigned long)exp(expoente(gerador));
+}
+
+/* Gera recursivamente o diretório de Inode 'numInode' (filho de 'pai'), com 'nivel' níveis de subdiretórios abaixo dele
+
+extras: entradas adicionais do diretório (usado pela raiz)
+*/
+static void geraDiretorio(struct Gerador *ger, const struct ConfigBench &cfg, mt19937_64 &gerador, unsigned int numInode,
+						  unsigned int pai, unsigned int nivel, vector<string> caminho, vector<struct EntradaDir> extras,
+						  vector<struct DiretorioGerado> &diretorios)
+{
+	unsigned int g = (numInode - 1) / super.s_inodes_per_group;
+	unsigned int numSubdirs = nivel > 0 ? cfg.ramificacao : 0;
+	vector<struct EntradaDir> entradas = {{numInode, tipoEntrada(S_IFDIR), "."}, {pai, tipoEntrada(S_IFDIR), ".."}};
+	struct DiretorioGerado gerado;
+	vector<unsigned int> subdirs;
+
+	entradas.insert(entradas.end(), extras.begin(), extras.end());
+	gerado.caminho = caminho;
+
+	// Nomes conhecidos de antemão: os blocos do diretório são alocados antes dos filhos, próximos ao seu Inode
+	for (unsigned int i = 0; i < cfg.arquivosPorDir; i++)
+		entradas.push_back({0, tipoEntrada(S_IFREG), "f" + to_string(i)});
+	for (unsigned int i = 0; i < numSubdirs; i++)
+		entradas.push_back({0, tipoEntrada(S_IFDIR), "d" + to_string(i)});
+
+	vector<unsigned int> blocos = alocaBlocosGerados(ger, g, empacotaEntradas(entradas, NULL));
+	size_t primeiro = entradas.size() - cfg.arquivosPorDir - numSubdirs;
+
+	for (unsigned int i = 0; i < cfg.arquivosPorDir; i++)
+	{
+		unsigned long tamanho = sorteiaTamanho(cfg, gerador);
+
+		entradas[primeiro + i].inode = geraArquivo(ger, g, tamanho);
+		gerado.arquivos.push_back({entradas[primeiro + i].nome, tamanho});
+	}
+
+	// Subdiretórios distribuídos entre os grupos
+	for (unsigned int i = 0; i < numSubdirs; i++)
+	{
+		unsigned int grupo = ger->proximoGrupoDir++ % ger->grupos.size();
+
+		subdirs.push_back(alocaInodeGerado(ger, grupo, 1));
+		entradas[primeiro + cfg.arquivosPorDir + i].inode = subdirs.back();
+	}
+
+	escreveDiretorioGerado(ger, numInode, entradas, blocos, 2 + numSubdirs);
+	diretorios.push_back(gerado);
+
+	for (unsigned int i = 0; i < numSubdirs; i++)
+	{
+		vector<string> caminhoFilho = caminho;
+
+		caminhoFilho.push_back("d" + to_string(i));
+		geraDiretorio(ger, cfg, gerador, subdirs[i], numInode, nivel - 1, caminhoFilho, {}, diretorios);
+	}
+}
+
+// Grava os bitmaps, Tabelas de Inodes, descritores e Superbloco (com suas cópias) do gerador
+static void gravaMetadadosGerados(struct Gerador *ger)
+{
+	vector<char> gdt(((ger->grupos.size() * sizeof(struct ext2_group_desc) + block_size - 1) / block_size) * block_size, 0);
+
+	super.s_free_blocks_count = 0;
+	super.s_free_inodes_count = 0;
+
+	for (unsigned int g = 0; g < ger->grupos.size(); g++)
+	{
+		super.s_free_blocks_count += ger->grupos[g].bg_free_blocks_count;
+		super.s_free_inodes_count += ger->grupos[g].bg_free_inodes_count;
+
+		pwrite(ger->fdImagem, ger->bitmapBlocos[g].data(), block_size, BLOCK_OFFSET(ger->grupos[g].bg_block_bitmap));
+		pwrite(ger->fdImagem, ger->bitmapInodes[g].data(), block_size, BLOCK_OFFSET(ger->grupos[g].bg_inode_bitmap));
+		pwrite(ger->fdImagem, ger->tabelas[g].data(), ger->tabelas[g].size(), BLOCK_OFFSET(ger->grupos[g].bg_inode_table));
+	}
+
+	memcpy(gdt.data(), ger->grupos.data(), ger->grupos.size() * sizeof(struct ext2_group_desc));
+
+	for (unsigned int g = 0; g < ger->grupos.size(); g++)
+	{
+		if (!grupoTemSuper(g))
+			continue;
+
+		struct ext2_super_block copia = super;
+		off_t offsetSuper = (g == 0) ? BASE_OFFSET : BLOCK_OFFSET(inicioGrupo(g));
+
+		copia.s_block_group_nr = g;
+		pwrite(ger->fdImagem, &copia, sizeof(copia), offsetSuper);
+		pwrite(ger->fdImagem, gdt.data(), gdt.size(), BLOCK_OFFSET(inicioGrupo(g) + 1));
+	}
+}
+
+/* Gera em 'arquivo' uma imagem EXT2 (revisão 1, Inodes de 128 bytes, sparse_super e filetype) conforme 'cfg'
+
+diretorios: recebe os diretórios gerados, na ordem de criação
+*/
+static void geraImagem(const char *arquivo, const struct ConfigBench &cfg, vector<struct DiretorioGerado> &diretorios)
+{
+	struct Gerador ger;
+	mt19937_64 gerador(cfg.semente);
+	unsigned int logBloco = 0;
+
+	while ((1024u << logBloco) < cfg.tamBloco)
+		logBloco++;
+
+	memset(&super, 0, sizeof(super));
+	super.s_log_block_size = logBloco;
+	super.s_log_frag_size = logBloco;
+	super.s_first_data_block = (cfg.tamBloco == 1024) ? 1 : 0;
+	super.s_blocks_per_group = min(8 * cfg.tamBloco, 65528u); // Contadores de blocos livres dos descritores têm 16 bits
+	super.s_frags_per_group = super.s_blocks_per_group;
+	super.s_inodes_per_group = cfg.inodesPorGrupo;
+	super.s_blocks_count = super.s_first_data_block + cfg.grupos * super.s_blocks_per_group;
+	super.s_inodes_count = cfg.grupos * cfg.inodesPorGrupo;
+	super.s_wtime = super.s_lastcheck = time(NULL);
+	super.s_max_mnt_count = -1;
+	super.s_magic = EXT2_SUPER_MAGIC;
+	super.s_state = 1;
+	super.s_errors = 1;
+	super.s_rev_level = 1;
+	super.s_first_ino = 11;
+	super.s_inode_size = sizeof(struct ext2_inode);
+	super.s_feature_incompat = EXT2_FEATURE_INCOMPAT_FILETYPE;
+	super.s_feature_ro_compat = EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER;
+
+	for (int i = 0; i < 16; i++)
+		super.s_uuid[i] = gerador();
+
+	if ((ger.fdImagem = open(arquivo, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0 ||
+		ftruncate(ger.fdImagem, (off_t)super.s_blocks_count * block_size) < 0)
+	{
+		perror(arquivo);
+		exit(1);
+	}
+
+	unsigned long blocosGdt = (cfg.grupos * sizeof(struct ext2_group_desc) + block_size - 1) / block_size;
+	unsigned long blocosTabela = ((unsigned long)cfg.inodesPorGrupo * inode_size + block_size - 1) / block_size;
+
+	ger.grupos.assign(cfg.grupos, {});
+	ger.bitmapBlocos.assign(cfg.grupos, vector<unsigned char>(block_size, 0));
+	ger.bitmapInodes.assign(cfg.grupos, vector<unsigned char>(block_size, 0xFF));
+	ger.tabelas.assign(cfg.grupos, vector<char>(blocosTabela * block_size, 0));
+	ger.padrao.resize(1 << 20);
+
+	for (size_t i = 0; i < ger.padrao.size(); i++)
+		ger.padrao[i] = (i % 64 == 63) ? '\n' : 'a' + (i % 26);
+
+	// Metadados de cada grupo no início do grupo, após a cópia do Superbloco e dos descritores
+	for (unsigned int g = 0; g < cfg.grupos; g++)
+	{
+		unsigned long usados = (grupoTemSuper(g) ? 1 + blocosGdt : 0);
+		struct ext2_group_desc *grupo = &ger.grupos[g];
+
+		grupo->bg_block_bitmap = inicioGrupo(g) + usados;
+		grupo->bg_inode_bitmap = grupo->bg_block_bitmap + 1;
+		grupo->bg_inode_table = grupo->bg_inode_bitmap + 1;
+		usados += 2 + blocosTabela;
+
+		for (unsigned long i = 0; i < 8ul * block_size; i++)
+			if (i < usados || i >= blocosNoGrupo(g))
+				ger.bitmapBlocos[g][i / 8] |= 1 << (i % 8);
+		for (unsigned int i = 0; i < cfg.inodesPorGrupo; i++)
+			ger.bitmapInodes[g][i / 8] &= ~(1 << (i % 8));
+
+		grupo->bg_free_blocks_count = blocosNoGrupo(g) - usados;
+		grupo->bg_free_inodes_count = cfg.inodesPorGrupo;
+		ger.blocosUsados += usados;
+	}
+
+	// Inodes reservados (1 a 10)
+	for (unsigned int i = 1; i < EXT2_FIRST_INO; i++)
+		alocaInodeGerado(&ger, 0, i == EXT2_ROOT_INO);
+
+	unsigned int lostFound = alocaInodeGerado(&ger, 0, 1);
+
+	escreveDiretorioGerado(&ger, lostFound, {{lostFound, tipoEntrada(S_IFDIR), "."}, {EXT2_ROOT_INO, tipoEntrada(S_IFDIR), ".."}},
+						   alocaBlocosGerados(&ger, 0, 1), 2);
+
+	// Raiz: lost+found, arquivos grandes e o diretório vazio usado pelo cenário 'mkdir_touch'
+	vector<struct EntradaDir> extras = {{lostFound, tipoEntrada(S_IFDIR), "lost+found"}};
+
+	for (unsigned int i = 0; i < cfg.arquivosGrandes; i++)
+		extras.push_back({geraArquivo(&ger, 0, cfg.tamGrande), tipoEntrada(S_IFREG), "big" + to_string(i)});
+
+	unsigned int tempestade = alocaInodeGerado(&ger, 0, 1);
+
+	escreveDiretorioGerado(&ger, tempestade, {{tempestade, tipoEntrada(S_IFDIR), "."}, {EXT2_ROOT_INO, tipoEntrada(S_IFDIR), ".."}},
+						   alocaBlocosGerados(&ger, 0, 1), 2);
+	extras.push_back({tempestade, tipoEntrada(S_IFDIR), "storm"});
+
+	geraDiretorio(&ger, cfg, gerador, EXT2_ROOT_INO, EXT2_ROOT_INO, cfg.profundidade, {}, extras, diretorios);
+
+	// A raiz é referenciada também pelo '..' de lost+found e de storm
+	inodeGerado(&ger, EXT2_ROOT_INO)->i_links_count += 2;
+
+	gravaMetadadosGerados(&ger);
+	close(ger.fdImagem);
+}
+
+// Posiciona 'inode' e 'group' no diretório 'caminho', a partir da raiz
+static void entraDiretorio(const vector<string> &caminho, struct ext2_inode *inode, struct ext2_group_desc *group)
+{
+	grupoAtual = 0;
+	read_image(group, sizeof(struct ext2_group_desc), GDT_OFFSET);
+	read_inode(EXT2_ROOT_INO, group, inode);
+
+	for (auto &nome : caminho)
+		funct_cd(inode, group, &grupoAtual, (char *)nome.c_str());
+
+	vetorCaminhoAtual.clear();
+}
+
+// Executa 'operacao' registrando sua latência e as chamadas de E/S emitidas em 'resultado'
+static void cronometra(struct ResultadoCenario &resultado, const function<void()> &operacao)
+{
+	unsigned long long antes[NUM_CONTADORES], depois[NUM_CONTADORES];
+
+	amostraContadores(antes);
+	auto inicio = chrono::steady_clock::now();
+
+	operacao();
+	liberaTemporarios(); // Como o shell faz ao fim de cada comando
+
+	double segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+
+	amostraContadores(depois);
+	resultado.latencias.push_back(segundos);
+	resultado.segundos += segundos;
+
+	for (int i = 0; i < NUM_CONTADORES; i++)
+		resultado.contadores[i] += depois[i] - antes[i];
+}
+
+// Percentil 'p' (0 a 100) das latências, em microssegundos
+static double percentil(vector<double> latencias, double p)
+{
+	if (latencias.empty())
+		return 0;
+
+	sort(latencias.begin(), latencias.end());
+
+	size_t posicao = (size_t)ceil(p / 100.0 * latencias.size());
+
+	return latencias[posicao > 0 ? posicao - 1 : 0] * 1e6;
+}
+
+static void imprimeResultado(FILE *saida, const struct ResultadoCenario &r, int ultimo)
+{
+	double segundos = r.segundos > 0 ? r.segundos : 1e-9;
+	const unsigned long long *c = r.contadores;
+
+	fprintf(saida,
+			"    {\"name\": \"%s\", \"ops\": %zu, \"seconds\": %.6f, \"ops_per_sec\": %.1f, \"mb_per_sec\": %.2f, "
+			"\"p50_us\": %.1f, \"p99_us\": %.1f, \"syscalls\": {\"pread\": %llu, \"pwrite\": %llu, \"fsync\": %llu}, "
+			"\"bytes_read\": %llu, \"bytes_written\": %llu, \"seeks\": %llu, \"alloc_probes\": %llu}%s\n",
+			r.nome.c_str(), r.latencias.size(), r.segundos, r.latencias.size() / segundos, r.bytes / segundos / (1 << 20),
+			percentil(r.latencias, 50), percentil(r.latencias, 99), c[CONT_LEITURAS], c[CONT_ESCRITAS], c[CONT_SINCRONIZACOES],
+			c[CONT_BYTES_LIDOS], c[CONT_BYTES_ESCRITOS], c[CONT_SALTOS], c[CONT_SONDAGENS], ultimo ? "" : ",");
+}
+
+// Interpreta 'texto' como um tamanho com sufixo opcional K, M ou G
+static unsigned long leTamanho(const char *texto)
+{
+	char *fim;
+	unsigned long valor = strtoul(texto, &fim, 10);
+
+	switch (*fim)
+	{
+	case 'G':
+	case 'g':
+		valor <<= 10;
+		// fallthrough
+	case 'M':
+	case 'm':
+		valor <<= 10;
+		// fallthrough
+	case 'K':
+	case 'k':
+		valor <<= 10;
+	}
+
+	return valor;
+}
+
+static void uso()
+{
+	fprintf(stderr, "usage: nEXT2bench [--block-size N] [--groups N] [--inodes-per-group N] [--fanout N] [--depth N] [--files N]\n"
+					"                  [--file-size MIN:MAX] [--large N:SIZE] [--storm N] [--repeat N] [--seed N] [--image FILE]\n");
+	exit(1);
+}
+
+static void leArgumentos(int argc, char **argv, struct ConfigBench &cfg)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 >= argc)
+			uso();
+
+		const char *opcao = argv[i];
+		const char *valor = argv[++i];
+		const char *separador = strchr(valor, ':');
+
+		if (!strcmp(opcao, "--block-size"))
+			cfg.tamBloco = leTamanho(valor);
+		else if (!strcmp(opcao, "--groups"))
+			cfg.grupos = atoi(valor);
+		else if (!strcmp(opcao, "--inodes-per-group"))
+			cfg.inodesPorGrupo = atoi(valor);
+		else if (!strcmp(opcao, "--fanout"))
+			cfg.ramificacao = atoi(valor);
+		else if (!strcmp(opcao, "--depth"))
+			cfg.profundidade = atoi(valor);
+		else if (!strcmp(opcao, "--files"))
+			cfg.arquivosPorDir = atoi(valor);
+		else if (!strcmp(opcao, "--file-size") && separador)
+		{
+			cfg.tamMinimo = leTamanho(valor);
+			cfg.tamMaximo = leTamanho(separador + 1);
+		}
+		else if (!strcmp(opcao, "--large") && separador)
+		{
+			cfg.arquivosGrandes = atoi(valor);
+			cfg.tamGrande = leTamanho(separador + 1);
+		}
+		else if (!strcmp(opcao, "--storm"))
+			cfg.tempestade = atoi(valor);
+		else if (!strcmp(opcao, "--repeat"))
+			cfg.repeticoes = atoi(valor);
+		else if (!strcmp(opcao, "--seed"))
+			cfg.semente = atoi(valor);
+		else if (!strcmp(opcao, "--image"))
+			cfg.imagem = valor;
+		else
+			uso();
+	}
+
+	if (cfg.tamBloco < 1024 || cfg.tamBloco > 65536 || (cfg.tamBloco & (cfg.tamBloco - 1)) || cfg.grupos == 0 ||
+		cfg.inodesPorGrupo == 0 || cfg.inodesPorGrupo % 8 || cfg.inodesPorGrupo > 8 * cfg.tamBloco ||
+		cfg.tamMinimo == 0 || cfg.tamMinimo > cfg.tamMaximo || cfg.repeticoes == 0)
+		uso();
+}
+
+int main(int argc, char **argv)
+{
+	struct ConfigBench cfg;
+	vector<struct DiretorioGerado> diretorios;
+	vector<struct ResultadoCenario> resultados;
+	struct ext2_inode inode;
+	struct ext2_group_desc group;
+	char diretorioTemp[] = "/tmp/nEXT2bench.XXXXXX";
+
+	leArgumentos(argc, argv, cfg);
+
+	if (cfg.imagem)
+	{
+		geraImagem(cfg.imagem, cfg, diretorios);
+		return 0;
+	}
+
+	// A imagem é gerada em um diretório temporário, pois o shell abre sempre FD_DEVICE no diretório corrente
+	if (!mkdtemp(diretorioTemp) || chdir(diretorioTemp) < 0)
+	{
+		perror(diretorioTemp);
+		return 1;
+	}
+
+	auto inicio = chrono::steady_clock::now();
+	geraImagem(FD_DEVICE, cfg, diretorios);
+	double segundosGeracao = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+
+	// A saída dos comandos é descartada; o JSON vai para a saída padrão original
+	FILE *saida = fdopen(dup(STDOUT_FILENO), "w");
+	int nulo = open("/dev/null", O_WRONLY);
+
+	fflush(stdout);
+	dup2(nulo, STDOUT_FILENO);
+	close(nulo);
+
+	init_super(&group, &inode);
+
+	string destinoCp = string(diretorioTemp) + "/cp.out";
+	struct ResultadoCenario lookup, ls, cat, cp, mkdirTouch, lote, leituraAleatoria, rm, rmRecursivo, liberacao, clone, diferenca;
+
+	lookup.nome = "lookup";
+	ls.nome = "ls";
+	cat.nome = "cat";
+	cp.nome = "cp";
+	mkdirTouch.nome = "mkdir_touch";
+	lote.nome = "batch_touch_rm";
+	leituraAleatoria.nome = "read_random";
+	rm.nome = "rm_large";
+	rmRecursivo.nome = "rm_recursive";
+	liberacao.nome = "orphan_release";
+	clone.nome = "clone";
+	diferenca.nome = "clone_diff";
+
+	for (unsigned int rep = 0; rep < cfg.repeticoes; rep++)
+	{
+		for (auto &dir : diretorios)
+		{
+			entraDiretorio(dir.caminho, &inode, &group);
+
+			cronometra(ls, [&]
+					   { funct_ls(&inode, &group); });
+
+			for (auto &arquivo : dir.arquivos)
+			{
+				long valorInode;
+				string ausente = arquivo.first + "x";
+
+				cronometra(lookup, [&]
+						   { read_dir(&inode, &group, &valorInode, (char *)arquivo.first.c_str()); });
+				cronometra(lookup, [&]
+						   { read_dir(&inode, &group, &valorInode, (char *)ausente.c_str()); });
+
+				cronometra(cat, [&]
+						   { funct_cat(&inode, &group, (char *)arquivo.first.c_str(), &grupoAtual); fflush(stdout); });
+				cat.bytes += arquivo.second;
+
+				cronometra(cp, [&]
+						   { funct_cp(&inode, &group, (char *)arquivo.first.c_str(), &grupoAtual, (char *)destinoCp.c_str()); });
+				cp.bytes += arquivo.second;
+			}
+		}
+	}
+
+	entraDiretorio({"storm"}, &inode, &group);
+
+	for (unsigned int i = 0; i < cfg.tempestade; i++)
+	{
+		string nome = (i % 2 ? "t" : "m") + to_string(i);
+
+		if (i % 2)
+			cronometra(mkdirTouch, [&]
+					   { funct_touch(&inode, &group, (char *)nome.c_str(), grupoAtual); });
+		else
+			cronometra(mkdirTouch, [&]
+					   { funct_mkdir(&inode, &group, (char *)nome.c_str(), grupoAtual); });
+	}
+
+	// Lote: cria de uma vez 'storm' arquivos e os remove com um único padrão
+	vector<string> nomesLote;
+	vector<char *> argumentosLote;
+	char padraoLote[] = "storm/*.tmp";
+	char *argumentosRm[] = {padraoLote};
+
+	for (unsigned int i = 0; i < cfg.tempestade; i++)
+		nomesLote.push_back("storm/b" + to_string(i) + ".tmp");
+
+	for (auto &nome : nomesLote)
+		argumentosLote.push_back((char *)nome.c_str());
+
+	entraDiretorio({}, &inode, &group);
+	cronometra(lote, [&]
+			   {
+				   vector<struct AlvosDiretorio> alvos;
+				   if (agrupaAlvos(argumentosLote.data(), argumentosLote.size(), alvos) == 0)
+					   funct_cria_lote(alvos, 0);
+			   });
+	cronometra(lote, [&]
+			   {
+				   vector<struct AlvosDiretorio> alvos;
+				   if (agrupaAlvos(argumentosRm, 1, alvos) == 0)
+					   funct_rm_lote(alvos);
+			   });
+
+	// Leituras de 4 KiB em posições aleatórias dos arquivos grandes, pela cache de extensões
+	mt19937_64 gerador(cfg.semente);
+
+	entraDiretorio({}, &inode, &group);
+
+	for (unsigned int i = 0; i < cfg.arquivosGrandes && cfg.tamGrande > 4096; i++)
+	{
+		string nome = "big" + to_string(i);
+
+		for (int k = 0; k < 256; k++)
+		{
+			unsigned long long offset = gerador() % (cfg.tamGrande - 4096);
+
+			cronometra(leituraAleatoria, [&]
+					   { funct_read(&inode, &group, (char *)nome.c_str(), offset, 4096); fflush(stdout); });
+			leituraAleatoria.bytes += 4096;
+		}
+	}
+
+	// Clone dos blocos alocados e diferença contra o próprio clone (nenhum bloco alterado)
+	string destinoClone = string(diretorioTemp) + "/clone.img", destinoDiferenca = string(diretorioTemp) + "/clone.diff";
+
+	cronometra(clone, [&]
+			   { funct_clone(NULL, destinoClone.c_str()); });
+	cronometra(diferenca, [&]
+			   { funct_clone(destinoClone.c_str(), destinoDiferenca.c_str()); });
+	clone.bytes = diferenca.bytes = (unsigned long long)(super.s_blocks_count - super.s_free_blocks_count) * block_size;
+
+	for (unsigned int i = 0; i < cfg.arquivosGrandes; i++)
+	{
+		string nome = "big" + to_string(i);
+
+		entraDiretorio({}, &inode, &group);
+		cronometra(rm, [&]
+				   { funct_rm(&inode, &group, (char *)nome.c_str(), grupoAtual); });
+		rm.bytes += cfg.tamGrande;
+	}
+
+	// rm -r de toda a árvore gerada em um comando; a liberação dos órfãos em segundo plano é medida à parte
+	vector<string> raizes = {"storm"};
+	vector<char *> argumentosRecursivo;
+
+	for (auto &dir : diretorios)
+	{
+		if (dir.caminho.size() == 1)
+			raizes.push_back(dir.caminho[0]);
+
+		for (auto &arquivo : dir.arquivos)
+			rmRecursivo.bytes += arquivo.second;
+	}
+
+	for (auto &raiz : raizes)
+		argumentosRecursivo.push_back((char *)raiz.c_str());
+
+	entraDiretorio({}, &inode, &group);
+	cronometra(rmRecursivo, [&]
+			   {
+				   vector<struct AlvosDiretorio> alvos;
+				   if (agrupaAlvos(argumentosRecursivo.data(), argumentosRecursivo.size(), alvos) == 0)
+					   funct_rm_recursivo(alvos);
+			   });
+	cronometra(liberacao, [&]
+			   { encerraLiberacaoOrfaos(); });
+	liberacao.bytes = rmRecursivo.bytes;
+
+	resultados = {lookup, ls, cat, cp, mkdirTouch, lote, leituraAleatoria, rm, rmRecursivo, liberacao, clone, diferenca};
+
+	fprintf(saida, "{\n  \"config\": {\"block_size\": %u, \"groups\": %u, \"inodes_per_group\": %u, \"fanout\": %u, \"depth\": %u, "
+				   "\"files_per_dir\": %u, \"file_size_min\": %lu, \"file_size_max\": %lu, \"large_files\": %u, \"large_size\": %lu, "
+				   "\"storm\": %u, \"repeat\": %u, \"seed\": %u},\n",
+			cfg.tamBloco, cfg.grupos, cfg.inodesPorGrupo, cfg.ramificacao, cfg.profundidade, cfg.arquivosPorDir, cfg.tamMinimo,
+			cfg.tamMaximo, cfg.arquivosGrandes, cfg.tamGrande, cfg.tempestade, cfg.repeticoes, cfg.semente);
+	fprintf(saida, "  \"generate\": {\"seconds\": %.6f, \"directories\": %zu, \"image_bytes\": %llu},\n", segundosGeracao,
+			diretorios.size(), (unsigned long long)super.s_blocks_count * block_size);
+	fprintf(saida, "  \"scenarios\": [\n");
+
+	for (size_t i = 0; i < resultados.size(); i++)
+		imprimeResultado(saida, resultados[i], i + 1 == resultados.size());
+
+	fprintf(saida, "  ]\n}\n");
+	fclose(saida);
+
+	close(fd);
+	unlink(FD_DEVICE);
+	unlink(destinoCp.c_str());
+
+	for (auto &arquivo : {destinoClone, destinoDiferenca})
+	{
+		unlink(arquivo.c_str());
+		unlink((arquivo + SUFIXO_HASHES).c_str());
+	}
+	rmdir(diretorioTemp);
+
+	return 0;
+}
@@ -0,0 +1,390 @@
+/**
+ * Descrição: Microbenchmarks dos laços internos do nEXT2shell: busca de bit livre nos bitmaps (procuraBitLivre, usada
+ * por find_free_block e find_free_inode, com tamanho em tempo de execução e especializado), busca de entrada em um bloco
+ * de diretório (procuraEntradaBloco, usada por read_dir, também nas duas formas), percurso do mapa de blocos com indireção
+ * (percorreMapaBlocos, especializado pelo tamanho do bloco da imagem), detecção de bloco nulo (blocoNulo, usada
+ * na elisão de blocos de arquivos esparsos), percurso das faixas livres de um bitmap (percorreFaixasLivres, usada por
+ * freefrag) e alocação contígua no plano (planejaBlocosContiguos, com e sem o índice de faixas livres). Cada kernel é executado sobre buffers
+ * montados em memória; o mapa de blocos é lido de uma imagem em memória (memfd). Os resultados vão em JSON para a
+ * saída padrão.
+ *
+ * Uso: ./nEXT2micro [--min-ms N] [--filter TEXTO]
+ *
+ * Para comparar uma versão otimizada de um kernel, acrescente-a à tabela de casos em main com outro nome de kernel.
+ */
+
+#include <sys/mman.h>
+#include <set>
+
+#define NEXT2SHELL_SEM_MAIN
+#include "nEXT2shell.cpp"
+
+// Caso medido: kernel, descrição da entrada e a operação a ser repetida
+struct CasoMicro
+{
+	string kernel;
+	string caso;
+	unsigned long bytesPorOp; // Bytes de entrada percorridos por operação (0 se não se aplica)
+	function<long()> operacao;
+};
+
+static volatile long sumidouro; // Impede que o compilador descarte os resultados dos kernels
+
+/* Executa 'operacao' em lotes até somar 'minimo' segundos e retorna o tempo por operação, em nanossegundos
+
+O menor tempo entre 5 medições é usado, para descontar interrupções
+*/
+static double medeNs(const function<long()> &operacao, double minimo, unsigned long long *ops)
+{
+	unsigned long long lote = 1;
+	double melhor = 0;
+
+	// Calibração: dobra o lote até que ele dure ao menos um quinto do tempo mínimo
+	while (true)
+	{
+		auto inicio = chrono::steady_clock::now();
+
+		for (unsigned long long i = 0; i < lote; i++)
+			sumidouro += operacao();
+
+		if (chrono::duration<double>(chrono::steady_clock::now() - inicio).count() >= minimo / 5 || lote >= (1ULL << 40))
+			break;
+
+		lote *= 2;
+	}
+
+	for (int rep = 0; rep < 5; rep++)
+	{
+		auto inicio = chrono::steady_clock::now();
+
+		for (unsigned long long i = 0; i < lote; i++)
+			sumidouro += operacao();
+
+		double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - inicio).count() / lote;
+
+		if (rep == 0 || ns < melhor)
+			melhor = ns;
+	}
+
+	*ops = lote * 6;
+
+	return melhor;
+}
+
+/* Bitmap de 'tamanho' bytes com 'ocupados' bits iniciais marcados
+
+ocupados == tamanho * 8 produz um bitmap cheio
+*/
+static vector<unsigned char> montaBitmap(unsigned int tamanho, unsigned long ocupados)
+{
+	vector<unsigned char> bitmap(tamanho, 0);
+
+	for (unsigned long i = 0; i < ocupados; i++)
+		bitmap[i / 8] |= 1 << (i % 8);
+
+	return bitmap;
+}
+
+// Bloco de diretório de 'tamanho' bytes com '.', '..' e 'numEntradas' entradas "arquivoNNNNN" (ou tantas quanto couberem)
+static vector<char> montaDiretorio(unsigned int tamanho, unsigned int numEntradas, string *ultimo)
+{
+	vector<struct EntradaDir> entradas = {{2, 2, "."}, {2, 2, ".."}};
+	unsigned int usado = tamanhoEntrada(1) + tamanhoEntrada(2);
+	vector<char> bloco(tamanho, 0);
+
+	for (unsigned int i = 0; i < numEntradas; i++)
+	{
+		char nome[32];
+		snprintf(nome, sizeof(nome), "arquivo%05u", i);
+
+		if (usado + tamanhoEntrada(strlen(nome)) > tamanho)
+			break;
+
+		entradas.push_back({12 + i, 1, nome});
+		usado += tamanhoEntrada(strlen(nome));
+		*ultimo = nome;
+	}
+
+	// O empacotamento usa o tamanho de bloco do Superbloco em memória
+	unsigned int logAnterior = super.s_log_block_size;
+
+	super.s_log_block_size = (tamanho == 4096) ? 2 : 0;
+	empacotaEntradas(entradas, &bloco);
+	super.s_log_block_size = logAnterior;
+
+	return bloco;
+}
+
+/* Monta na imagem em memória o mapa de blocos de um arquivo de 'numBlocos' blocos de 1 KiB, cujos blocos de dados
+começam no bloco 'inicio'
+
+passo: mantém apenas um a cada 'passo' blocos de dados (os demais viram buracos); 1 produz um mapa denso
+*/
+static struct ext2_inode montaMapa(unsigned long numBlocos, unsigned int inicio, unsigned int passo)
+{
+	struct ext2_inode inode;
+	vector<struct BlocoPlanejado> indiretos;
+	vector<unsigned int> dados;
+	unsigned long total = numBlocos + blocosIndiretosNecessarios(numBlocos);
+	vector<unsigned int> blocos(total);
+
+	for (unsigned long i = 0; i < total; i++)
+		blocos[i] = inicio + i;
+
+	memset(&inode, 0, sizeof(inode));
+	inode.i_mode = S_IFREG | 0644;
+	inode.i_size = numBlocos * block_size;
+
+	montaMapaBlocos(&inode, blocos, numBlocos, indiretos, dados);
+
+	// Buracos: ponteiros de dados zerados nos blocos diretos e nos blocos de indireção de último nível
+	if (passo > 1)
+	{
+		set<unsigned int> mantidos;
+
+		for (unsigned long i = 0; i < dados.size(); i += passo)
+			mantidos.insert(dados[i]);
+
+		for (int i = 0; i < EXT2_NDIR_BLOCKS; i++)
+			if (inode.i_block[i] && !mantidos.count(inode.i_block[i]))
+				inode.i_block[i] = 0;
+
+		set<unsigned int> blocosDados(dados.begin(), dados.end());
+
+		for (auto &indireto : indiretos)
+		{
+			__u32 *ponteiros = (__u32 *)indireto.dados.data();
+
+			for (unsigned long i = 0; i < block_size / sizeof(__u32); i++)
+				if (blocosDados.count(ponteiros[i]) && !mantidos.count(ponteiros[i]))
+					ponteiros[i] = 0;
+		}
+	}
+
+	for (auto &indireto : indiretos)
+		pwrite(fd, indireto.dados.data(), block_size, BLOCK_OFFSET(indireto.bloco));
+
+	return inode;
+}
+
+int main(int argc, char **argv)
+{
+	double minimo = 0.2;
+	const char *filtro = "";
+
+	for (int i = 1; i < argc; i += 2)
+	{
+		if (i + 1 < argc && !strcmp(argv[i], "--min-ms"))
+			minimo = atof(argv[i + 1]) / 1000;
+		else if (i + 1 < argc && !strcmp(argv[i], "--filter"))
+			filtro = argv[i + 1];
+		else
+		{
+			fprintf(stderr, "usage: nEXT2micro [--min-ms N] [--filter TEXT]\n");
+			return 1;
+		}
+	}
+
+	// Imagem em memória de 1 GiB esparsa com blocos de 1 KiB, usada pelo percurso do mapa de blocos
+	memset(&super, 0, sizeof(super));
+	super.s_blocks_count = 1 << 20;
+	super.s_first_data_block = 1;
+
+	if ((fd = memfd_create("nEXT2micro", 0)) < 0 || ftruncate(fd, (off_t)super.s_blocks_count * block_size) < 0)
+	{
+		perror("memfd_create");
+		return 1;
+	}
+
+	vector<struct CasoMicro> casos;
+
+	// Bitmaps: vazio, metade ocupada, quase cheio (último bit livre) e cheio
+	static vector<unsigned char> bitmaps[8];
+	unsigned int tamanhosBitmap[2] = {1024, 4096};
+
+	for (int t = 0; t < 2; t++)
+	{
+		unsigned int tamanho = tamanhosBitmap[t];
+		const char *nomes[4] = {"empty", "half", "nearly_full", "full"};
+		unsigned long ocupados[4] = {0, tamanho * 4ul, tamanho * 8ul - 1, tamanho * 8ul};
+
+		for (int k = 0; k < 4; k++)
+		{
+			vector<unsigned char> *bitmap = &bitmaps[t * 4 + k];
+
+			*bitmap = montaBitmap(tamanho, ocupados[k]);
+			casos.push_back({"procuraBitLivre", string(nomes[k]) + "_" + to_string(tamanho), tamanho,
+							 [bitmap]
+							 { return (long)procuraBitLivre(bitmap->data(), bitmap->size()); }});
+			// Mesma busca com o tamanho como constante de compilação, como despachaTamanhoBloco a chama
+			casos.push_back({"procuraBitLivre_const", string(nomes[k]) + "_" + to_string(tamanho), tamanho,
+							 [bitmap, tamanho]
+							 {
+								 if (tamanho == 4096)
+									 return (long)procuraBitLivre(bitmap->data(), integral_constant<unsigned int, 4096>());
+								 return (long)procuraBitLivre(bitmap->data(), integral_constant<unsigned int, 1024>());
+							 }});
+		}
+	}
+
+	// Diretórios: pequeno (1 KiB, 8 entradas) e grandes (1 KiB e 4 KiB cheios); busca da última entrada e de um nome ausente
+	static vector<char> diretorios[3];
+	static string ultimos[3];
+	unsigned int tamanhosDir[3] = {1024, 1024, 4096};
+	unsigned int entradasDir[3] = {8, 1000, 1000};
+	const char *nomesDir[3] = {"small_1024", "large_1024", "large_4096"};
+
+	for (int d = 0; d < 3; d++)
+	{
+		vector<char> *bloco = &diretorios[d];
+		string *ultimo = &ultimos[d];
+
+		*bloco = montaDiretorio(tamanhosDir[d], entradasDir[d], ultimo);
+		casos.push_back({"procuraEntradaBloco", string(nomesDir[d]) + "_hit_last", tamanhosDir[d],
+						 [bloco, ultimo]
+						 { return procuraEntradaBloco(bloco->data(), bloco->size(), ultimo->c_str()); }});
+		casos.push_back({"procuraEntradaBloco", string(nomesDir[d]) + "_miss", tamanhosDir[d],
+						 [bloco]
+						 { return procuraEntradaBloco(bloco->data(), bloco->size(), "ausente"); }});
+		casos.push_back({"procuraEntradaBloco_const", string(nomesDir[d]) + "_miss", tamanhosDir[d],
+						 [bloco]
+						 {
+							 if (bloco->size() == 4096)
+								 return procuraEntradaBloco(bloco->data(), integral_constant<unsigned int, 4096>(), "ausente");
+							 return procuraEntradaBloco(bloco->data(), integral_constant<unsigned int, 1024>(), "ausente");
+						 }});
+	}
+
+	// Mapas de blocos: denso pequeno (diretos e indireção simples), denso grande (dupla indireção) e esparso grande
+	static struct ext2_inode mapas[3];
+	const char *nomesMapa[3] = {"dense_256K", "dense_64M", "sparse_64M"};
+
+	mapas[0] = montaMapa(256, 1000, 1);
+	mapas[1] = montaMapa(65536, 2000, 1);
+	mapas[2] = montaMapa(65536, 200000, 64);
+
+	for (int m = 0; m < 3; m++)
+	{
+		struct ext2_inode *inode = &mapas[m];
+
+		casos.push_back({"percorreMapaBlocos", nomesMapa[m], 0,
+						 [inode]
+						 {
+							 long soma = 0;
+							 percorreMapaBlocos(inode, [&](unsigned long, unsigned int fisico)
+												{ soma += fisico; },
+												NULL);
+							 return soma;
+						 }});
+	}
+
+	// Blocos nulos (percorridos por inteiro) e com um byte não nulo no início e no fim
+	static vector<char> blocosNulo[6];
+	const char *nomesNulo[3] = {"zero", "nonzero_first", "nonzero_last"};
+
+	for (int t = 0; t < 2; t++)
+	{
+		unsigned int tamanho = tamanhosBitmap[t];
+
+		for (int k = 0; k < 3; k++)
+		{
+			vector<char> *bloco = &blocosNulo[t * 3 + k];
+
+			bloco->assign(tamanho, 0);
+			if (k == 1)
+				(*bloco)[0] = 1;
+			else if (k == 2)
+				(*bloco)[tamanho - 1] = 1;
+
+			casos.push_back({"blocoNulo", string(nomesNulo[k]) + "_" + to_string(tamanho), tamanho,
+							 [bloco]
+							 { return (long)blocoNulo(bloco->data(), bloco->size()); }});
+		}
+	}
+
+	// Faixas livres: bitmaps vazio, metade ocupada, fragmentado (um bit ocupado a cada 8) e alternado (faixas de 1 bit)
+	static vector<unsigned char> bitmapsFaixas[8];
+	const char *nomesFaixas[4] = {"empty", "half", "fragmented", "alternating"};
+
+	for (int t = 0; t < 2; t++)
+	{
+		unsigned int tamanho = tamanhosBitmap[t];
+
+		for (int k = 0; k < 4; k++)
+		{
+			vector<unsigned char> *bitmap = &bitmapsFaixas[t * 4 + k];
+
+			*bitmap = montaBitmap(tamanho, k == 1 ? tamanho * 4ul : 0);
+			if (k >= 2)
+				fill(bitmap->begin(), bitmap->end(), k == 2 ? 0x01 : 0x55);
+
+			casos.push_back({"percorreFaixasLivres", string(nomesFaixas[k]) + "_" + to_string(tamanho), tamanho,
+							 [bitmap]
+							 {
+								 long faixas = 0;
+								 percorreFaixasLivres(bitmap->data(), bitmap->size() * 8ul, [&](unsigned long, unsigned long tamanho)
+													  { faixas += tamanho; });
+								 return faixas;
+							 }});
+		}
+	}
+
+	/* Alocação contígua de 256 blocos em 128 grupos fragmentados (um bit ocupado a cada 8), em que só o último grupo tem
+	uma faixa suficiente: com a varredura dos bitmaps do plano e com o índice de faixas livres */
+	static struct PlanoAlocacao plano;
+
+	super.s_blocks_per_group = 8192;
+
+	unsigned int numGrupos = num_grupos;
+
+	plano.grupos.assign(numGrupos, ext2_group_desc());
+	plano.bitmapsBlocos.assign(numGrupos, vector<unsigned char>(1024, 0x01));
+	plano.blocosUsados.assign(numGrupos, 0);
+	fill(plano.bitmapsBlocos[numGrupos - 1].begin() + 512, plano.bitmapsBlocos[numGrupos - 1].begin() + 544, 0);
+
+	indiceLivres.porInicio.assign(numGrupos, map<unsigned long, unsigned long>());
+	indiceLivres.porTamanho.assign(numGrupos, set<pair<unsigned long, unsigned long>>());
+	indiceLivres.valido = 1;
+
+	for (unsigned int g = 0; g < numGrupos; g++)
+	{
+		plano.grupos[g].bg_free_blocks_count = blocosNoGrupo(g);
+		indexaGrupoLivre(g, plano.bitmapsBlocos[g].data());
+	}
+
+	for (int comIndice = 0; comIndice < 2; comIndice++)
+		casos.push_back({"planejaBlocosContiguos", comIndice ? "fragmented_128_groups_index" : "fragmented_128_groups_scan", 0,
+						 [comIndice]
+						 {
+							 vector<unsigned int> blocos;
+
+							 indiceLivres.valido = comIndice;
+							 planejaBlocosContiguos(&plano, 0, 0, 256, blocos);
+							 devolveBlocosPlano(&plano, blocos.data(), blocos.size());
+							 return (long)blocos[0];
+						 }});
+
+	printf("[\n");
+
+	int primeiro = 1;
+
+	for (auto &caso : casos)
+	{
+		if (!strstr((caso.kernel + "/" + caso.caso).c_str(), filtro))
+			continue;
+
+		unsigned long long ops;
+		double ns = medeNs(caso.operacao, minimo, &ops);
+
+		printf("%s  {\"kernel\": \"%s\", \"case\": \"%s\", \"ns_per_op\": %.1f, \"ops_per_sec\": %.0f, \"mb_per_sec\": %.1f, \"ops\": %llu}",
+			   primeiro ? "" : ",\n", caso.kernel.c_str(), caso.caso.c_str(), ns, 1e9 / ns,
+			   caso.bytesPorOp ? caso.bytesPorOp * 1e9 / ns / (1 << 20) : 0.0, ops);
+		fflush(stdout);
+		primeiro = 0;
+	}
+
+	printf("\n]\n");
+	close(fd);
+
+	return 0;
+}
@@ -0,0 +1,312 @@
+/**
+ * Descrição: Reexecuta um rastro de E/S gravado pelo comando 'trace' do nEXT2shell sobre uma cópia da imagem, no ritmo
+ * original (respeitando os instantes registrados) ou na velocidade máxima, e reporta em JSON a latência por operação e
+ * por comando de origem. Opcionalmente simula, sobre as mesmas leituras, um cache LRU de blocos com leitura antecipada,
+ * para avaliar tamanhos de cache e políticas de readahead sem alterar o shell.
+ *
+ * Uso: ./nEXT2replay RASTRO IMAGEM [--max-speed] [--cache N[,N...]] [--readahead N]
+ *
+ * As escritas são reexecutadas com blocos zerados: o conteúdo da cópia da imagem é destruído nas faixas escritas.
+ * As operações do jornal vão para IMAGEM.journal.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <list>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// Operação registrada no rastro
+struct RegistroRastro
+{
+	long long ns;		// Instante desde o início do rastro
+	char operacao;		// R, W ou S
+	char arquivo;		// i (imagem) ou j (jornal)
+	long long offset;
+	long long bytes;
+	string comando;
+};
+
+// Latências acumuladas de um grupo de operações
+struct Latencias
+{
+	unsigned long long bytes = 0;
+	vector<double> us;
+};
+
+/* Cache LRU de blocos simulado
+
+Uma falta de leitura traz o bloco e os 'antecipados' blocos seguintes; escritas apenas atualizam o cache
+*/
+struct CacheSimulado
+{
+	unsigned long capacidade;
+	unsigned int antecipados;
+	list<long long> ordem; // Mais recente na frente
+	unordered_map<long long, list<long long>::iterator> blocos;
+	unsigned long long acertos = 0, faltas = 0;
+
+	void insere(long long bloco)
+	{
+		auto it = blocos.find(bloco);
+
+		if (it != blocos.end())
+		{
+			ordem.splice(ordem.begin(), ordem, it->second);
+			return;
+		}
+
+		ordem.push_front(bloco);
+		blocos[bloco] = ordem.begin();
+
+		if (blocos.size() > capacidade)
+		{
+			blocos.erase(ordem.back());
+			ordem.pop_back();
+		}
+	}
+
+	void le(long long bloco)
+	{
+		if (blocos.count(bloco))
+		{
+			acertos++;
+			insere(bloco);
+			return;
+		}
+
+		faltas++;
+
+		for (unsigned int i = antecipados; i > 0; i--)
+			insere(bloco + i);
+
+		insere(bloco);
+	}
+};
+
+// Lê o rastro de 'caminho'; retorna -1 se o arquivo não puder ser lido
+static int leRastro(const char *caminho, vector<struct RegistroRastro> &registros, unsigned int *tamanhoBloco)
+{
+	FILE *arquivo = fopen(caminho, "r");
+	char linha[256];
+
+	if (!arquivo)
+		return -1;
+
+	while (fgets(linha, sizeof(linha), arquivo))
+	{
+		struct RegistroRastro registro;
+		char comando[64];
+		long long bloco;
+
+		if (linha[0] == '#')
+		{
+			const char *tamanho = strstr(linha, "block_size=");
+
+			if (tamanho)
+				*tamanhoBloco = atoi(tamanho + strlen("block_size="));
+			continue;
+		}
+
+		if (sscanf(linha, "%lld %c %c %lld %lld %lld %63s", &registro.ns, &registro.operacao, &registro.arquivo,
+				   &registro.offset, &registro.bytes, &bloco, comando) != 7)
+			continue;
+
+		registro.comando = comando;
+		registros.push_back(registro);
+	}
+
+	fclose(arquivo);
+
+	return 0;
+}
+
+// Imprime as latências de 'grupo' como um objeto JSON
+static void imprimeLatencias(const char *nome, struct Latencias &grupo, int ultimo)
+{
+	double total = 0;
+
+	sort(grupo.us.begin(), grupo.us.end());
+
+	for (double us : grupo.us)
+		total += us;
+
+	size_t n = grupo.us.size();
+
+	printf("    \"%s\": {\"ops\": %zu, \"bytes\": %llu, \"total_us\": %.1f, \"mean_us\": %.2f, \"p50_us\": %.2f, \"p99_us\": %.2f}%s\n",
+		   nome, n, grupo.bytes, total, n ? total / n : 0.0, n ? grupo.us[n / 2] : 0.0, n ? grupo.us[min(n - 1, n * 99 / 100)] : 0.0,
+		   ultimo ? "" : ",");
+}
+
+int main(int argc, char **argv)
+{
+	int velocidadeMaxima = 0;
+	unsigned int antecipados = 0, tamanhoBloco = 1024;
+	vector<unsigned long> tamanhosCache;
+
+	if (argc < 3)
+	{
+		fprintf(stderr, "usage: nEXT2replay TRACE IMAGE [--max-speed] [--cache N[,N...]] [--readahead N]\n");
+		return 1;
+	}
+
+	for (int i = 3; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "--max-speed"))
+			velocidadeMaxima = 1;
+		else if (i + 1 < argc && !strcmp(argv[i], "--cache"))
+		{
+			for (char *item = strtok(argv[++i], ","); item; item = strtok(NULL, ","))
+				tamanhosCache.push_back(strtoul(item, NULL, 10));
+		}
+		else if (i + 1 < argc && !strcmp(argv[i], "--readahead"))
+			antecipados = atoi(argv[++i]);
+		else
+		{
+			fprintf(stderr, "usage: nEXT2replay TRACE IMAGE [--max-speed] [--cache N[,N...]] [--readahead N]\n");
+			return 1;
+		}
+	}
+
+	vector<struct RegistroRastro> registros;
+
+	if (leRastro(argv[1], registros, &tamanhoBloco) < 0)
+	{
+		perror(argv[1]);
+		return 1;
+	}
+
+	string caminhoJornal = string(argv[2]) + ".journal";
+	int arquivos[2];
+
+	if ((arquivos[0] = open(argv[2], O_RDWR)) < 0)
+	{
+		perror(argv[2]);
+		return 1;
+	}
+
+	arquivos[1] = -1; // O jornal só é aberto se o rastro tiver operações sobre ele
+
+	vector<struct CacheSimulado> caches;
+
+	for (unsigned long capacidade : tamanhosCache)
+	{
+		caches.push_back(CacheSimulado());
+		caches.back().capacidade = capacidade;
+		caches.back().antecipados = antecipados;
+	}
+
+	vector<char> buffer;
+	map<char, struct Latencias> porOperacao;
+	map<string, struct Latencias> porComando;
+	auto inicio = chrono::steady_clock::now();
+
+	for (auto &registro : registros)
+	{
+		int indice = (registro.arquivo == 'j') ? 1 : 0;
+
+		if (indice == 1 && arquivos[1] < 0 && (arquivos[1] = open(caminhoJornal.c_str(), O_RDWR | O_CREAT, 0644)) < 0)
+		{
+			perror(caminhoJornal.c_str());
+			return 1;
+		}
+
+		if (!velocidadeMaxima)
+		{
+			auto instante = inicio + chrono::nanoseconds(registro.ns);
+
+			if (instante > chrono::steady_clock::now())
+			{
+				long long espera = chrono::duration_cast<chrono::nanoseconds>(instante - chrono::steady_clock::now()).count();
+				struct timespec ts = {(time_t)(espera / 1000000000), (long)(espera % 1000000000)};
+
+				nanosleep(&ts, NULL);
+			}
+		}
+
+		if (buffer.size() < (size_t)registro.bytes)
+			buffer.resize(registro.bytes);
+
+		auto antes = chrono::steady_clock::now();
+		ssize_t resultado = 0;
+
+		if (registro.operacao == 'R')
+			resultado = pread(arquivos[indice], buffer.data(), registro.bytes, registro.offset);
+		else if (registro.operacao == 'W')
+		{
+			memset(buffer.data(), 0, registro.bytes);
+			resultado = pwrite(arquivos[indice], buffer.data(), registro.bytes, registro.offset);
+		}
+		else if (registro.operacao == 'S')
+			resultado = fdatasync(arquivos[indice]);
+
+		if (resultado < 0)
+			perror("replay");
+
+		double us = chrono::duration<double, micro>(chrono::steady_clock::now() - antes).count();
+
+		porOperacao[registro.operacao].us.push_back(us);
+		porOperacao[registro.operacao].bytes += registro.bytes;
+		porComando[registro.comando].us.push_back(us);
+		porComando[registro.comando].bytes += registro.bytes;
+
+		// O cache simulado considera apenas a imagem, bloco a bloco
+		if (indice == 0 && registro.operacao != 'S')
+			for (long long bloco = registro.offset / tamanhoBloco; bloco * tamanhoBloco < registro.offset + registro.bytes; bloco++)
+				for (auto &cache : caches)
+				{
+					if (registro.operacao == 'R')
+						cache.le(bloco);
+					else
+						cache.insere(bloco);
+				}
+	}
+
+	double decorrido = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+
+	printf("{\n  \"trace\": \"%s\",\n  \"records\": %zu,\n  \"block_size\": %u,\n  \"max_speed\": %s,\n",
+		   argv[1], registros.size(), tamanhoBloco, velocidadeMaxima ? "true" : "false");
+	printf("  \"trace_span_s\": %.6f,\n  \"elapsed_s\": %.6f,\n", registros.empty() ? 0.0 : registros.back().ns / 1e9, decorrido);
+
+	const char *nomesOperacao[3] = {"read", "write", "sync"};
+	const char operacoes[3] = {'R', 'W', 'S'};
+
+	printf("  \"ops\": {\n");
+	for (int i = 0; i < 3; i++)
+		imprimeLatencias(nomesOperacao[i], porOperacao[operacoes[i]], i == 2);
+	printf("  },\n  \"commands\": {\n");
+
+	size_t restantes = porComando.size();
+
+	for (auto &comando : porComando)
+		imprimeLatencias(comando.first.c_str(), comando.second, --restantes == 0);
+	printf("  },\n  \"cache\": [");
+
+	for (size_t i = 0; i < caches.size(); i++)
+	{
+		unsigned long long total = caches[i].acertos + caches[i].faltas;
+
+		printf("%s\n    {\"blocks\": %lu, \"readahead\": %u, \"hits\": %llu, \"misses\": %llu, \"hit_ratio\": %.4f}",
+			   i ? "," : "", caches[i].capacidade, antecipados, caches[i].acertos, caches[i].faltas,
+			   total ? (double)caches[i].acertos / total : 0.0);
+	}
+
+	printf("%s]\n}\n", caches.empty() ? "" : "\n  ");
+
+	close(arquivos[0]);
+
+	if (arquivos[1] >= 0)
+		close(arquivos[1]);
+
+	return 0;
+}
@@ -24,15 +24,46 @@
 #include <cstring>
 #include <iostream>
 #include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include <stdarg.h>
+#include <errno.h>
+#include <dirent.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <stddef.h>
+#include <limits.h>
+#include <fnmatch.h>
+#include <set>
+#include <deque>
+#include <unordered_map>
+#include <tuple>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 using namespace std;
 
 #define BASE_OFFSET 1024											 // Localização do superbloco
 #define FD_DEVICE "./myext2image.img"								 // Imagem do sistema de arquivos
 #define EXT2_SUPER_MAGIC 0xEF53										 // Número mágico do EXT2
-#define BLOCK_OFFSET(block) (BASE_OFFSET + (block - 1) * block_size) // Função que calcula a posição de um bloco com base em seu número
+#define BLOCK_OFFSET(block) ((off_t)(block) * block_size)					 // Função que calcula a posição de um bloco com base em seu número
 #define block_size (1024 << super.s_log_block_size)					 // Tamanho do bloco: s_log_block_size expressa o tamanho do bloco em potências de 2
 																	 // Como temos que s_log_block_size = 0, temos que o tamanho do bloco é dado por 1024 * 2^0 = 1024
 
+#define GDT_OFFSET BLOCK_OFFSET(super.s_first_data_block + 1)											   // Localização da tabela de descritores de Grupo: bloco seguinte ao do Superbloco
+#define inode_size (super.s_rev_level == 0 ? 128 : super.s_inode_size)							   // Tamanho de cada Inode na Tabela de Inodes
+#define num_grupos ((super.s_blocks_count - super.s_first_data_block + super.s_blocks_per_group - 1) / super.s_blocks_per_group) // Número de Grupos de blocos
+#define EXT2_FIRST_INO (super.s_rev_level == 0 ? 11 : super.s_first_ino)								   // Primeiro Inode não reservado
+#define EXT2_ROOT_INO 2																				   // Inode do diretório 'root'
+#define EXT2_FEATURE_COMPAT_RESIZE_INODE 0x0010		// Blocos reservados para crescimento da tabela de descritores
+#define EXT2_FEATURE_INCOMPAT_FILETYPE 0x0002		// Entradas de diretório registram o tipo do arquivo
+#define EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER 0x0001	// Cópias do Superbloco apenas nos grupos 0, 1 e potências de 3, 5 e 7
+#define EXT2_FEATURE_RO_COMPAT_LARGE_FILE 0x0002	// Arquivos regulares usam i_dir_acl como os 32 bits altos do tamanho
+
 #define EXT2_S_IRUSR 0x0100 // Usuário: read
 #define EXT2_S_IWUSR 0x0080 // Usuário: write
 #define EXT2_S_IXUSR 0x0040 // Usuário: execute
@@ -48,1904 +79,8308 @@ using namespace std;
 static struct ext2_super_block super;		 // Superbloco
 static int fd;								 // Descritor da imagem do sistema de arquivos
 vector<string> vetorCaminhoAtual;			 // Caminho de diretórios atual
-vector<ext2_dir_entry_2 *> vetorEntradasDir; // Vetor auxiliar para renomeação de arquivos
 int grupoAtual = 0;							 // Variável auxiliar para armazenar o valor do Grupo de blocos atual
 
 void read_inode_bitmap(int fd, struct ext2_group_desc *group);
 
-// Posiciona o leitor do arquivo em  (Inicio_Tabela_Inodes + Distancia_Inode_Desejado) bytes e lê o Inode desejado na variável Inode passada por parâmetro
-static void read_inode(unsigned int inode_no, struct ext2_group_desc *group, struct ext2_inode *inode)
+/* Contadores do motor: chamadas de E/S sobre a imagem e seu jornal, cache e alocador
+
+Sempre contados (incrementos relaxados); o tempo gasto em E/S só é medido com as estatísticas ativas ('stats on').
+Usados pelo comando 'stats' e pelo benchmark (nEXT2bench)
+*/
+enum ContadorMotor
+{
+	CONT_LEITURAS,		  // preads
+	CONT_ESCRITAS,		  // pwrites
+	CONT_SINCRONIZACOES,  // fsyncs e fdatasyncs
+	CONT_BYTES_LIDOS,
+	CONT_BYTES_ESCRITOS,
+	CONT_BLOCOS_LIDOS,	  // Blocos tocados pelas leituras
+	CONT_BLOCOS_ESCRITOS, // Blocos tocados pelas escritas
+	CONT_SALTOS,		  // E/S na imagem que não continua a anterior (seek)
+	CONT_ACERTOS_CACHE,	  // Blocos servidos da memória sem ler a imagem
+	CONT_FALTAS_CACHE,	  // Blocos procurados na memória e lidos da imagem
+	CONT_SONDAGENS,		  // Bits examinados pelo alocador
+	CONT_NS_ES,			  // Nanossegundos em chamadas de E/S
+	NUM_CONTADORES
+};
+
+static const char *nomesContadores[NUM_CONTADORES] = {"pread", "pwrite", "fsync", "bytes_read", "bytes_written", "blocks_read",
+													   "blocks_written", "seeks", "cache_hits", "cache_misses", "alloc_probes", "io_ns"};
+static atomic<unsigned long long> contadores[NUM_CONTADORES];
+static atomic<off_t> fimUltimaES{-1}; // Posição seguinte à última E/S na imagem
+static bool estatisticasAtivas = false;
+
+static inline void conta(enum ContadorMotor contador, unsigned long long n = 1)
 {
-	lseek(fd, BLOCK_OFFSET(group->bg_inode_table) + (inode_no - 1) * sizeof(struct ext2_inode),
-		  SEEK_SET);
-	read(fd, inode, sizeof(struct ext2_inode));
+	contadores[contador].fetch_add(n, memory_order_relaxed);
 }
 
-/* Se o grupo do Inode é diferente do grupo atual: atualiza a variável grupoAtual e posiciona o leitor do arquivo no descritor do novo grupo, fazendo a leitura
-deste na variável group passada por parâmetro
+// Copia o valor atual dos contadores em 'amostra'
+static void amostraContadores(unsigned long long *amostra)
+{
+	for (int i = 0; i < NUM_CONTADORES; i++)
+		amostra[i] = contadores[i].load(memory_order_relaxed);
+}
 
-valor: valor do Inode
-grupoAtual: Grupo corrente
+/* Rastro de E/S (comando 'trace')
+
+Cada chamada de E/S sobre a imagem e o jornal gera uma linha "<ns> <op> <arquivo> <offset> <bytes> <bloco> <comando>":
+ns desde o início do rastro, op R (leitura), W (escrita) ou S (sincronização), arquivo i (imagem) ou j (jornal)
 */
-void trocaGrupo(long int *valor, struct ext2_group_desc *group, int *grupoAtual)
+#define FD_TRACE "./nEXT2shell.trace" // Arquivo de rastro padrão
+
+static FILE *arquivoRastro = NULL;
+static bool rastreamentoAtivo = false;
+static mutex mutexRastro;
+static chrono::steady_clock::time_point inicioRastro;
+static char comandoAtual[32] = "-";				   // Comando em execução no shell
+static thread_local const char *origemRastro = NULL; // Origem das E/S de threads próprias (ex.: commit do jornal)
+static unsigned long long registrosRastro = 0;
+
+static void registraRastro(char operacao, int arquivo, off_t offset, ssize_t bytes)
 {
-	long int block_group = ((*valor) - 1) / super.s_inodes_per_group; // Cálculo do grupo do Inode
+	long long ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - inicioRastro).count();
+	lock_guard<mutex> trava(mutexRastro);
 
-	if (block_group != (*grupoAtual))
-	{
-		*grupoAtual = block_group;
+	if (!arquivoRastro)
+		return;
 
-		lseek(fd, BASE_OFFSET + block_size + sizeof(struct ext2_group_desc) * block_group, SEEK_SET);
-		read(fd, group, sizeof(struct ext2_group_desc));
-	}
+	fprintf(arquivoRastro, "%lld %c %c %lld %zd %lld %s\n", ns, operacao, arquivo == fd ? 'i' : 'j', (long long)offset, bytes,
+			(long long)(offset / block_size), origemRastro ? origemRastro : comandoAtual);
+	registrosRastro++;
 }
 
-/* Atualiza valorInode com o Inode da entrada que possui nome 'nome'
-
-inode, group: Inode/Grupo do diretório
-valorInode: variável que receberá o Inode da entrada com nome 'nome'
-nome: nome da entrada procurada no diretório
- */
-void read_dir(struct ext2_inode *inode, struct ext2_group_desc *group, long int *valorInode, char *nome)
+// Registra uma chamada de E/S de 'bytes' bytes na posição 'offset' de 'arquivo', iniciada em 'inicio'
+static void registraES(int arquivo, int escrita, off_t offset, ssize_t bytes, chrono::steady_clock::time_point inicio)
 {
-	void *block;
-	(*valorInode) = -1;
-	if (!strlen(nome))
-		*valorInode = -2;
-	if (S_ISDIR(inode->i_mode))
-	{
-		struct ext2_dir_entry_2 *entry;
-		unsigned int size = 0;
+	conta(escrita ? CONT_ESCRITAS : CONT_LEITURAS);
 
-		if ((block = malloc(block_size)) == NULL)
-		{
-			fprintf(stderr, "\nmemory insufficient.\n");
-			close(fd);
-			exit(1);
-		}
+	if (bytes > 0)
+	{
+		conta(escrita ? CONT_BYTES_ESCRITOS : CONT_BYTES_LIDOS, bytes);
+		conta(escrita ? CONT_BLOCOS_ESCRITOS : CONT_BLOCOS_LIDOS, (offset + bytes - 1) / block_size - offset / block_size + 1);
+	}
 
-		lseek(fd, BLOCK_OFFSET(inode->i_block[0]), SEEK_SET);
-		read(fd, block, block_size);
+	if (arquivo == fd && fimUltimaES.exchange(offset + (bytes > 0 ? bytes : 0), memory_order_relaxed) != offset)
+		conta(CONT_SALTOS);
 
-		entry = (struct ext2_dir_entry_2 *)block;
+	if (estatisticasAtivas)
+		conta(CONT_NS_ES, chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - inicio).count());
 
-		while ((size < inode->i_size) && entry->inode)
-		{
-			char file_name[EXT2_NAME_LEN + 1];
-			memcpy(file_name, entry->name, entry->name_len);
-			file_name[entry->name_len] = 0;
+	if (rastreamentoAtivo)
+		registraRastro(escrita ? 'W' : 'R', arquivo, offset, bytes);
+}
 
-			if (!strcmp(nome, file_name))
-			{
-				*valorInode = entry->inode;
-				break;
-			}
+// pread contabilizado nos contadores do motor
+static ssize_t preadContado(int arquivo, void *buffer, size_t n, off_t offset)
+{
+	auto inicio = estatisticasAtivas ? chrono::steady_clock::now() : chrono::steady_clock::time_point();
+	ssize_t lidos = pread(arquivo, buffer, n, offset);
 
-			entry = (ext2_dir_entry_2 *)((char *)entry + entry->rec_len);
-			size += entry->rec_len;
-		}
+	registraES(arquivo, 0, offset, lidos, inicio);
 
-		free(block);
-	}
+	return lidos;
 }
 
-// Retorna a última posição da lista de arquivos de um diretório
-int getLastEntry(struct ext2_inode *inode, struct ext2_group_desc *group)
+// pwrite contabilizado nos contadores do motor
+static ssize_t pwriteContado(int arquivo, const void *buffer, size_t n, off_t offset)
 {
-	int acc = 0;
-	void *block;
+	auto inicio = estatisticasAtivas ? chrono::steady_clock::now() : chrono::steady_clock::time_point();
+	ssize_t escritos = pwrite(arquivo, buffer, n, offset);
 
-	// Verifica se o Inode pertence a um diretório
-	if (S_ISDIR(inode->i_mode))
-	{
-		struct ext2_dir_entry_2 *entry;
-		unsigned int size = 0;
+	registraES(arquivo, 1, offset, escritos, inicio);
 
-		if ((block = malloc(block_size)) == NULL)
-		{
-			fprintf(stderr, "\nmemory insufficient.\n");
-			close(fd);
-			exit(1);
-		}
+	return escritos;
+}
 
-		lseek(fd, BLOCK_OFFSET(inode->i_block[0]), SEEK_SET);
-		read(fd, block, block_size);
+// fsync (ou fdatasync, se 'apenasDados') contabilizado nos contadores do motor
+static int fsyncContado(int arquivo, int apenasDados)
+{
+	auto inicio = estatisticasAtivas ? chrono::steady_clock::now() : chrono::steady_clock::time_point();
+	int status = apenasDados ? fdatasync(arquivo) : fsync(arquivo);
 
-		entry = (struct ext2_dir_entry_2 *)block;
+	conta(CONT_SINCRONIZACOES);
 
-		while ((size < inode->i_size) && entry->inode)
-		{
-			if (acc + entry->rec_len < 1024)
-			{
-				acc += entry->rec_len;
-			}
+	if (estatisticasAtivas)
+		conta(CONT_NS_ES, chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - inicio).count());
 
-			entry = (ext2_dir_entry_2 *)((char *)entry + entry->rec_len);
-			size += entry->rec_len;
-		}
+	if (rastreamentoAtivo)
+		registraRastro('S', arquivo, 0, 0);
 
-		free(block);
-	}
-	return acc;
+	return status;
 }
 
-/* Escreve o inode 'inode' de número 'inode_no' na Tabela de Inodes de 'group'
+/* Jornal de metadados (opcional)
+ *
+ * Quando ativado, as escritas de metadados de cada comando não vão direto para a imagem: ficam em 'transacaoAtual' e, ao
+ * fim do comando, formam uma transação. Uma thread de commit junta todas as transações enfileiradas em um único registro
+ * no arquivo de jornal (FD_JOURNAL) com um único fsync (commit em grupo). O checkpoint é preguiçoso: os blocos
+ * confirmados ficam em 'blocosPendentes', visíveis às leituras, e só vão para as posições originais (seguidos do fsync da
+ * imagem e do truncamento do jornal) quando o jornal excede TAM_MAX_JORNAL, ao desativá-lo ou antes de uma escrita
+ * direta de dados sobre um bloco que ainda tem versão no jornal (preparaEscritaDireta).
+ * Na abertura da imagem, as transações completas do jornal são reaplicadas.
+ */
 
-inode_no: número do Inode 'inode' a ser escrito
-group: Grupo em que 'inode' será escrito
-inode: Inode a ser escrito
-*/
-void write_inode(unsigned int inode_no, struct ext2_group_desc *group, struct ext2_inode *inode)
+#define FD_JOURNAL FD_DEVICE ".journal"		// Arquivo de jornal, ao lado da imagem
+#define JORNAL_MAGIC 0x4C4E524A				// "JRNL"
+#define JORNAL_DESCRITOR 1					// Registro que inicia uma transação
+#define JORNAL_COMMIT 2						// Registro que confirma uma transação
+#define TAM_MAX_JORNAL (8 << 20)			// Tamanho do jornal que dispara um checkpoint
+
+// Registro do jornal. Um descritor é seguido pelos números e pelos conteúdos dos blocos da transação
+struct RegistroJornal
 {
-	lseek(fd, BLOCK_OFFSET(group->bg_inode_table) + (inode_no - 1) * sizeof(struct ext2_inode),
-		  SEEK_SET);
-	write(fd, inode, sizeof(struct ext2_inode));
+	__u32 magic;
+	__u32 tipo;		 // JORNAL_DESCRITOR ou JORNAL_COMMIT
+	__u64 tid;		 // Identificador da transação
+	__u32 numBlocos; // Quantidade de blocos da transação
+	__u32 tamBloco;	 // Tamanho de cada bloco registrado
+	__u64 checksum;	 // Commit: checksum dos números e dos conteúdos dos blocos
+};
+
+static int fdJornal = -1;												  // Descritor do jornal (-1 se desativado)
+static mutex mutexJornal;												  // Protege o estado do jornal abaixo
+static condition_variable condJornal;									  // Sinaliza novas transações e commits concluídos
+static map<unsigned long, vector<char>> transacaoAtual;					  // Blocos alterados pelo comando em execução
+static map<unsigned long, pair<unsigned long long, vector<char>>> blocosPendentes; // Blocos no jornal, fora da posição original (tid, conteúdo)
+static vector<pair<unsigned long long, map<unsigned long, vector<char>>>> filaCommit; // Transações aguardando o commit em grupo
+static unsigned long long ultimoTid = 0;								  // Última transação criada
+static unsigned long long tidDuravel = 0;								  // Última transação gravada no jornal
+static unsigned long long tamJornal = 0;								  // Bytes no arquivo de jornal
+static unsigned long commitsEmGrupo = 0;								  // Quantidade de fsyncs do jornal realizados
+static bool encerrarCommit = false;
+static thread threadCommit;
+
+// Checksum FNV-1a de 'n' bytes de 'dados', a partir de 'hash'
+static unsigned long long checksumJornal(const void *dados, size_t n, unsigned long long hash)
+{
+	const unsigned char *bytes = (const unsigned char *)dados;
+
+	for (size_t i = 0; i < n; i++)
+		hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+
+	return hash;
 }
 
-/* Faz o tratamento do parâmetro passado em 'cd', modificando 'vetorCaminhoAtual' e atualizando 'valorInode'
-com o valor de Inode do diretório parametrizado
+/* Lê 'n' bytes da imagem na posição 'offset'
 
-valorInode: variável inicialmente zerada para receber o Inode do diretório de nome 'nome'
+Com o jornal ativo, sobrepõe ao conteúdo lido os blocos da transação atual e os confirmados que ainda não chegaram
+à posição original
 */
-void constroiCaminho(struct ext2_inode *inode, struct ext2_group_desc *group, long int *valorInode, const char *nome)
+static ssize_t read_image(void *buffer, size_t n, off_t offset)
 {
-	void *block;
-	*valorInode = -1;
-	struct ext2_dir_entry_2 *entry;
-	unsigned int size = 0;
+	ssize_t lidos = preadContado(fd, buffer, n, offset);
+
+	if (fdJornal < 0 || lidos <= 0)
+		return lidos;
+
+	lock_guard<mutex> trava(mutexJornal);
+
+	if (transacaoAtual.empty() && blocosPendentes.empty())
+		return lidos;
 
-	if ((block = malloc(block_size)) == NULL)
+	for (unsigned long bloco = offset / block_size; (off_t)(bloco * block_size) < offset + lidos; bloco++)
 	{
-		fprintf(stderr, "\nmemory insufficient.\n");
-		close(fd);
-		exit(1);
+		const vector<char> *conteudo = NULL;
+		auto atual = transacaoAtual.find(bloco);
+
+		if (atual != transacaoAtual.end())
+			conteudo = &atual->second;
+		else
+		{
+			auto pendente = blocosPendentes.find(bloco);
+
+			if (pendente != blocosPendentes.end())
+				conteudo = &pendente->second.second;
+		}
+
+		conta(conteudo ? CONT_ACERTOS_CACHE : CONT_FALTAS_CACHE);
+
+		if (!conteudo)
+			continue;
+
+		off_t inicio = max((off_t)(bloco * block_size), offset);
+		off_t fim = min((off_t)((bloco + 1) * block_size), offset + lidos);
+
+		memcpy((char *)buffer + (inicio - offset), conteudo->data() + (inicio - bloco * block_size), fim - inicio);
 	}
 
-	lseek(fd, BLOCK_OFFSET(inode->i_block[0]), SEEK_SET);
-	read(fd, block, block_size);
+	return lidos;
+}
 
-	entry = (struct ext2_dir_entry_2 *)block;
+/* Escreve 'n' bytes na imagem na posição 'offset'
 
-	int found = 0; // Verifica se achou um diretório correspondente
+Com o jornal ativo, a escrita é registrada na transação atual e só chega à imagem após o commit
+*/
+static ssize_t write_image(const void *buffer, size_t n, off_t offset)
+{
+	if (fdJornal < 0)
+		return pwriteContado(fd, buffer, n, offset);
 
-	while ((size < inode->i_size) && entry->inode)
+	for (unsigned long bloco = offset / block_size; (off_t)(bloco * block_size) < offset + (off_t)n; bloco++)
 	{
-		char file_name[EXT2_NAME_LEN + 1];
-		memcpy(file_name, entry->name, entry->name_len);
-		file_name[entry->name_len] = 0;
+		vector<char> *conteudo;
 
-		if (!strcmp(nome, file_name))
 		{
-			found = 1;
+			lock_guard<mutex> trava(mutexJornal);
+			auto atual = transacaoAtual.find(bloco);
+			conteudo = (atual != transacaoAtual.end()) ? &atual->second : NULL;
+		}
 
-			if (entry->file_type != 2)
-			{
-				printf("\nnot a directory.\n");
-				constroiCaminho(inode, group, valorInode, &("."[0]));
-				return;
-			}
+		// Primeira escrita no bloco nesta transação: parte do conteúdo visível atual
+		if (!conteudo)
+		{
+			vector<char> novo(block_size, 0);
 
-			string nomeEntrada = entry->name;
+			read_image(novo.data(), block_size, bloco * block_size);
 
-			if (!strcmp(entry->name, ".."))
-			{
-				if (vetorCaminhoAtual.empty()) // Se estivermos no diretório 'root', não se faz nada
-				{
-					break;
-				}
+			lock_guard<mutex> trava(mutexJornal);
+			conteudo = &transacaoAtual.emplace(bloco, move(novo)).first->second; // Mantém o de outra thread, se houver
+		}
 
-				vetorCaminhoAtual.pop_back(); // Se não for o 'root', removemos o último elemento
-				break;
-			}
+		off_t inicio = max((off_t)(bloco * block_size), offset);
+		off_t fim = min((off_t)((bloco + 1) * block_size), offset + (off_t)n);
 
-			if (!strcmp(entry->name, "."))
-			{
-				break;
-			}
+		lock_guard<mutex> trava(mutexJornal);
+		memcpy(conteudo->data() + (inicio - bloco * block_size), (const char *)buffer + (inicio - offset), fim - inicio);
+	}
 
-			vetorCaminhoAtual.push_back(nomeEntrada);
+	return n;
+}
 
-			break;
-		}
+// Escreve a transação 'transacao' de identificador 'tid' no fim de 'registro'
+static void serializaTransacao(vector<char> &registro, unsigned long long tid, const map<unsigned long, vector<char>> &transacao)
+{
+	struct RegistroJornal cab;
+	unsigned long long checksum = 0xCBF29CE484222325ULL;
+
+	memset(&cab, 0, sizeof(cab));
+	cab.magic = JORNAL_MAGIC;
+	cab.tipo = JORNAL_DESCRITOR;
+	cab.tid = tid;
+	cab.numBlocos = transacao.size();
+	cab.tamBloco = block_size;
+	registro.insert(registro.end(), (char *)&cab, (char *)&cab + sizeof(cab));
+
+	for (auto &bloco : transacao)
+	{
+		__u64 numero = bloco.first;
+		registro.insert(registro.end(), (char *)&numero, (char *)&numero + sizeof(numero));
+		checksum = checksumJornal(&numero, sizeof(numero), checksum);
+	}
 
-		entry = (ext2_dir_entry_2 *)((char *)entry + entry->rec_len);
-		size += entry->rec_len;
+	for (auto &bloco : transacao)
+	{
+		registro.insert(registro.end(), bloco.second.begin(), bloco.second.end());
+		checksum = checksumJornal(bloco.second.data(), bloco.second.size(), checksum);
 	}
-	if (!found)
-		printf("\ndirectory not found.\n");
-	*valorInode = entry->inode;
 
-	free(block);
+	cab.tipo = JORNAL_COMMIT;
+	cab.checksum = checksum;
+	registro.insert(registro.end(), (char *)&cab, (char *)&cab + sizeof(cab));
 }
 
-// Exibe as informações do Inode passado por parâmetro
-void printInode(struct ext2_inode *inode)
+/* Checkpoint: escreve os blocos pendentes em suas posições originais, em ordem de bloco, sincroniza a imagem e trunca o jornal
+
+Deve ser chamada com mutexJornal travado e sem transações confirmadas fora do jornal (filaCommit vazia e nenhum commit
+em andamento)
+*/
+static void aplicaCheckpoint()
 {
-	printf("Reading Inode\n"
-		   "File mode: %hu\n"
-		   "Owner UID: %hu\n"
-		   "Size     : %u bytes\n"
-		   "Blocks   : %u\n",
-		   inode->i_mode,
-		   inode->i_uid,
-		   inode->i_size,
-		   inode->i_blocks);
+	if (tamJornal == 0 && blocosPendentes.empty())
+		return;
 
-	for (int i = 0; i < EXT2_N_BLOCKS; i++)
-		if (i < EXT2_NDIR_BLOCKS)
-			printf("Block %2u : %u\n", i, inode->i_block[i]);
-		else if (i == EXT2_IND_BLOCK)
-			printf("Single   : %u\n", inode->i_block[i]);
-		else if (i == EXT2_DIND_BLOCK)
-			printf("Double   : %u\n", inode->i_block[i]);
-		else if (i == EXT2_TIND_BLOCK)
-			printf("Triple   : %u\n", inode->i_block[i]);
+	for (auto &bloco : blocosPendentes)
+		pwriteContado(fd, bloco.second.second.data(), block_size, bloco.first * block_size);
+
+	fsyncContado(fd, 0);
+	ftruncate(fdJornal, 0);
+	tamJornal = 0;
+	blocosPendentes.clear();
 }
 
-// Exibe as informações do arquivo do Inode passado por parâmetro, com tratamento de indireção
-void printaArquivo(struct ext2_inode *inode)
+// Thread de commit: junta as transações enfileiradas em um único registro e um único fsync; o checkpoint fica para quando o jornal excede TAM_MAX_JORNAL
+static void executaCommits()
 {
-	char *buffer = (char *)malloc(sizeof(char) * block_size);
+	unique_lock<mutex> trava(mutexJornal);
 
-	lseek(fd, BLOCK_OFFSET(inode->i_block[0]), SEEK_SET); // Posiciona o leitor no primeiro bloco de dados do Inode
-	read(fd, buffer, block_size);						  // Lê este bloco em buffer
+	origemRastro = "journal-commit";
 
-	int sizeTemp = inode->i_size;
+	while (true)
+	{
+		condJornal.wait(trava, []
+						{ return encerrarCommit || !filaCommit.empty(); });
 
-	// Com blocos de tamanho de 1024 bytes, haverão 256 blocos diretos em blocos de uma indireção e 256 blocos indiretos em blocos de dupla indireção
-	int singleInd[256];
-	int doubleInd[256];
+		if (filaCommit.empty() && encerrarCommit)
+			break;
 
-	for (int i = 0; i < 12; i++) // Itera sobre os blocos de dados sem indireção
-	{
-		lseek(fd, BLOCK_OFFSET(inode->i_block[i]), SEEK_SET);
-		read(fd, buffer, block_size); // Lê bloco i em buffer
+		auto lote = move(filaCommit);
+		filaCommit.clear();
+		trava.unlock();
 
-		for (int i = 0; i < 1024; i++) // Exibe o conteúdo do bloco i
-		{
-			printf("%c", buffer[i]);
+		vector<char> registro;
 
-			sizeTemp = sizeTemp - sizeof(char); // Controle de dados restantes
+		for (auto &transacao : lote)
+			serializaTransacao(registro, transacao.first, transacao.second);
 
-			if (sizeTemp <= 0)
-			{
-				break;
-			}
-		}
-		if (sizeTemp <= 0)
-		{
-			break;
-		}
-	}
+		// Commit em grupo: uma escrita e um fsync para todas as transações do lote
+		pwriteContado(fdJornal, registro.data(), registro.size(), tamJornal);
+		fsyncContado(fdJornal, 1);
 
-	if (sizeTemp > 0) // Se depois dos blocos sem indireção ainda há dados, passa pelo bloco 12 que tem uma indireção
-	{
-		lseek(fd, BLOCK_OFFSET(inode->i_block[12]), SEEK_SET);
-		read(fd, singleInd, block_size);
+		trava.lock();
 
-		for (int i = 0; i < 256; i++) // Iteração sobre os blocos diretos do bloco 12
-		{
-			lseek(fd, BLOCK_OFFSET(singleInd[i]), SEEK_SET);
-			read(fd, buffer, block_size);
+		tamJornal += registro.size();
+		commitsEmGrupo++;
+		tidDuravel = lote.back().first;
 
-			for (int j = 0; j < 1024; j++)
-			{
-				printf("%c", buffer[j]);
-				sizeTemp = sizeTemp - 1;
+		// Com todas as transações confirmadas no jornal, os blocos pendentes podem ir para a posição original
+		if (tamJornal > TAM_MAX_JORNAL && filaCommit.empty())
+			aplicaCheckpoint();
 
-				if (sizeTemp <= 0)
-				{
-					break;
-				}
-			}
-			if (sizeTemp <= 0)
-			{
-				break;
-			}
-		}
+		condJornal.notify_all();
 	}
+}
 
-	if (sizeTemp > 0) // Se depois dos blocos com uma indireção ainda há dados, passa pelo bloco 13 que tem dupla indireção
-	{
-		lseek(fd, BLOCK_OFFSET(inode->i_block[13]), SEEK_SET);
-		read(fd, doubleInd, block_size);
-
-		for (int i = 0; i < 256; i++)
-		{
-			if (sizeTemp <= 0)
-			{
-				break;
-			}
+// Encerra a transação do comando atual, enfileirando-a para o próximo commit em grupo sem aguardá-lo
+static void confirmaTransacao()
+{
+	if (fdJornal < 0)
+		return;
 
-			lseek(fd, BLOCK_OFFSET(doubleInd[i]), SEEK_SET);
-			read(fd, singleInd, block_size);
+	lock_guard<mutex> trava(mutexJornal);
 
-			for (int k = 0; k < 256; k++) // Iteração sobre os blocos diretos do bloco 13
-			{
-				if (sizeTemp <= 0)
-				{
-					break;
-				}
+	if (transacaoAtual.empty())
+		return;
 
-				lseek(fd, BLOCK_OFFSET(singleInd[k]), SEEK_SET);
-				read(fd, buffer, block_size);
+	unsigned long long tid = ++ultimoTid;
 
-				for (int j = 0; j < 1024; j++)
-				{
-					printf("%c", buffer[j]);
-					sizeTemp = sizeTemp - 1;
-					if (sizeTemp <= 0)
-					{
-						break;
-					}
-				}
-			}
-		}
-	}
+	for (auto &bloco : transacaoAtual)
+		blocosPendentes[bloco.first] = {tid, bloco.second};
 
-	free(buffer);
+	filaCommit.push_back({tid, move(transacaoAtual)});
+	transacaoAtual.clear();
+	condJornal.notify_all();
 }
 
-// Exibe as informações do Grupo passado por parâmetro
-void printGroup(struct ext2_group_desc *group)
+// Aguarda até que todas as transações enfileiradas estejam gravadas no jornal
+static void aguardaCommits()
 {
-	printf("\n\n\nReading first group-descriptor from device " FD_DEVICE ":\n"
-		   "Blocks bitmap block: %u\n"
-		   "Inodes bitmap block: %u\n"
-		   "Inodes table block : %u\n"
-		   "Free blocks count  : %u\n"
-		   "Free inodes count  : %u\n"
-		   "Directories count  : %u\n",
-		   group->bg_block_bitmap,
-		   group->bg_inode_bitmap,
-		   group->bg_inode_table,
-		   group->bg_free_blocks_count,
-		   group->bg_free_inodes_count,
-		   group->bg_used_dirs_count);
+	if (fdJornal < 0)
+		return;
+
+	unique_lock<mutex> trava(mutexJornal);
+	condJornal.wait(trava, []
+					{ return tidDuravel == ultimoTid; });
 }
 
-// Abre a imagem do sistema de arquivos, lê o Superbloco em super, verifica o número mágico, lê o Grupo 0 em group, e lê o Inode 2 em inode
-void init_super(struct ext2_group_desc *group, struct ext2_inode *inode)
+/* Prepara uma escrita direta na imagem, fora do jornal, dos 'n' blocos de 'blocos' (de qualquer bloco, se 'blocos' é NULL)
+
+Um bloco liberado pode ainda ter uma versão de metadados no jornal, que sobrescreveria os dados novos na recuperação
+após uma queda (e no próximo checkpoint): nesse caso, aguarda os commits e faz o checkpoint antes da escrita
+*/
+static void preparaEscritaDireta(const unsigned int *blocos, size_t n)
 {
-	// Abre a imagem do sistema de arquivos
-	if ((fd = open(FD_DEVICE, O_RDWR)) < 0)
-	{
-		perror(FD_DEVICE);
-		exit(1);
-	}
+	if (fdJornal < 0)
+		return;
 
-	// Leitura do Superbloco
-	lseek(fd, BASE_OFFSET, SEEK_SET);
-	read(fd, &super, sizeof(super));
+	unique_lock<mutex> trava(mutexJornal);
+	condJornal.wait(trava, []
+					{ return tidDuravel == ultimoTid; });
 
-	// Verificação do número mágico
-	if (super.s_magic != EXT2_SUPER_MAGIC)
-	{
-		fprintf(stderr, "not a Ext2 filesystem.\n");
-		exit(1);
-	}
+	int conflito = (blocos == NULL);
 
-	// Leitura do Grupo
-	lseek(fd, BASE_OFFSET + block_size, SEEK_SET);
-	read(fd, group, sizeof(struct ext2_group_desc));
+	for (size_t i = 0; i < n && !conflito && !blocosPendentes.empty(); i++)
+		conflito = blocosPendentes.count(blocos[i]);
 
-	// Leitura do Inode
-	read_inode(2, group, inode);
+	if (conflito)
+		aplicaCheckpoint();
 }
 
-/* Inicia novoInode e novoGrupo com o Grupo e o Inode do arquivo com nome 'nome'
+// Confirma a transação atual, aguarda o commit de todas as transações e faz o checkpoint
+static void sincronizaJornal()
+{
+	if (fdJornal < 0)
+		return;
 
-novoInode, novoGroup: variáveis auxiliares para manutenção dos antigos valores em inode e group
+	confirmaTransacao();
+	preparaEscritaDireta(NULL, 0);
+}
+
+/* Reaplica na imagem as transações completas do arquivo de jornal, descartando uma transação final incompleta
+
+Retorna a quantidade de transações reaplicadas, ou -1 se o jornal não existe
 */
-int getArquivoPorNome(struct ext2_inode *inode, struct ext2_group_desc *group, char *nome, int *grupoAtual, struct ext2_inode *novoInode, struct ext2_group_desc *novoGroup)
+static int recuperaJornal()
 {
-	long int valorInodeTmp;
+	int fdRecuperacao = open(FD_JOURNAL, O_RDWR);
 
-	// Cópia das variáveis para mudança de valores de Grupo e Inode
-	memcpy(novoGroup, group, sizeof(struct ext2_group_desc));
-	memcpy(novoInode, inode, sizeof(struct ext2_inode));
+	if (fdRecuperacao < 0)
+		return -1;
 
-	// Atualização do Inode para o que contém o arquivo 'nome'
-	read_dir(novoInode, novoGroup, &valorInodeTmp, nome);
+	off_t tamanho = lseek(fdRecuperacao, 0, SEEK_END);
+	vector<char> conteudo(tamanho);
+	off_t pos = 0;
+	int reaplicadas = 0;
 
-	if (valorInodeTmp == -1)
-	{
-		return -1;
-	}
-	else if (valorInodeTmp == -2)
+	pread(fdRecuperacao, conteudo.data(), tamanho, 0);
+
+	while (pos + (off_t)sizeof(struct RegistroJornal) <= tamanho)
 	{
-		return -2;
-	}
+		struct RegistroJornal cab;
+		memcpy(&cab, conteudo.data() + pos, sizeof(cab));
 
-	// Atualização do Groupo para o que contém o novo Inode
+		if (cab.magic != JORNAL_MAGIC || cab.tipo != JORNAL_DESCRITOR || cab.tamBloco == 0)
+			break;
+
+		off_t numeros = pos + sizeof(cab);
+		off_t blocos = numeros + (off_t)cab.numBlocos * sizeof(__u64);
+		off_t commit = blocos + (off_t)cab.numBlocos * cab.tamBloco;
+
+		if (commit + (off_t)sizeof(cab) > tamanho)
+			break;
+
+		struct RegistroJornal fim;
+		memcpy(&fim, conteudo.data() + commit, sizeof(fim));
+
+		unsigned long long checksum = checksumJornal(conteudo.data() + numeros, commit - numeros, 0xCBF29CE484222325ULL);
+
+		if (fim.magic != JORNAL_MAGIC || fim.tipo != JORNAL_COMMIT || fim.tid != cab.tid || fim.checksum != checksum)
+			break;
+
+		for (__u32 i = 0; i < cab.numBlocos; i++)
+		{
+			__u64 numero;
+			memcpy(&numero, conteudo.data() + numeros + i * sizeof(__u64), sizeof(numero));
+			pwrite(fd, conteudo.data() + blocos + (off_t)i * cab.tamBloco, cab.tamBloco, numero * cab.tamBloco);
+		}
+
+		reaplicadas++;
+		pos = commit + sizeof(cab);
+	}
+
+	fsync(fd);
+	ftruncate(fdRecuperacao, 0);
+	close(fdRecuperacao);
+
+	return reaplicadas;
+}
+
+// Ativa o jornal, criando o arquivo de jornal se necessário e iniciando a thread de commit
+static int ativaJornal()
+{
+	if (fdJornal >= 0)
+		return 0;
+
+	int novo = open(FD_JOURNAL, O_RDWR | O_CREAT, 0644);
+
+	if (novo < 0)
+		return -1;
+
+	tamJornal = lseek(novo, 0, SEEK_END);
+	encerrarCommit = false;
+	fdJornal = novo;
+	threadCommit = thread(executaCommits);
+
+	return 0;
+}
+
+// Desativa o jornal: aplica todas as transações, encerra a thread de commit e, se 'remover', apaga o arquivo de jornal
+static void desativaJornal(int remover)
+{
+	if (fdJornal < 0)
+		return;
+
+	sincronizaJornal();
+
+	{
+		lock_guard<mutex> trava(mutexJornal);
+		encerrarCommit = true;
+		condJornal.notify_all();
+	}
+
+	threadCommit.join();
+	close(fdJornal);
+	fdJornal = -1;
+
+	if (remover)
+		unlink(FD_JOURNAL);
+}
+
+/* Arena de memória temporária dos comandos
+
+Os buffers de trabalho de um comando (blocos, Inodes, descritores, caminhos) são retirados em sequência de segmentos
+alinhados que são reaproveitados entre os comandos. liberaTemporarios, chamada ao fim de cada comando, devolve tudo
+de uma vez; os segmentos que excedem TAM_RETIDO_ARENA são devolvidos ao sistema, para que um comando grande não
+retenha memória nos seguintes
+*/
+#define TAM_SEGMENTO_ARENA (256 * 1024)		 // Tamanho mínimo de cada segmento
+#define TAM_RETIDO_ARENA (4 * 1024 * 1024) // Memória mantida entre os comandos
+#define ALINHAMENTO_ARENA 64				 // Alinhamento dos buffers (linha de cache)
+
+struct SegmentoArena
+{
+	char *dados;
+	size_t tamanho;
+	size_t usado;
+};
+
+static vector<struct SegmentoArena> segmentosArena;
+static size_t segmentoAtualArena = 0;
+static mutex mutexArena;
+
+// Retorna um buffer de 'n' bytes válido até o fim do comando atual
+static void *alocaTemporario(size_t n)
+{
+	n = (n + ALINHAMENTO_ARENA - 1) & ~(size_t)(ALINHAMENTO_ARENA - 1);
+
+	lock_guard<mutex> trava(mutexArena);
+
+	for (; segmentoAtualArena < segmentosArena.size(); segmentoAtualArena++)
+	{
+		struct SegmentoArena &segmento = segmentosArena[segmentoAtualArena];
+
+		if (segmento.tamanho - segmento.usado >= n)
+		{
+			void *buffer = segmento.dados + segmento.usado;
+			segmento.usado += n;
+			return buffer;
+		}
+	}
+
+	size_t tamanho = max<size_t>(n, TAM_SEGMENTO_ARENA);
+	char *dados = (char *)aligned_alloc(ALINHAMENTO_ARENA, tamanho);
+
+	if (dados == NULL)
+	{
+		fprintf(stderr, "\nmemory insufficient.\n");
+		close(fd);
+		exit(1);
+	}
+
+	segmentosArena.push_back({dados, tamanho, n});
+	segmentoAtualArena = segmentosArena.size() - 1;
+
+	return dados;
+}
+
+// Retorna um buffer do tamanho de um bloco válido até o fim do comando atual
+static inline void *blocoTemporario()
+{
+	return alocaTemporario(block_size);
+}
+
+/* Devolve à arena todos os buffers temporários do comando
+
+reter: 0 devolve também os segmentos ao sistema (fim do shell)
+*/
+[[maybe_unused]] static void liberaTemporarios(int reter = 1)
+{
+	lock_guard<mutex> trava(mutexArena);
+	vector<struct SegmentoArena> mantidos;
+	size_t retido = 0;
+
+	for (auto &segmento : segmentosArena)
+	{
+		if (reter && retido + segmento.tamanho <= TAM_RETIDO_ARENA)
+		{
+			segmento.usado = 0;
+			retido += segmento.tamanho;
+			mantidos.push_back(segmento);
+		}
+		else
+			free(segmento.dados);
+	}
+
+	segmentosArena.swap(mantidos);
+	segmentoAtualArena = 0;
+}
+
+/* Marca a posição atual da arena; ao sair de escopo, devolve os buffers obtidos depois da marca
+
+Usada pelas rotinas chamadas em laço dentro de um comando (ex.: desmarcar cada bloco no 'rm'), para que a memória do
+comando não cresça com o número de chamadas. Os buffers devem ser obtidos e devolvidos na thread principal
+*/
+struct EscopoArena
+{
+	size_t segmento, usado;
+
+	EscopoArena()
+	{
+		lock_guard<mutex> trava(mutexArena);
+		segmento = segmentoAtualArena;
+		usado = (segmento < segmentosArena.size()) ? segmentosArena[segmento].usado : 0;
+	}
+
+	~EscopoArena()
+	{
+		lock_guard<mutex> trava(mutexArena);
+
+		for (size_t i = segmento + 1; i < segmentosArena.size(); i++)
+			segmentosArena[i].usado = 0;
+
+		if (segmento < segmentosArena.size())
+			segmentosArena[segmento].usado = usado;
+
+		segmentoAtualArena = segmento;
+	}
+};
+
+// Posiciona o leitor do arquivo em  (Inicio_Tabela_Inodes + Distancia_Inode_Desejado) bytes e lê o Inode desejado na variável Inode passada por parâmetro
+static void read_inode(unsigned int inode_no, struct ext2_group_desc *group, struct ext2_inode *inode)
+{
+	read_image(inode, sizeof(struct ext2_inode), BLOCK_OFFSET(group->bg_inode_table) + (off_t)(inode_no - 1) * inode_size);
+}
+
+/* Se o grupo do Inode é diferente do grupo atual: atualiza a variável grupoAtual e posiciona o leitor do arquivo no descritor do novo grupo, fazendo a leitura
+deste na variável group passada por parâmetro
+
+valor: valor do Inode
+grupoAtual: Grupo corrente
+*/
+void trocaGrupo(long int *valor, struct ext2_group_desc *group, int *grupoAtual)
+{
+	long int block_group = ((*valor) - 1) / super.s_inodes_per_group; // Cálculo do grupo do Inode
+
+	if (block_group != (*grupoAtual))
+	{
+		*grupoAtual = block_group;
+
+		read_image(group, sizeof(struct ext2_group_desc), GDT_OFFSET + sizeof(struct ext2_group_desc) * block_group);
+	}
+}
+
+/* Executa 'f' com o tamanho de bloco da imagem
+
+Os tamanhos de 1, 2, 4 e 64 KiB são passados como constantes de compilação (integral_constant), para que os laços que
+dependem do tamanho do bloco (busca em bitmap, busca em bloco de diretório, percurso dos blocos de indireção) sejam
+especializados pelo compilador; os demais são passados como valor comum
+*/
+template <typename F>
+static auto despachaTamanhoBloco(F f) -> decltype(f(1024u))
+{
+	switch (block_size)
+	{
+	case 1024:
+		return f(integral_constant<unsigned int, 1024>());
+	case 2048:
+		return f(integral_constant<unsigned int, 2048>());
+	case 4096:
+		return f(integral_constant<unsigned int, 4096>());
+	case 65536:
+		return f(integral_constant<unsigned int, 65536>());
+	default:
+		return f((unsigned int)block_size);
+	}
+}
+
+/* Converte o rec_len gravado em disco no tamanho do registro
+
+Um registro que ocupa um bloco de 64 KiB inteiro não cabe nos 16 bits de rec_len: o mke2fs grava 65535 e versões
+antigas gravavam 0. Nos dois casos o tamanho é 65536, como em ext2_rec_len_from_disk do kernel
+*/
+static inline unsigned int rec_len_from_disk(__u16 dlen)
+{
+	if (block_size == 65536 && (dlen == 65535 || dlen == 0))
+		return 65536;
+
+	return dlen;
+}
+
+// Converte o tamanho de um registro no rec_len a ser gravado em disco (65536 é gravado como 65535)
+static inline __u16 rec_len_to_disk(unsigned int len)
+{
+	return (len == 65536) ? 65535 : len;
+}
+
+// Acrescenta 'n' bytes ao registro da entrada 'entry', que passa a incorporar o registro seguinte
+static inline void estendeRegistro(struct ext2_dir_entry_2 *entry, unsigned int n)
+{
+	entry->rec_len = rec_len_to_disk(rec_len_from_disk(entry->rec_len) + n);
+}
+
+/* Procura a entrada de nome 'nome' entre os 'tamanho' primeiros bytes do bloco de diretório 'bloco'
+
+Entradas sem Inode (a primeira de um bloco cuja entrada foi removida) são puladas. Retorna o Inode da entrada, ou -1
+se ela não foi encontrada
+*/
+template <typename Tam>
+static long procuraEntradaBloco(const void *bloco, Tam tamanho, const char *nome)
+{
+	const struct ext2_dir_entry_2 *entry = (const struct ext2_dir_entry_2 *)bloco;
+	unsigned int size = 0;
+
+	while ((size + 8 <= (unsigned int)tamanho) && rec_len_from_disk(entry->rec_len) >= 8)
+	{
+		char file_name[EXT2_NAME_LEN + 1];
+		memcpy(file_name, entry->name, entry->name_len);
+		file_name[entry->name_len] = 0;
+
+		if (entry->inode && !strcmp(nome, file_name))
+			return entry->inode;
+
+		size += rec_len_from_disk(entry->rec_len);
+		entry = (const ext2_dir_entry_2 *)((const char *)entry + rec_len_from_disk(entry->rec_len));
+	}
+
+	return -1;
+}
+
+/* Escreve o inode 'inode' de número 'inode_no' na Tabela de Inodes de 'group'
+
+inode_no: número do Inode 'inode' a ser escrito
+group: Grupo em que 'inode' será escrito
+inode: Inode a ser escrito
+*/
+void write_inode(unsigned int inode_no, struct ext2_group_desc *group, struct ext2_inode *inode)
+{
+	write_image(inode, sizeof(struct ext2_inode), BLOCK_OFFSET(group->bg_inode_table) + (off_t)(inode_no - 1) * inode_size);
+}
+
+/* Rotinas de E/S posicional
+ *
+ * Utilizam pread/pwrite, que não dependem da posição do leitor compartilhado de 'fd', e por isso podem ser chamadas
+ * concorrentemente por várias threads
+ */
+
+// Lê o bloco 'bloco' em 'buffer'. Retorna 0 em caso de sucesso e -1 caso contrário
+static int read_block(unsigned int bloco, void *buffer)
+{
+	return read_image(buffer, block_size, BLOCK_OFFSET(bloco)) == block_size ? 0 : -1;
+}
+
+// Escreve 'buffer' no bloco 'bloco'. Retorna 0 em caso de sucesso e -1 caso contrário
+static int write_block(unsigned int bloco, const void *buffer)
+{
+	return write_image(buffer, block_size, BLOCK_OFFSET(bloco)) == block_size ? 0 : -1;
+}
+
+// Lê todos os descritores de grupo da tabela de descritores em 'grupos'
+static void read_group_descs(vector<struct ext2_group_desc> &grupos)
+{
+	grupos.resize(num_grupos);
+	read_image(grupos.data(), sizeof(struct ext2_group_desc) * grupos.size(), GDT_OFFSET);
+}
+
+// Retorna o tamanho em bytes de 'inode', considerando os 32 bits altos guardados em i_dir_acl nos arquivos regulares
+static unsigned long long tamanhoInode(const struct ext2_inode *inode)
+{
+	unsigned long long tamanho = inode->i_size;
+
+	if (S_ISREG(inode->i_mode) && (super.s_feature_ro_compat & EXT2_FEATURE_RO_COMPAT_LARGE_FILE))
+		tamanho |= ((unsigned long long)inode->i_dir_acl) << 32;
+
+	return tamanho;
+}
+
+/* Percorre o bloco de indireção 'bloco' de nível 'nivel' (1 = simples, 2 = dupla, 3 = tripla)
+
+logico: primeiro bloco lógico coberto por 'bloco', avançado conforme a subárvore é percorrida
+restantes: quantidade de blocos lógicos do arquivo que ainda não foram percorridos
+visitaDado: chamada com (bloco lógico, bloco físico) para cada bloco de dados não nulo
+visitaIndireto: chamada para cada bloco de indireção percorrido (pode ser vazia)
+*/
+template <typename Tam>
+static int percorreIndirecao(unsigned int bloco, int nivel, unsigned long *logico, unsigned long *restantes, Tam tamBloco,
+							 const function<void(unsigned long, unsigned int)> &visitaDado,
+							 const function<void(unsigned int)> &visitaIndireto)
+{
+	const unsigned long porBloco = (unsigned int)tamBloco / sizeof(__u32);
+	unsigned long cobertura = porBloco; // Quantidade de blocos lógicos cobertos por 'bloco'
+
+	for (int i = 1; i < nivel; i++)
+		cobertura *= porBloco;
+
+	// Ponteiro nulo: toda a subárvore é um buraco
+	if (bloco == 0)
+	{
+		unsigned long pular = (*restantes < cobertura) ? *restantes : cobertura;
+		*logico += pular;
+		*restantes -= pular;
+		return 0;
+	}
+
+	if (bloco >= super.s_blocks_count)
+		return -1;
+
+	if (visitaIndireto)
+		visitaIndireto(bloco);
+
+	vector<__u32> ponteiros(porBloco);
+
+	if (read_block(bloco, ponteiros.data()) < 0)
+		return -1;
+
+	int status = 0;
+
+	for (unsigned long i = 0; i < porBloco && *restantes > 0; i++)
+	{
+		if (nivel > 1)
+		{
+			if (percorreIndirecao(ponteiros[i], nivel - 1, logico, restantes, tamBloco, visitaDado, visitaIndireto) < 0)
+				status = -1;
+			continue;
+		}
+
+		if (ponteiros[i] >= super.s_blocks_count)
+			status = -1;
+		else if (ponteiros[i] != 0)
+			visitaDado(*logico, ponteiros[i]);
+
+		(*logico)++;
+		(*restantes)--;
+	}
+
+	return status;
+}
+
+/* Percorre o mapa de blocos de 'inode' (blocos diretos, simples, dupla e tripla indireção) até cobrir o seu tamanho
+
+Retorna -1 se algum ponteiro aponta para fora da imagem e 0 caso contrário
+*/
+static int percorreMapaBlocos(struct ext2_inode *inode,
+							  const function<void(unsigned long, unsigned int)> &visitaDado,
+							  const function<void(unsigned int)> &visitaIndireto)
+{
+	// Links simbólicos rápidos guardam o destino em i_block e não possuem blocos
+	if (S_ISLNK(inode->i_mode) && inode->i_blocks == 0)
+		return 0;
+
+	unsigned long restantes = (tamanhoInode(inode) + block_size - 1) / block_size;
+	unsigned long logico = 0;
+	int status = 0;
+
+	for (int i = 0; i < EXT2_NDIR_BLOCKS && restantes > 0; i++)
+	{
+		if (inode->i_block[i] >= super.s_blocks_count)
+			status = -1;
+		else if (inode->i_block[i] != 0)
+			visitaDado(logico, inode->i_block[i]);
+
+		logico++;
+		restantes--;
+	}
+
+	// Os blocos de indireção são percorridos com o tamanho do bloco como constante de compilação
+	despachaTamanhoBloco([&](auto tamanho)
+						 {
+							 for (int nivel = 1; nivel <= 3 && restantes > 0; nivel++)
+							 {
+								 if (percorreIndirecao(inode->i_block[EXT2_IND_BLOCK + nivel - 1], nivel, &logico, &restantes, tamanho, visitaDado, visitaIndireto) < 0)
+									 status = -1;
+							 } });
+
+	return status;
+}
+
+/* Resolve o mapa de blocos de 'inode' em 'blocos', em ordem lógica e com 0 nas posições de buracos
+
+indiretos: se não for nulo, recebe os blocos de indireção percorridos
+*/
+static int resolve_block_map(struct ext2_inode *inode, vector<unsigned int> &blocos, vector<unsigned int> *indiretos)
+{
+	if (S_ISLNK(inode->i_mode) && inode->i_blocks == 0)
+		blocos.clear();
+	else
+		blocos.assign((tamanhoInode(inode) + block_size - 1) / block_size, 0);
+
+	function<void(unsigned int)> visitaIndireto;
+
+	if (indiretos)
+		visitaIndireto = [indiretos](unsigned int bloco)
+		{ indiretos->push_back(bloco); };
+
+	return percorreMapaBlocos(
+		inode, [&blocos](unsigned long logico, unsigned int bloco)
+		{ blocos[logico] = bloco; },
+		visitaIndireto);
+}
+
+/* Atualiza valorInode com o Inode da entrada que possui nome 'nome'
+
+Todos os blocos do diretório são examinados, em ordem, até a entrada ser encontrada
+inode, group: Inode/Grupo do diretório
+valorInode: variável que receberá o Inode da entrada com nome 'nome'
+nome: nome da entrada procurada no diretório
+ */
+void read_dir(struct ext2_inode *inode, struct ext2_group_desc *group, long int *valorInode, char *nome)
+{
+	EscopoArena escopo; // Buffers devolvidos ao retornar
+	void *block;
+	(*valorInode) = -1;
+	if (!strlen(nome))
+		*valorInode = -2;
+	if (S_ISDIR(inode->i_mode))
+	{
+		vector<unsigned int> blocos;
+
+		block = blocoTemporario();
+		resolve_block_map(inode, blocos, NULL);
+
+		for (unsigned int numBloco : blocos)
+		{
+			if (numBloco == 0)
+				continue;
+
+			read_image(block, block_size, BLOCK_OFFSET(numBloco));
+
+			long encontrado = despachaTamanhoBloco([block, nome](auto tamanho)
+												   { return procuraEntradaBloco(block, tamanho, nome); });
+
+			if (encontrado != -1)
+			{
+				*valorInode = encontrado;
+				break;
+			}
+		}
+	}
+}
+
+#define MAX_INODES_CACHE_EXTENSOES 64 // Inodes com extensões em cache; ao ser atingido, a cache é esvaziada
+
+// Blocos lógicos consecutivos mapeados para blocos físicos consecutivos
+struct ExtensaoBlocos
+{
+	unsigned int fisico;	// Primeiro bloco físico (0 se a extensão é um buraco)
+	unsigned long numBlocos;
+};
+
+// Extensões conhecidas do mapa de blocos de um Inode
+struct CacheExtensoes
+{
+	__u32 mapa[EXT2_N_BLOCKS];						// i_block quando as extensões foram lidas
+	__u32 tamanho, blocos;							// i_size e i_blocks quando as extensões foram lidas
+	map<unsigned long, struct ExtensaoBlocos> extensoes; // Primeiro bloco lógico -> extensão
+};
+
+map<unsigned int, struct CacheExtensoes> cacheExtensoes; // Número do Inode -> extensões do seu mapa de blocos
+
+// Descarta as extensões em cache do Inode 'numInode'. Chamada quando o mapa de blocos do Inode muda
+static void invalidaExtensoes(unsigned int numInode)
+{
+	cacheExtensoes.erase(numInode);
+}
+
+// Acrescenta a 'cache' as extensões formadas pelos 'n' ponteiros de 'ponteiros', que mapeiam os blocos lógicos a partir de 'logico'
+static void registraExtensoes(struct CacheExtensoes &cache, unsigned long logico, const __u32 *ponteiros, unsigned long n)
+{
+	for (unsigned long i = 0; i < n;)
+	{
+		unsigned long j = i + 1;
+
+		// Estende enquanto os blocos físicos forem consecutivos (ou enquanto durar o buraco)
+		while (j < n && (ponteiros[i] ? ponteiros[j] == ponteiros[i] + (j - i) : ponteiros[j] == 0))
+			j++;
+
+		cache.extensoes[logico + i] = {ponteiros[i], j - i};
+		i = j;
+	}
+}
+
+/* Retorna a extensão de 'inode' (de número 'numInode') que contém o bloco lógico 'logico', cujo primeiro bloco lógico
+vai para 'inicio'
+
+Em uma falta, os ponteiros até o bloco são calculados aritmeticamente e apenas os blocos de indireção do caminho
+são lidos; todo o bloco de indireção de último nível é convertido em extensões, de modo que acessos próximos não leem
+o mapa novamente. Uma subárvore com ponteiro nulo vira uma única extensão de buraco
+*/
+static struct ExtensaoBlocos extensaoDoBloco(unsigned int numInode, struct ext2_inode *inode, unsigned long logico, unsigned long *inicio)
+{
+	auto it = cacheExtensoes.find(numInode);
+
+	// O mapa de blocos mudou desde que as extensões foram lidas
+	if (it != cacheExtensoes.end() && (memcmp(it->second.mapa, inode->i_block, sizeof(inode->i_block)) ||
+									   it->second.tamanho != inode->i_size || it->second.blocos != inode->i_blocks))
+	{
+		cacheExtensoes.erase(it);
+		it = cacheExtensoes.end();
+	}
+
+	if (it == cacheExtensoes.end())
+	{
+		if (cacheExtensoes.size() >= MAX_INODES_CACHE_EXTENSOES)
+			cacheExtensoes.clear();
+
+		it = cacheExtensoes.emplace(numInode, CacheExtensoes()).first;
+		memcpy(it->second.mapa, inode->i_block, sizeof(inode->i_block));
+		it->second.tamanho = inode->i_size;
+		it->second.blocos = inode->i_blocks;
+	}
+
+	struct CacheExtensoes &cache = it->second;
+	auto extensao = cache.extensoes.upper_bound(logico);
+
+	if (extensao != cache.extensoes.begin() && logico < prev(extensao)->first + prev(extensao)->second.numBlocos)
+	{
+		*inicio = prev(extensao)->first;
+		return prev(extensao)->second;
+	}
+
+	unsigned long porBloco = block_size / sizeof(__u32);
+
+	if (logico < EXT2_NDIR_BLOCKS)
+		registraExtensoes(cache, 0, inode->i_block, EXT2_NDIR_BLOCKS);
+	else
+	{
+		// Nível de indireção e posição do bloco dentro da subárvore do ponteiro de i_block
+		unsigned long resto = logico - EXT2_NDIR_BLOCKS, cobertura = porBloco, base = EXT2_NDIR_BLOCKS;
+		int nivel = 1;
+
+		while (nivel < 3 && resto >= cobertura)
+		{
+			resto -= cobertura;
+			base += cobertura;
+			cobertura *= porBloco;
+			nivel++;
+		}
+
+		unsigned int bloco = inode->i_block[EXT2_IND_BLOCK + nivel - 1];
+		vector<__u32> ponteiros(porBloco);
+
+		// Desce até o bloco de indireção de último nível; um ponteiro nulo torna toda a subárvore um buraco
+		for (; nivel > 1 && bloco; nivel--)
+		{
+			cobertura /= porBloco;
+
+			if (bloco >= super.s_blocks_count || read_block(bloco, ponteiros.data()) < 0)
+				bloco = 0;
+			else
+				bloco = ponteiros[resto / cobertura];
+
+			base += resto / cobertura * cobertura;
+			resto %= cobertura;
+		}
+
+		if (bloco == 0 || bloco >= super.s_blocks_count || read_block(bloco, ponteiros.data()) < 0)
+			cache.extensoes[base] = {0, cobertura};
+		else
+			registraExtensoes(cache, base, ponteiros.data(), porBloco);
+	}
+
+	extensao = prev(cache.extensoes.upper_bound(logico));
+	*inicio = extensao->first;
+
+	return extensao->second;
+}
+
+/* Lê 'n' bytes a partir do byte 'offset' do arquivo de 'inode' (de número 'numInode') em 'destino'
+
+Os blocos são localizados pela cache de extensões (extensaoDoBloco), sem percorrer o mapa desde o início, e cada trecho
+fisicamente contíguo é lido com uma única leitura; os buracos são entregues como zeros
+Retorna o número de bytes lidos (menor que 'n' se a faixa passa do fim do arquivo) ou -1 em caso de erro
+*/
+static long long leFaixaArquivo(unsigned int numInode, struct ext2_inode *inode, unsigned long long offset, unsigned long long n, char *destino)
+{
+	unsigned long long tamanho = tamanhoInode(inode);
+
+	if (offset >= tamanho)
+		return 0;
+
+	n = min(n, tamanho - offset);
+
+	for (unsigned long long pos = offset; pos < offset + n;)
+	{
+		unsigned long logico = pos / block_size, inicio;
+		struct ExtensaoBlocos extensao = extensaoDoBloco(numInode, inode, logico, &inicio);
+		unsigned long long fim = min<unsigned long long>((unsigned long long)(inicio + extensao.numBlocos) * block_size, offset + n);
+
+		if (extensao.fisico == 0)
+			memset(destino + (pos - offset), 0, fim - pos);
+		else if (read_image(destino + (pos - offset), fim - pos, BLOCK_OFFSET(extensao.fisico + (logico - inicio)) + pos % block_size) != (ssize_t)(fim - pos))
+			return -1;
+
+		pos = fim;
+	}
+
+	return n;
+}
+
+// Executa 'tarefa' para cada índice em [0, n), distribuindo os índices entre as threads disponíveis
+static void executaParalelo(unsigned int n, const function<void(unsigned int)> &tarefa)
+{
+	unsigned int numThreads = thread::hardware_concurrency();
+
+	if (numThreads == 0)
+		numThreads = 1;
+	if (numThreads > n)
+		numThreads = n;
+
+	atomic<unsigned int> proximo(0);
+	vector<thread> threads;
+
+	for (unsigned int t = 0; t < numThreads; t++)
+	{
+		threads.emplace_back([&]()
+							 {
+			unsigned int i;
+			while ((i = proximo++) < n)
+				tarefa(i); });
+	}
+
+	for (auto &t : threads)
+		t.join();
+}
+
+// Lê o Inode de número 'numInode' em 'inode', localizando seu grupo em 'grupos'. Retorna 0 em caso de sucesso e -1 caso contrário
+static int read_inode_by_number(unsigned int numInode, const vector<struct ext2_group_desc> &grupos, struct ext2_inode *inode)
+{
+	if (numInode == 0 || numInode > super.s_inodes_count)
+		return -1;
+
+	unsigned int g = (numInode - 1) / super.s_inodes_per_group;
+	off_t offset = BLOCK_OFFSET(grupos[g].bg_inode_table) + (off_t)((numInode - 1) % super.s_inodes_per_group) * inode_size;
+
+	return read_image(inode, sizeof(struct ext2_inode), offset) == sizeof(struct ext2_inode) ? 0 : -1;
+}
+
+// Escreve 'inode' na posição do Inode de número 'numInode' em sua Tabela de Inodes. Retorna 0 em caso de sucesso e -1 caso contrário
+static int write_inode_by_number(unsigned int numInode, const vector<struct ext2_group_desc> &grupos, struct ext2_inode *inode)
+{
+	if (numInode == 0 || numInode > super.s_inodes_count)
+		return -1;
+
+	unsigned int g = (numInode - 1) / super.s_inodes_per_group;
+	off_t offset = BLOCK_OFFSET(grupos[g].bg_inode_table) + (off_t)((numInode - 1) % super.s_inodes_per_group) * inode_size;
+
+	return write_image(inode, sizeof(struct ext2_inode), offset) == sizeof(struct ext2_inode) ? 0 : -1;
+}
+
+#define LACUNA_LOTE_INODES 8			// Blocos não pedidos que uma leitura em lote da Tabela de Inodes pode atravessar
+#define MAX_LOTE_INODES (256 * 1024) // Tamanho máximo, em bytes, de cada leitura em lote da Tabela de Inodes
+
+/* Lê os Inodes de 'numeros' com poucas leituras grandes da Tabela de Inodes
+
+'numeros' é ordenado e tem as repetições removidas; 'inodes' recebe os Inodes na mesma ordem. Inodes próximos na
+Tabela (até LACUNA_LOTE_INODES blocos de distância, no mesmo grupo) são lidos em uma única leitura dos blocos que os cobrem
+Retorna o número de leituras feitas ou -1 em caso de erro
+*/
+static int leInodesEmLote(vector<unsigned int> &numeros, const vector<struct ext2_group_desc> &grupos, vector<struct ext2_inode> &inodes)
+{
+	EscopoArena escopo; // Buffers devolvidos ao retornar
+	int leituras = 0;
+
+	sort(numeros.begin(), numeros.end());
+	numeros.erase(unique(numeros.begin(), numeros.end()), numeros.end());
+	numeros.erase(remove_if(numeros.begin(), numeros.end(), [](unsigned int n)
+							{ return n == 0 || n > super.s_inodes_count; }),
+				  numeros.end());
+	inodes.resize(numeros.size());
+
+	for (size_t i = 0; i < numeros.size();)
+	{
+		unsigned int g = (numeros[i] - 1) / super.s_inodes_per_group;
+		off_t tabela = BLOCK_OFFSET(grupos[g].bg_inode_table);
+		off_t inicio = ((off_t)((numeros[i] - 1) % super.s_inodes_per_group) * inode_size) / block_size * block_size;
+		off_t fim = inicio;
+		size_t j = i;
+
+		// Estende a leitura enquanto o próximo Inode está no mesmo grupo, perto o bastante e dentro do limite
+		for (; j < numeros.size() && (numeros[j] - 1) / super.s_inodes_per_group == g; j++)
+		{
+			off_t posicao = (off_t)((numeros[j] - 1) % super.s_inodes_per_group) * inode_size;
+			off_t fimBloco = (posicao / block_size + 1) * block_size;
+
+			if (j > i && (posicao >= fim + (off_t)LACUNA_LOTE_INODES * block_size || fimBloco - inicio > MAX_LOTE_INODES))
+				break;
+
+			fim = max(fim, fimBloco);
+		}
+
+		char *buffer = (char *)alocaTemporario(fim - inicio);
+
+		if (read_image(buffer, fim - inicio, tabela + inicio) != fim - inicio)
+			return -1;
+
+		leituras++;
+
+		for (; i < j; i++)
+			memcpy(&inodes[i], buffer + (off_t)((numeros[i] - 1) % super.s_inodes_per_group) * inode_size - inicio, sizeof(struct ext2_inode));
+	}
+
+	return leituras;
+}
+
+// Entrada de diretório já decodificada
+struct EntradaDir
+{
+	unsigned int inode;	 // Número do Inode
+	unsigned char tipo;	 // file_type da entrada (0 se o sistema de arquivos não o registra)
+	string nome;		 // Nome da entrada
+};
+
+// Lê todas as entradas em uso de todos os blocos do diretório 'dir' em 'entradas', incluindo '.' e '..'
+static int le_entradas_diretorio(struct ext2_inode *dir, vector<struct EntradaDir> &entradas)
+{
+	vector<unsigned int> blocos;
+	vector<char> bloco(block_size);
+	int status = resolve_block_map(dir, blocos, NULL);
+
+	entradas.clear();
+
+	for (unsigned int numBloco : blocos)
+	{
+		if (numBloco == 0 || read_block(numBloco, bloco.data()) < 0)
+		{
+			status = -1;
+			continue;
+		}
+
+		unsigned int offset = 0;
+
+		while (offset + 8 <= (unsigned int)block_size)
+		{
+			struct ext2_dir_entry_2 *entry = (struct ext2_dir_entry_2 *)(bloco.data() + offset);
+			unsigned int tamRegistro = rec_len_from_disk(entry->rec_len);
+
+			if (tamRegistro < 8 || offset + tamRegistro > (unsigned int)block_size)
+			{
+				status = -1;
+				break;
+			}
+
+			if (entry->inode)
+				entradas.push_back({entry->inode, entry->file_type, string(entry->name, entry->name_len)});
+
+			offset += tamRegistro;
+		}
+	}
+
+	return status;
+}
+
+// Retorna o rec_len mínimo de uma entrada com nome de 'tamNome' caracteres (múltiplo de 4)
+static inline unsigned int tamanhoEntrada(unsigned int tamNome)
+{
+	return (8 + tamNome + 3) & ~3u;
+}
+
+// Retorna o file_type a ser gravado em uma entrada para o modo 'modo', ou 0 se o sistema de arquivos não registra tipos
+static unsigned char tipoEntrada(unsigned int modo)
+{
+	if (!(super.s_feature_incompat & EXT2_FEATURE_INCOMPAT_FILETYPE))
+		return 0;
+	if (S_ISDIR(modo))
+		return 2;
+	if (S_ISLNK(modo))
+		return 7;
+	return 1;
+}
+
+/* Insere em memória a entrada ('nome', 'numInode', 'tipo') no bloco de diretório 'bloco', ocupando a folga da primeira
+entrada cujo rec_len comporta o novo nome
+
+inicio, fim: recebem a faixa de bytes do bloco alterada
+Retorna 0 em caso de sucesso e -1 se o bloco não possui espaço
+*/
+static int insereEntradaBloco(char *bloco, const char *nome, unsigned int numInode, unsigned char tipo, unsigned int *inicio, unsigned int *fim)
+{
+	unsigned int tamNome = strlen(nome);
+	unsigned int necessario = tamanhoEntrada(tamNome);
+	unsigned int offset = 0;
+
+	while (offset + 8 <= (unsigned int)block_size)
+	{
+		struct ext2_dir_entry_2 *entry = (struct ext2_dir_entry_2 *)(bloco + offset);
+		unsigned int tamRegistro = rec_len_from_disk(entry->rec_len);
+
+		if (tamRegistro < 8 || offset + tamRegistro > (unsigned int)block_size)
+			break;
+
+		unsigned int usado = entry->inode ? tamanhoEntrada(entry->name_len) : 0;
+
+		if (tamRegistro >= usado + necessario)
+		{
+			struct ext2_dir_entry_2 *novaEntrada = (struct ext2_dir_entry_2 *)((char *)entry + usado);
+
+			// Divide o registro: a entrada existente fica com o mínimo e a nova recebe o restante
+			if (usado)
+				entry->rec_len = rec_len_to_disk(usado);
+
+			novaEntrada->inode = numInode;
+			novaEntrada->rec_len = rec_len_to_disk(tamRegistro - usado);
+			novaEntrada->name_len = tamNome;
+			novaEntrada->file_type = tipo;
+			memcpy(novaEntrada->name, nome, tamNome);
+
+			*inicio = offset;
+			*fim = offset + usado + necessario;
+
+			return 0;
+		}
+
+		offset += tamRegistro;
+	}
+
+	return -1;
+}
+
+/* Insere a entrada ('nome', 'numInode', 'tipo') no diretório 'dir', ocupando a folga da primeira entrada cujo rec_len comporta o novo nome
+
+Apenas os bytes da entrada dividida são reescritos. Retorna 0 em caso de sucesso e -1 se nenhum bloco do diretório possui espaço
+*/
+static int adicionaEntradaDiretorio(struct ext2_inode *dir, const char *nome, unsigned int numInode, unsigned char tipo)
+{
+	vector<unsigned int> blocos;
+	vector<char> bloco(block_size);
+
+	resolve_block_map(dir, blocos, NULL);
+
+	for (unsigned int numBloco : blocos)
+	{
+		unsigned int inicio, fim;
+
+		if (numBloco == 0 || read_block(numBloco, bloco.data()) < 0)
+			continue;
+
+		if (insereEntradaBloco(bloco.data(), nome, numInode, tipo, &inicio, &fim) == 0)
+			return write_image(bloco.data() + inicio, fim - inicio, BLOCK_OFFSET(numBloco) + inicio) < 0 ? -1 : 0;
+	}
+
+	return -1;
+}
+
+// Posição de uma entrada em um diretório
+struct PosicaoEntrada
+{
+	unsigned int numBloco; // Bloco do diretório que contém a entrada
+	int offset;			   // Posição da entrada no bloco
+	int anterior;		   // Posição da entrada anterior no mesmo bloco (-1 se é a primeira)
+	unsigned int inode;
+	unsigned char tipo;
+};
+
+/* Localiza a entrada 'nome' no diretório 'dir', deixando em 'bloco' o conteúdo do bloco que a contém
+
+Retorna 0 se a entrada foi encontrada e -1 caso contrário
+*/
+static int localizaEntradaDiretorio(struct ext2_inode *dir, const char *nome, vector<char> &bloco, struct PosicaoEntrada *pos)
+{
+	vector<unsigned int> blocos;
+	size_t tamNome = strlen(nome);
+
+	if (!S_ISDIR(dir->i_mode))
+		return -1;
+
+	bloco.resize(block_size);
+	resolve_block_map(dir, blocos, NULL);
+
+	for (unsigned int numBloco : blocos)
+	{
+		if (numBloco == 0 || read_block(numBloco, bloco.data()) < 0)
+			continue;
+
+		int offset = 0, anterior = -1;
+
+		while (offset + 8 <= block_size)
+		{
+			struct ext2_dir_entry_2 *entry = (struct ext2_dir_entry_2 *)(bloco.data() + offset);
+			int tamRegistro = rec_len_from_disk(entry->rec_len);
+
+			if (tamRegistro < 8 || offset + tamRegistro > block_size)
+				break;
+
+			if (entry->inode && entry->name_len == tamNome && !memcmp(entry->name, nome, tamNome))
+			{
+				*pos = {numBloco, offset, anterior, entry->inode, entry->file_type};
+				return 0;
+			}
+
+			anterior = offset;
+			offset += tamRegistro;
+		}
+	}
+
+	return -1;
+}
+
+/* Remove em memória a entrada de 'pos' do bloco de diretório 'bloco': o registro é incorporado ao da entrada anterior,
+ou, se for a primeira do bloco, apenas tem o Inode zerado
+
+inicio, fim: recebem a faixa de bytes do bloco alterada
+*/
+static void removeEntradaBloco(char *bloco, const struct PosicaoEntrada *pos, unsigned int *inicio, unsigned int *fim)
+{
+	struct ext2_dir_entry_2 *entry = (struct ext2_dir_entry_2 *)(bloco + pos->offset);
+
+	if (pos->anterior >= 0)
+	{
+		struct ext2_dir_entry_2 *anterior = (struct ext2_dir_entry_2 *)(bloco + pos->anterior);
+
+		estendeRegistro(anterior, rec_len_from_disk(entry->rec_len));
+		*inicio = pos->anterior;
+	}
+	else
+	{
+		entry->inode = 0;
+		*inicio = pos->offset;
+	}
+
+	*fim = *inicio + 8;
+}
+
+/* Retorna o Inode do caminho 'caminho', absoluto ou relativo ao diretório de Inode 'numAtual', ou 0 se algum
+componente não existe ou não é diretório
+*/
+static unsigned int resolveCaminho(const char *caminho, unsigned int numAtual, const vector<struct ext2_group_desc> &grupos)
+{
+	unsigned int numInode = (caminho[0] == '/') ? EXT2_ROOT_INO : numAtual;
+	vector<char> bloco;
+	string copia = caminho;
+	char *contexto;
+
+	for (char *nome = strtok_r(&copia[0], "/", &contexto); nome; nome = strtok_r(NULL, "/", &contexto))
+	{
+		struct ext2_inode dir;
+		struct PosicaoEntrada pos;
+
+		if (!strcmp(nome, "."))
+			continue;
+
+		if (read_inode_by_number(numInode, grupos, &dir) < 0 || localizaEntradaDiretorio(&dir, nome, bloco, &pos) < 0)
+			return 0;
+
+		numInode = pos.inode;
+	}
+
+	return numInode;
+}
+
+#define MAX_CACHE_CAMINHOS 4096 // Número máximo de diretórios na cache de caminhos; ao ser atingido, a cache é esvaziada
+
+map<string, unsigned int> cacheCaminhos; // Caminho absoluto normalizado de um diretório -> seu Inode
+
+// Esvazia a cache de caminhos. Chamada quando um diretório é removido ou movido
+static void invalidaCacheCaminhos()
+{
+	cacheCaminhos.clear();
+}
+
+/* Retorna os componentes do caminho absoluto equivalente a 'caminho', absoluto ou relativo ao diretório corrente
+
+'.' e '..' são resolvidos sobre os próprios componentes, como em 'vetorCaminhoAtual' ('..' na raiz permanece na raiz)
+*/
+static vector<string> normalizaCaminho(const char *caminho)
+{
+	vector<string> componentes;
+	string copia = caminho;
+	char *contexto;
+
+	if (caminho[0] != '/')
+		componentes = vetorCaminhoAtual;
+
+	for (char *nome = strtok_r(&copia[0], "/", &contexto); nome; nome = strtok_r(NULL, "/", &contexto))
+	{
+		if (!strcmp(nome, "."))
+			continue;
+
+		if (!strcmp(nome, ".."))
+		{
+			if (!componentes.empty())
+				componentes.pop_back();
+			continue;
+		}
+
+		componentes.push_back(nome);
+	}
+
+	return componentes;
+}
+
+/* Retorna o Inode do caminho de componentes 'componentes' (normalizado por normalizaCaminho), ou 0 se algum componente
+não existe ou algum componente intermediário não é diretório
+
+A busca parte do maior prefixo presente em 'cacheCaminhos' e percorre os componentes restantes um a um, acrescentando à
+cache os diretórios encontrados
+*/
+static unsigned int resolveComponentes(const vector<string> &componentes, const vector<struct ext2_group_desc> &grupos)
+{
+	vector<string> prefixos(componentes.size() + 1, "/");
+	size_t i = componentes.size();
+	unsigned int numInode = EXT2_ROOT_INO;
+	vector<char> bloco;
+
+	for (size_t k = 0; k < componentes.size(); k++)
+		prefixos[k + 1] = (k ? prefixos[k] + "/" : "/") + componentes[k];
+
+	// Maior prefixo já resolvido
+	for (; i > 0; i--)
+	{
+		auto it = cacheCaminhos.find(prefixos[i]);
+
+		if (it != cacheCaminhos.end())
+		{
+			numInode = it->second;
+			break;
+		}
+	}
+
+	for (; i < componentes.size(); i++)
+	{
+		struct ext2_inode dir;
+		struct PosicaoEntrada pos;
+
+		if (read_inode_by_number(numInode, grupos, &dir) < 0 || !S_ISDIR(dir.i_mode) ||
+			localizaEntradaDiretorio(&dir, componentes[i].c_str(), bloco, &pos) < 0)
+			return 0;
+
+		if (cacheCaminhos.size() >= MAX_CACHE_CAMINHOS)
+			invalidaCacheCaminhos();
+
+		cacheCaminhos[prefixos[i]] = numInode;
+		numInode = pos.inode;
+
+		if (pos.tipo == tipoEntrada(S_IFDIR) && pos.tipo)
+			cacheCaminhos[prefixos[i + 1]] = numInode;
+	}
+
+	return numInode;
+}
+
+// Retorna o Inode do caminho 'caminho', absoluto ou relativo ao diretório corrente, ou 0 se ele não existe
+static unsigned int resolveCaminhoCache(const char *caminho, const vector<struct ext2_group_desc> &grupos)
+{
+	return resolveComponentes(normalizaCaminho(caminho), grupos);
+}
+
+/* Diretório e nome de um argumento de caminho de um comando
+
+Para um nome simples, 'inode' e 'group' apontam para o diretório corrente; para um caminho, apontam para as cópias
+do diretório que contém o último componente
+*/
+struct AlvoCaminho
+{
+	struct ext2_inode *inode;		 // Diretório que contém o alvo
+	struct ext2_group_desc *group;	 // Descritor do grupo desse diretório
+	int numGrupo;					 // Número desse grupo
+	char *nome;						 // Último componente do caminho
+	struct ext2_inode dir;			 // Cópia do diretório quando ele não é o corrente
+	struct ext2_group_desc grupoDir; // Cópia do descritor do seu grupo
+	char nomeFinal[EXT2_NAME_LEN + 1];
+};
+
+/* Separa 'caminho' no diretório que contém o último componente ('pai') e no nome desse componente
+
+Caminhos terminados em '/' têm as barras finais ignoradas; "/" é tratado como "/."; sem '/', 'pai' é "."
+*/
+static void separaCaminho(const char *caminho, string &pai, string &nome)
+{
+	string texto = caminho;
+
+	while (texto.size() > 1 && texto.back() == '/')
+		texto.pop_back();
+
+	size_t barra = texto.rfind('/');
+	pai = (barra == string::npos) ? "." : (barra == 0 ? "/" : texto.substr(0, barra));
+	nome = (barra == string::npos) ? texto : texto.substr(barra + 1);
+
+	if (nome.empty())
+		nome = ".";
+}
+
+/* Resolve o argumento 'caminho' em 'alvo': o diretório que contém o último componente e o nome desse componente,
+como em separaCaminho
+
+Retorna 0 em caso de sucesso e -1 se o diretório não existe (com a mensagem de erro já exibida)
+*/
+static int resolveAlvo(char *caminho, struct ext2_inode *inode, struct ext2_group_desc *group, struct AlvoCaminho *alvo)
+{
+	alvo->inode = inode;
+	alvo->group = group;
+	alvo->numGrupo = grupoAtual;
+	alvo->nome = caminho;
+
+	if (!strchr(caminho, '/'))
+		return 0;
+
+	string pai, nome;
+
+	separaCaminho(caminho, pai, nome);
+
+	if (nome.size() > EXT2_NAME_LEN)
+	{
+		printf("\ninvalid sintax.\n");
+		return -1;
+	}
+
+	vector<struct ext2_group_desc> grupos;
+
+	read_group_descs(grupos);
+
+	unsigned int numDir = resolveCaminhoCache(pai.c_str(), grupos);
+
+	if (numDir == 0 || read_inode_by_number(numDir, grupos, &alvo->dir) < 0)
+	{
+		printf("\ndirectory not found.\n");
+		return -1;
+	}
+
+	if (!S_ISDIR(alvo->dir.i_mode))
+	{
+		printf("\nnot a directory.\n");
+		return -1;
+	}
+
+	alvo->numGrupo = (numDir - 1) / super.s_inodes_per_group;
+	alvo->grupoDir = grupos[alvo->numGrupo];
+	alvo->inode = &alvo->dir;
+	alvo->group = &alvo->grupoDir;
+	strcpy(alvo->nomeFinal, nome.c_str());
+	alvo->nome = alvo->nomeFinal;
+
+	return 0;
+}
+
+/* Relê do disco o Inode do diretório corrente e o descritor do seu grupo
+
+Utilizada após um comando que alterou outro diretório por meio de um caminho, pois as alocações e contagens podem
+ter mudado as cópias em memória
+*/
+static void recarregaDiretorioCorrente(struct ext2_inode *inode, struct ext2_group_desc *group)
+{
+	vector<struct ext2_group_desc> grupos;
+	long numAtual;
+
+	read_dir(inode, group, &numAtual, (char *)".");
+	read_group_descs(grupos);
+
+	if (numAtual > 0)
+		read_inode_by_number(numAtual, grupos, inode);
+
+	memcpy(group, &grupos[grupoAtual], sizeof(struct ext2_group_desc));
+}
+
+// Exibe as informações do Inode passado por parâmetro
+void printInode(struct ext2_inode *inode)
+{
+	printf("Reading Inode\n"
+		   "File mode: %hu\n"
+		   "Owner UID: %hu\n"
+		   "Size     : %u bytes\n"
+		   "Blocks   : %u\n",
+		   inode->i_mode,
+		   inode->i_uid,
+		   inode->i_size,
+		   inode->i_blocks);
+
+	for (int i = 0; i < EXT2_N_BLOCKS; i++)
+		if (i < EXT2_NDIR_BLOCKS)
+			printf("Block %2u : %u\n", i, inode->i_block[i]);
+		else if (i == EXT2_IND_BLOCK)
+			printf("Single   : %u\n", inode->i_block[i]);
+		else if (i == EXT2_DIND_BLOCK)
+			printf("Double   : %u\n", inode->i_block[i]);
+		else if (i == EXT2_TIND_BLOCK)
+			printf("Triple   : %u\n", inode->i_block[i]);
+}
+
+/* Entrega a 'escreve', em ordem, o conteúdo do arquivo de 'inode', um bloco por chamada
+
+Os blocos são localizados pelo mapa de blocos (com qualquer nível de indireção) e os buracos são entregues como zeros
+*/
+static void leConteudoArquivo(struct ext2_inode *inode, const function<void(const char *, size_t)> &escreve)
+{
+	vector<unsigned int> blocos;
+	vector<char> buffer(block_size);
+	unsigned long long restantes = tamanhoInode(inode);
+
+	resolve_block_map(inode, blocos, NULL);
+
+	for (size_t i = 0; i < blocos.size() && restantes > 0; i++)
+	{
+		size_t n = min<unsigned long long>(restantes, block_size);
+
+		if (blocos[i] == 0 || read_block(blocos[i], buffer.data()) < 0)
+			memset(buffer.data(), 0, block_size);
+
+		escreve(buffer.data(), n);
+		restantes -= n;
+	}
+}
+
+// Exibe as informações do arquivo do Inode passado por parâmetro, com tratamento de indireção
+void printaArquivo(struct ext2_inode *inode)
+{
+	leConteudoArquivo(inode, [](const char *dados, size_t n)
+					  { fwrite(dados, 1, n, stdout); });
+}
+
+// Exibe as informações do Grupo passado por parâmetro
+void printGroup(struct ext2_group_desc *group)
+{
+	printf("\n\n\nReading first group-descriptor from device " FD_DEVICE ":\n"
+		   "Blocks bitmap block: %u\n"
+		   "Inodes bitmap block: %u\n"
+		   "Inodes table block : %u\n"
+		   "Free blocks count  : %u\n"
+		   "Free inodes count  : %u\n"
+		   "Directories count  : %u\n",
+		   group->bg_block_bitmap,
+		   group->bg_inode_bitmap,
+		   group->bg_inode_table,
+		   group->bg_free_blocks_count,
+		   group->bg_free_inodes_count,
+		   group->bg_used_dirs_count);
+}
+
+// Retorna a quantidade de blocos do grupo 'g' (o último grupo pode ser menor)
+static unsigned long blocosNoGrupo(unsigned int g)
+{
+	unsigned long inicio = super.s_first_data_block + (unsigned long)g * super.s_blocks_per_group;
+	unsigned long restantes = super.s_blocks_count - inicio;
+
+	return (restantes < super.s_blocks_per_group) ? restantes : super.s_blocks_per_group;
+}
+
+// Indica se o bit 'bit' de 'mapa' está marcado
+static inline int testaBit(const unsigned char *mapa, unsigned long bit)
+{
+	return (mapa[bit / 8] >> (bit % 8)) & 0x01;
+}
+
+// Conta os bits marcados nos 'n' primeiros bits de 'mapa'
+static unsigned long contaBits(const unsigned char *mapa, unsigned long n)
+{
+	unsigned long total = 0;
+	unsigned long i = 0;
+
+	for (; i + 64 <= n; i += 64)
+	{
+		unsigned long long palavra;
+		memcpy(&palavra, mapa + i / 8, sizeof(palavra));
+		total += __builtin_popcountll(palavra);
+	}
+
+	for (; i < n; i++)
+		total += testaBit(mapa, i);
+
+	return total;
+}
+
+/* Percorre as faixas de bits livres (0) dos 'n' primeiros bits de 'mapa', chamando visita(inicio, tamanho) para cada uma
+
+O bitmap é lido em palavras de 64 bits: palavras inteiramente livres são somadas de uma vez, e nas demais o início e o
+fim de cada faixa são localizados com __builtin_ctzll, sem testar bit a bit
+*/
+template <typename F>
+static void percorreFaixasLivres(const unsigned char *mapa, unsigned long n, F visita)
+{
+	unsigned long inicio = 0, tamanho = 0; // Faixa em andamento (tamanho 0: nenhuma)
+
+	for (unsigned long base = 0; base < n; base += 64)
+	{
+		unsigned long long palavra = ~0ULL;
+
+		memcpy(&palavra, mapa + base / 8, min(8ul, (n - base + 7) / 8));
+
+		unsigned long long livres = ~palavra;
+
+		if (n - base < 64)
+			livres &= (1ULL << (n - base)) - 1; // Bits além do fim do mapa contam como ocupados
+
+		if (livres == ~0ULL)
+		{
+			if (!tamanho)
+				inicio = base;
+			tamanho += 64;
+			continue;
+		}
+
+		for (unsigned int bit = 0; bit < 64;)
+		{
+			if (!tamanho)
+			{
+				if ((livres >> bit) == 0)
+					break;
+
+				bit += __builtin_ctzll(livres >> bit);
+				inicio = base + bit;
+			}
+
+			// Estende a faixa até o próximo bit ocupado: ~(livres >> bit) tem os bits acima do deslocamento ligados
+			unsigned int k = __builtin_ctzll(~(livres >> bit));
+
+			tamanho += k;
+			bit += k;
+
+			if (bit < 64)
+			{
+				visita(inicio, tamanho);
+				tamanho = 0;
+			}
+		}
+	}
+
+	if (tamanho)
+		visita(inicio, tamanho);
+}
+
+/* Índice em memória das faixas livres dos bitmaps de blocos, montado por montaIndiceLivres na abertura da imagem
+
+Cada grupo guarda suas faixas em uma árvore ordenada pelo início, que localiza a faixa de um bloco ocupado e as vizinhas
+de um bloco liberado, e em outra ordenada por tamanho; a árvore global, ordenada por (tamanho, grupo, início), responde
+em O(log n) pela menor faixa que comporta um pedido e pelas maiores faixas do sistema. Posições são bits do grupo.
+É mantido por set_block_bitmap, unset_block_bitmap, liberaBlocos e gravaPlano, os pontos que gravam bitmaps de blocos
+*/
+struct IndiceFaixasLivres
+{
+	vector<map<unsigned long, unsigned long>> porInicio;		   // Por grupo: início -> tamanho
+	vector<set<pair<unsigned long, unsigned long>>> porTamanho;	   // Por grupo: (tamanho, início)
+	set<tuple<unsigned long, unsigned int, unsigned long>> global; // (tamanho, grupo, início)
+	unordered_map<unsigned int, unsigned int> grupoDoBitmap;	   // Bloco do bitmap de blocos -> grupo
+	int valido;
+};
+
+static struct IndiceFaixasLivres indiceLivres;
+
+static void insereFaixaLivre(unsigned int g, unsigned long inicio, unsigned long tamanho)
+{
+	indiceLivres.porInicio[g][inicio] = tamanho;
+	indiceLivres.porTamanho[g].insert(make_pair(tamanho, inicio));
+	indiceLivres.global.insert(make_tuple(tamanho, g, inicio));
+}
+
+static void removeFaixaLivre(unsigned int g, unsigned long inicio, unsigned long tamanho)
+{
+	indiceLivres.porInicio[g].erase(inicio);
+	indiceLivres.porTamanho[g].erase(make_pair(tamanho, inicio));
+	indiceLivres.global.erase(make_tuple(tamanho, g, inicio));
+}
+
+// Refaz as faixas do grupo 'g' no índice a partir de seu bitmap de blocos
+static void indexaGrupoLivre(unsigned int g, const unsigned char *bitmap)
+{
+	if (!indiceLivres.valido)
+		return;
+
+	for (auto &faixa : indiceLivres.porInicio[g])
+		indiceLivres.global.erase(make_tuple(faixa.second, g, faixa.first));
+
+	indiceLivres.porInicio[g].clear();
+	indiceLivres.porTamanho[g].clear();
+
+	percorreFaixasLivres(bitmap, blocosNoGrupo(g), [g](unsigned long inicio, unsigned long tamanho)
+						 { insereFaixaLivre(g, inicio, tamanho); });
+}
+
+// Monta o índice de faixas livres com os bitmaps de blocos de todos os grupos, lidos em paralelo
+static void montaIndiceLivres()
+{
+	vector<struct ext2_group_desc> grupos;
+
+	read_group_descs(grupos);
+
+	unsigned int n = grupos.size();
+	vector<unsigned char> bitmaps((size_t)n * block_size);
+
+	executaParalelo(n, [&](unsigned int g)
+					{ read_block(grupos[g].bg_block_bitmap, bitmaps.data() + (size_t)g * block_size); });
+
+	indiceLivres.porInicio.assign(n, map<unsigned long, unsigned long>());
+	indiceLivres.porTamanho.assign(n, set<pair<unsigned long, unsigned long>>());
+	indiceLivres.global.clear();
+	indiceLivres.grupoDoBitmap.clear();
+	indiceLivres.valido = 1;
+
+	for (unsigned int g = 0; g < n; g++)
+	{
+		indiceLivres.grupoDoBitmap[grupos[g].bg_block_bitmap] = g;
+		indexaGrupoLivre(g, bitmaps.data() + (size_t)g * block_size);
+	}
+}
+
+// Retorna o número do grupo cujo descritor é 'group', ou -1 se o índice não está montado
+static int grupoNoIndice(const struct ext2_group_desc *group)
+{
+	if (!indiceLivres.valido)
+		return -1;
+
+	auto it = indiceLivres.grupoDoBitmap.find(group->bg_block_bitmap);
+
+	return (it == indiceLivres.grupoDoBitmap.end()) ? -1 : (int)it->second;
+}
+
+// Retira do índice o bit 'bit' do grupo 'g', dividindo a faixa que o contém
+static void ocupaBitIndice(unsigned int g, unsigned long bit)
+{
+	auto &faixas = indiceLivres.porInicio[g];
+	auto it = faixas.upper_bound(bit);
+
+	if (it == faixas.begin())
+		return;
+
+	--it;
+
+	unsigned long inicio = it->first, fim = it->first + it->second;
+
+	if (bit >= fim) // Já ocupado
+		return;
+
+	removeFaixaLivre(g, inicio, fim - inicio);
+
+	if (bit > inicio)
+		insereFaixaLivre(g, inicio, bit - inicio);
+	if (bit + 1 < fim)
+		insereFaixaLivre(g, bit + 1, fim - bit - 1);
+}
+
+// Devolve ao índice o bit 'bit' do grupo 'g', unindo-o às faixas vizinhas
+static void liberaBitIndice(unsigned int g, unsigned long bit)
+{
+	auto &faixas = indiceLivres.porInicio[g];
+	auto it = faixas.upper_bound(bit);
+	unsigned long inicio = bit, fim = bit + 1;
+
+	if (it != faixas.begin())
+	{
+		auto anterior = prev(it);
+
+		if (anterior->first + anterior->second > bit) // Já livre
+			return;
+
+		if (anterior->first + anterior->second == bit)
+			inicio = anterior->first;
+	}
+
+	if (it != faixas.end() && it->first == bit + 1)
+		fim = it->first + it->second;
+
+	if (fim > bit + 1)
+		removeFaixaLivre(g, bit + 1, fim - bit - 1);
+	if (inicio < bit)
+		removeFaixaLivre(g, inicio, bit - inicio);
+
+	insereFaixaLivre(g, inicio, fim - inicio);
+}
+
+// Abre a imagem do sistema de arquivos, lê o Superbloco em super, verifica o número mágico, lê o Grupo 0 em group, e lê o Inode 2 em inode
+void init_super(struct ext2_group_desc *group, struct ext2_inode *inode)
+{
+	// Abre a imagem do sistema de arquivos
+	if ((fd = open(FD_DEVICE, O_RDWR)) < 0)
+	{
+		perror(FD_DEVICE);
+		exit(1);
+	}
+
+	// Reaplica as transações completas de um jornal existente e o mantém ativo
+	int reaplicadas = recuperaJornal();
+
+	if (reaplicadas > 0)
+		fprintf(stderr, "journal: %d transactions replayed.\n", reaplicadas);
+
+	// Leitura do Superbloco
+	read_image(&super, sizeof(super), BASE_OFFSET);
+
+	// Verificação do número mágico
+	if (super.s_magic != EXT2_SUPER_MAGIC)
+	{
+		fprintf(stderr, "not a Ext2 filesystem.\n");
+		exit(1);
+	}
+
+	// Leitura do Grupo
+	read_image(group, sizeof(struct ext2_group_desc), GDT_OFFSET);
+
+	// Leitura do Inode
+	read_inode(2, group, inode);
+
+	// Índice das faixas livres, usado na busca de blocos livres e na alocação contígua
+	montaIndiceLivres();
+
+	if (reaplicadas >= 0)
+		ativaJornal();
+}
+
+/* Inicia novoInode e novoGrupo com o Grupo e o Inode do arquivo com nome 'nome'
+
+novoInode, novoGroup: variáveis auxiliares para manutenção dos antigos valores em inode e group
+*/
+int getArquivoPorNome(struct ext2_inode *inode, struct ext2_group_desc *group, char *nome, int *grupoAtual, struct ext2_inode *novoInode, struct ext2_group_desc *novoGroup)
+{
+	long int valorInodeTmp;
+
+	// Cópia das variáveis para mudança de valores de Grupo e Inode
+	memcpy(novoGroup, group, sizeof(struct ext2_group_desc));
+	memcpy(novoInode, inode, sizeof(struct ext2_inode));
+
+	// Atualização do Inode para o que contém o arquivo 'nome'
+	read_dir(novoInode, novoGroup, &valorInodeTmp, nome);
+
+	if (valorInodeTmp == -1)
+	{
+		return -1;
+	}
+	else if (valorInodeTmp == -2)
+	{
+		return -2;
+	}
+
+	// Atualização do Groupo para o que contém o novo Inode
 	trocaGrupo(&valorInodeTmp, novoGroup, grupoAtual);
 
-	// Cálculo do index real do Inode no novo Grupo
-	unsigned int index = valorInodeTmp % super.s_inodes_per_group;
+	// Cálculo do index real do Inode no novo Grupo
+	unsigned int index = (valorInodeTmp - 1) % super.s_inodes_per_group + 1;
+
+	// Atualização do Inode no novo Grupo
+	read_inode(index, novoGroup, novoInode);
+
+	return 0;
+}
+
+// Copia o conteúdo dos blocos de dados em inode para arquivo
+void copiaArquivo(struct ext2_inode *inode, char *arquivo)
+{
+	ofstream destineFile(arquivo, ios::binary);
+
+	leConteudoArquivo(inode, [&destineFile](const char *dados, size_t n)
+					  { destineFile.write(dados, n); });
+}
+
+// Exibe o bitmap de blocos do grupo 'group'
+void read_block_bitmap(struct ext2_group_desc *group)
+{
+	unsigned char *bitmap;
+
+	// bitmap tem tamanho de um bloco
+	bitmap = (unsigned char *)blocoTemporario();
+
+	// Lê o bitmap de blocos em 'bitmap'
+	read_image(bitmap, block_size, BLOCK_OFFSET(group->bg_block_bitmap));
+
+	// Exemplo:
+	// a = 10110011
+	// j = 4
+	// a >> j = 00001011
+	// 00001011 & 00000001 = 00000001
+	// !!(00000001) = 00000001
+
+	// Percorre todos os bytes do bitmap
+	for (int i = 0; i < block_size; i++)
+	{
+		char a = bitmap[i];
+		printf("%d - ", i);
+
+		// Exibe os bits que indicam o estado de cada Bloco
+		for (int j = 0; j < 8; j++)
+		{
+			printf("%d ", !!((a >> j) & 0x01));
+		}
+		printf("\n");
+	}
+
+}
+
+// Exibe o bitmap de Inodes do grupo 'group'
+void read_inode_bitmap(struct ext2_group_desc *group)
+{
+	char *bitmap;
+
+	bitmap = (char *)blocoTemporario();
+
+	// Lê o bitmap de inodes em 'bitmap'
+	read_image(bitmap, block_size, BLOCK_OFFSET(group->bg_inode_bitmap));
+
+	// Percorre todos os bytes do bitmap
+	for (int i = 0; i < block_size; i++)
+	{
+		char a = bitmap[i];
+		printf("%d - ", i);
+
+		// Exibe os bits que indicam o estado de cada Inode
+		for (int j = 0; j < 8; j++)
+		{
+			printf("%d ", !!((a >> j) & 0x01));
+		}
+		printf("\n");
+	}
+
+}
+
+/* Retorna a posição do primeiro bit livre (0) nos 'numBytes' primeiros bytes de 'bitmap', ou -1 se todos estão ocupados
+
+As palavras de 64 bits totalmente ocupadas são puladas de uma vez
+*/
+template <typename Tam>
+static int procuraBitLivre(const unsigned char *bitmap, Tam numBytes)
+{
+	unsigned int i = 0;
+
+	for (; i + 8 <= (unsigned int)numBytes; i += 8)
+	{
+		unsigned long long palavra;
+		memcpy(&palavra, bitmap + i, sizeof(palavra));
+
+		if (palavra != ~0ULL)
+			break;
+	}
+
+	for (; i < (unsigned int)numBytes; i++)
+	{
+		if (bitmap[i] != 0xFF)
+			return (8 * i) + __builtin_ctz(~bitmap[i] & 0xFF);
+	}
+
+	return -1;
+}
+
+/* Retorna 1 se os 'n' bytes de 'dados' são todos nulos
+
+Com SSE2, 64 bytes são combinados por iteração com OR em registradores de 128 bits e comparados com zero ao fim de
+cada trecho de 1 KiB, de modo que um bloco com dados é rejeitado cedo; sem SSE2, a combinação é feita em palavras de 64 bits
+*/
+static int blocoNulo(const char *dados, size_t n)
+{
+	size_t i = 0;
+
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+
+	while (i + 64 <= n)
+	{
+		__m128i acumulado = zero;
+		size_t fim = min(n - n % 64, i + 1024);
+
+		for (; i < fim; i += 64)
+		{
+			__m128i a = _mm_loadu_si128((const __m128i *)(dados + i));
+			__m128i b = _mm_loadu_si128((const __m128i *)(dados + i + 16));
+			__m128i c = _mm_loadu_si128((const __m128i *)(dados + i + 32));
+			__m128i d = _mm_loadu_si128((const __m128i *)(dados + i + 48));
+
+			acumulado = _mm_or_si128(acumulado, _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)));
+		}
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(acumulado, zero)) != 0xFFFF)
+			return 0;
+	}
+#endif
+
+	for (; i + 8 <= n; i += 8)
+	{
+		unsigned long long palavra;
+		memcpy(&palavra, dados + i, sizeof(palavra));
+
+		if (palavra)
+			return 0;
+	}
+
+	for (; i < n; i++)
+	{
+		if (dados[i])
+			return 0;
+	}
+
+	return 1;
+}
+
+// Retorna o offset do primeiro Inode livre no bitmap de Inodes
+int find_free_inode(struct ext2_group_desc *group)
+{
+	EscopoArena escopo; // Buffers devolvidos ao retornar
+	unsigned char *bitmap;
+
+	bitmap = (unsigned char *)blocoTemporario();
+
+	read_image(bitmap, block_size, BLOCK_OFFSET(group->bg_inode_bitmap));
+
+	int livre = despachaTamanhoBloco([bitmap](auto tamanho)
+									 { return procuraBitLivre(bitmap, tamanho); }); // Offset do Inode no bitmap de Inodes
+
+	conta(CONT_SONDAGENS, livre < 0 ? 8 * block_size : livre + 1);
+
+	return (livre < 0) ? 0 : livre;
+}
+
+// Retorna o offset do primeiro Bloco livre no bitmap de Blocos; com o índice de faixas livres montado, o bitmap não é lido
+int find_free_block(struct ext2_group_desc *group)
+{
+	EscopoArena escopo; // Buffers devolvidos ao retornar
+	unsigned char *bitmap;
+	int g = grupoNoIndice(group);
+
+	if (g >= 0)
+	{
+		conta(CONT_SONDAGENS, 1);
+		return indiceLivres.porInicio[g].empty() ? 0 : indiceLivres.porInicio[g].begin()->first;
+	}
+
+	bitmap = (unsigned char *)blocoTemporario();
+	read_image(bitmap, block_size, BLOCK_OFFSET(group->bg_block_bitmap));
+
+	int livre = despachaTamanhoBloco([bitmap](auto tamanho)
+									 { return procuraBitLivre(bitmap, tamanho); }); // Offset do Bloco no bitmap de Blocos
+
+	conta(CONT_SONDAGENS, livre < 0 ? 8 * block_size : livre + 1);
+
+	return (livre < 0) ? 0 : livre;
+}
+
+// Marca a posição bitVal no bitmap de Blocos como ocupada
+void set_block_bitmap(struct ext2_group_desc *group, int bitVal)
+{
+	EscopoArena escopo; // Buffers devolvidos ao retornar
+	char *bitmap;
+
+	int y = bitVal / 8; // Pega o byte em que se encontra o bloco
+	int x = bitVal % 8; // Pega o offset no byte
+
+	int marcado = (0x1 << x); // Transforma o offset em número binário
+
+	bitmap = (char *)blocoTemporario();
+
+	// Lê o bitmap de blocos
+	read_image(bitmap, block_size, BLOCK_OFFSET(group->bg_block_bitmap));
+
+	// Pega o byte correspondente de bitVal
+	char tmp = bitmap[y];
+
+	tmp = (tmp | marcado); // Constrói o valor do byte de 'bitVal' que teríamos se estivesse 'ocupado'
+	bitmap[y] = tmp;	   // Armazena no bitmap
+
+	// Atualiza o bitmap
+	write_image(bitmap, block_size, BLOCK_OFFSET(group->bg_block_bitmap));
+
+	int g = grupoNoIndice(group);
+
+	if (g >= 0)
+		ocupaBitIndice(g, bitVal);
+}
+
+// Marca a posição bitVal no bitmap de Inodes como ocupada
+void set_inode_bitmap(struct ext2_group_desc *group, int bitVal)
+{
+	EscopoArena escopo; // Buffers devolvidos ao retornar
+	char *bitmap;
+	int y = bitVal / 8; // Pega o byte em que se encontra o Inode
+	int x = bitVal % 8; // Pega o offset no byte
+
+	int marcado = (0x1 << x);
+
+	bitmap = (char *)blocoTemporario();
+
+	read_image(bitmap, block_size, BLOCK_OFFSET(group->bg_inode_bitmap));
+
+	char tmp = bitmap[y];
+
+	tmp = (tmp | marcado);
+	bitmap[y] = tmp;
+
+	write_image(bitmap, block_size, BLOCK_OFFSET(group->bg_inode_bitmap));
+
+}
+
+/* Atualiza o valor de 'group' com base em 'groupNum', e o valor de 'super'
+
+Utilizado nas funções: touch, mkdir, rm e rmdir
+*/
+void rewriteSuperAndGroup(struct ext2_group_desc *group, int groupNum)
+{
+	write_image(group, sizeof(struct ext2_group_desc), GDT_OFFSET + sizeof(struct ext2_group_desc) * groupNum);
+
+	write_image(&super, sizeof(struct ext2_super_block), BASE_OFFSET);
+}
+
+/* Cria um diretório de nome 'nome' no diretório atual
+
+A entrada ocupa a folga da primeira entrada do diretório corrente que comporta o nome; apenas os bytes da entrada
+dividida são reescritos
+nome: nome do diretório que se deseja criar
+numGrupo: valor de grupoAtual
+*/
+void funct_mkdir(struct ext2_inode *inode, struct ext2_group_desc *group, char *nome, int numGrupo)
+{
+	struct ext2_inode *inodeTemp = (struct ext2_inode *)alocaTemporario(sizeof(struct ext2_inode));
+	struct ext2_group_desc *groupDest = (struct ext2_group_desc *)alocaTemporario(sizeof(struct ext2_group_desc)); // Grupo 0
+	vector<struct ext2_group_desc> grupos;
+
+	// Lê em groupDest, o grupo 0
+	read_image(groupDest, sizeof(struct ext2_group_desc), GDT_OFFSET + sizeof(struct ext2_group_desc) * 0);
+
+	void *producedBlock;
+	struct ext2_dir_entry_2 *producedEntry;
+
+	int inodeVal = 0;	 // Offset do primeiro Inode livre no bitmap de Inodes do grupo 0
+	long existe = 0;	 // Variável para validação de 'nome'
+	int blockVal = 0;	 // Offset do primeiro Bloco livre no bitmap de Blocos do grupo 0
+	long inodeAtual = 0; // Número do Inode do diretório corrente
+
+	// Verifica se 'nome' é nome de alguma entrada do diretório corrente
+	read_dir(inode, group, &existe, nome);
+
+	if (existe != -1)
+	{
+		printf("\nfile already exists.\n");
+		return;
+	}
+
+	if (strlen(nome) > EXT2_NAME_LEN)
+	{
+		printf("\ninvalid sintax.\n");
+		return;
+	}
+
+	// Atribui para inodeAtual o número do Inode do diretório corrente
+	read_dir(inode, group, &inodeAtual, (char *)".");
+
+	inodeVal = find_free_inode(groupDest) + 1;
+	blockVal = find_free_block(groupDest) + super.s_first_data_block;
+
+	// O bit 0 dos dois bitmaps do grupo 0 está sempre ocupado: 0 indica que não há posição livre
+	if (inodeVal == 1 || blockVal == (int)super.s_first_data_block)
+	{
+		printf("\nno space left on device.\n");
+		return;
+	}
+
+	// Insere a entrada antes de alocar: sem espaço no diretório, nada é alterado
+	if (adicionaEntradaDiretorio(inode, nome, inodeVal, tipoEntrada(S_IFDIR)) < 0)
+	{
+		printf("\nno space left in directory.\n");
+		return;
+	}
+
+	set_inode_bitmap(groupDest, (inodeVal - 1));
+	set_block_bitmap(groupDest, (blockVal - super.s_first_data_block));
+
+	// Criação do bloco do diretório novo, com as entradas '.' e '..'
+	producedBlock = blocoTemporario();
+	memset(producedBlock, 0, block_size);
+	producedEntry = (struct ext2_dir_entry_2 *)producedBlock;
+
+	// Na posição 0 contém a entrada '.'
+	producedEntry->file_type = tipoEntrada(S_IFDIR);
+	producedEntry->name_len = 1;
+	producedEntry->rec_len = rec_len_to_disk(12);
+	memcpy(producedEntry->name, ".\0\0\0", 4);
+	producedEntry->inode = inodeVal; // Referencia o Inode identificado como vazio no bitmap
+
+	// Na posição 12 contém a entrada '..'
+	producedEntry = (ext2_dir_entry_2 *)((char *)producedEntry + 12);
+	producedEntry->file_type = tipoEntrada(S_IFDIR);
+	producedEntry->name_len = 2;
+	producedEntry->rec_len = rec_len_to_disk(block_size - 12);
+	memcpy(producedEntry->name, "..\0\0", 4);
+	producedEntry->inode = inodeAtual; // Referencia o Inode do diretório pai
+
+	// Escreve o bloco producedBlock que contém as entradas '.' e '..' criadas, no primeiro bloco vazio do grupo 0
+	write_image(producedBlock, block_size, BLOCK_OFFSET(blockVal));
+
+	// Criação do Inode do diretório novo
+	memset(inodeTemp, 0, sizeof(struct ext2_inode));
+	inodeTemp->i_block[0] = blockVal;
+	inodeTemp->i_atime = 1668912196;
+	inodeTemp->i_blocks = block_size / 512;
+	inodeTemp->i_ctime = 1668911978;
+	inodeTemp->i_generation = -1833064728;
+	inodeTemp->i_links_count = 2;
+	inodeTemp->i_mode = 16877;
+	inodeTemp->i_mtime = 1668911978;
+	inodeTemp->i_size = block_size;
+
+	write_inode(inodeVal, groupDest, inodeTemp);
+
+	// O '..' do diretório novo é um link a mais para o diretório corrente
+	read_group_descs(grupos);
+	read_inode_by_number(inodeAtual, grupos, inode);
+	inode->i_links_count++;
+	write_inode_by_number(inodeAtual, grupos, inode);
+
+	// Atualização do número de Blocos e Inodes livres e de diretórios em 'groupDest' e 'super'
+	groupDest->bg_free_blocks_count--;
+	groupDest->bg_free_inodes_count--;
+	groupDest->bg_used_dirs_count++;
+	super.s_free_blocks_count--;
+	super.s_free_inodes_count--;
+
+	// Escrita dos novos valores
+	rewriteSuperAndGroup(groupDest, 0);
+
+	if (numGrupo == 0) // Mantém a cópia em memória do grupo corrente atualizada
+		memcpy(group, groupDest, sizeof(struct ext2_group_desc));
+}
+
+/* Cria um arquivo com nome 'nome'
+
+A entrada ocupa a folga da primeira entrada do diretório corrente que comporta o nome
+grupoAtual: variável global que indica o grupo corrente
+*/
+void funct_touch(struct ext2_inode *inode, struct ext2_group_desc *group, char *nome, int grupoAtual)
+{
+	struct ext2_inode *inodeTemp = (struct ext2_inode *)alocaTemporario(sizeof(struct ext2_inode));
+	struct ext2_group_desc *groupDest = (struct ext2_group_desc *)alocaTemporario(sizeof(struct ext2_group_desc)); // Grupo em que será criado o arquivo
+
+	// Lê em groupDest o grupo 0
+	read_image(groupDest, sizeof(struct ext2_group_desc), GDT_OFFSET + sizeof(struct ext2_group_desc) * 0);
+
+	int inodeVal = 0; // Offset do primeiro Inode livre no bitmap de Inodes do grupo 0
+	long existe = 0;  // Variável para validação de 'nome'
+
+	// Verifica se 'nome' é nome de alguma entrada do diretório corrente
+	read_dir(inode, group, &existe, nome);
+
+	if (existe != -1)
+	{
+		printf("\nfile already exists.\n");
+		return;
+	}
+
+	if (strlen(nome) > EXT2_NAME_LEN)
+	{
+		printf("\ninvalid sintax.\n");
+		return;
+	}
+
+	inodeVal = find_free_inode(groupDest) + 1;
+
+	if (inodeVal == 1) // O Inode 1 é reservado: 0 indica que não há Inode livre
+	{
+		printf("\nno space left on device.\n");
+		return;
+	}
+
+	// Insere a entrada antes de alocar: sem espaço no diretório, nada é alterado
+	if (adicionaEntradaDiretorio(inode, nome, inodeVal, tipoEntrada(S_IFREG)) < 0)
+	{
+		printf("\nno space left in directory.\n");
+		return;
+	}
+
+	set_inode_bitmap(groupDest, (inodeVal - 1));
+
+	// Criação do Inode do arquivo novo
+	memset(inodeTemp, 0, sizeof(struct ext2_inode));
+	inodeTemp->i_atime = 1668911917;
+	inodeTemp->i_ctime = 1668911917;
+	inodeTemp->i_generation = -1280917867;
+	inodeTemp->i_links_count = 1;
+	inodeTemp->i_mode = 33188;
+	inodeTemp->i_mtime = 1668911917;
+
+	write_inode(inodeVal, groupDest, inodeTemp);
+
+	// Atualização do número de Inodes livres em 'groupDest' e 'super'
+	groupDest->bg_free_inodes_count--;
+	super.s_free_inodes_count--;
+
+	// Escrita dos novos valores
+	rewriteSuperAndGroup(groupDest, 0);
+
+	if (grupoAtual == 0) // Mantém a cópia em memória do grupo corrente atualizada
+		memcpy(group, groupDest, sizeof(struct ext2_group_desc));
+}
+
+// Retorna quantas entradas o diretório de inode 'inode' possui. Desconta as entradas '.' e '..'
+int isLoaded(struct ext2_inode *inode, struct ext2_group_desc *group)
+{
+	vector<struct EntradaDir> entradas;
+
+	if (!S_ISDIR(inode->i_mode))
+		return -1;
+
+	le_entradas_diretorio(inode, entradas);
+
+	return (int)entradas.size() - 2;
+}
+
+/* Se o bloco passado em 'valor' não pertence ao grupo 'grupoAtual', troca o grupo para o correspondente do bloco
+
+valor: número do bloco
+grupoAtual: variável global que indica o grupo corrente
+*/
+void trocaGrupoBlock(int valor, struct ext2_group_desc *group, int *grupoAtual)
+{
+	// Calcula-se o grupo de um bloco sabendo da quantidade de blocos por grupo
+	unsigned int block_group = (valor - super.s_first_data_block) / super.s_blocks_per_group;
+
+	if (block_group != (*grupoAtual))
+	{
+		*grupoAtual = block_group;
+
+		read_image(group, sizeof(struct ext2_group_desc), GDT_OFFSET + sizeof(struct ext2_group_desc) * block_group);
+	}
+}
+
+/* Marca o bloco de número 'bitVal' como desocupado no bitmap de blocos de 'group'
+
+Utilizado nas funções rm e rmdir
+bitVal: número do bloco a ser desmarcado no bitmap de blocos
+*/
+void unset_block_bitmap(struct ext2_group_desc *group, int bitVal)
+{
+	EscopoArena escopo; // Buffers devolvidos ao retornar
+	char *bitmap;
+	unsigned int g = (bitVal - super.s_first_data_block) / super.s_blocks_per_group; // Grupo do bloco
+
+	bitVal = (bitVal - super.s_first_data_block) % super.s_blocks_per_group; // Posição do bloco no bitmap do seu grupo
+
+	int y = (bitVal) / 8; // Pega o byte em que se encontra o Bloco
+	int x = (bitVal) % 8; // Pega o offset no byte
+
+	// Exemplo:
+	// bitVal = 10110011 = 179
+	// y = 22
+	// x = 3
+	// marcado = 11111110 << 3 = 11110000
+	// marcado = 11110000 | (11111111 >> 5) = 11110000 | 00000111 = 11110111
+
+	int marcado = (0xFE << x);
+
+	marcado = marcado | (0xFF >> (8 - x));
+
+	bitmap = (char *)blocoTemporario(); 
+
+	// Lê o bitmap do grupo 'group' em bitmap
+	read_image(bitmap, block_size, BLOCK_OFFSET(group->bg_block_bitmap));
+
+	char tmp = bitmap[y];
+	
+	tmp = (tmp & marcado);
+
+	bitmap[y] = tmp;
+
+	// Reescreve o bitmap com o bloco desmarcado
+	write_image(bitmap, block_size, BLOCK_OFFSET(group->bg_block_bitmap));
+
+	if (indiceLivres.valido)
+		liberaBitIndice(g, bitVal);
+
+	// Atualiza o número de Blocos livres
+	group->bg_free_blocks_count = group->bg_free_blocks_count + 1;
+	super.s_free_blocks_count = super.s_free_blocks_count + 1;
+
+}
+
+/* Marca os blocos de 'blocos' como desocupados, com uma leitura e uma escrita do bitmap de cada grupo envolvido
+
+Os blocos são ordenados e agrupados por grupo; a tabela de descritores e o Superbloco são reescritos uma única vez ao fim.
+Blocos nulos e blocos que já estão livres são ignorados
+Utilizada nas funções rm, rmdir e truncate
+recontar: 1 recalcula as contagens de blocos livres dos grupos envolvidos a partir dos bitmaps, e a do Superbloco a partir
+dos grupos, em vez de somar os blocos liberados (liberação de órfãos, que pode retomar um passo interrompido entre a
+escrita do bitmap e a dos contadores)
+Retorna o número de blocos liberados
+*/
+static unsigned long liberaBlocos(vector<unsigned int> &blocos, int recontar = 0)
+{
+	vector<struct ext2_group_desc> grupos;
+	vector<unsigned char> bitmap(block_size);
+	unsigned long total = 0;
+
+	blocos.erase(remove(blocos.begin(), blocos.end(), 0u), blocos.end());
+
+	if (blocos.empty())
+		return 0;
+
+	sort(blocos.begin(), blocos.end());
+	read_group_descs(grupos);
+
+	for (size_t i = 0; i < blocos.size();)
+	{
+		unsigned int g = (blocos[i] - super.s_first_data_block) / super.s_blocks_per_group;
+		unsigned int liberados = 0;
+
+		read_block(grupos[g].bg_block_bitmap, bitmap.data());
+
+		for (; i < blocos.size() && (blocos[i] - super.s_first_data_block) / super.s_blocks_per_group == g; i++)
+		{
+			unsigned long bit = (blocos[i] - super.s_first_data_block) % super.s_blocks_per_group;
+
+			if (bitmap[bit / 8] & (0x1 << (bit % 8)))
+			{
+				bitmap[bit / 8] &= ~(0x1 << (bit % 8));
+				liberados++;
+			}
+		}
+
+		if (liberados)
+		{
+			write_block(grupos[g].bg_block_bitmap, bitmap.data());
+			indexaGrupoLivre(g, bitmap.data());
+		}
+
+		if (recontar)
+			grupos[g].bg_free_blocks_count = blocosNoGrupo(g) - contaBits(bitmap.data(), blocosNoGrupo(g));
+		else
+			grupos[g].bg_free_blocks_count += liberados;
+		total += liberados;
+	}
+
+	write_image(grupos.data(), sizeof(struct ext2_group_desc) * grupos.size(), GDT_OFFSET);
+
+	if (recontar)
+	{
+		super.s_free_blocks_count = 0;
+		for (auto &grupo : grupos)
+			super.s_free_blocks_count += grupo.bg_free_blocks_count;
+	}
+	else
+		super.s_free_blocks_count += total;
+	write_image(&super, sizeof(struct ext2_super_block), BASE_OFFSET);
+
+	return total;
+}
+
+/* Marca os Inodes de 'numeros' como desocupados, com uma leitura e uma escrita do bitmap de Inodes de cada grupo envolvido,
+como liberaBlocos faz com os blocos (inclusive quanto a 'recontar')
+
+Retorna o número de Inodes liberados
+*/
+static unsigned long liberaInodes(vector<unsigned int> &numeros, int recontar = 0)
+{
+	vector<struct ext2_group_desc> grupos;
+	vector<unsigned char> bitmap(block_size);
+	unsigned long total = 0;
+
+	if (numeros.empty())
+		return 0;
+
+	sort(numeros.begin(), numeros.end());
+	read_group_descs(grupos);
+
+	for (size_t i = 0; i < numeros.size();)
+	{
+		unsigned int g = (numeros[i] - 1) / super.s_inodes_per_group;
+		unsigned int liberados = 0;
+
+		read_block(grupos[g].bg_inode_bitmap, bitmap.data());
+
+		for (; i < numeros.size() && (numeros[i] - 1) / super.s_inodes_per_group == g; i++)
+		{
+			unsigned long bit = (numeros[i] - 1) % super.s_inodes_per_group;
+
+			if (bitmap[bit / 8] & (0x1 << (bit % 8)))
+			{
+				bitmap[bit / 8] &= ~(0x1 << (bit % 8));
+				liberados++;
+			}
+		}
+
+		if (liberados)
+			write_block(grupos[g].bg_inode_bitmap, bitmap.data());
+
+		if (recontar)
+			grupos[g].bg_free_inodes_count = super.s_inodes_per_group - contaBits(bitmap.data(), super.s_inodes_per_group);
+		else
+			grupos[g].bg_free_inodes_count += liberados;
+		total += liberados;
+	}
+
+	write_image(grupos.data(), sizeof(struct ext2_group_desc) * grupos.size(), GDT_OFFSET);
+
+	if (recontar)
+	{
+		super.s_free_inodes_count = 0;
+		for (auto &grupo : grupos)
+			super.s_free_inodes_count += grupo.bg_free_inodes_count;
+	}
+	else
+		super.s_free_inodes_count += total;
+	write_image(&super, sizeof(struct ext2_super_block), BASE_OFFSET);
+
+	return total;
+}
+
+/* Lista de órfãos e liberação em segundo plano (rm -r)
+
+Os Inodes desligados por rm -r ficam sem links e encadeados a partir de s_last_orphan no Superbloco, cada um com o
+número do próximo em i_dtime (o formato da lista de órfãos do ext3, que o e2fsck também percorre). A liberação dos seus
+blocos fica para uma thread, que libera um órfão por vez e confirma cada passo como uma transação própria do jornal.
+Os comandos e a thread se alternam por mutexSistemaArquivos, com prioridade para os comandos: a thread só continua
+quando nenhum comando está esperando. A lista continua no Superbloco se o shell for interrompido e é retomada na
+abertura seguinte
+*/
+
+static mutex mutexSistemaArquivos;				// Serializa os comandos e os passos da liberação de órfãos
+static condition_variable condOrfaos;			// Sinaliza à thread de liberação que nenhum comando está esperando
+static atomic<int> comandosAguardando{0};		// Comandos esperando por mutexSistemaArquivos
+static atomic<unsigned long> orfaosLiberados{0}; // Órfãos liberados desde o início do shell
+static bool liberandoOrfaos = false;			// A thread de liberação está em execução (protegido pelo mutex)
+static thread threadOrfaos;
+
+/* Libera o primeiro Inode da lista de órfãos: seus blocos de dados e de indireção com uma escrita de bitmap por grupo,
+depois o próprio Inode, que passa a ter a data de remoção em i_dtime
+
+Deve ser chamada com mutexSistemaArquivos travado. O mapa de blocos do Inode é zerado antes da escrita dos bitmaps e a
+cabeça da lista avança junto com a liberação do Inode: se a execução for interrompida antes disso, o órfão é processado
+de novo sem blocos a liberar.
+Uma lista com um Inode inválido (fora da tabela, reservado ou com links) é descartada, como faz o e2fsck
+Retorna 1 se um órfão foi liberado e 0 se a lista está vazia
+*/
+static int liberaProximoOrfao()
+{
+	vector<struct ext2_group_desc> grupos;
+	struct ext2_inode inode;
+	unsigned int numero = super.s_last_orphan;
+
+	if (numero == 0)
+		return 0;
+
+	read_group_descs(grupos);
+
+	if (numero < EXT2_FIRST_INO || read_inode_by_number(numero, grupos, &inode) < 0 || inode.i_links_count)
+	{
+		fprintf(stderr, "orphan list: invalid inode %u, list dropped.\n", numero);
+		super.s_last_orphan = 0;
+		write_image(&super, sizeof(struct ext2_super_block), BASE_OFFSET);
+		return 0;
+	}
+
+	vector<unsigned int> blocos, indiretos, numeros(1, numero);
+
+	resolve_block_map(&inode, blocos, &indiretos);
+	blocos.insert(blocos.end(), indiretos.begin(), indiretos.end());
+
+	// O mapa de blocos é zerado antes dos bitmaps: uma interrupção entre as duas escritas perde blocos, que o e2fsck
+	// recupera, mas nunca deixa o órfão apontando para blocos já livres (talvez realocados) na retomada
+	memset(inode.i_block, 0, sizeof(inode.i_block));
+	inode.i_blocks = 0;
+	inode.i_size = 0;
+	write_inode_by_number(numero, grupos, &inode);
+
+	liberaBlocos(blocos, 1);
+
+	// liberaInodes reescreve o Superbloco já com a nova cabeça da lista
+	super.s_last_orphan = inode.i_dtime;
+
+	if (liberaInodes(numeros, 1) && S_ISDIR(inode.i_mode))
+	{
+		unsigned int g = (numero - 1) / super.s_inodes_per_group;
+		struct ext2_group_desc grupo;
+
+		read_image(&grupo, sizeof(struct ext2_group_desc), GDT_OFFSET + sizeof(struct ext2_group_desc) * g);
+		grupo.bg_used_dirs_count--;
+		write_image(&grupo, sizeof(struct ext2_group_desc), GDT_OFFSET + sizeof(struct ext2_group_desc) * g);
+	}
+
+	inode.i_dtime = time(NULL);
+	write_inode_by_number(numero, grupos, &inode);
+	orfaosLiberados++;
+
+	return 1;
+}
+
+/* Recalcula a partir dos bitmaps as contagens de blocos e Inodes livres de todos os grupos e do Superbloco
+
+Usada ao retomar uma liberação interrompida: um passo interrompido entre a escrita de um bitmap e a dos contadores deixa
+as contagens abaixo do real, e o órfão retomado já não tem no mapa os blocos que as corrigiriam
+*/
+[[maybe_unused]] static void recontaLivres()
+{
+	vector<struct ext2_group_desc> grupos;
+	vector<unsigned char> bitmap(block_size);
+
+	read_group_descs(grupos);
+	super.s_free_blocks_count = 0;
+	super.s_free_inodes_count = 0;
+
+	for (unsigned int g = 0; g < grupos.size(); g++)
+	{
+		read_block(grupos[g].bg_block_bitmap, bitmap.data());
+		grupos[g].bg_free_blocks_count = blocosNoGrupo(g) - contaBits(bitmap.data(), blocosNoGrupo(g));
+
+		read_block(grupos[g].bg_inode_bitmap, bitmap.data());
+		grupos[g].bg_free_inodes_count = super.s_inodes_per_group - contaBits(bitmap.data(), super.s_inodes_per_group);
+
+		super.s_free_blocks_count += grupos[g].bg_free_blocks_count;
+		super.s_free_inodes_count += grupos[g].bg_free_inodes_count;
+	}
+
+	write_image(grupos.data(), sizeof(struct ext2_group_desc) * grupos.size(), GDT_OFFSET);
+	write_image(&super, sizeof(struct ext2_super_block), BASE_OFFSET);
+}
+
+// Thread de liberação: libera os órfãos um a um, cedendo a vez aos comandos que estiverem esperando
+static void executaLiberacaoOrfaos()
+{
+	unique_lock<mutex> trava(mutexSistemaArquivos);
+
+	origemRastro = "orphan-release";
+
+	while (true)
+	{
+		condOrfaos.wait(trava, []
+						{ return comandosAguardando == 0; });
+
+		if (!liberaProximoOrfao())
+			break;
+
+		confirmaTransacao(); // Cada órfão liberado é uma transação do jornal
+	}
+
+	liberandoOrfaos = false;
+}
+
+// Inicia a thread de liberação, se ela não estiver em execução. Deve ser chamada com mutexSistemaArquivos travado
+static void iniciaLiberacaoOrfaos()
+{
+	if (liberandoOrfaos || super.s_last_orphan == 0)
+		return;
+
+	// Uma thread anterior já encerrou o laço e apenas retorna
+	if (threadOrfaos.joinable())
+		threadOrfaos.join();
+
+	liberandoOrfaos = true;
+	threadOrfaos = thread(executaLiberacaoOrfaos);
+}
+
+// Libera todos os órfãos restantes e aguarda o fim da thread de liberação (fim do shell)
+[[maybe_unused]] static void encerraLiberacaoOrfaos()
+{
+	{
+		lock_guard<mutex> trava(mutexSistemaArquivos);
+
+		while (liberaProximoOrfao())
+			;
+	}
+
+	condOrfaos.notify_all();
+
+	if (threadOrfaos.joinable())
+		threadOrfaos.join();
+}
+
+/* Remove a entrada de nome 'nome' da lista de entradas do diretório de inode 'inode'
+
+O registro da entrada é incorporado ao da entrada anterior (ou, se for a primeira do bloco, tem o Inode zerado); apenas
+o cabeçalho alterado é reescrito
+Utilizada nas funções rm e rmdir
+nome: nome da entrada a ser removida
+*/
+void removeEntry(struct ext2_inode *inode, struct ext2_group_desc *group, char *nome)
+{
+	vector<char> bloco;
+	struct PosicaoEntrada pos;
+	unsigned int inicio, fim;
+
+	if (localizaEntradaDiretorio(inode, nome, bloco, &pos) < 0)
+		return;
+
+	removeEntradaBloco(bloco.data(), &pos, &inicio, &fim);
+	write_image(bloco.data() + inicio, fim - inicio, BLOCK_OFFSET(pos.numBloco) + inicio);
+}
+
+/* Marca o inode de número 'bitVal' como desocupado no bitmap de Inodes de 'group'
+
+Utilizado nas funções rm e rmdir
+bitVal: número do inode a ser desmarcado no bitmap de Inodes de 'group'
+*/
+void unset_inode_bitmap(struct ext2_group_desc *group, int bitVal)
+{
+	EscopoArena escopo; // Buffers devolvidos ao retornar
+	char *bitmap;
+
+	bitVal = (bitVal - 1) % super.s_inodes_per_group; // Posição do Inode no bitmap do seu grupo
+
+	int y = (bitVal) / 8; // Pega o byte em que se encontra o Inode
+	int x = (bitVal) % 8; // Pega o offset no byte
+
+	// Exemplo:
+	// bitVal = 10110011 = 179
+	// y = 22
+	// x = 3
+	// marcado = 11111110 << 3 = 11110000
+	// marcado = 11110000 | (11111111 >> 5) = 11110000 | 00000111 = 11110111
+
+	int marcado = (0xFE << x);
+
+	marcado = marcado | (0xFF >> (8 - x));
+
+	bitmap = (char *)blocoTemporario();
+
+	read_image(bitmap, block_size, BLOCK_OFFSET(group->bg_inode_bitmap));
+
+	char tmp = bitmap[y];
+
+	tmp = (tmp & marcado);
+
+	bitmap[y] = tmp;
+
+	// Reescreve o bitmap com o bitmap no qual foi desmarcado o Inode
+	write_image(bitmap, block_size, BLOCK_OFFSET(group->bg_inode_bitmap));
+
+	// Atualiza o número de Inodes livres
+	group->bg_free_inodes_count = group->bg_free_inodes_count + 1;
+	super.s_free_inodes_count = super.s_free_inodes_count + 1;
+
+}
+
+/* Remove o diretório de nome 'nome'
+
+nome: nome do diretório a ser removido
+grupoAtual: variável global que indica o grupo corrente
+*/
+void funct_rmdir(struct ext2_inode *inode, struct ext2_group_desc *group, char *nome, int grupoAtual)
+{
+	int numGrupo = grupoAtual;
+	int numblocos = 0;
+	long valorInodeTmp;
+
+	struct ext2_group_desc *grupoTemp = (struct ext2_group_desc *)alocaTemporario(sizeof(struct ext2_group_desc));
+	struct ext2_inode *inodeTemp = (struct ext2_inode *)alocaTemporario(sizeof(struct ext2_inode));
+	memcpy(grupoTemp, group, sizeof(struct ext2_group_desc));
+	memcpy(inodeTemp, inode, sizeof(struct ext2_inode));
+
+	if (!strcmp(nome, ".") || !strcmp(nome, ".."))
+	{
+		printf("\ninvalid sintax.\n");
+		return;
+	}
+
+	read_dir(inodeTemp, grupoTemp, &valorInodeTmp, nome);
+
+	if (valorInodeTmp < 0)
+	{
+		printf("\nfile not found.\n");
+		return;
+	}
+
+	trocaGrupo(&valorInodeTmp, grupoTemp, &numGrupo);
+
+	unsigned int index = (valorInodeTmp - 1) % super.s_inodes_per_group + 1;
+
+	read_inode(index, grupoTemp, inodeTemp);
+
+	numblocos = inodeTemp->i_blocks;
+
+	if (S_ISDIR(inodeTemp->i_mode) == 0)
+	{
+		printf("\nnot a directory.\n");
+		return;
+	}
+
+	// Se não há entradas no diretório
+	if (!isLoaded(inodeTemp, grupoTemp))
+	{
+		removeEntry(inode, group, nome); // Remove o diretório da lista de entradas do diretório pai
+		invalidaCacheCaminhos();		 // O Inode do diretório pode ser reutilizado
+
+		// Libera o Inode do diretório (sem links e com data de remoção) e o desconta dos diretórios do seu grupo
+		inodeTemp->i_links_count = 0;
+		inodeTemp->i_dtime = time(NULL);
+		write_inode(index, grupoTemp, inodeTemp);
+		unset_inode_bitmap(grupoTemp, valorInodeTmp);
+		grupoTemp->bg_used_dirs_count--;
+		rewriteSuperAndGroup(grupoTemp, numGrupo);
+
+		// Desmarca os blocos do diretório (que pode ter mais de um bloco) e atualiza o número de Blocos livres
+		vector<unsigned int> blocos, indiretos;
+
+		resolve_block_map(inodeTemp, blocos, &indiretos);
+		blocos.insert(blocos.end(), indiretos.begin(), indiretos.end());
+		liberaBlocos(blocos);
+
+		// O diretório pai perde o link do '..' removido
+		vector<struct ext2_group_desc> grupos;
+		long inodeAtual;
+
+		read_dir(inode, group, &inodeAtual, (char *)".");
+		read_group_descs(grupos);
+		read_inode_by_number(inodeAtual, grupos, inode);
+		inode->i_links_count--;
+		write_inode_by_number(inodeAtual, grupos, inode);
+
+		memcpy(group, &grupos[grupoAtual], sizeof(struct ext2_group_desc)); // Mantém a cópia em memória do grupo corrente atualizada
+	}
+	else
+	{
+		printf("\ndirectory not empty.\n");
+	}
+}
+
+/* Remove o arquivo de nome 'nome'
+
+nome: nome do arquivo a ser removido
+grupoAtual: variável global que indica o grupo corrente
+*/
+void funct_rm(struct ext2_inode *inode, struct ext2_group_desc *group, char *nome, int grupoAtual)
+{
+	int numGrupo = grupoAtual;
+	int numblocos = 0;
+	long valorInodeTmp;
+
+	struct ext2_group_desc *grupoTemp = (struct ext2_group_desc *)alocaTemporario(sizeof(struct ext2_group_desc));
+	struct ext2_inode *inodeTemp = (struct ext2_inode *)alocaTemporario(sizeof(struct ext2_inode));
+	memcpy(grupoTemp, group, sizeof(struct ext2_group_desc));
+	memcpy(inodeTemp, inode, sizeof(struct ext2_inode));
+
+	read_dir(inodeTemp, grupoTemp, &valorInodeTmp, nome);
+
+	if (valorInodeTmp == -1)
+	{
+		printf("\nfile not found.\n");
+		return;
+	}
+
+	// Localiza o grupo do Inode do arquivo a ser removido
+	trocaGrupo(&valorInodeTmp, grupoTemp, &numGrupo);
+
+	unsigned int index = (valorInodeTmp - 1) % super.s_inodes_per_group + 1;
+
+	// Obtém a estrutura do Inode do arquivo a ser removido
+	read_inode(index, grupoTemp, inodeTemp);
+
+	numblocos = inodeTemp->i_blocks;
+
+	if (S_ISDIR(inodeTemp->i_mode))
+	{
+		printf("\nnot a file.\n");
+		return;
+	}
+
+	// Desmarca todos os blocos do Inode do arquivo (dados e indireção), em lote por grupo, e atualiza a contagem de blocos
+	vector<unsigned int> blocos, indiretos;
+
+	resolve_block_map(inodeTemp, blocos, &indiretos);
+	blocos.insert(blocos.end(), indiretos.begin(), indiretos.end());
+	liberaBlocos(blocos);
+
+	// O descritor do grupo do Inode foi reescrito por liberaBlocos
+	read_image(grupoTemp, sizeof(struct ext2_group_desc), GDT_OFFSET + sizeof(struct ext2_group_desc) * numGrupo);
+
+	removeEntry(inode, group, nome); 					// Remove a entrada correspondente ao arquivo removido da lista de entradas
+
+	// O Inode liberado fica sem links e com a data de remoção, como o e2fsck espera de um Inode livre
+	inodeTemp->i_links_count = 0;
+	inodeTemp->i_dtime = time(NULL);
+	write_inode(index, grupoTemp, inodeTemp);
+
+	unset_inode_bitmap(grupoTemp, valorInodeTmp);	    // Marca o bit do Inode removido como desocupado no bitmap de Inodes do grupo correspondente
+	invalidaExtensoes(valorInodeTmp);
+	rewriteSuperAndGroup(grupoTemp, numGrupo);			// Atualiza o número de Inodes livres em 'super' e 'group'
+
+	// Mantém a cópia em memória do grupo corrente atualizada
+	read_image(group, sizeof(struct ext2_group_desc), GDT_OFFSET + sizeof(struct ext2_group_desc) * grupoAtual);
+	
+}
+
+/* Copia os dados do arquivo de nome 'nome' para o arquivo de caminho absoluto 'arquivoDest'
+
+nome: nome do arquivo a ser copiado
+arquivoDest: caminho absoluto do arquivo a ser escrito a cópia
+*/
+void funct_cp(struct ext2_inode *inode, struct ext2_group_desc *group, char *nome, int *grupoAtual, char *arquivoDest)
+{
+	struct ext2_group_desc *grupoTemp = (struct ext2_group_desc *)alocaTemporario(sizeof(struct ext2_group_desc));
+	struct ext2_inode *inodeTemp = (struct ext2_inode *)alocaTemporario(sizeof(struct ext2_inode));
+
+	int retorno = getArquivoPorNome(inode, group, nome, grupoAtual, inodeTemp, grupoTemp);
+	if (retorno == -1)
+	{
+		printf("\nfile not found.\n");
+		return;
+	}
+
+	copiaArquivo(inodeTemp, arquivoDest);
+
+}
+
+/* Exibe o conteúdo do arquivo de nome 'nome'
+
+nome: nome do arquivo
+*/
+void funct_cat(struct ext2_inode *inode, struct ext2_group_desc *group, char *nome, int *grupoAtual)
+{
+	struct ext2_group_desc *grupoTemp = (struct ext2_group_desc *)alocaTemporario(sizeof(struct ext2_group_desc));
+	struct ext2_inode *inodeTemp = (struct ext2_inode *)alocaTemporario(sizeof(struct ext2_inode));
+
+	int retorno = getArquivoPorNome(inode, group, nome, grupoAtual, inodeTemp, grupoTemp);
+
+	if (retorno == -1)
+	{
+		printf("\nfile not found.\n");
+		return;
+	}
+
+	if (S_ISDIR(inodeTemp->i_mode))
+	{
+		printf("\nnot a file.\n");
+		return;
+	}
+
+	printaArquivo(inodeTemp);
+
+}
+
+#define TAM_LEITURA_FAIXA (1024 * 1024) // Tamanho máximo de cada leitura de 'read' antes de escrever na saída
+
+/* Exibe 'tamanho' bytes do arquivo 'nome' a partir do byte 'offset'
+
+A faixa é lida por leFaixaArquivo, que localiza diretamente os blocos pedidos
+*/
+void funct_read(struct ext2_inode *inode, struct ext2_group_desc *group, char *nome, unsigned long long offset, unsigned long long tamanho)
+{
+	vector<struct ext2_group_desc> grupos;
+	vector<char> bloco;
+	struct PosicaoEntrada pos;
+	struct ext2_inode arquivo;
+
+	read_group_descs(grupos);
+
+	if (localizaEntradaDiretorio(inode, nome, bloco, &pos) < 0 || read_inode_by_number(pos.inode, grupos, &arquivo) < 0)
+	{
+		printf("\nfile not found.\n");
+		return;
+	}
+
+	if (S_ISDIR(arquivo.i_mode))
+	{
+		printf("\nnot a file.\n");
+		return;
+	}
+
+	char *buffer = (char *)alocaTemporario(min<unsigned long long>(tamanho, TAM_LEITURA_FAIXA));
+
+	while (tamanho > 0)
+	{
+		long long lidos = leFaixaArquivo(pos.inode, &arquivo, offset, min<unsigned long long>(tamanho, TAM_LEITURA_FAIXA), buffer);
+
+		if (lidos <= 0)
+			break;
+
+		fwrite(buffer, 1, lidos, stdout);
+		offset += lidos;
+		tamanho -= lidos;
+	}
+}
+
+// Exibe informações do disco e do sistema de arquivos
+void funct_info()
+{
+	printf( //"Reading super-block from device " FD_DEVICE ":\n"
+		"Volume name.....: %s\n"
+		"Image size......: %u bytes\n"
+		"Free space......: %u KiB\n"
+		"Free inodes.....: %u\n"
+		"Free blocks.....: %u\n"
+		"Block size......: %u bytes\n"
+		"Inode size......: %u bytes\n"
+		"Groups count....: %u\n"
+		"Groups size.....: %u blocks\n"
+		"Groups inodes...: %u inodes\n"
+		"Inodetable size.: %u blocks\n",
+
+		super.s_volume_name,
+		(super.s_blocks_count * block_size),
+		((super.s_free_blocks_count - super.s_r_blocks_count) * block_size) / 1024,
+		
+		super.s_free_inodes_count,
+		super.s_free_blocks_count,
+		block_size,
+		super.s_inode_size,
+		(super.s_blocks_count / super.s_blocks_per_group), 
+		
+		super.s_blocks_per_group,
+		super.s_inodes_per_group,
+		(super.s_inodes_per_group / (block_size / inode_size)));
+}
+
+// Exibe os atributos do arquivo ou diretório de nome 'nome'
+/* Escreve em 'saida' as colunas de atributos de 'inode' exibidas por attr e 'ls -l': permissões, uid, gid, tamanho e
+data de modificação
+
+Retorna o número de caracteres escritos
+*/
+static int formataAtributos(const struct ext2_inode *inode, char *saida, size_t tamanho)
+{
+	const char *letras = "rwxrwxrwx";
+	char permissoes[11];
+	int n;
+
+	permissoes[0] = S_ISDIR(inode->i_mode) ? 'd' : 'f';
+
+	// Bits de leitura, escrita e execução do usuário, do grupo e dos outros, de EXT2_S_IRUSR a EXT2_S_IXOTH
+	for (int i = 0; i < 9; i++)
+		permissoes[i + 1] = (inode->i_mode & (EXT2_S_IRUSR >> i)) ? letras[i] : '-';
+
+	permissoes[10] = 0;
+
+	n = snprintf(saida, tamanho, "%s    %d      %d ", permissoes, inode->i_uid, inode->i_gid);
+
+	unsigned long long bytes = tamanhoInode(inode);
+
+	if (bytes > 1024)
+		n += snprintf(saida + n, tamanho - n, "   %.1f KiB", ((double)bytes) / 1024);
+	else
+		n += snprintf(saida + n, tamanho - n, "    %llu B ", bytes);
+
+	time_t tempo = inode->i_mtime;
+	struct tm tm;
+
+	localtime_r(&tempo, &tm);
+
+	n += snprintf(saida + n, tamanho - n, "  %d/%d/%d %d:%d", tm.tm_mday, tm.tm_mon + 1, tm.tm_year + 1900, tm.tm_hour, tm.tm_min);
+
+	return n;
+}
+
+void funct_attr(struct ext2_inode *inode, struct ext2_group_desc *group, char *nome, int grupoAtual)
+{
+	struct ext2_group_desc *grupoTemp = (struct ext2_group_desc *)alocaTemporario(sizeof(struct ext2_group_desc));
+	struct ext2_inode *inodeTemp = (struct ext2_inode *)alocaTemporario(sizeof(struct ext2_inode));
+
+	int retorno = getArquivoPorNome(inode, group, nome, &grupoAtual, inodeTemp, grupoTemp);
+
+	if (retorno == -1)
+	{
+		printf("\nfile not found\n");
+		return;
+	}
+
+	char linha[128];
+
+	formataAtributos(inodeTemp, linha, sizeof(linha));
+	printf("permissões   uid   gid    tamanho    modificado em\n");
+	printf("%s\n", linha);
+}
+
+/* Altera o diretório corrente para o diretório 'nome', um caminho absoluto ou relativo ao diretório corrente
+
+O Inode é resolvido pela cache de caminhos e 'vetorCaminhoAtual' recebe o caminho normalizado
+*/
+void funct_cd(struct ext2_inode *inode, struct ext2_group_desc *group, int *grupoAtual, char *nome)
+{
+	vector<struct ext2_group_desc> grupos;
+	vector<string> componentes = normalizaCaminho(nome);
+	struct ext2_inode dir;
+
+	read_group_descs(grupos);
+
+	unsigned int numDir = resolveComponentes(componentes, grupos);
+
+	if (numDir == 0 || read_inode_by_number(numDir, grupos, &dir) < 0)
+	{
+		printf("\ndirectory not found.\n");
+		return;
+	}
+
+	if (!S_ISDIR(dir.i_mode))
+	{
+		printf("\nnot a directory.\n");
+		return;
+	}
+
+	*grupoAtual = (numDir - 1) / super.s_inodes_per_group;
+	memcpy(group, &grupos[*grupoAtual], sizeof(struct ext2_group_desc));
+	memcpy(inode, &dir, sizeof(struct ext2_inode));
+	vetorCaminhoAtual = componentes;
+}
+
+// Lista os arquivos e diretórios do diretório corrente
+void funct_ls(struct ext2_inode *inode, struct ext2_group_desc *group)
+{
+	void *block;
+	if (S_ISDIR(inode->i_mode))
+	{
+		struct ext2_dir_entry_2 *entry;
+		vector<unsigned int> blocos;
+
+		block = blocoTemporario();
+		resolve_block_map(inode, blocos, NULL);
+
+		// Lista as entradas de todos os blocos do diretório, pulando as que não têm Inode
+		for (unsigned int numBloco : blocos)
+		{
+			unsigned int size = 0;
+
+			if (numBloco == 0)
+				continue;
+
+			read_image(block, block_size, BLOCK_OFFSET(numBloco));
+
+			entry = (struct ext2_dir_entry_2 *)block;
+
+			while (size + 8 <= (unsigned int)block_size && rec_len_from_disk(entry->rec_len) >= 8)
+			{
+				if (entry->inode)
+				{
+					char file_name[EXT2_NAME_LEN + 1];
+					memcpy(file_name, entry->name, entry->name_len);
+					file_name[entry->name_len] = 0;
+
+					printf("%s\n", file_name);
+					printf("inode: %u\n", entry->inode);
+					printf("record length: %u\n", rec_len_from_disk(entry->rec_len));
+					printf("name length: %u\n", entry->name_len);
+					printf("file type: %u\n", entry->file_type);
+					printf("\n");
+				}
+
+				size += rec_len_from_disk(entry->rec_len);
+				entry = (ext2_dir_entry_2 *)((char *)entry + rec_len_from_disk(entry->rec_len));
+			}
+		}
+	}
+}
+
+/* Lista as entradas do diretório corrente com os atributos de attr ('ls -l')
+
+Os Inodes das entradas são lidos em lote (leInodesEmLote), com poucas leituras da Tabela de Inodes, e a listagem é
+montada em um único buffer antes de ser impressa
+*/
+void funct_ls_longo(struct ext2_inode *inode, struct ext2_group_desc *group)
+{
+	vector<struct EntradaDir> entradas;
+	vector<struct ext2_group_desc> grupos;
+	vector<unsigned int> numeros;
+	vector<struct ext2_inode> inodes;
+
+	if (!S_ISDIR(inode->i_mode))
+		return;
+
+	le_entradas_diretorio(inode, entradas);
+	read_group_descs(grupos);
+
+	for (auto &entrada : entradas)
+		numeros.push_back(entrada.inode);
+
+	if (leInodesEmLote(numeros, grupos, inodes) < 0)
+	{
+		printf("\nerror reading inode table.\n");
+		return;
+	}
+
+	string saida = "permissões   uid   gid    tamanho    modificado em    nome\n";
+	char linha[128];
+
+	for (auto &entrada : entradas)
+	{
+		size_t i = lower_bound(numeros.begin(), numeros.end(), entrada.inode) - numeros.begin();
+
+		if (i == numeros.size() || numeros[i] != entrada.inode)
+			continue;
+
+		saida.append(linha, formataAtributos(&inodes[i], linha, sizeof(linha)));
+		saida += "    ";
+		saida += entrada.nome;
+		saida += '\n';
+	}
+
+	fwrite(saida.data(), 1, saida.size(), stdout);
+}
+
+/* Renomeia a entrada 'nomeArquivo' do diretório 'inode' para 'novoNomeArquivo'
+
+novoNomeArquivo: relativo ao diretório corrente, como no mv: novo nome, um diretório existente (a entrada é movida para
+ele com o mesmo nome) ou um caminho "diretorio/novo_nome" (a entrada é movida e renomeada)
+
+Quando o novo nome cabe no registro da entrada, apenas ela é reescrita; senão, a entrada é removida (seu registro é
+incorporado ao anterior) e reinserida na folga de outra entrada, de preferência no mesmo bloco, com uma única escrita
+Retorna 0 se a entrada foi renomeada e -1 caso contrário
+*/
+static int renomeiaEntrada(struct ext2_inode *inode, struct ext2_group_desc *group, char *nomeArquivo, char *novoNomeArquivo)
+{
+	vector<struct ext2_group_desc> grupos;
+	vector<char> bloco, blocoDestino;
+	struct PosicaoEntrada origem, existente;
+	struct ext2_inode dirDestino, alvo;
+	long numDir;
+
+	read_dir(inode, group, &numDir, (char *)".");
+	read_group_descs(grupos);
+
+	if (!strcmp(nomeArquivo, ".") || !strcmp(nomeArquivo, "..") || strchr(nomeArquivo, '/'))
+	{
+		printf("\ninvalid sintax.\n");
+		return -1;
+	}
+
+	if (localizaEntradaDiretorio(inode, nomeArquivo, bloco, &origem) < 0 || read_inode_by_number(origem.inode, grupos, &alvo) < 0)
+	{
+		printf("\nfile not found.\n");
+		return -1;
+	}
+
+	int ehDiretorio = S_ISDIR(alvo.i_mode);
+
+	// Separa o diretório de destino do novo nome; como no mv, o destino é relativo ao diretório corrente, não ao da origem
+	string destino = ".", novoNome = novoNomeArquivo;
+	size_t barra = novoNome.rfind('/');
+
+	if (barra != string::npos)
+	{
+		destino = (barra == 0) ? "/" : novoNome.substr(0, barra);
+		novoNome = novoNome.substr(barra + 1);
+
+		if (novoNome.empty())
+			novoNome = nomeArquivo;
+	}
+
+	unsigned int numDestino = resolveCaminhoCache(destino.c_str(), grupos);
+
+	if (numDestino == 0 || read_inode_by_number(numDestino, grupos, &dirDestino) < 0 || !S_ISDIR(dirDestino.i_mode))
+	{
+		printf("\nnot a directory.\n");
+		return -1;
+	}
+
+	// Um diretório existente como destino recebe a entrada com o mesmo nome
+	if (barra == string::npos && localizaEntradaDiretorio(&dirDestino, novoNome.c_str(), blocoDestino, &existente) == 0 &&
+		existente.inode != origem.inode && read_inode_by_number(existente.inode, grupos, &alvo) == 0 && S_ISDIR(alvo.i_mode))
+	{
+		numDestino = existente.inode;
+		novoNome = nomeArquivo;
+		read_inode_by_number(numDestino, grupos, &dirDestino);
+	}
+
+	if (novoNome == "." || novoNome == ".." || novoNome.size() > EXT2_NAME_LEN)
+	{
+		printf("\ninvalid sintax.\n");
+		return -1;
+	}
+
+	if (localizaEntradaDiretorio(&dirDestino, novoNome.c_str(), blocoDestino, &existente) == 0)
+	{
+		printf("\nfile already exists.\n");
+		return -1;
+	}
+
+	if (ehDiretorio) // Os caminhos sob o diretório renomeado deixam de valer
+		invalidaCacheCaminhos();
+
+	struct ext2_dir_entry_2 *entry = (struct ext2_dir_entry_2 *)(bloco.data() + origem.offset);
+	unsigned int tamNome = novoNome.size();
+	off_t inicioBloco = BLOCK_OFFSET(origem.numBloco);
+	unsigned int inicio, fim, inicioInsercao, fimInsercao;
+
+	if (numDestino == (unsigned int)numDir)
+	{
+		// O novo nome cabe no registro: reescreve apenas a entrada
+		if (tamanhoEntrada(tamNome) <= rec_len_from_disk(entry->rec_len))
+		{
+			entry->name_len = tamNome;
+			memcpy(entry->name, novoNome.c_str(), tamNome);
+			write_image(entry, 8 + tamNome, inicioBloco + origem.offset);
+			return 0;
+		}
+
+		// Remove e reinsere no mesmo bloco, gravando apenas a faixa alterada
+		removeEntradaBloco(bloco.data(), &origem, &inicio, &fim);
+
+		if (insereEntradaBloco(bloco.data(), novoNome.c_str(), origem.inode, origem.tipo, &inicioInsercao, &fimInsercao) == 0)
+		{
+			inicio = min(inicio, inicioInsercao);
+			fim = max(fim, fimInsercao);
+			write_image(bloco.data() + inicio, fim - inicio, inicioBloco + inicio);
+			return 0;
+		}
+	}
+	else if (ehDiretorio)
+	{
+		// Um diretório não pode ser movido para dentro de si mesmo ou de um descendente
+		for (unsigned int ancestral = numDestino; ancestral != EXT2_ROOT_INO;)
+		{
+			if (ancestral == origem.inode || (ancestral = resolveCaminho("..", ancestral, grupos)) == 0)
+			{
+				printf("\ninvalid sintax.\n");
+				return -1;
+			}
+		}
+
+		removeEntradaBloco(bloco.data(), &origem, &inicio, &fim);
+	}
+	else
+		removeEntradaBloco(bloco.data(), &origem, &inicio, &fim);
+
+	// Insere em outro bloco (ou diretório) antes de gravar a remoção, para não perder a entrada se não houver espaço
+	if (adicionaEntradaDiretorio(&dirDestino, novoNome.c_str(), origem.inode, origem.tipo) < 0)
+	{
+		printf("\nno space left in directory.\n");
+		return -1;
+	}
+
+	write_image(bloco.data() + inicio, fim - inicio, inicioBloco + inicio);
+
+	if (numDestino == (unsigned int)numDir || !ehDiretorio)
+		return 0;
+
+	// Diretório movido: '..' passa a apontar para o novo pai, que ganha o link que o antigo perde
+	struct ext2_inode movido, dirOrigem;
+	struct PosicaoEntrada pai;
+
+	if (read_inode_by_number(origem.inode, grupos, &movido) == 0 && localizaEntradaDiretorio(&movido, "..", bloco, &pai) == 0)
+	{
+		__u32 numNovoPai = numDestino;
+		write_image(&numNovoPai, sizeof(numNovoPai), BLOCK_OFFSET(pai.numBloco) + pai.offset);
+	}
+
+	read_inode_by_number(numDir, grupos, &dirOrigem);
+	dirOrigem.i_links_count--;
+	write_inode_by_number(numDir, grupos, &dirOrigem);
+
+	read_inode_by_number(numDestino, grupos, &dirDestino);
+	dirDestino.i_links_count++;
+	write_inode_by_number(numDestino, grupos, &dirDestino);
+
+	memcpy(inode, &dirOrigem, sizeof(struct ext2_inode)); // Mantém a cópia em memória do diretório corrente atualizada
+
+	return 0;
+}
+
+// Refaz 'vetorCaminhoAtual' a partir do Inode 'numInode' do diretório corrente, subindo pelas entradas '..' até a raiz
+static void refazCaminhoAtual(unsigned int numInode, const vector<struct ext2_group_desc> &grupos)
+{
+	vector<string> componentes;
+
+	while (numInode != EXT2_ROOT_INO)
+	{
+		unsigned int pai = resolveCaminho("..", numInode, grupos);
+		struct ext2_inode dir;
+		vector<struct EntradaDir> entradas;
+		size_t i = 0;
+
+		if (pai == 0 || read_inode_by_number(pai, grupos, &dir) < 0 || le_entradas_diretorio(&dir, entradas) < 0)
+			return;
+
+		while (i < entradas.size() && (entradas[i].inode != numInode || entradas[i].nome == "." || entradas[i].nome == ".."))
+			i++;
+
+		if (i == entradas.size())
+			return;
+
+		componentes.push_back(entradas[i].nome);
+		numInode = pai;
+	}
+
+	reverse(componentes.begin(), componentes.end());
+	vetorCaminhoAtual = componentes;
+}
+
+/* Renomeia ou move a entrada 'nomeArquivo' do diretório 'inode' (ver renomeiaEntrada)
+
+Se a entrada é o diretório corrente ou um de seus ancestrais, o caminho corrente é refeito com os novos nomes
+*/
+void funct_rename(struct ext2_inode *inode, struct ext2_group_desc *group, char *nomeArquivo, char *novoNomeArquivo)
+{
+	vector<struct ext2_group_desc> grupos;
+	vector<unsigned int> cadeia; // Inodes dos ancestrais do diretório corrente, da raiz até ele
+
+	read_group_descs(grupos);
+
+	for (size_t k = 0; k <= vetorCaminhoAtual.size(); k++)
+		cadeia.push_back(resolveComponentes(vector<string>(vetorCaminhoAtual.begin(), vetorCaminhoAtual.begin() + k), grupos));
+
+	if (renomeiaEntrada(inode, group, nomeArquivo, novoNomeArquivo) < 0)
+		return;
+
+	for (size_t k = 1; k < cadeia.size(); k++)
+	{
+		struct ext2_inode alvo;
+		vector<char> bloco;
+		struct PosicaoEntrada posicao;
+
+		// O nome antigo não está mais no pai anterior: o componente k foi renomeado ou movido
+		if (read_inode_by_number(cadeia[k - 1], grupos, &alvo) < 0 ||
+			localizaEntradaDiretorio(&alvo, vetorCaminhoAtual[k - 1].c_str(), bloco, &posicao) < 0 || posicao.inode != cadeia[k])
+		{
+			refazCaminhoAtual(cadeia.back(), grupos);
+			return;
+		}
+	}
+}
+
+#define MAX_MENSAGENS_GRUPO 10 // Limite de inconsistências exibidas por grupo na verificação
+
+// Estado compartilhado pelas threads da verificação de consistência
+struct EstadoVerificacao
+{
+	vector<struct ext2_group_desc> grupos;		   // Descritores de todos os grupos
+	vector<unsigned char> blocosCalc;			   // Bitmap de blocos reconstruído (bit 0 = s_first_data_block)
+	vector<unsigned char> inodesCalc;			   // Bitmap de Inodes reconstruído (bit 0 = Inode 1)
+	vector<vector<unsigned int>> diretorios;	   // Inodes de diretórios encontrados em cada grupo
+	vector<vector<string>> mensagens;			   // Inconsistências encontradas em cada grupo
+	vector<unsigned long> blocosLivresCalc;		   // Blocos livres reconstruídos por grupo
+	vector<unsigned long> inodesLivresCalc;		   // Inodes livres reconstruídos por grupo
+	atomic<unsigned long> erros;				   // Total de inconsistências
+	atomic<unsigned long> inodesEmUso;			   // Total de Inodes em uso percorridos
+};
+
+// Registra uma inconsistência no grupo 'g', guardando a mensagem apenas enquanto não exceder MAX_MENSAGENS_GRUPO
+static void registraErro(struct EstadoVerificacao *estado, unsigned int g, const char *formato, ...)
+{
+	estado->erros++;
+
+	if (estado->mensagens[g].size() > MAX_MENSAGENS_GRUPO)
+		return;
+
+	char mensagem[256];
+	va_list args;
+
+	va_start(args, formato);
+	vsnprintf(mensagem, sizeof(mensagem), formato, args);
+	va_end(args);
+
+	estado->mensagens[g].push_back(mensagem);
+}
+
+// Marca atomicamente o bit 'bit' de 'mapa', retornando seu valor anterior
+static inline int marcaBitAtomico(unsigned char *mapa, unsigned long bit)
+{
+	unsigned char mascara = 0x1 << (bit % 8);
+
+	return !!(__atomic_fetch_or(&mapa[bit / 8], mascara, __ATOMIC_RELAXED) & mascara);
+}
+
+// Indica se o grupo 'g' guarda uma cópia do Superbloco e da tabela de descritores
+static int grupoTemSuper(unsigned int g)
+{
+	if (g <= 1 || !(super.s_feature_ro_compat & EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER))
+		return 1;
+
+	for (unsigned int base = 3; base <= 7; base += 2)
+	{
+		unsigned long potencia = base;
+
+		while (potencia < g)
+			potencia *= base;
+
+		if (potencia == g)
+			return 1;
+	}
+
+	return 0;
+}
+
+/* Marca como ocupados no bitmap reconstruído os blocos de metadados do grupo 'g': cópia do Superbloco,
+tabela de descritores, blocos reservados da tabela, bitmaps e Tabela de Inodes
+*/
+static void marcaMetadadosGrupo(struct EstadoVerificacao *estado, unsigned int g)
+{
+	struct ext2_group_desc *grupo = &estado->grupos[g];
+	unsigned long inicio = (unsigned long)g * super.s_blocks_per_group;
+	unsigned long blocosTabela = (super.s_inodes_per_group * inode_size + block_size - 1) / block_size;
+
+	if (grupoTemSuper(g))
+	{
+		unsigned long blocosDescritores = (num_grupos * sizeof(struct ext2_group_desc) + block_size - 1) / block_size;
+		unsigned long reservados = (super.s_feature_compat & EXT2_FEATURE_COMPAT_RESIZE_INODE) ? super.s_reserved_gdt_blocks : 0;
+
+		for (unsigned long i = 0; i < 1 + blocosDescritores + reservados; i++)
+			marcaBitAtomico(estado->blocosCalc.data(), inicio + i);
+	}
+
+	marcaBitAtomico(estado->blocosCalc.data(), grupo->bg_block_bitmap - super.s_first_data_block);
+	marcaBitAtomico(estado->blocosCalc.data(), grupo->bg_inode_bitmap - super.s_first_data_block);
+
+	for (unsigned long i = 0; i < blocosTabela; i++)
+		marcaBitAtomico(estado->blocosCalc.data(), grupo->bg_inode_table + i - super.s_first_data_block);
+}
+
+/* Percorre a Tabela de Inodes do grupo 'g', reconstruindo o uso de Inodes e, a partir dos mapas de blocos,
+o uso de blocos. Blocos reivindicados por mais de um dono são reportados
+*/
+static void verificaInodesGrupo(struct EstadoVerificacao *estado, unsigned int g)
+{
+	struct ext2_group_desc *grupo = &estado->grupos[g];
+	unsigned long tamTabela = (unsigned long)super.s_inodes_per_group * inode_size;
+	vector<char> tabela(tamTabela);
+	unsigned long livres = 0;
+
+	// Lê a Tabela de Inodes inteira do grupo com uma única leitura
+	if (read_image(tabela.data(), tamTabela, BLOCK_OFFSET(grupo->bg_inode_table)) != (ssize_t)tamTabela)
+	{
+		registraErro(estado, g, "group %u: cannot read inode table at block %u", g, grupo->bg_inode_table);
+		return;
+	}
+
+	for (unsigned int i = 0; i < super.s_inodes_per_group; i++)
+	{
+		unsigned int numInode = g * super.s_inodes_per_group + i + 1;
+		struct ext2_inode inode;
+		int reservado = numInode < EXT2_FIRST_INO && numInode != EXT2_ROOT_INO;
+
+		memcpy(&inode, tabela.data() + (unsigned long)i * inode_size, sizeof(struct ext2_inode));
+
+		if (!reservado && inode.i_links_count == 0)
+		{
+			livres++;
+			continue;
+		}
+
+		marcaBitAtomico(estado->inodesCalc.data(), numInode - 1);
+
+		if (reservado && inode.i_mode == 0)
+			continue;
+
+		estado->inodesEmUso++;
+
+		if (S_ISDIR(inode.i_mode))
+			estado->diretorios[g].push_back(numInode);
+
+		// Inodes reservados (ex.: Inode de redimensionamento) apontam para metadados já marcados
+		auto marca = [&](unsigned int bloco)
+		{
+			if (bloco < super.s_first_data_block)
+				return;
+			if (marcaBitAtomico(estado->blocosCalc.data(), bloco - super.s_first_data_block) && !reservado)
+				registraErro(estado, g, "inode %u: block %u is claimed by more than one owner", numInode, bloco);
+		};
+
+		if (percorreMapaBlocos(
+				&inode, [&](unsigned long, unsigned int bloco)
+				{ marca(bloco); },
+				marca) < 0)
+		{
+			registraErro(estado, g, "inode %u: block map points outside the filesystem", numInode);
+		}
+	}
+
+	estado->inodesLivresCalc[g] = livres;
+}
+
+/* Valida as listas de entradas dos diretórios do grupo 'g': rec_len alinhado e dentro do bloco, name_len compatível,
+encadeamento cobrindo exatamente o bloco, entradas '.' e '..' e Inodes referenciados em uso
+*/
+static void verificaDiretoriosGrupo(struct EstadoVerificacao *estado, unsigned int g)
+{
+	vector<char> bloco(block_size);
+	vector<unsigned int> blocos;
+
+	for (unsigned int numInode : estado->diretorios[g])
+	{
+		struct ext2_inode inode;
+
+		read_image(&inode, sizeof(struct ext2_inode),
+			  BLOCK_OFFSET(estado->grupos[g].bg_inode_table) + (off_t)((numInode - 1) % super.s_inodes_per_group) * inode_size);
+
+		resolve_block_map(&inode, blocos, NULL);
+
+		if (blocos.empty() || blocos[0] == 0)
+		{
+			registraErro(estado, g, "directory %u: has no data blocks", numInode);
+			continue;
+		}
+
+		for (unsigned long b = 0; b < blocos.size(); b++)
+		{
+			if (blocos[b] == 0 || read_block(blocos[b], bloco.data()) < 0)
+			{
+				registraErro(estado, g, "directory %u: cannot read logical block %lu", numInode, b);
+				continue;
+			}
+
+			unsigned int offset = 0;
+			unsigned int contador = 0;
+
+			while (offset < (unsigned int)block_size)
+			{
+				struct ext2_dir_entry_2 *entry = (struct ext2_dir_entry_2 *)(bloco.data() + offset);
+				unsigned int tamRegistro = (offset + 8 <= (unsigned int)block_size) ? rec_len_from_disk(entry->rec_len) : 0;
+
+				if (offset + 8 > (unsigned int)block_size || tamRegistro < 8 || tamRegistro % 4 != 0 ||
+					offset + tamRegistro > (unsigned int)block_size || 8u + entry->name_len > tamRegistro)
+				{
+					registraErro(estado, g, "directory %u: bad entry at block %u offset %u (rec_len %u, name_len %u)",
+								 numInode, blocos[b], offset, tamRegistro,
+								 (offset + 8 <= (unsigned int)block_size) ? entry->name_len : 0);
+					break;
+				}
+
+				if (entry->inode)
+				{
+					if (entry->inode > super.s_inodes_count)
+						registraErro(estado, g, "directory %u: entry '%.*s' has invalid inode %u", numInode,
+									 entry->name_len, entry->name, entry->inode);
+					else if (!testaBit(estado->inodesCalc.data(), entry->inode - 1))
+						registraErro(estado, g, "directory %u: entry '%.*s' references free inode %u", numInode,
+									 entry->name_len, entry->name, entry->inode);
+				}
+
+				if (b == 0 && contador < 2)
+				{
+					const char *esperado = contador == 0 ? "." : "..";
+
+					if (entry->name_len != strlen(esperado) || memcmp(entry->name, esperado, entry->name_len))
+						registraErro(estado, g, "directory %u: missing '%s' entry", numInode, esperado);
+					else if (contador == 0 && entry->inode != numInode)
+						registraErro(estado, g, "directory %u: '.' points to inode %u", numInode, entry->inode);
+				}
+
+				offset += tamRegistro;
+				contador++;
+			}
+		}
+	}
+}
+
+// Compara os bitmaps e contadores em disco do grupo 'g' com o uso reconstruído
+static void comparaBitmapsGrupo(struct EstadoVerificacao *estado, unsigned int g)
+{
+	struct ext2_group_desc *grupo = &estado->grupos[g];
+	vector<unsigned char> bitmap(block_size);
+	unsigned long n = blocosNoGrupo(g);
+	unsigned long inicio = (unsigned long)g * super.s_blocks_per_group;
+	const unsigned char *calc = estado->blocosCalc.data() + inicio / 8;
+
+	if (read_block(grupo->bg_block_bitmap, bitmap.data()) < 0)
+	{
+		registraErro(estado, g, "group %u: cannot read block bitmap", g);
+		return;
+	}
+
+	// Compara byte a byte e só examina os bits dos bytes divergentes
+	for (unsigned long i = 0; i < (n + 7) / 8; i++)
+	{
+		unsigned char diferenca = bitmap[i] ^ calc[i];
+
+		while (diferenca)
+		{
+			unsigned long bit = i * 8 + __builtin_ctz(diferenca);
+			diferenca &= diferenca - 1;
+
+			if (bit >= n)
+				break;
+
+			unsigned long numBloco = super.s_first_data_block + inicio + bit;
+
+			if (testaBit(calc, bit))
+				registraErro(estado, g, "block %lu: in use but marked free in bitmap", numBloco);
+			else
+				registraErro(estado, g, "block %lu: marked in use in bitmap but not referenced", numBloco);
+		}
+	}
+
+	estado->blocosLivresCalc[g] = n - contaBits(calc, n);
+
+	if (grupo->bg_free_blocks_count != estado->blocosLivresCalc[g])
+		registraErro(estado, g, "group %u: bg_free_blocks_count is %u, counted %lu", g,
+					 grupo->bg_free_blocks_count, estado->blocosLivresCalc[g]);
+
+	if (read_block(grupo->bg_inode_bitmap, bitmap.data()) < 0)
+	{
+		registraErro(estado, g, "group %u: cannot read inode bitmap", g);
+		return;
+	}
+
+	unsigned long primeiroInode = (unsigned long)g * super.s_inodes_per_group;
+
+	for (unsigned long i = 0; i < super.s_inodes_per_group; i++)
+	{
+		int calculado = testaBit(estado->inodesCalc.data(), primeiroInode + i);
+
+		if (testaBit(bitmap.data(), i) != calculado)
+			registraErro(estado, g, "inode %lu: %s", primeiroInode + i + 1,
+						 calculado ? "in use but marked free in bitmap" : "marked in use in bitmap but unused");
+	}
+
+	if (grupo->bg_free_inodes_count != estado->inodesLivresCalc[g])
+		registraErro(estado, g, "group %u: bg_free_inodes_count is %u, counted %lu", g,
+					 grupo->bg_free_inodes_count, estado->inodesLivresCalc[g]);
+
+	if (grupo->bg_used_dirs_count != estado->diretorios[g].size())
+		registraErro(estado, g, "group %u: bg_used_dirs_count is %u, counted %lu", g,
+					 grupo->bg_used_dirs_count, estado->diretorios[g].size());
+}
+
+/* Verifica a consistência da imagem
+
+Antes da verificação, a liberação dos órfãos pendentes é concluída (bitmaps, Inodes e Superbloco são escritos), pois eles
+contariam como Inodes e blocos em uso sem dono; essa é a única escrita do comando. Reconstrói o uso de blocos e Inodes a
+partir das Tabelas de Inodes e mapas de blocos, compara com os bitmaps e contadores 'bg_free_*'/'s_free_*' em disco e
+valida as listas de entradas de todos os diretórios. Cada etapa processa os grupos em paralelo
+*/
+void funct_check()
+{
+	struct EstadoVerificacao estado;
+	unsigned int n = num_grupos;
+	auto inicio = chrono::steady_clock::now();
+
+	// Órfãos ainda não liberados contariam como Inodes e blocos em uso sem dono
+	while (liberaProximoOrfao())
+		;
+
+	read_group_descs(estado.grupos);
+	estado.blocosCalc.assign((super.s_blocks_count - super.s_first_data_block + 7) / 8 + 8, 0);
+	estado.inodesCalc.assign((super.s_inodes_count + 7) / 8 + 8, 0);
+	estado.diretorios.resize(n);
+	estado.mensagens.resize(n);
+	estado.blocosLivresCalc.assign(n, 0);
+	estado.inodesLivresCalc.assign(n, 0);
+	estado.erros = 0;
+	estado.inodesEmUso = 0;
+
+	executaParalelo(n, [&](unsigned int g)
+					{ marcaMetadadosGrupo(&estado, g); });
+	executaParalelo(n, [&](unsigned int g)
+					{ verificaInodesGrupo(&estado, g); });
+	executaParalelo(n, [&](unsigned int g)
+					{ verificaDiretoriosGrupo(&estado, g); });
+	executaParalelo(n, [&](unsigned int g)
+					{ comparaBitmapsGrupo(&estado, g); });
+
+	unsigned long blocosLivres = 0;
+	unsigned long inodesLivres = 0;
+
+	for (unsigned int g = 0; g < n; g++)
+	{
+		blocosLivres += estado.blocosLivresCalc[g];
+		inodesLivres += estado.inodesLivresCalc[g];
+	}
+
+	if (super.s_free_blocks_count != blocosLivres)
+		registraErro(&estado, 0, "superblock: s_free_blocks_count is %u, counted %lu", super.s_free_blocks_count, blocosLivres);
+	if (super.s_free_inodes_count != inodesLivres)
+		registraErro(&estado, 0, "superblock: s_free_inodes_count is %u, counted %lu", super.s_free_inodes_count, inodesLivres);
+
+	for (unsigned int g = 0; g < n; g++)
+	{
+		for (unsigned long i = 0; i < estado.mensagens[g].size() && i < MAX_MENSAGENS_GRUPO; i++)
+			printf("%s\n", estado.mensagens[g][i].c_str());
+
+		if (estado.mensagens[g].size() > MAX_MENSAGENS_GRUPO)
+			printf("group %u: further inconsistencies omitted.\n", g);
+	}
+
+	double segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+
+	printf("\n%u groups, %lu inodes in use, %u blocks checked in %.3f s.\n", n, estado.inodesEmUso.load(),
+		   super.s_blocks_count, segundos);
+
+	if (estado.erros)
+		printf("%lu inconsistencies found.\n", estado.erros.load());
+	else
+		printf("filesystem clean.\n");
+}
+
+#define NUM_CLASSES_FAIXAS 32 // Classes do histograma de faixas livres: a classe k tem faixas de 2^k a 2^(k+1) - 1 blocos
+
+// Espaço livre de um grupo, calculado por freefrag a partir dos bitmaps
+struct EspacoLivreGrupo
+{
+	unsigned long blocosLivres;
+	unsigned long faixas;
+	unsigned long maiorFaixa;
+	unsigned long inodesUsados;
+	unsigned long faixasPorClasse[NUM_CLASSES_FAIXAS];
+	unsigned long blocosPorClasse[NUM_CLASSES_FAIXAS];
+};
+
+/* Exibe o espaço livre de cada grupo (blocos livres, faixas livres, maior faixa, Inodes usados e livres), o total e o
+histograma das faixas livres por tamanho
+
+Os bitmaps dos grupos são lidos e analisados em paralelo: as contagens usam popcount (contaBits) e as faixas,
+percorreFaixasLivres. As contagens calculadas que diferem dos descritores de grupo e do Superbloco são marcadas com '*'
+*/
+void funct_freefrag()
+{
+	vector<struct ext2_group_desc> grupos;
+	unsigned int n = num_grupos;
+	auto inicio = chrono::steady_clock::now();
+
+	read_group_descs(grupos);
+
+	vector<struct EspacoLivreGrupo> espacos(n);
+
+	executaParalelo(n, [&](unsigned int g)
+					{
+						struct EspacoLivreGrupo &espaco = espacos[g];
+						vector<unsigned char> bitmap(block_size);
+						unsigned long total = blocosNoGrupo(g);
+
+						memset(&espaco, 0, sizeof(espaco));
+
+						read_block(grupos[g].bg_block_bitmap, bitmap.data());
+						espaco.blocosLivres = total - contaBits(bitmap.data(), total);
+
+						percorreFaixasLivres(bitmap.data(), total, [&](unsigned long, unsigned long tamanho)
+											 {
+												 int classe = 63 - __builtin_clzl(tamanho);
+
+												 espaco.faixas++;
+												 espaco.maiorFaixa = max(espaco.maiorFaixa, tamanho);
+												 espaco.faixasPorClasse[classe]++;
+												 espaco.blocosPorClasse[classe] += tamanho;
+											 });
+
+						read_block(grupos[g].bg_inode_bitmap, bitmap.data());
+						espaco.inodesUsados = contaBits(bitmap.data(), super.s_inodes_per_group); });
+
+	struct EspacoLivreGrupo total;
+	unsigned int divergentes = 0;
+
+	memset(&total, 0, sizeof(total));
+	printf("\ngroup  free blocks  (desc)  extents  largest  used inodes  free inodes  (desc)\n");
+
+	for (unsigned int g = 0; g < n; g++)
+	{
+		struct EspacoLivreGrupo &espaco = espacos[g];
+		unsigned long inodesLivres = super.s_inodes_per_group - espaco.inodesUsados;
+		int blocosDivergem = espaco.blocosLivres != grupos[g].bg_free_blocks_count;
+		int inodesDivergem = inodesLivres != grupos[g].bg_free_inodes_count;
+
+		printf("%5u  %11lu  %5u%c  %7lu  %7lu  %11lu  %11lu  %5u%c\n", g, espaco.blocosLivres, grupos[g].bg_free_blocks_count,
+			   blocosDivergem ? '*' : ' ', espaco.faixas, espaco.maiorFaixa, espaco.inodesUsados, inodesLivres,
+			   grupos[g].bg_free_inodes_count, inodesDivergem ? '*' : ' ');
+
+		divergentes += (blocosDivergem || inodesDivergem);
+		total.blocosLivres += espaco.blocosLivres;
+		total.faixas += espaco.faixas;
+		total.maiorFaixa = max(total.maiorFaixa, espaco.maiorFaixa);
+		total.inodesUsados += espaco.inodesUsados;
+
+		for (int k = 0; k < NUM_CLASSES_FAIXAS; k++)
+		{
+			total.faixasPorClasse[k] += espaco.faixasPorClasse[k];
+			total.blocosPorClasse[k] += espaco.blocosPorClasse[k];
+		}
+	}
+
+	unsigned long inodesLivres = super.s_inodes_count - total.inodesUsados;
+	unsigned long blocosTotal = super.s_blocks_count - super.s_first_data_block;
+
+	printf("\n%lu free blocks of %lu (%.1f%%) in %lu free extents; largest %lu blocks, average %.1f blocks.\n",
+		   total.blocosLivres, blocosTotal, 100.0 * total.blocosLivres / blocosTotal, total.faixas, total.maiorFaixa,
+		   total.faixas ? (double)total.blocosLivres / total.faixas : 0.0);
+	printf("%lu free inodes of %u.\n", inodesLivres, super.s_inodes_count);
+
+	printf("\nextent size (blocks)     free extents    free blocks  percent\n");
+
+	for (int k = 0; k < NUM_CLASSES_FAIXAS; k++)
+	{
+		if (!total.faixasPorClasse[k])
+			continue;
+
+		printf("%9lu - %-9lu  %13lu  %13lu  %6.2f%%\n", 1ul << k, (2ul << k) - 1, total.faixasPorClasse[k],
+			   total.blocosPorClasse[k], 100.0 * total.blocosPorClasse[k] / total.blocosLivres);
+	}
+
+	if (total.blocosLivres != super.s_free_blocks_count || inodesLivres != super.s_free_inodes_count)
+		printf("\nsuperblock counters differ: %u free blocks, %u free inodes.\n", super.s_free_blocks_count, super.s_free_inodes_count);
+
+	if (divergentes)
+		printf("%u groups differ from their descriptors (*).\n", divergentes);
+
+	printf("\n%u groups scanned in %.3f s.\n", n, chrono::duration<double>(chrono::steady_clock::now() - inicio).count());
+}
+
+#define TAM_BUFFER_EXPORTACAO (1 << 20) // Buffer de cada thread na exportação: limita a memória e o tamanho das leituras
+
+// Arquivo a ser exportado para o host
+struct ArquivoExportado
+{
+	unsigned int inode; // Inode do arquivo na imagem
+	string destino;		// Caminho do arquivo no host
+};
+
+/* Copia o arquivo de Inode 'numInode' para o caminho 'destino' do host
+
+Blocos físicos contíguos são agrupados em leituras de até 'tamBuffer' bytes; buracos não são escritos e o tamanho final é
+ajustado com ftruncate. Preserva as permissões e a data de modificação. Retorna a quantidade de bytes copiados ou -1
+*/
+static long long exportaArquivo(unsigned int numInode, const char *destino, const vector<struct ext2_group_desc> &grupos, char *buffer, size_t tamBuffer)
+{
+	struct ext2_inode inode;
+
+	if (read_inode_by_number(numInode, grupos, &inode) < 0)
+		return -1;
+
+	unsigned long long tamanho = tamanhoInode(&inode);
+
+	if (S_ISLNK(inode.i_mode))
+	{
+		string alvo;
+
+		if (inode.i_blocks == 0)
+			alvo.assign((char *)inode.i_block, tamanho);
+		else
+		{
+			if (read_block(inode.i_block[0], buffer) < 0)
+				return -1;
+			alvo.assign(buffer, tamanho);
+		}
+
+		unlink(destino);
+		return symlink(alvo.c_str(), destino) < 0 ? -1 : (long long)tamanho;
+	}
+
+	int fdDestino = open(destino, O_WRONLY | O_CREAT | O_TRUNC, inode.i_mode & 0777);
+
+	if (fdDestino < 0)
+		return -1;
+
+	vector<unsigned int> blocos;
+	unsigned long maxBlocos = tamBuffer / block_size;
+	int status = resolve_block_map(&inode, blocos, NULL);
+
+	for (unsigned long i = 0; i < blocos.size() && status == 0;)
+	{
+		if (blocos[i] == 0) // Buraco
+		{
+			i++;
+			continue;
+		}
+
+		// Agrupa os blocos físicos contíguos a partir do bloco lógico i
+		unsigned long n = 1;
+
+		while (i + n < blocos.size() && n < maxBlocos && blocos[i + n] == blocos[i] + n)
+			n++;
+
+		unsigned long long offset = (unsigned long long)i * block_size;
+		size_t bytes = n * block_size;
+
+		if (offset + bytes > tamanho)
+			bytes = tamanho - offset;
+
+		if (read_image(buffer, bytes, BLOCK_OFFSET(blocos[i])) != (ssize_t)bytes ||
+			pwrite(fdDestino, buffer, bytes, offset) != (ssize_t)bytes)
+			status = -1;
+
+		i += n;
+	}
+
+	if (ftruncate(fdDestino, tamanho) < 0)
+		status = -1;
+
+	struct timespec tempos[2];
+	tempos[0].tv_sec = inode.i_atime;
+	tempos[0].tv_nsec = 0;
+	tempos[1].tv_sec = inode.i_mtime;
+	tempos[1].tv_nsec = 0;
+	futimens(fdDestino, tempos);
+
+	close(fdDestino);
+
+	return status < 0 ? -1 : (long long)tamanho;
+}
+
+/* Exporta recursivamente a entrada de nome 'nome' do diretório atual para o caminho 'destino' do host
+
+Primeiro percorre a subárvore criando todos os diretórios no host e listando os arquivos; depois copia os arquivos
+concorrentemente, com um buffer de tamanho fixo por thread
+*/
+void funct_export(struct ext2_inode *inode, struct ext2_group_desc *group, char *nome, char *destino)
+{
+	long numInode;
+	vector<struct ext2_group_desc> grupos;
+	vector<struct ArquivoExportado> arquivos;
+	vector<pair<unsigned int, string>> pilha; // Diretórios ainda não percorridos
+	unsigned long numDiretorios = 0;
+	auto inicio = chrono::steady_clock::now();
+
+	read_dir(inode, group, &numInode, nome);
+
+	if (numInode < 0)
+	{
+		printf("\nfile not found.\n");
+		return;
+	}
+
+	read_group_descs(grupos);
+
+	struct ext2_inode raiz;
+
+	if (read_inode_by_number(numInode, grupos, &raiz) < 0)
+	{
+		printf("\nfile not found.\n");
+		return;
+	}
+
+	if (S_ISDIR(raiz.i_mode))
+		pilha.push_back({(unsigned int)numInode, destino});
+	else
+		arquivos.push_back({(unsigned int)numInode, destino});
+
+	// Percorre a subárvore: cria os diretórios antecipadamente e coleta os arquivos
+	while (!pilha.empty())
+	{
+		auto atual = pilha.back();
+		pilha.pop_back();
+
+		struct ext2_inode dir;
+		vector<struct EntradaDir> entradas;
+
+		read_inode_by_number(atual.first, grupos, &dir);
+
+		if (mkdir(atual.second.c_str(), dir.i_mode & 0777) < 0 && errno != EEXIST)
+		{
+			perror(atual.second.c_str());
+			continue;
+		}
+
+		numDiretorios++;
+
+		if (le_entradas_diretorio(&dir, entradas) < 0)
+			printf("\n%s: corrupted directory.\n", atual.second.c_str());
+
+		for (auto &entrada : entradas)
+		{
+			if (entrada.nome == "." || entrada.nome == "..")
+				continue;
+
+			struct ext2_inode filho;
+			string caminho = atual.second + "/" + entrada.nome;
+
+			if (read_inode_by_number(entrada.inode, grupos, &filho) < 0)
+				continue;
+
+			if (S_ISDIR(filho.i_mode))
+				pilha.push_back({entrada.inode, caminho});
+			else if (S_ISREG(filho.i_mode) || S_ISLNK(filho.i_mode))
+				arquivos.push_back({entrada.inode, caminho});
+		}
+	}
+
+	// Copia os arquivos concorrentemente; cada thread reutiliza seu próprio buffer
+	atomic<unsigned long long> bytesCopiados(0);
+	atomic<unsigned long> falhas(0);
+
+	executaParalelo(arquivos.size(), [&](unsigned int i)
+					{
+		thread_local vector<char> buffer;
+
+		if (buffer.size() < TAM_BUFFER_EXPORTACAO)
+			buffer.resize(TAM_BUFFER_EXPORTACAO);
+
+		long long bytes = exportaArquivo(arquivos[i].inode, arquivos[i].destino.c_str(), grupos, buffer.data(), buffer.size());
+
+		if (bytes < 0)
+		{
+			fprintf(stderr, "%s: %s\n", arquivos[i].destino.c_str(), strerror(errno));
+			falhas++;
+		}
+		else
+			bytesCopiados += bytes; });
+
+	double segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+
+	printf("\n%lu directories, %lu files, %llu bytes exported in %.3f s.\n", numDiretorios,
+		   arquivos.size() - falhas.load(), bytesCopiados.load(), segundos);
+
+	if (falhas)
+		printf("%lu files could not be exported.\n", falhas.load());
+}
+
+/*
+ * Clone da imagem
+ *
+ * 'clone' copia para um arquivo do host apenas os blocos alocados segundo os bitmaps de blocos (o que inclui os metadados:
+ * Superblocos, descritores, bitmaps e tabelas de Inodes), mais os blocos anteriores ao primeiro grupo. O destino é um
+ * arquivo esparso do tamanho da imagem, em que os blocos livres e os blocos nulos ficam como buracos, e ao seu lado fica
+ * DESTINO.hashes, com o hash de cada bloco alocado.
+ * 'clone -d BASE DESTINO' compara os blocos alocados com BASE.hashes e grava em DESTINO somente as faixas de blocos
+ * alteradas; 'clone -a DIFERENCA ALVO' aplica a diferença sobre um clone.
+ */
+
+#define SUFIXO_HASHES ".hashes" // Tabela de hashes ao lado do clone ou da diferença
+#define MAGICA_HASHES "NX2HASH1"
+#define MAGICA_DIFERENCA "NX2DIFF1"
+
+// Cabeçalho da tabela de hashes e do arquivo de diferença
+struct CabecalhoClone
+{
+	char magica[8];
+	__u32 tamBloco;
+	__u32 numBlocos;
+	__u64 numFaixas; // Diferença: quantidade de faixas gravadas
+};
+
+// Faixa de blocos de um arquivo de diferença, seguida pelo conteúdo dos blocos
+struct FaixaDiferenca
+{
+	__u32 inicio;
+	__u32 quantidade;
+};
+
+// Hash de um bloco: FNV-1a sobre palavras de 64 bits, com os bits altos dobrados sobre os baixos. Nunca é 0, que marca os blocos livres
+static unsigned long long hashBloco(const char *dados)
+{
+	unsigned long long hash = 0xCBF29CE484222325ULL;
+
+	for (unsigned int i = 0; i < (unsigned int)block_size; i += 8)
+	{
+		unsigned long long palavra;
+
+		memcpy(&palavra, dados + i, sizeof(palavra));
+		hash = (hash ^ palavra) * 0x100000001B3ULL;
+		hash ^= hash >> 32;
+	}
+
+	return hash ? hash : 1;
+}
+
+// Escreve 'n' bytes de 'dados' em 'fdDestino', repetindo escritas parciais. Retorna -1 em caso de erro
+static int escreveTudo(int fdDestino, const void *dados, size_t n)
+{
+	const char *p = (const char *)dados;
+
+	while (n > 0)
+	{
+		ssize_t escritos = write(fdDestino, p, n);
+
+		if (escritos <= 0)
+			return -1;
+
+		p += escritos;
+		n -= escritos;
+	}
+
+	return 0;
+}
+
+// Grava a tabela de hashes 'hashes' em 'caminho'. Retorna -1 em caso de erro
+static int gravaHashes(const string &caminho, const vector<unsigned long long> &hashes)
+{
+	struct CabecalhoClone cab;
+	int fdHashes = open(caminho.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (fdHashes < 0)
+		return -1;
+
+	memset(&cab, 0, sizeof(cab));
+	memcpy(cab.magica, MAGICA_HASHES, sizeof(cab.magica));
+	cab.tamBloco = block_size;
+	cab.numBlocos = hashes.size();
+
+	int status = escreveTudo(fdHashes, &cab, sizeof(cab));
+
+	if (status == 0)
+		status = escreveTudo(fdHashes, hashes.data(), hashes.size() * sizeof(hashes[0]));
+
+	close(fdHashes);
+
+	return status;
+}
+
+// Lê a tabela de hashes de 'caminho' em 'hashes'. Retorna -1 se o arquivo não existe ou não é de uma imagem com a geometria atual
+static int leHashes(const string &caminho, vector<unsigned long long> &hashes)
+{
+	struct CabecalhoClone cab;
+	int fdHashes = open(caminho.c_str(), O_RDONLY);
+
+	if (fdHashes < 0)
+		return -1;
+
+	int status = -1;
+
+	if (read(fdHashes, &cab, sizeof(cab)) == sizeof(cab) && !memcmp(cab.magica, MAGICA_HASHES, sizeof(cab.magica)) &&
+		cab.tamBloco == (__u32)block_size && cab.numBlocos == super.s_blocks_count)
+	{
+		size_t bytes = (size_t)cab.numBlocos * sizeof(hashes[0]);
+
+		hashes.resize(cab.numBlocos);
+		status = (pread(fdHashes, hashes.data(), bytes, sizeof(cab)) == (ssize_t)bytes) ? 0 : -1;
+	}
+
+	close(fdHashes);
+
+	return status;
+}
+
+/* Copia a imagem para 'destino' (clone) ou grava em 'destino' as faixas alteradas desde o clone 'base' (diferença)
+
+Os grupos são percorridos em paralelo: cada thread lê o bitmap de blocos do grupo e lê as faixas de blocos alocados em
+leituras de até TAM_BUFFER_EXPORTACAO bytes, calculando o hash de cada bloco; no clone, os blocos não nulos de cada faixa
+são escritos na mesma posição do destino. Na diferença, os blocos cujo hash difere do da base são anotados por grupo e
+depois lidos de novo e gravados em ordem, unidos em faixas
+*/
+void funct_clone(const char *base, const char *destino)
+{
+	vector<struct ext2_group_desc> grupos;
+	vector<unsigned long long> hashes(super.s_blocks_count, 0), hashesBase;
+	unsigned int n = num_grupos;
+	auto inicio = chrono::steady_clock::now();
+
+	if (base && leHashes(string(base) + SUFIXO_HASHES, hashesBase) < 0)
+	{
+		printf("\n%s%s: not a hash table of this image.\n", base, SUFIXO_HASHES);
+		return;
+	}
+
+	int fdDestino = open(destino, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (fdDestino < 0)
+	{
+		perror(destino);
+		return;
+	}
+
+	// O clone tem o tamanho da imagem; os blocos livres ficam como buracos
+	if (!base && ftruncate(fdDestino, (off_t)super.s_blocks_count * block_size) < 0)
+	{
+		perror(destino);
+		close(fdDestino);
+		return;
+	}
+
+	read_group_descs(grupos);
+
+	vector<vector<unsigned int>> alterados(n + 1); // Por grupo; o último guarda os blocos anteriores ao primeiro grupo
+	atomic<unsigned long> blocosAlocados(0);
+	atomic<unsigned long> falhas(0);
+
+	// Lê e calcula o hash de 'quantidade' blocos a partir de 'bloco', copiando-os (clone) ou anotando os alterados em 'lista'
+	auto processaFaixa = [&](unsigned long bloco, unsigned long quantidade, vector<char> &buffer, vector<unsigned int> &lista)
+	{
+		unsigned long maxBlocos = buffer.size() / block_size;
+
+		blocosAlocados += quantidade;
+
+		for (unsigned long i = 0; i < quantidade;)
+		{
+			unsigned long k = min(maxBlocos, quantidade - i);
+			size_t bytes = k * block_size;
+
+			if (read_image(buffer.data(), bytes, BLOCK_OFFSET(bloco + i)) != (ssize_t)bytes)
+			{
+				falhas++;
+				memset(buffer.data(), 0, bytes);
+			}
+
+			unsigned long escritos = 0; // Blocos do buffer já escritos ou deixados como buraco
+
+			for (unsigned long j = 0; j <= k; j++)
+			{
+				unsigned long atual = bloco + i + j;
+				int nulo = (j == k) || blocoNulo(buffer.data() + j * block_size, block_size);
+
+				if (j < k)
+				{
+					hashes[atual] = hashBloco(buffer.data() + j * block_size);
+
+					if (base && hashes[atual] != hashesBase[atual])
+						lista.push_back(atual);
+				}
+
+				// No clone, os blocos não nulos consecutivos são escritos juntos; os nulos ficam como buracos
+				if (!base && nulo)
+				{
+					size_t trecho = (j - escritos) * block_size;
+
+					if (trecho && pwrite(fdDestino, buffer.data() + escritos * block_size, trecho, BLOCK_OFFSET(bloco + i + escritos)) != (ssize_t)trecho)
+						falhas++;
+
+					escritos = j + 1;
+				}
+			}
+
+			i += k;
+		}
+	};
+
+	executaParalelo(n + 1, [&](unsigned int g)
+					{
+						thread_local vector<char> buffer;
+
+						if (buffer.size() < TAM_BUFFER_EXPORTACAO)
+							buffer.resize(TAM_BUFFER_EXPORTACAO);
+
+						if (g == n)
+						{
+							if (super.s_first_data_block)
+								processaFaixa(0, super.s_first_data_block, buffer, alterados[g]);
+							return;
+						}
+
+						vector<unsigned char> bitmap(block_size);
+						unsigned long primeiro = super.s_first_data_block + (unsigned long)g * super.s_blocks_per_group;
+						unsigned long total = blocosNoGrupo(g), usados = 0; // usados: início da faixa alocada em andamento
+
+						read_block(grupos[g].bg_block_bitmap, bitmap.data());
+
+						// As faixas alocadas são os intervalos entre as faixas livres
+						percorreFaixasLivres(bitmap.data(), total, [&](unsigned long livre, unsigned long tamanho)
+											 {
+												 if (livre > usados)
+													 processaFaixa(primeiro + usados, livre - usados, buffer, alterados[g]);
+												 usados = livre + tamanho; });
+
+						if (total > usados)
+							processaFaixa(primeiro + usados, total - usados, buffer, alterados[g]); });
+
+	unsigned long blocosGravados = blocosAlocados, numFaixas = 0;
+
+	// Diferença: as faixas alteradas, em ordem de bloco, cada uma precedida por seu início e quantidade
+	if (base)
+	{
+		struct CabecalhoClone cab;
+		vector<char> buffer(TAM_BUFFER_EXPORTACAO);
+		vector<unsigned int> blocos;
+		unsigned long maxBlocos = buffer.size() / block_size;
+
+		blocos.insert(blocos.end(), alterados[n].begin(), alterados[n].end());
+
+		for (unsigned int g = 0; g < n; g++)
+			blocos.insert(blocos.end(), alterados[g].begin(), alterados[g].end());
+
+		memset(&cab, 0, sizeof(cab));
+		memcpy(cab.magica, MAGICA_DIFERENCA, sizeof(cab.magica));
+		cab.tamBloco = block_size;
+		cab.numBlocos = super.s_blocks_count;
+
+		if (escreveTudo(fdDestino, &cab, sizeof(cab)) < 0)
+			falhas++;
+
+		for (size_t i = 0; i < blocos.size() && !falhas;)
+		{
+			struct FaixaDiferenca faixa;
+			size_t k = 1;
+
+			while (i + k < blocos.size() && k < maxBlocos && blocos[i + k] == blocos[i] + k)
+				k++;
+
+			faixa.inicio = blocos[i];
+			faixa.quantidade = k;
+
+			if (read_image(buffer.data(), k * block_size, BLOCK_OFFSET(blocos[i])) != (ssize_t)(k * block_size) ||
+				escreveTudo(fdDestino, &faixa, sizeof(faixa)) < 0 || escreveTudo(fdDestino, buffer.data(), k * block_size) < 0)
+				falhas++;
+
+			numFaixas++;
+			i += k;
+		}
+
+		cab.numFaixas = numFaixas;
+
+		if (pwrite(fdDestino, &cab, sizeof(cab), 0) != sizeof(cab))
+			falhas++;
+
+		blocosGravados = blocos.size();
+	}
+
+	close(fdDestino);
+
+	if (falhas || gravaHashes(string(destino) + SUFIXO_HASHES, hashes) < 0)
+	{
+		printf("\n%s: write failed.\n", destino);
+		return;
+	}
+
+	double segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+
+	if (base)
+		printf("\n%lu of %lu allocated blocks changed, %lu extents (%llu bytes) written to %s in %.3f s.\n", blocosGravados,
+			   blocosAlocados.load(), numFaixas, (unsigned long long)blocosGravados * block_size, destino, segundos);
+	else
+		printf("\n%lu of %u blocks copied (%llu bytes) to %s in %.3f s.\n", blocosGravados, super.s_blocks_count,
+			   (unsigned long long)blocosGravados * block_size, destino, segundos);
+}
+
+// Aplica a diferença 'diferenca' sobre o clone 'alvo', que passa a ter a tabela de hashes da diferença
+void funct_clone_aplica(const char *diferenca, const char *alvo)
+{
+	struct CabecalhoClone cab;
+	struct stat info;
+	auto inicio = chrono::steady_clock::now();
+	int fdDiferenca = open(diferenca, O_RDONLY);
+
+	if (fdDiferenca < 0)
+	{
+		perror(diferenca);
+		return;
+	}
+
+	int fdAlvo = open(alvo, O_WRONLY);
+
+	if (fdAlvo < 0)
+	{
+		perror(alvo);
+		close(fdDiferenca);
+		return;
+	}
+
+	if (read(fdDiferenca, &cab, sizeof(cab)) != sizeof(cab) || memcmp(cab.magica, MAGICA_DIFERENCA, sizeof(cab.magica)) ||
+		fstat(fdAlvo, &info) < 0 || info.st_size != (off_t)cab.numBlocos * cab.tamBloco)
+	{
+		printf("\n%s: not a diff of %s.\n", diferenca, alvo);
+		close(fdDiferenca);
+		close(fdAlvo);
+		return;
+	}
+
+	vector<char> buffer;
+	unsigned long blocos = 0;
+	int status = 0;
+
+	for (unsigned long i = 0; i < cab.numFaixas && status == 0; i++)
+	{
+		struct FaixaDiferenca faixa;
+
+		if (read(fdDiferenca, &faixa, sizeof(faixa)) != sizeof(faixa) || (unsigned long)faixa.inicio + faixa.quantidade > cab.numBlocos)
+		{
+			status = -1;
+			break;
+		}
+
+		size_t bytes = (size_t)faixa.quantidade * cab.tamBloco;
+
+		if (buffer.size() < bytes)
+			buffer.resize(bytes);
+
+		if (read(fdDiferenca, buffer.data(), bytes) != (ssize_t)bytes ||
+			pwrite(fdAlvo, buffer.data(), bytes, (off_t)faixa.inicio * cab.tamBloco) != (ssize_t)bytes)
+			status = -1;
+
+		blocos += faixa.quantidade;
+	}
+
+	close(fdDiferenca);
+	close(fdAlvo);
+
+	// A tabela de hashes da diferença descreve o alvo atualizado
+	vector<char> tabela;
+	string origemHashes = string(diferenca) + SUFIXO_HASHES;
+	int fdHashes = open(origemHashes.c_str(), O_RDONLY);
+
+	if (status == 0 && fdHashes >= 0 && fstat(fdHashes, &info) == 0)
+	{
+		tabela.resize(info.st_size);
+
+		if (pread(fdHashes, tabela.data(), tabela.size(), 0) != (ssize_t)tabela.size())
+			status = -1;
+	}
+	else
+		status = -1;
+
+	if (fdHashes >= 0)
+		close(fdHashes);
+
+	if (status == 0)
+	{
+		string destinoHashes = string(alvo) + SUFIXO_HASHES;
+		int fdDestino = open(destinoHashes.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+		if (fdDestino < 0 || escreveTudo(fdDestino, tabela.data(), tabela.size()) < 0)
+			status = -1;
+
+		if (fdDestino >= 0)
+			close(fdDestino);
+	}
+
+	if (status < 0)
+	{
+		printf("\n%s: corrupted diff.\n", diferenca);
+		return;
+	}
+
+	printf("\n%lu blocks in %lu extents applied to %s in %.3f s.\n", blocos, (unsigned long)cab.numFaixas, alvo,
+		   chrono::duration<double>(chrono::steady_clock::now() - inicio).count());
+}
+
+// Arquivo ou diretório do host a ser importado
+struct NoImportado
+{
+	string origem;			   // Caminho no host
+	string nome;			   // Nome da entrada na imagem
+	struct stat info;		   // Atributos do host
+	int pai;				   // Índice do diretório pai em 'nos' (-1 para a raiz da importação)
+	vector<int> filhos;		   // Índices dos filhos (apenas diretórios)
+	unsigned int inode;		   // Inode planejado
+	vector<unsigned int> blocos; // Blocos planejados, na ordem em que são consumidos pelo mapa de blocos
+	string alvo;			   // Destino, se for um link simbólico
+	vector<char> presentes;	   // Blocos lógicos com dados de um arquivo esparso (vazio se todos têm dados)
+};
+
+// Bloco de metadados (indireção ou diretório) montado em memória para ser escrito em lote
+struct BlocoPlanejado
+{
+	unsigned int bloco;
+	vector<char> dados;
+};
+
+// Estado do planejamento de alocação da importação, com os bitmaps de todos os grupos em memória
+struct PlanoAlocacao
+{
+	vector<struct ext2_group_desc> grupos;
+	vector<vector<unsigned char>> bitmapsBlocos;
+	vector<vector<unsigned char>> bitmapsInodes;
+	vector<unsigned long> cursorBlocos; // Próximo bit a examinar no bitmap de blocos de cada grupo
+	vector<unsigned int> blocosUsados;	// Blocos alocados pela importação em cada grupo
+	vector<unsigned int> inodesUsados;	// Inodes alocados pela importação em cada grupo
+	vector<unsigned int> diretoriosCriados;
+	unsigned int proximoGrupoDiretorio; // Distribui os diretórios entre os grupos
+};
+
+// Percorre recursivamente o diretório 'origem' do host, acrescentando seus filhos a 'nos'. Retorna -1 em caso de erro
+static int listaArvoreHost(vector<struct NoImportado> &nos, int indice)
+{
+	string origem = nos[indice].origem;
+	DIR *dir = opendir(origem.c_str());
+
+	if (!dir)
+	{
+		perror(origem.c_str());
+		return -1;
+	}
+
+	struct dirent *ent;
+	vector<string> nomes;
+
+	while ((ent = readdir(dir)) != NULL)
+	{
+		if (strcmp(ent->d_name, ".") && strcmp(ent->d_name, ".."))
+			nomes.push_back(ent->d_name);
+	}
+
+	closedir(dir);
+
+	for (auto &nome : nomes)
+	{
+		struct NoImportado no;
+
+		no.origem = origem + "/" + nome;
+		no.nome = nome;
+		no.pai = indice;
+		no.inode = 0;
+
+		if (nome.size() > EXT2_NAME_LEN || lstat(no.origem.c_str(), &no.info) < 0)
+		{
+			fprintf(stderr, "%s: skipped.\n", no.origem.c_str());
+			continue;
+		}
+
+		if (!S_ISDIR(no.info.st_mode) && !S_ISREG(no.info.st_mode) && !S_ISLNK(no.info.st_mode))
+			continue;
+
+		if (S_ISLNK(no.info.st_mode))
+		{
+			char alvo[PATH_MAX];
+			ssize_t tamAlvo = readlink(no.origem.c_str(), alvo, sizeof(alvo));
+
+			no.alvo.assign(alvo, tamAlvo > 0 ? tamAlvo : 0);
+		}
+
+		nos.push_back(no);
+		nos[indice].filhos.push_back(nos.size() - 1);
+
+		if (S_ISDIR(no.info.st_mode) && listaArvoreHost(nos, nos.size() - 1) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+// Retorna quantos blocos de indireção são necessários para mapear 'numDados' blocos de dados
+static unsigned long blocosIndiretosNecessarios(unsigned long numDados)
+{
+	unsigned long porBloco = block_size / sizeof(__u32);
+	unsigned long total = 0;
+	unsigned long cobertura = 1;
+
+	numDados = (numDados > EXT2_NDIR_BLOCKS) ? numDados - EXT2_NDIR_BLOCKS : 0;
+
+	for (int nivel = 1; nivel <= 3 && numDados > 0; nivel++)
+	{
+		cobertura *= porBloco;
+
+		unsigned long nesteNivel = (numDados < cobertura) ? numDados : cobertura;
+		unsigned long folhas = nesteNivel;
+
+		// Blocos de indireção de cada nível da subárvore
+		for (int k = 0; k < nivel; k++)
+		{
+			folhas = (folhas + porBloco - 1) / porBloco;
+			total += folhas;
+		}
+
+		numDados -= nesteNivel;
+	}
+
+	return total;
+}
+
+// Retorna 1 se algum dos 'n' blocos lógicos a partir de 'inicio' de 'presentes' tem dados (um mapa nulo indica um arquivo sem buracos)
+static int temDados(const vector<char> *presentes, unsigned long inicio, unsigned long n)
+{
+	if (!presentes)
+		return 1;
+
+	if (inicio >= presentes->size())
+		return 0;
+
+	return memchr(presentes->data() + inicio, 1, min(n, presentes->size() - inicio)) != NULL;
+}
+
+// Retorna quantos blocos lógicos um bloco de indireção de nível 'nivel' mapeia
+static unsigned long coberturaIndirecao(int nivel)
+{
+	unsigned long cobertura = 1;
+
+	for (int i = 0; i < nivel; i++)
+		cobertura *= block_size / sizeof(__u32);
+
+	return cobertura;
+}
+
+// Conta os blocos de indireção de nível 'nivel' e abaixo necessários para a subárvore esparsa que começa no bloco lógico 'inicio'
+static unsigned long contaIndiretosEsparsos(const vector<char> &presentes, int nivel, unsigned long inicio)
+{
+	unsigned long cobertura = coberturaIndirecao(nivel);
+	unsigned long total;
+
+	if (!temDados(&presentes, inicio, cobertura))
+		return 0;
+
+	total = 1;
+
+	for (unsigned long filho = inicio; nivel > 1 && filho < presentes.size() && filho < inicio + cobertura; filho += cobertura / (block_size / sizeof(__u32)))
+		total += contaIndiretosEsparsos(presentes, nivel - 1, filho);
+
+	return total;
+}
+
+/* Retorna quantos blocos de indireção são necessários para mapear os blocos com dados de 'presentes': subárvores
+sem dados ficam com ponteiro nulo e não ocupam blocos
+*/
+static unsigned long blocosIndiretosEsparsos(const vector<char> &presentes)
+{
+	unsigned long total = 0;
+	unsigned long inicio = EXT2_NDIR_BLOCKS;
+
+	for (int nivel = 1; nivel <= 3 && inicio < presentes.size(); nivel++)
+	{
+		total += contaIndiretosEsparsos(presentes, nivel, inicio);
+		inicio += coberturaIndirecao(nivel);
+	}
+
+	return total;
+}
+
+/* Constrói em memória o bloco de indireção de nível 'nivel', consumindo blocos de 'proximo' na mesma ordem
+usada por blocosIndiretosNecessarios: o bloco de indireção antecede os blocos que mapeia
+
+presentes: se não for nulo, os blocos lógicos sem dados (e as subárvores inteiras sem dados) ficam com ponteiro
+nulo e não consomem blocos; 'restantes' indica então a posição em 'presentes'
+Retorna o bloco de indireção, ou 0 se a subárvore não tem dados
+*/
+static unsigned int constroiIndirecao(int nivel, unsigned long *restantes, const unsigned int **proximo,
+									  vector<struct BlocoPlanejado> &indiretos, vector<unsigned int> &dados,
+									  const vector<char> *presentes)
+{
+	unsigned long porBloco = block_size / sizeof(__u32);
+	unsigned long logico = presentes ? presentes->size() - *restantes : 0;
+
+	if (!temDados(presentes, logico, coberturaIndirecao(nivel)))
+	{
+		unsigned long pular = min(*restantes, coberturaIndirecao(nivel));
+
+		dados.insert(dados.end(), pular, 0);
+		*restantes -= pular;
+		return 0;
+	}
+
+	unsigned int bloco = *(*proximo)++;
+	size_t indice = indiretos.size();
+
+	indiretos.push_back({bloco, vector<char>(block_size, 0)});
+
+	for (unsigned long i = 0; i < porBloco && *restantes > 0; i++)
+	{
+		unsigned int ponteiro;
+
+		if (nivel == 1)
+		{
+			ponteiro = temDados(presentes, logico + i, 1) ? *(*proximo)++ : 0;
+			dados.push_back(ponteiro);
+			(*restantes)--;
+		}
+		else
+			ponteiro = constroiIndirecao(nivel - 1, restantes, proximo, indiretos, dados, presentes);
+
+		((__u32 *)indiretos[indice].dados.data())[i] = ponteiro;
+	}
+
+	return bloco;
+}
+
+/* Preenche i_block de 'inode' a partir dos blocos planejados, acrescentando os blocos de indireção a 'indiretos' e os de dados a 'dados'
+
+presentes: se não for nulo, os blocos lógicos sem dados viram buracos (0 em 'dados'), como em constroiIndirecao
+*/
+static void montaMapaBlocos(struct ext2_inode *inode, const vector<unsigned int> &blocos, unsigned long numDados,
+							vector<struct BlocoPlanejado> &indiretos, vector<unsigned int> &dados,
+							const vector<char> *presentes = NULL)
+{
+	const unsigned int *proximo = blocos.data();
+	unsigned long restantes = numDados;
+
+	for (int i = 0; i < EXT2_NDIR_BLOCKS && restantes > 0; i++, restantes--)
+	{
+		inode->i_block[i] = temDados(presentes, i, 1) ? *proximo++ : 0;
+		dados.push_back(inode->i_block[i]);
+	}
+
+	for (int nivel = 1; nivel <= 3 && restantes > 0; nivel++)
+		inode->i_block[EXT2_IND_BLOCK + nivel - 1] = constroiIndirecao(nivel, &restantes, &proximo, indiretos, dados, presentes);
+}
+
+/* Distribui as entradas 'entradas' em blocos de diretório, sem que nenhuma cruze o limite de um bloco;
+a última entrada de cada bloco estende seu rec_len até o fim do bloco
+
+saida: se não for nulo, recebe o conteúdo dos blocos
+Retorna a quantidade de blocos necessária
+*/
+static unsigned long empacotaEntradas(const vector<struct EntradaDir> &entradas, vector<char> *saida)
+{
+	unsigned long numBlocos = 1;
+	unsigned int offset = 0;
+	long anterior = -1; // Offset absoluto da entrada anterior
+
+	if (saida)
+		saida->assign(block_size, 0);
+
+	for (auto &entrada : entradas)
+	{
+		unsigned int tamanho = tamanhoEntrada(entrada.nome.size());
+
+		if (offset + tamanho > (unsigned int)block_size)
+		{
+			if (saida)
+			{
+				estendeRegistro((struct ext2_dir_entry_2 *)(saida->data() + anterior), block_size - offset);
+				saida->resize((numBlocos + 1) * block_size, 0);
+			}
+			numBlocos++;
+			offset = 0;
+		}
+
+		if (saida)
+		{
+			anterior = (numBlocos - 1) * block_size + offset;
+
+			struct ext2_dir_entry_2 *entry = (struct ext2_dir_entry_2 *)(saida->data() + anterior);
+			entry->inode = entrada.inode;
+			entry->rec_len = rec_len_to_disk(tamanho);
+			entry->name_len = entrada.nome.size();
+			entry->file_type = entrada.tipo;
+			memcpy(entry->name, entrada.nome.data(), entrada.nome.size());
+		}
+
+		offset += tamanho;
+	}
+
+	if (saida && anterior >= 0)
+		estendeRegistro((struct ext2_dir_entry_2 *)(saida->data() + anterior), block_size - offset);
+
+	return numBlocos;
+}
+
+// Carrega no plano os descritores e os bitmaps de todos os grupos. Novos diretórios começam a ser distribuídos a partir de 'grupoInicial'
+static void carregaPlano(struct PlanoAlocacao *plano, unsigned int grupoInicial)
+{
+	unsigned int n = num_grupos;
+
+	read_group_descs(plano->grupos);
+	plano->bitmapsBlocos.assign(n, vector<unsigned char>(block_size));
+	plano->bitmapsInodes.assign(n, vector<unsigned char>(block_size));
+	plano->cursorBlocos.assign(n, 0);
+	plano->blocosUsados.assign(n, 0);
+	plano->inodesUsados.assign(n, 0);
+	plano->diretoriosCriados.assign(n, 0);
+	plano->proximoGrupoDiretorio = grupoInicial;
+
+	for (unsigned int g = 0; g < n; g++)
+	{
+		read_block(plano->grupos[g].bg_block_bitmap, plano->bitmapsBlocos[g].data());
+		read_block(plano->grupos[g].bg_inode_bitmap, plano->bitmapsInodes[g].data());
+	}
+}
+
+/* Grava as alocações do plano: bitmaps modificados, tabela de descritores inteira e Superbloco
+
+blocosTotal, inodesTotal: recebem a quantidade de blocos e Inodes alocados
+*/
+static void gravaPlano(struct PlanoAlocacao *plano, unsigned long *blocosTotal, unsigned long *inodesTotal)
+{
+	*blocosTotal = 0;
+	*inodesTotal = 0;
+
+	for (unsigned int g = 0; g < plano->grupos.size(); g++)
+	{
+		if (plano->blocosUsados[g])
+		{
+			write_block(plano->grupos[g].bg_block_bitmap, plano->bitmapsBlocos[g].data());
+			indexaGrupoLivre(g, plano->bitmapsBlocos[g].data());
+		}
+		if (plano->inodesUsados[g])
+			write_block(plano->grupos[g].bg_inode_bitmap, plano->bitmapsInodes[g].data());
+
+		plano->grupos[g].bg_free_blocks_count -= plano->blocosUsados[g];
+		plano->grupos[g].bg_free_inodes_count -= plano->inodesUsados[g];
+		plano->grupos[g].bg_used_dirs_count += plano->diretoriosCriados[g];
+
+		*blocosTotal += plano->blocosUsados[g];
+		*inodesTotal += plano->inodesUsados[g];
+	}
+
+	write_image(plano->grupos.data(), sizeof(struct ext2_group_desc) * plano->grupos.size(), GDT_OFFSET);
+
+	super.s_free_blocks_count -= *blocosTotal;
+	super.s_free_inodes_count -= *inodesTotal;
+	write_image(&super, sizeof(struct ext2_super_block), BASE_OFFSET);
+}
+
+// Aloca no plano um Inode livre, começando pelo grupo 'grupo'. Retorna o número do Inode ou 0 se não há Inodes livres
+static unsigned int planejaInode(struct PlanoAlocacao *plano, unsigned int grupo)
+{
+	unsigned int n = plano->grupos.size();
+
+	for (unsigned int k = 0; k < n; k++)
+	{
+		unsigned int g = (grupo + k) % n;
+
+		if (plano->grupos[g].bg_free_inodes_count <= plano->inodesUsados[g])
+			continue;
+
+		for (unsigned int i = 0; i < super.s_inodes_per_group; i++)
+		{
+			if (!testaBit(plano->bitmapsInodes[g].data(), i))
+			{
+				plano->bitmapsInodes[g][i / 8] |= 0x1 << (i % 8);
+				plano->inodesUsados[g]++;
+				conta(CONT_SONDAGENS, i + 1);
+				return g * super.s_inodes_per_group + i + 1;
+			}
+		}
+
+		conta(CONT_SONDAGENS, super.s_inodes_per_group);
+	}
+
+	return 0;
+}
+
+// Escolhe o grupo de um novo diretório, alternando entre os grupos que ainda possuem Inodes e blocos livres
+static unsigned int grupoParaDiretorio(struct PlanoAlocacao *plano)
+{
+	unsigned int n = plano->grupos.size();
+
+	for (unsigned int k = 0; k < n; k++)
+	{
+		unsigned int g = (plano->proximoGrupoDiretorio + k) % n;
+
+		if (plano->grupos[g].bg_free_inodes_count > plano->inodesUsados[g] &&
+			plano->grupos[g].bg_free_blocks_count > plano->blocosUsados[g])
+		{
+			plano->proximoGrupoDiretorio = g + 1;
+			return g;
+		}
+	}
+
+	return 0;
+}
+
+// Aloca no plano o Inode de um novo diretório, no grupo escolhido por grupoParaDiretorio. Retorna 0 se não há Inodes livres
+static unsigned int planejaInodeDiretorio(struct PlanoAlocacao *plano)
+{
+	unsigned int numInode = planejaInode(plano, grupoParaDiretorio(plano));
+
+	if (numInode)
+		plano->diretoriosCriados[(numInode - 1) / super.s_inodes_per_group]++;
+
+	return numInode;
+}
+
+// Aloca no plano 'quantidade' blocos, preferencialmente contíguos e no grupo 'grupo'. Retorna -1 se não há blocos suficientes
+static int planejaBlocos(struct PlanoAlocacao *plano, unsigned int grupo, unsigned long quantidade, vector<unsigned int> &blocos)
+{
+	unsigned int n = plano->grupos.size();
+
+	for (unsigned int k = 0; k < n && quantidade > 0; k++)
+	{
+		unsigned int g = (grupo + k) % n;
+		unsigned long total = blocosNoGrupo(g);
+		unsigned long &cursor = plano->cursorBlocos[g];
+		unsigned char *bitmap = plano->bitmapsBlocos[g].data();
+		unsigned long sondagens = 0;
+
+		while (cursor < total && quantidade > 0)
+		{
+			sondagens++;
+
+			// Pula bytes completamente ocupados
+			if (cursor % 8 == 0 && bitmap[cursor / 8] == 0xFF)
+			{
+				cursor += 8;
+				continue;
+			}
+
+			if (!testaBit(bitmap, cursor))
+			{
+				bitmap[cursor / 8] |= 0x1 << (cursor % 8);
+				blocos.push_back(super.s_first_data_block + g * super.s_blocks_per_group + cursor);
+				plano->blocosUsados[g]++;
+				quantidade--;
+			}
+
+			cursor++;
+		}
+
+		conta(CONT_SONDAGENS, sondagens);
+	}
+
+	return quantidade ? -1 : 0;
+}
+
+/* Aloca no plano 'quantidade' blocos em faixas contíguas: a faixa livre que começa em 'alvo' (se não for zero), se
+comportar todos os blocos, ou a menor faixa que os comporta no grupo 'grupo' e, depois, em todo o sistema; sem uma faixa
+suficiente, as maiores faixas livres são usadas, da maior para a menor
+
+As faixas candidatas vêm do índice de faixas livres, e os bitmaps do plano só são examinados dentro delas (os blocos
+livres no plano também estão livres em disco). Sem o índice, os grupos são varridos a partir de 'grupo' e a primeira
+faixa suficiente é usada
+
+Retorna -1 se não há blocos suficientes (o plano fica parcialmente alterado)
+*/
+static int planejaBlocosContiguos(struct PlanoAlocacao *plano, unsigned int grupo, unsigned int alvo, unsigned long quantidade, vector<unsigned int> &blocos)
+{
+	unsigned int n = plano->grupos.size();
+
+	while (quantidade > 0)
+	{
+		unsigned int melhorGrupo = 0;
+		unsigned long melhorInicio = 0, melhorTamanho = 0;
+
+		// Mede a faixa livre que começa em 'inicio' no grupo 'g', limitada a 'quantidade' blocos
+		auto mede = [&](unsigned int g, unsigned long inicio)
+		{
+			unsigned long total = blocosNoGrupo(g), fim = inicio;
+			unsigned char *bitmap = plano->bitmapsBlocos[g].data();
+
+			while (fim < total && fim - inicio < quantidade)
+			{
+				if (fim % 8 == 0 && fim + 8 <= total && fim + 8 - inicio <= quantidade && bitmap[fim / 8] == 0)
+					fim += 8;
+				else if (!testaBit(bitmap, fim))
+					fim++;
+				else
+					break;
+			}
+
+			conta(CONT_SONDAGENS, (fim - inicio) / 8 + 1);
+
+			if (fim - inicio > melhorTamanho)
+			{
+				melhorGrupo = g;
+				melhorInicio = inicio;
+				melhorTamanho = fim - inicio;
+			}
+
+			return fim;
+		};
+
+		// Procura no plano a maior faixa livre entre os bits [inicio, fim) do grupo 'g'
+		auto examina = [&](unsigned int g, unsigned long inicio, unsigned long fim)
+		{
+			unsigned char *bitmap = plano->bitmapsBlocos[g].data();
+
+			for (unsigned long bit = inicio; bit < fim && melhorTamanho < quantidade;)
+			{
+				// Pula bytes completamente ocupados
+				if (bit % 8 == 0 && bitmap[bit / 8] == 0xFF)
+					bit += 8;
+				else if (testaBit(bitmap, bit))
+					bit++;
+				else
+					bit = mede(g, bit);
+			}
+		};
+
+		if (alvo >= super.s_first_data_block && alvo < super.s_blocks_count)
+			mede((alvo - super.s_first_data_block) / super.s_blocks_per_group, (alvo - super.s_first_data_block) % super.s_blocks_per_group);
+
+		if (indiceLivres.valido && indiceLivres.porInicio.size() == n)
+		{
+			auto &doGrupo = indiceLivres.porTamanho[grupo % n];
+			auto &global = indiceLivres.global;
+
+			for (auto it = doGrupo.lower_bound(make_pair(quantidade, 0ul)); it != doGrupo.end() && melhorTamanho < quantidade; ++it)
+				examina(grupo % n, it->second, it->second + it->first);
+
+			for (auto it = global.lower_bound(make_tuple(quantidade, 0u, 0ul)); it != global.end() && melhorTamanho < quantidade; ++it)
+				examina(get<1>(*it), get<2>(*it), get<2>(*it) + get<0>(*it));
+
+			// Nenhuma faixa comporta o pedido: as maiores, até que a faixa não possa superar a melhor já encontrada
+			for (auto it = global.rbegin(); it != global.rend() && get<0>(*it) > melhorTamanho && melhorTamanho < quantidade; ++it)
+				examina(get<1>(*it), get<2>(*it), get<2>(*it) + get<0>(*it));
+		}
+		else
+		{
+			for (unsigned int k = 0; k < n && melhorTamanho < quantidade; k++)
+			{
+				unsigned int g = (grupo + k) % n;
+
+				if (plano->grupos[g].bg_free_blocks_count <= plano->blocosUsados[g])
+					continue;
+
+				examina(g, 0, blocosNoGrupo(g));
+			}
+		}
+
+		if (melhorTamanho == 0)
+			return -1;
+
+		for (unsigned long bit = melhorInicio; bit < melhorInicio + melhorTamanho; bit++)
+		{
+			plano->bitmapsBlocos[melhorGrupo][bit / 8] |= 0x1 << (bit % 8);
+			blocos.push_back(super.s_first_data_block + melhorGrupo * super.s_blocks_per_group + bit);
+		}
+
+		plano->blocosUsados[melhorGrupo] += melhorTamanho;
+		quantidade -= melhorTamanho;
+		alvo = 0;
+	}
+
+	return 0;
+}
+
+// Desfaz no plano a alocação dos 'n' blocos de 'blocos'
+static void devolveBlocosPlano(struct PlanoAlocacao *plano, const unsigned int *blocos, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		unsigned int bloco = blocos[i] - super.s_first_data_block;
+		unsigned int g = bloco / super.s_blocks_per_group;
+		unsigned long bit = bloco % super.s_blocks_per_group;
+
+		plano->bitmapsBlocos[g][bit / 8] &= ~(0x1 << (bit % 8));
+		plano->blocosUsados[g]--;
+	}
+}
+
+// Copia o conteúdo do arquivo do host 'origem' para os blocos de dados 'dados', agrupando blocos contíguos em escritas grandes
+static int importaDadosArquivo(const char *origem, const vector<unsigned int> &dados, unsigned long long tamanho, char *buffer, size_t tamBuffer)
+{
+	int fdOrigem = open(origem, O_RDONLY);
+
+	if (fdOrigem < 0)
+		return -1;
+
+	unsigned long maxBlocos = tamBuffer / block_size;
+	int status = 0;
+
+	for (unsigned long i = 0; i < dados.size() && status == 0;)
+	{
+		unsigned long n = 1;
+
+		if (dados[i] == 0) // Buraco: o bloco nulo não foi alocado
+		{
+			i++;
+			continue;
+		}
+
+		while (i + n < dados.size() && n < maxBlocos && dados[i + n] == dados[i] + n)
+			n++;
+
+		unsigned long long offset = (unsigned long long)i * block_size;
+		size_t bytes = n * block_size;
+		size_t lidos = (offset + bytes > tamanho) ? tamanho - offset : bytes;
+
+		// O final do último bloco é preenchido com zeros
+		memset(buffer + lidos, 0, bytes - lidos);
+
+		if (pread(fdOrigem, buffer, lidos, offset) != (ssize_t)lidos ||
+			pwriteContado(fd, buffer, bytes, BLOCK_OFFSET(dados[i])) != (ssize_t)bytes)
+			status = -1;
+
+		i += n;
+	}
+
+	close(fdOrigem);
+
+	return status;
+}
+
+/* Marca em 'presentes' os blocos lógicos do arquivo do host 'origem' que têm algum byte não nulo
+
+Os buracos do próprio arquivo no host são pulados com SEEK_DATA/SEEK_HOLE, sem leitura; os trechos com dados são lidos
+e verificados bloco a bloco por blocoNulo. 'presentes' fica vazio se todos os blocos têm dados
+Retorna -1 se o arquivo não pode ser lido
+*/
+static int mapeiaBlocosComDados(const char *origem, unsigned long long tamanho, vector<char> &presentes, char *buffer, size_t tamBuffer)
+{
+	int fdOrigem = open(origem, O_RDONLY);
+	unsigned long long offset = 0;
+	int status = 0;
+
+	if (fdOrigem < 0)
+		return -1;
+
+	presentes.assign((tamanho + block_size - 1) / block_size, 0);
+
+	while (offset < tamanho && status == 0)
+	{
+		off_t dado = lseek(fdOrigem, offset, SEEK_DATA);
+
+		if (dado < 0 && errno == ENXIO) // Só há buraco até o fim
+			break;
+
+		if (dado < 0) // Sem suporte a SEEK_DATA: todo o restante é examinado
+			dado = offset;
+
+		off_t buraco = lseek(fdOrigem, dado, SEEK_HOLE);
+		unsigned long long fim = (buraco < 0 || (unsigned long long)buraco > tamanho) ? tamanho : buraco;
+
+		// Examina os blocos que cobrem [dado, fim), em leituras de até tamBuffer bytes
+		for (unsigned long long pos = dado / block_size * block_size; pos < fim && status == 0;)
+		{
+			size_t bytes = min<unsigned long long>(tamBuffer, min<unsigned long long>((fim + block_size - 1) / block_size * block_size, tamanho) - pos);
+			ssize_t lidos = pread(fdOrigem, buffer, bytes, pos);
+
+			if (lidos <= 0)
+			{
+				status = -1;
+				break;
+			}
+
+			for (ssize_t k = 0; k < lidos; k += block_size)
+				if (!blocoNulo(buffer + k, min<ssize_t>(block_size, lidos - k)))
+					presentes[(pos + k) / block_size] = 1;
+
+			pos += lidos;
+		}
+
+		offset = max<unsigned long long>(fim, offset + 1);
+	}
+
+	close(fdOrigem);
+
+	if (find(presentes.begin(), presentes.end(), 0) == presentes.end())
+		presentes.clear();
+
+	return status;
+}
+
+/* Escreve os blocos em 'blocos' ordenados pelo número do bloco, unindo blocos consecutivos em uma única escrita
+*/
+static int escreveBlocosOrdenados(vector<struct BlocoPlanejado> &blocos)
+{
+	int status = 0;
+	vector<char> lote;
+
+	sort(blocos.begin(), blocos.end(), [](const struct BlocoPlanejado &a, const struct BlocoPlanejado &b)
+		 { return a.bloco < b.bloco; });
+
+	for (size_t i = 0; i < blocos.size();)
+	{
+		size_t n = 1;
+
+		while (i + n < blocos.size() && blocos[i + n].bloco == blocos[i].bloco + n && n * block_size < TAM_BUFFER_EXPORTACAO)
+			n++;
+
+		lote.resize(n * block_size);
+
+		for (size_t k = 0; k < n; k++)
+			memcpy(lote.data() + k * block_size, blocos[i + k].dados.data(), block_size);
+
+		if (write_image(lote.data(), lote.size(), BLOCK_OFFSET(blocos[i].bloco)) != (ssize_t)lote.size())
+			status = -1;
+
+		i += n;
+	}
+
+	return status;
+}
+
+/* Escreve os Inodes de 'inodes' (ordenados pelo número) agrupando, em cada grupo, o trecho da Tabela de Inodes
+que os contém em uma leitura e uma escrita
+*/
+static int escreveInodesOrdenados(vector<pair<unsigned int, struct ext2_inode>> &inodes, const vector<struct ext2_group_desc> &grupos)
+{
+	int status = 0;
+	vector<char> trecho;
+
+	sort(inodes.begin(), inodes.end(), [](const pair<unsigned int, struct ext2_inode> &a, const pair<unsigned int, struct ext2_inode> &b)
+		 { return a.first < b.first; });
+
+	for (size_t i = 0; i < inodes.size();)
+	{
+		unsigned int g = (inodes[i].first - 1) / super.s_inodes_per_group;
+		size_t fim = i;
+
+		while (fim < inodes.size() && (inodes[fim].first - 1) / super.s_inodes_per_group == g)
+			fim++;
+
+		unsigned int primeiro = (inodes[i].first - 1) % super.s_inodes_per_group;
+		unsigned int ultimo = (inodes[fim - 1].first - 1) % super.s_inodes_per_group;
+		off_t offset = BLOCK_OFFSET(grupos[g].bg_inode_table) + (off_t)primeiro * inode_size;
+
+		trecho.resize((unsigned long)(ultimo - primeiro + 1) * inode_size);
+
+		if (read_image(trecho.data(), trecho.size(), offset) != (ssize_t)trecho.size())
+			status = -1;
+
+		for (size_t k = i; k < fim; k++)
+		{
+			char *destino = trecho.data() + (unsigned long)((inodes[k].first - 1) % super.s_inodes_per_group - primeiro) * inode_size;
+
+			memset(destino, 0, inode_size);
+			memcpy(destino, &inodes[k].second, sizeof(struct ext2_inode));
+		}
+
+		if (write_image(trecho.data(), trecho.size(), offset) != (ssize_t)trecho.size())
+			status = -1;
+
+		i = fim;
+	}
+
+	return status;
+}
+
+/* Planeja os blocos do nó 'i' e monta seu Inode, acrescentando-o a 'inodes'
+
+Os blocos de indireção, de diretório e de links simbólicos longos são montados em memória e acrescentados a 'metadados'.
+Diretórios exigem que os Inodes de todos os filhos já tenham sido planejados.
+dados: recebe os blocos de dados na ordem lógica
+Retorna -1 se não há blocos livres suficientes
+*/
+static int montaNoImportado(struct PlanoAlocacao *plano, vector<struct NoImportado> &nos, size_t i, unsigned int numDirAtual,
+							vector<struct BlocoPlanejado> &metadados, vector<pair<unsigned int, struct ext2_inode>> &inodes,
+							vector<unsigned int> &dados)
+{
+	struct NoImportado &no = nos[i];
+	struct ext2_inode novoInode;
+	unsigned long long tamanho = 0;
+	unsigned long numDados = 0;
+	vector<struct EntradaDir> entradas;
+	vector<char> conteudo;
+
+	memset(&novoInode, 0, sizeof(novoInode));
+
+	if (S_ISDIR(no.info.st_mode))
+	{
+		unsigned int numPai = (no.pai < 0) ? numDirAtual : nos[no.pai].inode;
+
+		entradas.push_back({no.inode, tipoEntrada(S_IFDIR), "."});
+		entradas.push_back({numPai, tipoEntrada(S_IFDIR), ".."});
+
+		novoInode.i_links_count = 2;
+
+		for (int filho : no.filhos)
+		{
+			entradas.push_back({nos[filho].inode, tipoEntrada(nos[filho].info.st_mode), nos[filho].nome});
+
+			if (S_ISDIR(nos[filho].info.st_mode))
+				novoInode.i_links_count++;
+		}
+
+		numDados = empacotaEntradas(entradas, &conteudo);
+		tamanho = (unsigned long long)numDados * block_size;
+	}
+	else if (S_ISLNK(no.info.st_mode))
+	{
+		size_t tamAlvo = (no.alvo.size() < (size_t)block_size) ? no.alvo.size() : block_size - 1;
+
+		conteudo.assign(block_size, 0);
+		memcpy(conteudo.data(), no.alvo.data(), tamAlvo);
+
+		tamanho = tamAlvo;
+		novoInode.i_links_count = 1;
+
+		// Links simbólicos curtos guardam o destino no próprio i_block
+		if (tamAlvo < sizeof(novoInode.i_block))
+			memcpy(novoInode.i_block, conteudo.data(), tamAlvo);
+		else
+			numDados = 1;
+	}
+	else
+	{
+		tamanho = no.info.st_size;
+		numDados = (tamanho + block_size - 1) / block_size;
+		novoInode.i_links_count = 1;
+	}
+
+	unsigned long numBlocos = numDados + blocosIndiretosNecessarios(numDados);
+	const vector<char> *presentes = NULL;
+
+	// Arquivo esparso: apenas os blocos com dados e a indireção que os mapeia são alocados
+	if (!no.presentes.empty())
+	{
+		presentes = &no.presentes;
+		numBlocos = count(no.presentes.begin(), no.presentes.end(), 1) + blocosIndiretosEsparsos(no.presentes);
+	}
+
+	if (planejaBlocos(plano, (no.inode - 1) / super.s_inodes_per_group, numBlocos, no.blocos) < 0)
+		return -1;
+
+	montaMapaBlocos(&novoInode, no.blocos, numDados, metadados, dados, presentes);
+
+	// Blocos de diretório e de links simbólicos longos são escritos junto com os demais metadados
+	for (unsigned long b = 0; b < dados.size() && !S_ISREG(no.info.st_mode); b++)
+		metadados.push_back({dados[b], vector<char>(conteudo.begin() + b * block_size, conteudo.begin() + (b + 1) * block_size)});
+
+	novoInode.i_mode = (S_ISDIR(no.info.st_mode) ? S_IFDIR : S_ISLNK(no.info.st_mode) ? S_IFLNK : S_IFREG) | (no.info.st_mode & 07777);
+	novoInode.i_uid = no.info.st_uid;
+	novoInode.i_gid = no.info.st_gid;
+	novoInode.i_size = tamanho & 0xFFFFFFFF;
+	novoInode.i_atime = no.info.st_atime;
+	novoInode.i_mtime = no.info.st_mtime;
+	novoInode.i_ctime = time(NULL);
+	novoInode.i_blocks = numBlocos * (block_size / 512);
+
+	if (S_ISREG(no.info.st_mode) && (tamanho >> 32))
+	{
+		novoInode.i_dir_acl = tamanho >> 32;
+		super.s_feature_ro_compat |= EXT2_FEATURE_RO_COMPAT_LARGE_FILE;
+	}
+
+	inodes.push_back({no.inode, novoInode});
+
+	return 0;
+}
+
+/* Importa recursivamente o arquivo ou diretório 'origem' do host para a entrada 'nome' do diretório atual
+
+Planeja antes de escrever a alocação de Inodes e blocos de toda a árvore, distribuindo os diretórios entre os grupos e mantendo
+cada arquivo no grupo de seu diretório. Depois escreve os dados dos arquivos em paralelo e os metadados (blocos de diretório,
+blocos de indireção, Tabelas de Inodes, bitmaps e descritores) em lotes ordenados
+*/
+void funct_import(struct ext2_inode *inode, struct ext2_group_desc *group, int *grupoAtual, char *origem, char *nome)
+{
+	struct PlanoAlocacao plano;
+	vector<struct NoImportado> nos;
+	auto inicio = chrono::steady_clock::now();
+	long existe;
+	long numDirAtual;
+
+	preparaEscritaDireta(NULL, 0); // Os dados são escritos diretamente na imagem, fora do jornal
+
+	read_dir(inode, group, &existe, nome);
+
+	if (existe != -1)
+	{
+		printf("\nfile already exists.\n");
+		return;
+	}
+
+	if (strlen(nome) > EXT2_NAME_LEN)
+	{
+		printf("\nname too long.\n");
+		return;
+	}
+
+	read_dir(inode, group, &numDirAtual, (char *)".");
+
+	nos.push_back(NoImportado());
+	nos[0].origem = origem;
+	nos[0].nome = nome;
+	nos[0].pai = -1;
+	nos[0].inode = 0;
+
+	if (lstat(origem, &nos[0].info) < 0)
+	{
+		perror(origem);
+		return;
+	}
+
+	if (!S_ISDIR(nos[0].info.st_mode) && !S_ISREG(nos[0].info.st_mode) && !S_ISLNK(nos[0].info.st_mode))
+	{
+		printf("\nunsupported file type.\n");
+		return;
+	}
+
+	if (S_ISLNK(nos[0].info.st_mode))
+	{
+		char alvo[PATH_MAX];
+		ssize_t tamAlvo = readlink(origem, alvo, sizeof(alvo));
+
+		nos[0].alvo.assign(alvo, tamAlvo > 0 ? tamAlvo : 0);
+	}
+
+	if (S_ISDIR(nos[0].info.st_mode) && listaArvoreHost(nos, 0) < 0)
+		return;
+
+	// Localiza em paralelo os blocos nulos dos arquivos regulares, que viram buracos em vez de serem alocados
+	executaParalelo(nos.size(), [&](unsigned int i)
+					{
+		if (!S_ISREG(nos[i].info.st_mode) || nos[i].info.st_size == 0)
+			return;
+
+		thread_local vector<char> buffer;
+
+		if (buffer.size() < TAM_BUFFER_EXPORTACAO)
+			buffer.resize(TAM_BUFFER_EXPORTACAO);
+
+		if (mapeiaBlocosComDados(nos[i].origem.c_str(), nos[i].info.st_size, nos[i].presentes, buffer.data(), buffer.size()) < 0)
+			nos[i].presentes.clear(); });
+
+	carregaPlano(&plano, (numDirAtual - 1) / super.s_inodes_per_group);
+
+	// Planeja os Inodes: diretórios são distribuídos entre os grupos e arquivos ficam no grupo do diretório pai
+	for (size_t i = 0; i < nos.size(); i++)
+	{
+		unsigned int numPai = (nos[i].pai < 0) ? numDirAtual : nos[nos[i].pai].inode;
+
+		if (S_ISDIR(nos[i].info.st_mode))
+			nos[i].inode = planejaInodeDiretorio(&plano);
+		else
+			nos[i].inode = planejaInode(&plano, (numPai - 1) / super.s_inodes_per_group);
+
+		if (nos[i].inode == 0)
+		{
+			printf("\nnot enough free inodes.\n");
+			return;
+		}
+	}
+
+	// Planeja os blocos e monta os Inodes, os blocos de diretório e os blocos de indireção
+	vector<struct BlocoPlanejado> metadados;
+	vector<pair<unsigned int, struct ext2_inode>> inodes;
+	vector<vector<unsigned int>> dadosArquivos(nos.size());
+
+	for (size_t i = 0; i < nos.size(); i++)
+	{
+		if (montaNoImportado(&plano, nos, i, numDirAtual, metadados, inodes, dadosArquivos[i]) < 0)
+		{
+			printf("\nnot enough free blocks.\n");
+			return;
+		}
+	}
+
+	// Escreve os dados dos arquivos regulares em paralelo
+	atomic<unsigned long> falhas(0);
+	atomic<unsigned long long> bytesImportados(0);
+
+	executaParalelo(nos.size(), [&](unsigned int i)
+					{
+		if (!S_ISREG(nos[i].info.st_mode))
+			return;
+
+		thread_local vector<char> buffer;
+
+		if (buffer.size() < TAM_BUFFER_EXPORTACAO)
+			buffer.resize(TAM_BUFFER_EXPORTACAO);
+
+		if (importaDadosArquivo(nos[i].origem.c_str(), dadosArquivos[i], nos[i].info.st_size, buffer.data(), buffer.size()) < 0)
+		{
+			fprintf(stderr, "%s: %s\n", nos[i].origem.c_str(), strerror(errno));
+			falhas++;
+		}
+		else
+			bytesImportados += nos[i].info.st_size; });
+
+	// Escreve os metadados em lotes ordenados: blocos de diretório e indireção, Tabelas de Inodes e bitmaps
+	escreveBlocosOrdenados(metadados);
+	escreveInodesOrdenados(inodes, plano.grupos);
+
+	// Liga a raiz importada ao diretório atual
+	if (adicionaEntradaDiretorio(inode, nome, nos[0].inode, tipoEntrada(nos[0].info.st_mode)) < 0)
+		printf("\nno space left in current directory: imported tree is unreachable.\n");
+	else if (S_ISDIR(nos[0].info.st_mode))
+	{
+		inode->i_links_count++;
+		write_inode_by_number(numDirAtual, plano.grupos, inode);
+	}
+
+	unsigned long blocosTotal;
+	unsigned long inodesTotal;
+
+	gravaPlano(&plano, &blocosTotal, &inodesTotal);
+
+	// Mantém a cópia em memória do grupo corrente coerente com o disco
+	memcpy(group, &plano.grupos[*grupoAtual], sizeof(struct ext2_group_desc));
+
+	double segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+
+	printf("\n%lu inodes, %lu blocks, %llu bytes imported in %.3f s.\n", inodesTotal, blocosTotal, bytesImportados.load(), segundos);
+
+	if (falhas)
+		printf("%lu files could not be read.\n", falhas.load());
+}
+
+/* Escrita posicional em arquivos existentes
+
+Os blocos que faltam (de dados e de indireção) são alocados sob demanda em um PlanoAlocacao, carregado apenas na
+primeira alocação e gravado uma única vez ao fim da escrita; os blocos de indireção alterados também são gravados
+uma única vez, em lote. Blocos já existentes recebem apenas os bytes alterados, sem reescrever o bloco inteiro
+*/
+
+// Estado de uma escrita em um arquivo
+struct EscritaArquivo
+{
+	unsigned int numInode;
+	struct ext2_inode *inode;
+	struct PlanoAlocacao *plano;			   // Plano das alocações: 'planoProprio' ou o de quem conduz a escrita (usaPlanoEscrita)
+	struct PlanoAlocacao planoProprio;
+	int planoCarregado;
+	map<unsigned int, vector<char>> indiretos; // Blocos de indireção lidos ou criados, pelo número do bloco
+	vector<unsigned int> indiretosAlterados;
+	unsigned int ultimoBloco;				   // Último bloco alocado: o próximo é procurado logo após ele
+	unsigned long blocosNovos;				   // Blocos de dados e de indireção alocados
+	vector<unsigned int> reservados;		   // Blocos já marcados no plano, consumidos em ordem antes de novas alocações
+	size_t proximoReservado;
+};
+
+// Prepara 'escrita' para o arquivo 'inode', de número 'numInode'
+static void iniciaEscrita(struct EscritaArquivo *escrita, unsigned int numInode, struct ext2_inode *inode)
+{
+	escrita->numInode = numInode;
+	escrita->inode = inode;
+	escrita->plano = &escrita->planoProprio;
+	escrita->planoCarregado = 0;
+	escrita->ultimoBloco = 0;
+	escrita->blocosNovos = 0;
+	escrita->reservados.clear();
+	escrita->proximoReservado = 0;
+}
+
+/* Faz 'escrita' alocar no plano já carregado 'plano', que continua sob a responsabilidade do chamador: concluiEscrita
+não o grava, para que várias escritas e outras alocações sejam gravadas juntas
+*/
+static void usaPlanoEscrita(struct EscritaArquivo *escrita, struct PlanoAlocacao *plano)
+{
+	escrita->plano = plano;
+	escrita->planoCarregado = 1;
+}
+
+/* Aloca um bloco para 'escrita': o próximo bloco reservado, se houver, senão preferencialmente o seguinte ao
+último alocado, senão no grupo do Inode
+
+Retorna o número do bloco ou 0 se não há blocos livres
+*/
+static unsigned int alocaBlocoEscrita(struct EscritaArquivo *escrita)
+{
+	struct PlanoAlocacao *plano = escrita->plano;
+
+	if (escrita->proximoReservado < escrita->reservados.size())
+	{
+		escrita->blocosNovos++;
+		return escrita->ultimoBloco = escrita->reservados[escrita->proximoReservado++];
+	}
+
+	if (!escrita->planoCarregado)
+	{
+		carregaPlano(plano, 0);
+		escrita->planoCarregado = 1;
+	}
+
+	unsigned int alvo = escrita->ultimoBloco + 1;
+
+	if (escrita->ultimoBloco && alvo < super.s_blocks_count)
+	{
+		unsigned int g = (alvo - super.s_first_data_block) / super.s_blocks_per_group;
+		unsigned long bit = (alvo - super.s_first_data_block) % super.s_blocks_per_group;
+
+		conta(CONT_SONDAGENS);
+
+		if (!testaBit(plano->bitmapsBlocos[g].data(), bit) && plano->grupos[g].bg_free_blocks_count > plano->blocosUsados[g])
+		{
+			plano->bitmapsBlocos[g][bit / 8] |= 0x1 << (bit % 8);
+			plano->blocosUsados[g]++;
+			escrita->blocosNovos++;
+			return escrita->ultimoBloco = alvo;
+		}
+	}
+
+	vector<unsigned int> bloco;
+
+	if (planejaBlocos(plano, (escrita->numInode - 1) / super.s_inodes_per_group, 1, bloco) < 0)
+		return 0;
+
+	escrita->blocosNovos++;
+
+	return escrita->ultimoBloco = bloco[0];
+}
+
+// Retorna os ponteiros do bloco de indireção 'bloco', lendo-o na primeira vez. 'novo' indica um bloco recém-alocado (zerado)
+static __u32 *ponteirosIndiretos(struct EscritaArquivo *escrita, unsigned int bloco, int novo)
+{
+	auto it = escrita->indiretos.find(bloco);
+
+	if (it == escrita->indiretos.end())
+	{
+		it = escrita->indiretos.emplace(bloco, vector<char>(block_size, 0)).first;
+
+		if (novo)
+			escrita->indiretosAlterados.push_back(bloco);
+		else if (read_block(bloco, it->second.data()) < 0)
+			memset(it->second.data(), 0, block_size);
+	}
+
+	return (__u32 *)it->second.data();
+}
+
+/* Retorna o bloco físico do bloco lógico 'logico' do arquivo de 'escrita'
+
+aloca: se não for zero, aloca o bloco de dados e os blocos de indireção do caminho que não existem; 'novo' indica
+se o bloco de dados foi alocado agora
+Retorna 0 para um buraco (sem 'aloca'), se não há espaço ou se 'logico' passa do limite do mapa de blocos
+*/
+static unsigned int blocoParaEscrita(struct EscritaArquivo *escrita, unsigned long logico, int aloca, int *novo)
+{
+	unsigned long porBloco = block_size / sizeof(__u32);
+	__u32 *ponteiro;
+
+	*novo = 0;
+
+	if (logico < EXT2_NDIR_BLOCKS)
+		ponteiro = &escrita->inode->i_block[logico];
+	else
+	{
+		unsigned long resto = logico - EXT2_NDIR_BLOCKS, cobertura = porBloco;
+		int nivel = 1;
+
+		while (resto >= cobertura)
+		{
+			if (nivel == 3)
+				return 0;
+
+			resto -= cobertura;
+			cobertura *= porBloco;
+			nivel++;
+		}
+
+		ponteiro = &escrita->inode->i_block[EXT2_IND_BLOCK + nivel - 1];
+
+		// Desce pelos blocos de indireção, alocando os que faltam
+		for (; nivel >= 1; nivel--)
+		{
+			int indiretoNovo = 0;
+
+			if (*ponteiro == 0)
+			{
+				if (!aloca || (*ponteiro = alocaBlocoEscrita(escrita)) == 0)
+					return 0;
+
+				indiretoNovo = 1;
+			}
+
+			unsigned int bloco = *ponteiro;
+			__u32 *ponteiros = ponteirosIndiretos(escrita, bloco, indiretoNovo);
+
+			cobertura /= porBloco;
+			ponteiro = &ponteiros[resto / cobertura];
+			resto %= cobertura;
+
+			if (aloca && *ponteiro == 0 && find(escrita->indiretosAlterados.begin(), escrita->indiretosAlterados.end(), bloco) == escrita->indiretosAlterados.end())
+				escrita->indiretosAlterados.push_back(bloco);
+		}
+	}
+
+	if (*ponteiro == 0 && aloca)
+	{
+		*ponteiro = alocaBlocoEscrita(escrita);
+		*novo = (*ponteiro != 0);
+	}
+
+	return *ponteiro;
+}
+
+/* Define o tamanho de 'inode' como 'tamanho', usando i_dir_acl para os 32 bits altos dos arquivos regulares
+
+Retorna -1 se o tamanho não pode ser representado
+*/
+static int defineTamanhoInode(struct ext2_inode *inode, unsigned long long tamanho)
+{
+	if ((tamanho >> 32) && !S_ISREG(inode->i_mode))
+		return -1;
+
+	inode->i_size = tamanho & 0xFFFFFFFF;
+
+	if (S_ISREG(inode->i_mode))
+	{
+		inode->i_dir_acl = tamanho >> 32;
+
+		if (tamanho >> 32)
+			super.s_feature_ro_compat |= EXT2_FEATURE_RO_COMPAT_LARGE_FILE;
+	}
+
+	return 0;
+}
+
+/* Conclui 'escrita': grava os blocos de indireção alterados, as alocações e o Inode, com o tamanho 'tamanho',
+i_blocks acrescido dos blocos alocados e i_mtime/i_ctime atualizados
+*/
+static int concluiEscrita(struct EscritaArquivo *escrita, unsigned long long tamanho, const vector<struct ext2_group_desc> &grupos)
+{
+	vector<struct BlocoPlanejado> blocos;
+	int status = 0;
 
-	// Atualização do Inode no novo Grupo
-	read_inode(index, novoGroup, novoInode);
+	for (unsigned int bloco : escrita->indiretosAlterados)
+		blocos.push_back({bloco, escrita->indiretos[bloco]});
+
+	if (escreveBlocosOrdenados(blocos) < 0)
+		status = -1;
+
+	// Devolve ao plano os blocos reservados que não foram usados
+	devolveBlocosPlano(escrita->plano, escrita->reservados.data() + escrita->proximoReservado, escrita->reservados.size() - escrita->proximoReservado);
+	escrita->proximoReservado = escrita->reservados.size();
+
+	if (escrita->planoCarregado && escrita->plano == &escrita->planoProprio)
+	{
+		unsigned long blocosTotal, inodesTotal;
+
+		gravaPlano(escrita->plano, &blocosTotal, &inodesTotal);
+	}
+
+	escrita->inode->i_blocks += escrita->blocosNovos * (block_size / 512);
+	escrita->inode->i_mtime = escrita->inode->i_ctime = time(NULL);
+	defineTamanhoInode(escrita->inode, tamanho);
+
+	if (write_inode_by_number(escrita->numInode, grupos, escrita->inode) < 0)
+		status = -1;
+
+	invalidaExtensoes(escrita->numInode);
+
+	return status;
+}
+
+/* Zera o trecho entre o fim antigo 'tamanho' e 'fim' no último bloco existente do arquivo de 'escrita', que passa a
+fazer parte do arquivo quando este aumenta
+*/
+static void zeraFimUltimoBloco(struct EscritaArquivo *escrita, unsigned long long tamanho, unsigned long long fim)
+{
+	int novo;
+
+	if (fim <= tamanho || tamanho % block_size == 0)
+		return;
+
+	unsigned int bloco = blocoParaEscrita(escrita, tamanho / block_size, 0, &novo);
+
+	if (bloco)
+	{
+		vector<char> zeros(min<unsigned long long>(block_size - tamanho % block_size, fim - tamanho), 0);
+		write_image(zeros.data(), zeros.size(), BLOCK_OFFSET(bloco) + tamanho % block_size);
+	}
+}
+
+/* Escreve os 'n' bytes de 'dados' a partir do byte 'offset' do arquivo de 'inode' (de número 'numInode')
+
+Um bloco recém-alocado é escrito inteiro (completado com zeros) e blocos recém-alocados consecutivos são unidos em uma
+única escrita; em um bloco existente apenas os bytes alterados são escritos. Uma escrita além do fim do arquivo deixa
+buracos nos blocos intermediários e zera o trecho entre o fim antigo e 'offset' no último bloco existente
+Retorna o número de bytes escritos ou -1 em caso de erro (o que foi escrito até o erro é mantido)
+*/
+static long long escreveFaixaArquivo(unsigned int numInode, struct ext2_inode *inode, unsigned long long offset, const char *dados, unsigned long long n)
+{
+	vector<struct ext2_group_desc> grupos;
+	struct EscritaArquivo escrita;
+	unsigned long long tamanho = tamanhoInode(inode);
+	unsigned long long escritos = 0;
+	vector<char> lote;
+	unsigned int inicioLote = 0;
+	int novo;
+	int status = 0;
+
+	read_group_descs(grupos);
+	iniciaEscrita(&escrita, numInode, inode);
+
+	// O último bloco do arquivo guia a alocação, para que os novos blocos fiquem contíguos a ele
+	if (min(offset, tamanho) > 0)
+		escrita.ultimoBloco = blocoParaEscrita(&escrita, (min(offset, tamanho) - 1) / block_size, 0, &novo);
+
+	// Zera o fim do último bloco existente quando a escrita começa depois do fim do arquivo
+	zeraFimUltimoBloco(&escrita, tamanho, offset);
+
+	auto descarregaLote = [&]()
+	{
+		if (!lote.empty() && write_image(lote.data(), lote.size(), BLOCK_OFFSET(inicioLote)) != (ssize_t)lote.size())
+			status = -1;
+		lote.clear();
+	};
+
+	while (escritos < n && status == 0)
+	{
+		unsigned long long pos = offset + escritos;
+		unsigned long logico = pos / block_size;
+		unsigned int inicio = pos % block_size;
+		unsigned int k = min<unsigned long long>(block_size - inicio, n - escritos);
+		unsigned int bloco = blocoParaEscrita(&escrita, logico, 0, &novo);
+
+		// Zeros sobre um buraco (ou além do fim) não alocam bloco: o buraco já é lido como zeros
+		if (bloco == 0 && blocoNulo(dados + escritos, k))
+		{
+			escritos += k;
+			continue;
+		}
+
+		if (bloco == 0)
+			bloco = blocoParaEscrita(&escrita, logico, 1, &novo);
+
+		if (bloco == 0)
+		{
+			status = -1;
+			break;
+		}
+
+		if (novo)
+		{
+			// Bloco novo: escrito inteiro, unido aos blocos novos consecutivos
+			if (!lote.empty() && bloco != inicioLote + lote.size() / block_size)
+				descarregaLote();
+
+			if (lote.empty())
+				inicioLote = bloco;
+
+			lote.resize(lote.size() + block_size, 0);
+			memcpy(lote.data() + lote.size() - block_size + inicio, dados + escritos, k);
+		}
+		else
+		{
+			descarregaLote();
+
+			if (write_image(dados + escritos, k, BLOCK_OFFSET(bloco) + inicio) != (ssize_t)k)
+				status = -1;
+		}
+
+		escritos += k;
+	}
+
+	descarregaLote();
+
+	if (concluiEscrita(&escrita, max(tamanho, offset + escritos), grupos) < 0)
+		status = -1;
+
+	return status < 0 ? -1 : (long long)escritos;
+}
+
+/* Decodifica as sequências de escape de 'texto' (\n, \t, \r, \0, \\, \s para espaço e \xHH), permitindo escrever
+bytes que o interpretador de comandos não aceita diretamente
+*/
+static string decodificaTexto(const char *texto)
+{
+	string saida;
+
+	for (const char *c = texto; *c; c++)
+	{
+		if (*c != '\\' || !c[1])
+		{
+			saida += *c;
+			continue;
+		}
+
+		c++;
+
+		if (*c == 'n')
+			saida += '\n';
+		else if (*c == 't')
+			saida += '\t';
+		else if (*c == 'r')
+			saida += '\r';
+		else if (*c == '0')
+			saida += '\0';
+		else if (*c == 's')
+			saida += ' ';
+		else if (*c == 'x' && isxdigit(c[1]) && isxdigit(c[2]))
+		{
+			char hex[3] = {c[1], c[2], 0};
+			saida += (char)strtol(hex, NULL, 16);
+			c += 2;
+		}
+		else
+			saida += *c;
+	}
+
+	return saida;
+}
+
+/* Localiza o arquivo regular 'nome' do diretório de 'inode', lendo seu Inode em 'arquivo' e seu número em 'numInode'
+
+Exibe a mensagem de erro e retorna -1 se não existe ou não é um arquivo regular
+*/
+static int localizaArquivoRegular(struct ext2_inode *inode, char *nome, const vector<struct ext2_group_desc> &grupos, unsigned int *numInode, struct ext2_inode *arquivo)
+{
+	vector<char> bloco;
+	struct PosicaoEntrada pos;
+
+	if (localizaEntradaDiretorio(inode, nome, bloco, &pos) < 0 || read_inode_by_number(pos.inode, grupos, arquivo) < 0)
+	{
+		printf("\nfile not found.\n");
+		return -1;
+	}
+
+	if (!S_ISREG(arquivo->i_mode))
+	{
+		printf("\nnot a file.\n");
+		return -1;
+	}
+
+	*numInode = pos.inode;
 
 	return 0;
 }
 
-// Copia o conteúdo dos blocos de dados em inode para arquivo
-void copiaArquivo(struct ext2_inode *inode, char *arquivo)
+/* Escreve 'texto' (com as sequências de escape de decodificaTexto) no arquivo 'nome' a partir do byte 'offset'
+
+grupoAtual: grupo de 'group'
+anexa: se não for zero, 'offset' é ignorado e o texto é acrescentado ao fim do arquivo
+*/
+void funct_write(struct ext2_inode *inode, struct ext2_group_desc *group, char *nome, int grupoAtual, unsigned long long offset, char *texto, int anexa)
+{
+	vector<struct ext2_group_desc> grupos;
+	struct ext2_inode arquivo;
+	unsigned int numInode;
+
+	read_group_descs(grupos);
+
+	if (localizaArquivoRegular(inode, nome, grupos, &numInode, &arquivo) < 0)
+		return;
+
+	string dados = decodificaTexto(texto);
+
+	if (anexa)
+		offset = tamanhoInode(&arquivo);
+
+	if (!(super.s_feature_ro_compat & EXT2_FEATURE_RO_COMPAT_LARGE_FILE) && offset + dados.size() > 0x7FFFFFFF)
+	{
+		printf("\nfile too large.\n");
+		return;
+	}
+
+	if (escreveFaixaArquivo(numInode, &arquivo, offset, dados.data(), dados.size()) < 0)
+		printf("\nno space left on device.\n");
+
+	// Mantém a cópia em memória do grupo corrente atualizada
+	read_image(group, sizeof(struct ext2_group_desc), GDT_OFFSET + sizeof(struct ext2_group_desc) * grupoAtual);
+}
+
+/* Libera os ponteiros da subárvore do bloco de indireção 'bloco' (de nível 'nivel', cujo primeiro bloco lógico é 'inicio')
+que mapeiam blocos lógicos a partir de 'primeiro'
+
+Os blocos liberados são acrescentados a 'liberados' e os blocos de indireção que permanecem com ponteiros alterados, a 'alterados'
+Retorna 1 se o bloco de indireção ficou sem ponteiros (e também foi acrescentado a 'liberados')
+*/
+static int podaIndirecao(unsigned int bloco, int nivel, unsigned long inicio, unsigned long primeiro,
+						 vector<unsigned int> &liberados, vector<struct BlocoPlanejado> &alterados)
+{
+	unsigned long porBloco = block_size / sizeof(__u32);
+	unsigned long cobertura = coberturaIndirecao(nivel - 1);
+	vector<char> dados(block_size);
+	int alterado = 0, restantes = 0;
+
+	if (read_block(bloco, dados.data()) < 0)
+		return 0;
+
+	__u32 *ponteiros = (__u32 *)dados.data();
+
+	for (unsigned long i = 0; i < porBloco; i++)
+	{
+		unsigned long inicioFilho = inicio + i * cobertura;
+
+		if (ponteiros[i] == 0)
+			continue;
+
+		if (inicioFilho + cobertura <= primeiro) // Inteiramente mantido
+		{
+			restantes = 1;
+			continue;
+		}
+
+		if (nivel == 1)
+			liberados.push_back(ponteiros[i]);
+		else if (!podaIndirecao(ponteiros[i], nivel - 1, inicioFilho, primeiro, liberados, alterados))
+		{
+			restantes = 1;
+			continue;
+		}
+
+		ponteiros[i] = 0;
+		alterado = 1;
+	}
+
+	if (!restantes)
+	{
+		liberados.push_back(bloco);
+		return 1;
+	}
+
+	if (alterado)
+		alterados.push_back({bloco, dados});
+
+	return 0;
+}
+
+/* Retira do mapa de blocos de 'inode' os blocos lógicos a partir de 'primeiro', junto com as subárvores de indireção
+que ficam vazias; os blocos retirados vão para 'liberados' e os blocos de indireção alterados para 'alterados'
+*/
+static void podaMapaBlocos(struct ext2_inode *inode, unsigned long primeiro, vector<unsigned int> &liberados, vector<struct BlocoPlanejado> &alterados)
+{
+	unsigned long inicio = EXT2_NDIR_BLOCKS;
+
+	for (unsigned long i = primeiro; i < EXT2_NDIR_BLOCKS; i++)
+	{
+		if (inode->i_block[i])
+			liberados.push_back(inode->i_block[i]);
+		inode->i_block[i] = 0;
+	}
+
+	for (int nivel = 1; nivel <= 3; nivel++)
+	{
+		__u32 *ponteiro = &inode->i_block[EXT2_IND_BLOCK + nivel - 1];
+
+		if (*ponteiro && inicio + coberturaIndirecao(nivel) > primeiro &&
+			podaIndirecao(*ponteiro, nivel, inicio, primeiro, liberados, alterados))
+			*ponteiro = 0;
+
+		inicio += coberturaIndirecao(nivel);
+	}
+}
+
+/* Altera o tamanho do arquivo 'nome' para 'tamanho' bytes
+
+Ao reduzir, os blocos além do novo fim e as subárvores de indireção que ficam vazias são liberados com uma escrita do
+bitmap por grupo (liberaBlocos), depois de o Inode e os blocos de indireção alterados serem gravados; ao aumentar, o
+trecho acrescentado fica como buraco e apenas o fim do último bloco existente é zerado
+grupoAtual: grupo de 'group'
+*/
+void funct_truncate(struct ext2_inode *inode, struct ext2_group_desc *group, char *nome, int grupoAtual, unsigned long long tamanho)
+{
+	vector<struct ext2_group_desc> grupos;
+	struct ext2_inode arquivo;
+	unsigned int numInode;
+
+	read_group_descs(grupos);
+
+	if (localizaArquivoRegular(inode, nome, grupos, &numInode, &arquivo) < 0)
+		return;
+
+	if (!(super.s_feature_ro_compat & EXT2_FEATURE_RO_COMPAT_LARGE_FILE) && tamanho > 0x7FFFFFFF)
+	{
+		printf("\nfile too large.\n");
+		return;
+	}
+
+	unsigned long long atual = tamanhoInode(&arquivo);
+	vector<unsigned int> liberados;
+	vector<struct BlocoPlanejado> alterados;
+
+	if (tamanho < atual)
+		podaMapaBlocos(&arquivo, (tamanho + block_size - 1) / block_size, liberados, alterados);
+	else
+	{
+		struct EscritaArquivo escrita;
+
+		// O fim do último bloco passa a fazer parte do arquivo e precisa ser lido como zeros
+		iniciaEscrita(&escrita, numInode, &arquivo);
+		zeraFimUltimoBloco(&escrita, atual, tamanho);
+	}
+
+	escreveBlocosOrdenados(alterados);
+
+	arquivo.i_blocks -= liberados.size() * (block_size / 512);
+	arquivo.i_mtime = arquivo.i_ctime = time(NULL);
+	defineTamanhoInode(&arquivo, tamanho);
+	write_inode_by_number(numInode, grupos, &arquivo);
+	invalidaExtensoes(numInode);
+
+	// Os blocos só são liberados depois de deixarem de ser referenciados pelo Inode
+	liberaBlocos(liberados);
+
+	// Mantém a cópia em memória do grupo corrente atualizada
+	read_image(group, sizeof(struct ext2_group_desc), GDT_OFFSET + sizeof(struct ext2_group_desc) * grupoAtual);
+}
+
+/* Reserva os blocos do trecho de 'tamanho' bytes a partir do byte 'offset' do arquivo 'nome', aumentando o arquivo se
+o trecho passa do fim
+
+Os blocos que faltam no trecho (de dados e de indireção) são reservados de uma vez em faixas contíguas, preferencialmente
+logo após o bloco que antecede o trecho, para que uma escrita grande posterior não fragmente o arquivo. Como o EXT2 não
+marca blocos como não escritos, os blocos de dados reservados são zerados, em escritas unindo blocos consecutivos.
+Nada é alterado se não há espaço para o trecho inteiro
+grupoAtual: grupo de 'group'
+*/
+void funct_fallocate(struct ext2_inode *inode, struct ext2_group_desc *group, char *nome, int grupoAtual, unsigned long long offset, unsigned long long tamanho)
+{
+	vector<struct ext2_group_desc> grupos;
+	struct ext2_inode arquivo;
+	struct EscritaArquivo escrita;
+	unsigned int numInode;
+	int novo;
+
+	read_group_descs(grupos);
+
+	if (localizaArquivoRegular(inode, nome, grupos, &numInode, &arquivo) < 0)
+		return;
+
+	unsigned long long limite = (EXT2_NDIR_BLOCKS + coberturaIndirecao(1) + coberturaIndirecao(2) + coberturaIndirecao(3)) * (unsigned long long)block_size;
+
+	if (tamanho == 0 || offset + tamanho > limite ||
+		(!(super.s_feature_ro_compat & EXT2_FEATURE_RO_COMPAT_LARGE_FILE) && offset + tamanho > 0x7FFFFFFF))
+	{
+		printf("\nfile too large.\n");
+		return;
+	}
+
+	unsigned long primeiro = offset / block_size, ultimo = (offset + tamanho - 1) / block_size;
+	unsigned long faltantes = 0;
+
+	iniciaEscrita(&escrita, numInode, &arquivo);
+	zeraFimUltimoBloco(&escrita, tamanhoInode(&arquivo), offset + tamanho);
+
+	for (unsigned long logico = primeiro; logico <= ultimo; logico++)
+		if (!blocoParaEscrita(&escrita, logico, 0, &novo))
+			faltantes++;
+
+	if (faltantes)
+	{
+		// Limite para os blocos de indireção do trecho: os de um arquivo que termina no trecho, menos os de um que termina antes dele, mais os ancestrais compartilhados
+		unsigned long indiretos = min(blocosIndiretosNecessarios(ultimo + 1), blocosIndiretosNecessarios(ultimo + 1) - blocosIndiretosNecessarios(primeiro) + 3);
+		unsigned int anterior = primeiro ? blocoParaEscrita(&escrita, primeiro - 1, 0, &novo) : 0;
+
+		carregaPlano(escrita.plano, 0);
+		escrita.planoCarregado = 1;
+
+		if (planejaBlocosContiguos(escrita.plano, (numInode - 1) / super.s_inodes_per_group, anterior ? anterior + 1 : 0,
+								   faltantes + indiretos, escrita.reservados) < 0)
+		{
+			printf("\nno space left on device.\n");
+			return;
+		}
+	}
+
+	// Consome as reservas na ordem do mapa de blocos: cada bloco de indireção antecede os blocos que mapeia
+	vector<unsigned int> novos;
+
+	for (unsigned long logico = primeiro; logico <= ultimo && faltantes; logico++)
+	{
+		unsigned int bloco = blocoParaEscrita(&escrita, logico, 1, &novo);
+
+		if (novo)
+			novos.push_back(bloco);
+	}
+
+	// Zera os blocos de dados reservados, unindo os consecutivos
+	vector<char> zeros(TAM_BUFFER_EXPORTACAO, 0);
+
+	sort(novos.begin(), novos.end());
+
+	for (size_t i = 0; i < novos.size();)
+	{
+		size_t n = 1;
+
+		while (i + n < novos.size() && novos[i + n] == novos[i] + n && (n + 1) * block_size <= zeros.size())
+			n++;
+
+		write_image(zeros.data(), n * block_size, BLOCK_OFFSET(novos[i]));
+		i += n;
+	}
+
+	concluiEscrita(&escrita, max(tamanhoInode(&arquivo), offset + tamanho), grupos);
+
+	// Mantém a cópia em memória do grupo corrente atualizada
+	read_image(group, sizeof(struct ext2_group_desc), GDT_OFFSET + sizeof(struct ext2_group_desc) * grupoAtual);
+}
+
+/* Comandos em lote
+
+rm, cat, cp, attr, touch e mkdir aceitam vários alvos e, exceto touch e mkdir, padrões com '*', '?' e '[...]' (fnmatch).
+Os alvos são agrupados pelo diretório que os contém e cada diretório é lido uma única vez: todos os nomes e padrões
+são comparados com as entradas nessa passada e a operação é aplicada ao conjunto, com uma escrita por bloco de
+diretório alterado e, na alocação e na liberação, uma escrita de bitmap por grupo
+*/
+
+// Alvos de um comando em lote contidos em um mesmo diretório
+struct AlvosDiretorio
+{
+	unsigned int numDir;
+	struct ext2_inode dir;
+	vector<string> nomes;					// Nomes e padrões pedidos, na ordem dos argumentos
+	vector<struct EntradaDir> selecionadas; // Entradas que correspondem a 'nomes', na ordem do diretório
+	vector<struct ext2_inode> inodes;		// Inodes de 'selecionadas', na mesma ordem
+};
+
+// Retorna 1 se 'nome' contém algum caractere especial de padrão
+static int temCoringa(const char *nome)
+{
+	return strpbrk(nome, "*?[") != NULL;
+}
+
+/* Agrupa os 'n' argumentos de 'args' pelo diretório que contém cada um, na ordem em que os diretórios aparecem
+
+Retorna -1 (com a mensagem de erro já exibida) se algum diretório não existe ou algum nome é longo demais
+*/
+static int agrupaAlvos(char **args, int n, vector<struct AlvosDiretorio> &alvos)
+{
+	vector<struct ext2_group_desc> grupos;
+	map<unsigned int, size_t> indices;
+
+	read_group_descs(grupos);
+	alvos.clear();
+
+	for (int i = 0; i < n; i++)
+	{
+		string pai, nome;
+
+		separaCaminho(args[i], pai, nome);
+
+		if (nome.size() > EXT2_NAME_LEN)
+		{
+			printf("\ninvalid sintax.\n");
+			return -1;
+		}
+
+		unsigned int numDir = resolveCaminhoCache(pai.c_str(), grupos);
+		auto it = indices.find(numDir);
+
+		if (it == indices.end())
+		{
+			struct AlvosDiretorio novo;
+
+			if (numDir == 0 || read_inode_by_number(numDir, grupos, &novo.dir) < 0)
+			{
+				printf("\ndirectory not found.\n");
+				return -1;
+			}
+
+			if (!S_ISDIR(novo.dir.i_mode))
+			{
+				printf("\nnot a directory.\n");
+				return -1;
+			}
+
+			novo.numDir = numDir;
+			it = indices.emplace(numDir, alvos.size()).first;
+			alvos.push_back(novo);
+		}
+
+		alvos[it->second].nomes.push_back(nome);
+	}
+
+	return 0;
+}
+
+/* Lê uma única vez o diretório de 'alvos' e seleciona as entradas que correspondem a algum dos nomes ou padrões,
+lendo em lote os seus Inodes
+
+Os padrões não selecionam '.' e '..' nem, como em um shell, nomes que começam com '.' (FNM_PERIOD). Os nomes e
+padrões sem correspondência são informados com "file not found"
+*/
+static void selecionaEntradas(struct AlvosDiretorio *alvos, const vector<struct ext2_group_desc> &grupos)
 {
-	ofstream destineFile(arquivo);
+	vector<struct EntradaDir> entradas;
+	unordered_map<string, size_t> literais;
+	vector<size_t> padroes;
+	vector<char> usados(alvos->nomes.size(), 0);
+
+	for (size_t k = 0; k < alvos->nomes.size(); k++)
+	{
+		if (temCoringa(alvos->nomes[k].c_str()))
+			padroes.push_back(k);
+		else
+			literais.emplace(alvos->nomes[k], k);
+	}
+
+	le_entradas_diretorio(&alvos->dir, entradas);
+
+	for (auto &entrada : entradas)
+	{
+		auto literal = literais.find(entrada.nome);
+		int selecionada = 0;
+
+		if (literal != literais.end())
+			selecionada = usados[literal->second] = 1;
+
+		for (size_t k : padroes)
+		{
+			if (fnmatch(alvos->nomes[k].c_str(), entrada.nome.c_str(), FNM_PERIOD) == 0)
+				selecionada = usados[k] = 1;
+		}
+
+		if (selecionada)
+			alvos->selecionadas.push_back(entrada);
+	}
+
+	for (size_t k = 0; k < alvos->nomes.size(); k++)
+	{
+		if (!usados[k] && (!literais.count(alvos->nomes[k]) || literais[alvos->nomes[k]] == k))
+			printf("\n%s: file not found.\n", alvos->nomes[k].c_str());
+	}
+
+	// Inodes em lote, devolvidos na ordem das entradas selecionadas
+	vector<unsigned int> numeros;
+	vector<struct ext2_inode> lidos;
+
+	for (auto &entrada : alvos->selecionadas)
+		numeros.push_back(entrada.inode);
+
+	leInodesEmLote(numeros, grupos, lidos);
+	alvos->inodes.clear();
 
-	// Aloca um bloco
-	char *buffer = (char *)malloc(sizeof(char) * block_size);
+	for (auto &entrada : alvos->selecionadas)
+		alvos->inodes.push_back(lidos[lower_bound(numeros.begin(), numeros.end(), entrada.inode) - numeros.begin()]);
+}
+
+/* Remove do diretório 'dir' as entradas cujos nomes estão em 'nomes', em uma passada pelos blocos do diretório, como
+removeEntradaBloco faz com uma entrada; cada bloco alterado é escrito uma única vez
 
-	// Posiciona o leitor no primeiro bloco de dados diretos e o lê em buffer
-	lseek(fd, BLOCK_OFFSET(inode->i_block[0]), SEEK_SET);
-	read(fd, buffer, block_size);
+Retorna o número de entradas removidas
+*/
+static unsigned long removeEntradasDiretorio(struct ext2_inode *dir, const set<string> &nomes)
+{
+	vector<unsigned int> blocos;
+	vector<char> bloco(block_size);
+	unsigned long removidas = 0;
 
-	int sizeTemp = inode->i_size;
-	int singleInd[256];
-	int doubleInd[256];
-	char charLido = '0';
+	resolve_block_map(dir, blocos, NULL);
 
-	// Iteração sobre os blocos de dados diretos
-	for (int i = 0; i < 12; i++)
+	for (unsigned int numBloco : blocos)
 	{
-		// Leitura do bloco i em buffer
-		lseek(fd, BLOCK_OFFSET(inode->i_block[i]), SEEK_SET);
-		read(fd, buffer, block_size);
+		if (numBloco == 0 || read_block(numBloco, bloco.data()) < 0)
+			continue;
 
-		// Iteração sobre o conteúdo do bloco i
-		for (int i = 0; i < 1024; i++)
-		{
-			// Copia o caracter i para charLido
-			charLido = buffer[i];
+		unsigned int offset = 0, inicio = block_size, fim = 0;
+		int anterior = -1;
 
-			// Escreve charLido em arquivo
-			destineFile << charLido;
+		while (offset + 8 <= (unsigned int)block_size)
+		{
+			struct ext2_dir_entry_2 *entry = (struct ext2_dir_entry_2 *)(bloco.data() + offset);
+			unsigned int tamRegistro = rec_len_from_disk(entry->rec_len);
 
-			// Decrementa sizeTemp que marca quantos bytes do Inode restam para serem lidos
-			sizeTemp = sizeTemp - sizeof(char);
+			if (tamRegistro < 8 || offset + tamRegistro > (unsigned int)block_size)
+				break;
 
-			if (sizeTemp <= 0)
+			if (entry->inode && nomes.count(string(entry->name, entry->name_len)))
 			{
-				break;
+				// O registro é incorporado ao anterior, que continua sendo o anterior da próxima entrada
+				if (anterior >= 0)
+					estendeRegistro((struct ext2_dir_entry_2 *)(bloco.data() + anterior), tamRegistro);
+				else
+				{
+					entry->inode = 0;
+					anterior = offset;
+				}
+
+				inicio = min(inicio, (unsigned int)anterior);
+				fim = max(fim, (unsigned int)anterior + 8);
+				removidas++;
 			}
+			else
+				anterior = offset;
+
+			offset += tamRegistro;
 		}
-		if (sizeTemp <= 0)
-		{
-			break;
-		}
+
+		if (fim > inicio)
+			write_image(bloco.data() + inicio, fim - inicio, BLOCK_OFFSET(numBloco) + inicio);
 	}
 
-	// Se há blocos a serem lidos após a leitura dos blocos diretos, lê o bloco 12 com uma indireção
-	if (sizeTemp > 0)
+	return removidas;
+}
+
+/* Insere as entradas de 'novas' no diretório 'dir' ocupando as folgas dos seus blocos, como insereEntradaBloco, em uma
+passada pelos blocos; os blocos alterados vão para 'alterados', para serem escritos pelo chamador
+
+Retorna quantas entradas, do início de 'novas', couberam
+*/
+static size_t adicionaEntradasDiretorio(struct ext2_inode *dir, const vector<struct EntradaDir> &novas, vector<struct BlocoPlanejado> &alterados)
+{
+	vector<unsigned int> blocos;
+	size_t proxima = 0;
+
+	resolve_block_map(dir, blocos, NULL);
+
+	for (size_t b = 0; b < blocos.size() && proxima < novas.size(); b++)
 	{
-		lseek(fd, BLOCK_OFFSET(inode->i_block[12]), SEEK_SET);
-		read(fd, singleInd, block_size);
+		vector<char> bloco(block_size);
+		unsigned int inicio, fim;
+		int alterado = 0;
 
-		for (int i = 0; i < 256; i++)
-		{
-			lseek(fd, BLOCK_OFFSET(singleInd[i]), SEEK_SET);
-			read(fd, buffer, block_size);
+		if (blocos[b] == 0 || read_block(blocos[b], bloco.data()) < 0)
+			continue;
 
-			for (int j = 0; j < 1024; j++)
-			{
-				charLido = buffer[j];
-				destineFile << charLido;
-				sizeTemp = sizeTemp - 1;
-				if (sizeTemp <= 0)
-				{
-					break;
-				}
-			}
-			if (sizeTemp <= 0)
-			{
-				break;
-			}
+		// Os nomes que não cabem neste bloco são tentados nos seguintes
+		while (proxima < novas.size() && insereEntradaBloco(bloco.data(), novas[proxima].nome.c_str(), novas[proxima].inode, novas[proxima].tipo, &inicio, &fim) == 0)
+		{
+			proxima++;
+			alterado = 1;
 		}
+
+		if (alterado)
+			alterados.push_back({blocos[b], bloco});
 	}
 
-	// Se há blocos a serem lidos após a leitura do bloco 12, lê o bloco 13 com dupla indireção
-	if (sizeTemp > 0)
+	return proxima;
+}
+
+/* Remove os arquivos selecionados por 'alvos' (rm com vários alvos ou padrões)
+
+As entradas de cada diretório são removidas em uma passada; depois os Inodes são gravados em lote sem links e com
+data de remoção, e os blocos e Inodes de todos os arquivos são liberados com uma escrita de bitmap por grupo
+*/
+void funct_rm_lote(vector<struct AlvosDiretorio> &alvos)
+{
+	vector<struct ext2_group_desc> grupos;
+	vector<pair<unsigned int, struct ext2_inode>> liberados;
+	vector<unsigned int> blocos, numeros;
+	set<unsigned int> vistos;
+
+	read_group_descs(grupos);
+
+	for (auto &alvo : alvos)
 	{
-		lseek(fd, BLOCK_OFFSET(inode->i_block[13]), SEEK_SET);
-		read(fd, doubleInd, block_size);
+		set<string> nomes;
 
-		for (int i = 0; i < 256; i++)
+		selecionaEntradas(&alvo, grupos);
+
+		for (size_t i = 0; i < alvo.selecionadas.size(); i++)
 		{
-			if (sizeTemp <= 0)
+			if (S_ISDIR(alvo.inodes[i].i_mode))
 			{
-				break;
+				printf("\n%s: not a file.\n", alvo.selecionadas[i].nome.c_str());
+				continue;
 			}
 
-			lseek(fd, BLOCK_OFFSET(doubleInd[i]), SEEK_SET);
-			read(fd, singleInd, block_size);
+			nomes.insert(alvo.selecionadas[i].nome);
 
-			for (int k = 0; k < 256; k++)
-			{
-				if (sizeTemp <= 0)
-				{
-					break;
-				}
+			if (!vistos.insert(alvo.selecionadas[i].inode).second)
+				continue;
 
-				lseek(fd, BLOCK_OFFSET(singleInd[k]), SEEK_SET);
-				read(fd, buffer, block_size);
+			struct ext2_inode inode = alvo.inodes[i];
+			vector<unsigned int> dados, indiretos;
 
-				for (int j = 0; j < 1024; j++)
-				{
-					charLido = buffer[j];
-					destineFile << charLido;
-					sizeTemp = sizeTemp - 1;
-					if (sizeTemp <= 0)
-					{
-						break;
-					}
-				}
-			}
+			// resolve_block_map substitui o conteúdo do vetor: os blocos de cada arquivo são acumulados em 'blocos'
+			resolve_block_map(&inode, dados, &indiretos);
+			blocos.insert(blocos.end(), dados.begin(), dados.end());
+			blocos.insert(blocos.end(), indiretos.begin(), indiretos.end());
+
+			inode.i_links_count = 0;
+			inode.i_dtime = time(NULL);
+			liberados.push_back({alvo.selecionadas[i].inode, inode});
+			numeros.push_back(alvo.selecionadas[i].inode);
 		}
+
+		removeEntradasDiretorio(&alvo.dir, nomes);
 	}
 
-	free(buffer);
+	// Os blocos e Inodes só são liberados depois de deixarem de ser referenciados pelos diretórios
+	escreveInodesOrdenados(liberados, grupos);
+	liberaBlocos(blocos);
+	liberaInodes(numeros);
+
+	for (unsigned int numero : numeros)
+		invalidaExtensoes(numero);
 }
 
-// Exibe o bitmap de blocos do grupo 'group'
-void read_block_bitmap(struct ext2_group_desc *group)
+/* Exibe o conteúdo dos arquivos selecionados por 'alvos', em sequência (cat com vários alvos ou padrões)
+*/
+void funct_cat_lote(vector<struct AlvosDiretorio> &alvos)
 {
-	unsigned char *bitmap;
+	vector<struct ext2_group_desc> grupos;
 
-	// bitmap tem tamanho de um bloco
-	bitmap = (unsigned char *)malloc(block_size);
+	read_group_descs(grupos);
 
-	// Lê o bitmap de blocos em 'bitmap'
-	lseek(fd, BLOCK_OFFSET(group->bg_block_bitmap), SEEK_SET);
-	read(fd, bitmap, block_size);
+	for (auto &alvo : alvos)
+	{
+		selecionaEntradas(&alvo, grupos);
 
-	// Exemplo:
-	// a = 10110011
-	// j = 4
-	// a >> j = 00001011
-	// 00001011 & 00000001 = 00000001
-	// !!(00000001) = 00000001
+		for (size_t i = 0; i < alvo.selecionadas.size(); i++)
+		{
+			if (S_ISDIR(alvo.inodes[i].i_mode))
+				printf("\n%s: not a file.\n", alvo.selecionadas[i].nome.c_str());
+			else
+				printaArquivo(&alvo.inodes[i]);
+		}
+	}
+}
 
-	// Percorre todos os bytes do bitmap
-	for (int i = 0; i < 1024; i++)
+/* Exibe os atributos das entradas selecionadas por 'alvos', uma por linha seguida do nome (attr com vários alvos ou padrões)
+*/
+void funct_attr_lote(vector<struct AlvosDiretorio> &alvos)
+{
+	vector<struct ext2_group_desc> grupos;
+	string saida = "permissões   uid   gid    tamanho    modificado em        nome\n";
+
+	read_group_descs(grupos);
+
+	for (auto &alvo : alvos)
 	{
-		char a = bitmap[i];
-		printf("%d - ", i);
+		selecionaEntradas(&alvo, grupos);
 
-		// Exibe os bits que indicam o estado de cada Bloco
-		for (int j = 0; j < 8; j++)
+		for (size_t i = 0; i < alvo.selecionadas.size(); i++)
 		{
-			printf("%d ", !!((a >> j) & 0x01));
+			char linha[128];
+
+			formataAtributos(&alvo.inodes[i], linha, sizeof(linha));
+			saida += string(linha) + "  " + alvo.selecionadas[i].nome + "\n";
 		}
-		printf("\n");
 	}
 
-	free(bitmap);
+	fwrite(saida.data(), 1, saida.size(), stdout);
 }
 
-// Exibe o bitmap de Inodes do grupo 'group'
-void read_inode_bitmap(struct ext2_group_desc *group)
+/* Copia os arquivos selecionados por 'alvos' para o diretório do host 'destino', com os mesmos nomes (cp com vários
+alvos ou padrões)
+*/
+void funct_cp_lote(vector<struct AlvosDiretorio> &alvos, char *destino)
 {
-	char *bitmap;
+	vector<struct ext2_group_desc> grupos;
+	struct stat info;
 
-	bitmap = (char *)malloc(block_size);
+	if (stat(destino, &info) < 0 || !S_ISDIR(info.st_mode))
+	{
+		printf("\nnot a directory.\n");
+		return;
+	}
 
-	// Lê o bitmap de inodes em 'bitmap'
-	lseek(fd, BLOCK_OFFSET(group->bg_inode_bitmap), SEEK_SET);
-	read(fd, bitmap, block_size);
+	read_group_descs(grupos);
 
-	// Percorre todos os bytes do bitmap
-	for (int i = 0; i < 1024; i++)
+	for (auto &alvo : alvos)
 	{
-		char a = bitmap[i];
-		printf("%d - ", i);
+		selecionaEntradas(&alvo, grupos);
 
-		// Exibe os bits que indicam o estado de cada Inode
-		for (int j = 0; j < 8; j++)
+		for (size_t i = 0; i < alvo.selecionadas.size(); i++)
 		{
-			printf("%d ", !!((a >> j) & 0x01));
+			if (S_ISDIR(alvo.inodes[i].i_mode))
+			{
+				printf("\n%s: not a file.\n", alvo.selecionadas[i].nome.c_str());
+				continue;
+			}
+
+			string caminho = string(destino) + "/" + alvo.selecionadas[i].nome;
+			copiaArquivo(&alvo.inodes[i], (char *)caminho.c_str());
 		}
-		printf("\n");
 	}
-
-	free(bitmap);
 }
 
-// Retorna o offset do primeiro Inode livre no bitmap de Inodes
-int find_free_inode(struct ext2_group_desc *group)
+/* Cria os arquivos (ou, com 'diretorio', os diretórios) nomeados por 'alvos' (touch e mkdir com vários alvos)
+
+Cada diretório é lido uma única vez para descartar os nomes existentes. Os Inodes (e os blocos dos novos diretórios)
+são alocados em um PlanoAlocacao, no grupo do diretório que os contém (os diretórios, distribuídos entre os grupos),
+e as entradas são inseridas em lote nas folgas dos blocos; as que não cabem são empacotadas em blocos novos
+acrescentados ao diretório. Nada é escrito se falta espaço
+*/
+void funct_cria_lote(vector<struct AlvosDiretorio> &alvos, int diretorio)
 {
-	char *bitmap;
+	struct PlanoAlocacao plano;
+	vector<struct BlocoPlanejado> blocos;
+	vector<pair<unsigned int, struct ext2_inode>> inodes;
+	deque<struct EscritaArquivo> crescimentos; // Diretórios que recebem blocos novos
+	vector<unsigned long long> novosTamanhos;  // Tamanho de cada diretório de 'crescimentos' com os blocos novos
+	unsigned int agora = time(NULL);
 
-	bitmap = (char *)malloc(block_size);
+	carregaPlano(&plano, 0);
 
-	lseek(fd, BLOCK_OFFSET(group->bg_inode_bitmap), SEEK_SET);
-	read(fd, bitmap, block_size);
+	for (auto &alvo : alvos)
+	{
+		vector<struct EntradaDir> entradas, novas;
+		set<string> existentes;
 
-	int buscar = 1;
+		le_entradas_diretorio(&alvo.dir, entradas);
 
-	for (int i = 0; i < 1024 && buscar; i++)
-	{
-		char a = bitmap[i];
+		for (auto &entrada : entradas)
+			existentes.insert(entrada.nome);
+
+		for (auto &nome : alvo.nomes)
+		{
+			if (!existentes.insert(nome).second)
+			{
+				printf("\n%s: file already exists.\n", nome.c_str());
+				continue;
+			}
+
+			unsigned int numInode = diretorio ? planejaInodeDiretorio(&plano) : planejaInode(&plano, (alvo.numDir - 1) / super.s_inodes_per_group);
+			struct ext2_inode novo;
+			vector<unsigned int> bloco;
+
+			if (numInode == 0 || (diretorio && planejaBlocos(&plano, (numInode - 1) / super.s_inodes_per_group, 1, bloco) < 0))
+			{
+				printf("\nno space left on device.\n");
+				return;
+			}
+
+			memset(&novo, 0, sizeof(novo));
+			novo.i_atime = novo.i_ctime = novo.i_mtime = agora;
+
+			if (diretorio)
+			{
+				vector<char> conteudo;
+
+				empacotaEntradas({{numInode, tipoEntrada(S_IFDIR), "."}, {alvo.numDir, tipoEntrada(S_IFDIR), ".."}}, &conteudo);
+				blocos.push_back({bloco[0], conteudo});
+
+				novo.i_mode = S_IFDIR | 0755;
+				novo.i_links_count = 2;
+				novo.i_size = block_size;
+				novo.i_blocks = block_size / 512;
+				novo.i_block[0] = bloco[0];
+				alvo.dir.i_links_count++; // O '..' do novo diretório
+			}
+			else
+			{
+				novo.i_mode = S_IFREG | 0644;
+				novo.i_links_count = 1;
+			}
+
+			inodes.push_back({numInode, novo});
+			novas.push_back({numInode, tipoEntrada(novo.i_mode), nome});
+		}
+
+		size_t inseridas = adicionaEntradasDiretorio(&alvo.dir, novas, blocos);
+
+		if (inseridas == novas.size())
+			continue;
 
-		for (int j = 0; j < 8 && buscar; j++)
+		// As entradas restantes ocupam blocos novos no fim do diretório
+		vector<struct EntradaDir> restantes(novas.begin() + inseridas, novas.end());
+		vector<char> conteudo;
+		unsigned long numBlocos = empacotaEntradas(restantes, &conteudo);
+		unsigned long primeiro = tamanhoInode(&alvo.dir) / block_size;
+		int novo;
+
+		crescimentos.emplace_back();
+		novosTamanhos.push_back((unsigned long long)(primeiro + numBlocos) * block_size);
+		iniciaEscrita(&crescimentos.back(), alvo.numDir, &alvo.dir);
+		usaPlanoEscrita(&crescimentos.back(), &plano);
+
+		for (unsigned long b = 0; b < numBlocos; b++)
 		{
-			if (!((a >> j) & 0x01)) // Se achou um bit 0, para a busca e retorna o offset
-			{						// do Inode no bitmap de Inodes
-				buscar = 0;
-				return ((8 * i) + (j));
+			unsigned int bloco = blocoParaEscrita(&crescimentos.back(), primeiro + b, 1, &novo);
+
+			if (bloco == 0)
+			{
+				printf("\nno space left on device.\n");
+				return;
 			}
+
+			blocos.push_back({bloco, vector<char>(conteudo.begin() + b * block_size, conteudo.begin() + (b + 1) * block_size)});
 		}
 	}
 
-	free(bitmap);
+	unsigned long blocosTotal, inodesTotal;
 
-	return 0;
+	// Blocos de diretório, Inodes novos e diretórios pais (os que cresceram, com seus blocos de indireção); por último, as alocações
+	escreveBlocosOrdenados(blocos);
+	escreveInodesOrdenados(inodes, plano.grupos);
+
+	for (size_t i = 0; i < crescimentos.size(); i++)
+		concluiEscrita(&crescimentos[i], novosTamanhos[i], plano.grupos);
+
+	for (auto &alvo : alvos)
+		if (diretorio && find_if(crescimentos.begin(), crescimentos.end(), [&](const struct EscritaArquivo &e)
+								 { return e.numInode == alvo.numDir; }) == crescimentos.end())
+			write_inode_by_number(alvo.numDir, plano.grupos, &alvo.dir);
+
+	gravaPlano(&plano, &blocosTotal, &inodesTotal);
 }
 
-// Retorna o offset do primeiro Bloco livre no bitmap de Blocos
-int find_free_block(struct ext2_group_desc *group)
+/* Remove recursivamente as entradas selecionadas por 'alvos' (rm -r com um ou mais caminhos ou padrões)
+
+As subárvores são percorridas nível a nível, com os Inodes de cada nível lidos em lote. As entradas são removidas dos
+diretórios primeiro, em uma passada por diretório; só então os Inodes sem links restantes são encadeados na lista de
+órfãos e gravados em lote. Uma interrupção entre as duas etapas deixa Inodes inalcançáveis, que o e2fsck recupera, mas
+nunca entradas apontando para órfãos que a retomada liberaria. A liberação dos blocos e dos Inodes fica para a thread de liberação de órfãos, de modo que o
+comando não depende do volume de dados removido. Arquivos com links fora das subárvores apenas perdem os links removidos
+*/
+void funct_rm_recursivo(vector<struct AlvosDiretorio> &alvos)
 {
-	unsigned char *bitmap;
+	vector<struct ext2_group_desc> grupos;
+	set<unsigned int> emUso, vistos;
+	map<unsigned int, unsigned int> referencias; // Inode -> entradas removidas que o referenciam
+	vector<pair<unsigned int, struct ext2_inode>> orfaos, ajustados;
+	vector<set<string>> nomes(alvos.size());
+	vector<unsigned int> subdiretorios(alvos.size(), 0), nivel;
 
-	int buscar = 1;
+	read_group_descs(grupos);
 
-	bitmap = (unsigned char *)malloc(block_size);
-	lseek(fd, BLOCK_OFFSET(group->bg_block_bitmap), SEEK_SET);
-	read(fd, bitmap, block_size);
+	// O diretório corrente e os seus ancestrais não podem ser removidos
+	for (size_t k = 0; k <= vetorCaminhoAtual.size(); k++)
+		emUso.insert(resolveComponentes(vector<string>(vetorCaminhoAtual.begin(), vetorCaminhoAtual.begin() + k), grupos));
 
-	for (int i = 0; i < 1024 && buscar; i++)
+	for (size_t a = 0; a < alvos.size(); a++)
 	{
-		char a = bitmap[i];
+		selecionaEntradas(&alvos[a], grupos);
 
-		for (int j = 0; j < 8 && buscar; j++)
+		for (size_t i = 0; i < alvos[a].selecionadas.size(); i++)
 		{
-			if (!((a >> j) & 0x01)) // Se achou um bit 0, para a busca e retorna o offset
-			{						// do Bloco no bitmap de Blocos
-				buscar = 0;
-				return ((8 * i) + (j));
+			struct EntradaDir &entrada = alvos[a].selecionadas[i];
+
+			if (entrada.nome == "." || entrada.nome == "..")
+			{
+				printf("\ninvalid sintax.\n");
+				continue;
+			}
+
+			if (emUso.count(entrada.inode))
+			{
+				printf("\n%s: directory in use.\n", entrada.nome.c_str());
+				continue;
+			}
+
+			nomes[a].insert(entrada.nome);
+			referencias[entrada.inode]++;
+
+			if (S_ISDIR(alvos[a].inodes[i].i_mode))
+				subdiretorios[a]++;
+
+			if (vistos.insert(entrada.inode).second)
+			{
+				orfaos.push_back({entrada.inode, alvos[a].inodes[i]});
+
+				if (S_ISDIR(alvos[a].inodes[i].i_mode))
+					nivel.push_back(entrada.inode);
 			}
 		}
 	}
 
-	free(bitmap);
+	// Percorre as subárvores nível a nível; 'vistos' evita percorrer duas vezes um diretório repetido ou corrompido
+	while (!nivel.empty())
+	{
+		vector<unsigned int> diretorios = nivel, numeros;
+		vector<struct ext2_inode> lidos, inodesNivel;
 
-	return 0;
-}
+		nivel.clear();
+		leInodesEmLote(diretorios, grupos, lidos);
 
-// Marca a posição bitVal no bitmap de Blocos como ocupada
-void set_block_bitmap(struct ext2_group_desc *group, int bitVal)
-{
-	char *bitmap;
+		for (auto &dir : lidos)
+		{
+			vector<struct EntradaDir> entradas;
 
-	int y = bitVal / 8; // Pega o byte em que se encontra o bloco
-	int x = bitVal % 8; // Pega o offset no byte
+			le_entradas_diretorio(&dir, entradas);
 
-	int marcado = (0x1 << x); // Transforma o offset em número binário
+			for (auto &entrada : entradas)
+			{
+				if (entrada.nome == "." || entrada.nome == "..")
+					continue;
 
-	bitmap = (char *)malloc(block_size);
+				referencias[entrada.inode]++;
 
-	// Lê o bitmap de blocos
-	lseek(fd, BLOCK_OFFSET(group->bg_block_bitmap), SEEK_SET);
-	read(fd, bitmap, block_size);
+				if (!vistos.count(entrada.inode))
+					numeros.push_back(entrada.inode);
+			}
+		}
 
-	// Pega o byte correspondente de bitVal
-	char tmp = bitmap[y];
+		leInodesEmLote(numeros, grupos, inodesNivel);
 
-	tmp = (tmp | marcado); // Constrói o valor do byte de 'bitVal' que teríamos se estivesse 'ocupado'
-	bitmap[y] = tmp;	   // Armazena no bitmap
+		for (size_t i = 0; i < numeros.size(); i++)
+		{
+			vistos.insert(numeros[i]);
+			orfaos.push_back({numeros[i], inodesNivel[i]});
 
-	// Atualiza o bitmap
-	lseek(fd, BLOCK_OFFSET(group->bg_block_bitmap), SEEK_SET);
-	write(fd, bitmap, block_size);
+			if (S_ISDIR(inodesNivel[i].i_mode))
+				nivel.push_back(numeros[i]);
+		}
+	}
 
-	free(bitmap);
-}
+	if (orfaos.empty())
+		return;
 
-// Marca a posição bitVal no bitmap de Inodes como ocupada
-void set_inode_bitmap(struct ext2_group_desc *group, int bitVal)
-{
-	char *bitmap;
-	int y = bitVal / 8; // Pega o byte em que se encontra o Inode
-	int x = bitVal % 8; // Pega o offset no byte
+	// Arquivos ainda referenciados fora das subárvores ficam com os links restantes
+	orfaos.erase(remove_if(orfaos.begin(), orfaos.end(), [&](pair<unsigned int, struct ext2_inode> &orfao)
+						   {
+							   if (S_ISDIR(orfao.second.i_mode) || orfao.second.i_links_count <= referencias[orfao.first])
+								   return false;
 
-	int marcado = (0x1 << x);
+							   orfao.second.i_links_count -= referencias[orfao.first];
+							   ajustados.push_back(orfao);
+							   return true; }),
+				 orfaos.end());
+
+	// Primeiro as entradas deixam os diretórios; cada subdiretório removido leva um link do pai ('..')
+	for (size_t a = 0; a < alvos.size(); a++)
+	{
+		if (nomes[a].empty() || vistos.count(alvos[a].numDir))
+			continue;
 
-	bitmap = (char *)malloc(block_size);
+		removeEntradasDiretorio(&alvos[a].dir, nomes[a]);
 
-	lseek(fd, BLOCK_OFFSET(group->bg_inode_bitmap), SEEK_SET);
-	read(fd, bitmap, block_size);
+		if (subdiretorios[a])
+		{
+			read_inode_by_number(alvos[a].numDir, grupos, &alvos[a].dir);
+			alvos[a].dir.i_links_count -= subdiretorios[a];
+			write_inode_by_number(alvos[a].numDir, grupos, &alvos[a].dir);
+		}
+	}
 
-	char tmp = bitmap[y];
+	// Só então os órfãos, já sem entradas, são encadeados em ordem de Inode à frente da lista existente
+	sort(orfaos.begin(), orfaos.end(), [](const pair<unsigned int, struct ext2_inode> &a, const pair<unsigned int, struct ext2_inode> &b)
+		 { return a.first < b.first; });
 
-	tmp = (tmp | marcado);
-	bitmap[y] = tmp;
+	for (size_t i = 0; i < orfaos.size(); i++)
+	{
+		orfaos[i].second.i_links_count = 0;
+		orfaos[i].second.i_dtime = (i + 1 < orfaos.size()) ? orfaos[i + 1].first : super.s_last_orphan;
+		invalidaExtensoes(orfaos[i].first);
+	}
 
-	lseek(fd, BLOCK_OFFSET(group->bg_inode_bitmap), SEEK_SET);
-	write(fd, bitmap, block_size);
+	escreveInodesOrdenados(orfaos, grupos);
+	escreveInodesOrdenados(ajustados, grupos);
 
-	free(bitmap);
-}
+	if (!orfaos.empty())
+	{
+		super.s_last_orphan = orfaos[0].first;
+		write_image(&super, sizeof(struct ext2_super_block), BASE_OFFSET);
+	}
 
-// Cacula o número a ser somado ao tamanho do nome do arquivo para que a entrada tenha tamanho múltiplo de 4
-int roundLen(int tamanho)
-{
-	return (tamanho % 4 == 0) ? 0 : 4 - (tamanho % 4);
+	invalidaCacheCaminhos();
+	iniciaLiberacaoOrfaos();
 }
 
-/* Atualiza o valor de 'group' com base em 'groupNum', e o valor de 'super'
+#define TAM_BUFFER_DESFRAGMENTACAO (1 << 20) // Maior escrita contígua da desfragmentação
 
-Utilizado nas funções: touch, mkdir, rm e rmdir
+/* Retorna o número de fragmentos de 'inode': faixas de blocos físicos consecutivos no percurso do mapa, na ordem em
+que montaMapaBlocos dispõe os blocos (cada bloco de indireção antes dos blocos que ele mapeia); buracos não contam
+
+numBlocos: recebe a quantidade de blocos do arquivo, de dados e de indireção
 */
-void rewriteSuperAndGroup(struct ext2_group_desc *group, int groupNum)
+static unsigned long contaFragmentos(struct ext2_inode *inode, unsigned long *numBlocos)
 {
-	lseek(fd, BASE_OFFSET + block_size + sizeof(struct ext2_group_desc) * groupNum, SEEK_SET);
-	write(fd, group, sizeof(struct ext2_group_desc));
+	unsigned long fragmentos = 0;
+	unsigned int anterior = 0;
 
-	lseek(fd, BASE_OFFSET, SEEK_SET);
-	write(fd, &super, sizeof(struct ext2_super_block));
-}
+	*numBlocos = 0;
 
-/* Cria um diretório de nome 'nome' no diretório atual
+	auto visita = [&](unsigned int bloco)
+	{
+		if (anterior == 0 || bloco != anterior + 1)
+			fragmentos++;
 
-nome: nome do diretório que se deseja criar
-numGrupo: valor de grupoAtual
+		anterior = bloco;
+		(*numBlocos)++;
+	};
+
+	percorreMapaBlocos(
+		inode, [&](unsigned long, unsigned int bloco)
+		{ visita(bloco); },
+		visita);
+
+	return fragmentos;
+}
+
+// Estado de uma execução de defrag
+struct Desfragmentacao
+{
+	struct PlanoAlocacao plano; // Carregado no primeiro arquivo realocado e mantido em dia entre os arquivos
+	int planoCarregado;
+	vector<char> buffer;
+	unsigned long long limite;		  // Taxa máxima de cópia, em bytes por segundo (0: sem limite)
+	unsigned long long bytesCopiados;
+	chrono::steady_clock::time_point inicio;
+};
+
+// Bloco de destino de uma realocação e a origem do seu conteúdo: um bloco antigo de dados ou um bloco de indireção novo
+struct CopiaBloco
+{
+	unsigned int destino;
+	unsigned int origem;
+	const char *conteudo;
+};
+
+/* Realoca o arquivo de Inode 'numInode', hoje com 'fragmentos' fragmentos, para blocos contíguos
+
+Os blocos de dados (com os buracos preservados) e de indireção são planejados com planejaBlocosContiguos; se a alocação
+obtida não tiver menos fragmentos que a atual, nada é alterado. O conteúdo é montado e escrito em faixas contíguas de
+destino de até TAM_BUFFER_DESFRAGMENTACAO bytes, respeitando o limite de taxa. Depois vão os blocos de indireção, as
+alocações e o Inode, e só então os blocos antigos são liberados, em lote
+Retorna o número de fragmentos resultante, ou 0 se o arquivo não foi realocado
 */
-void funct_mkdir(struct ext2_inode *inode, struct ext2_group_desc *group, char *nome, int numGrupo)
+static unsigned long realocaArquivo(struct Desfragmentacao *d, unsigned int numInode, struct ext2_inode *inode, unsigned long fragmentos)
 {
-	struct ext2_dir_entry_2 *entryTmp = (struct ext2_dir_entry_2 *)malloc(sizeof(struct ext2_dir_entry_2));
-	struct ext2_inode *inodeTemp = (struct ext2_inode *)malloc(sizeof(struct ext2_inode));
-	struct ext2_group_desc *groupDest = (struct ext2_group_desc *)malloc(sizeof(struct ext2_group_desc)); // Grupo 0
+	vector<unsigned int> antigos, indiretosAntigos, destino, novos;
+	vector<struct BlocoPlanejado> indiretosNovos;
 
-	// Lê em groupDest, o grupo 0
-	lseek(fd, BASE_OFFSET + block_size + sizeof(struct ext2_group_desc) * 0, SEEK_SET);
-	read(fd, groupDest, sizeof(struct ext2_group_desc));
+	resolve_block_map(inode, antigos, &indiretosAntigos);
 
-	void *producedBlock;
-	struct ext2_dir_entry_2 *producedEntry;
+	vector<char> presentes(antigos.size());
+	unsigned long numDados = 0;
 
-	char *nomeFinal;
-	int tamNome;
-	int arredondamento = 0;
-	int tamanho = 0;
-	int inodeVal = 0;	 // Offset do primeiro Inode livre no bitmap de Inodes do grupo 0
-	long existe = 0;	 // Variável para validação de 'nome'
-	int blockVal = 0;	 // Offset do primeiro Bloco livre no bitmap de Blocos do grupo 0
-	long inodeAtual = 0; // Número do Inode do diretório corrente
+	for (size_t i = 0; i < antigos.size(); i++)
+		numDados += presentes[i] = (antigos[i] != 0);
 
-	// Verifica se 'nome' é nome de alguma entrada do diretório corrente
-	read_dir(inode, group, &existe, nome);
+	unsigned long quantidade = numDados + blocosIndiretosEsparsos(presentes);
+	unsigned long faixas = 1;
 
-	if (existe != -1)
+	if (planejaBlocosContiguos(&d->plano, (numInode - 1) / super.s_inodes_per_group, 0, quantidade, destino) < 0)
 	{
-		printf("\nfile already exists.\n");
-		return;
+		devolveBlocosPlano(&d->plano, destino.data(), destino.size());
+		return 0;
 	}
 
-	// Atribui para inodeAtual o número do Inode do diretório corrente
-	read_dir(inode, group, &inodeAtual, ".");
-
-	inodeVal = find_free_inode(groupDest) + 1;
-
-	set_inode_bitmap(groupDest, (inodeVal - 1));
-
-	// Tratamento do nome do diretório novo
-	tamNome = strlen(nome);
-	arredondamento = roundLen(8 + tamNome);
-	nomeFinal = (char *)malloc((tamNome + arredondamento) * sizeof(char));
-	strcpy(nomeFinal, nome);
+	for (size_t i = 1; i < destino.size(); i++)
+		faixas += (destino[i] != destino[i - 1] + 1);
 
-	for (int i = 0; i < arredondamento; i++)
+	if (faixas >= fragmentos)
 	{
-		strcat(nomeFinal, "\0");
+		devolveBlocosPlano(&d->plano, destino.data(), destino.size());
+		return 0;
 	}
 
-	// Criação de uma entrada do tipo diretório
+	struct ext2_inode novo = *inode;
 
-	// Entrada tem o tamanho de um bloco
-	producedBlock = malloc(block_size);
-	producedEntry = (struct ext2_dir_entry_2 *)producedBlock;
+	memset(novo.i_block, 0, sizeof(novo.i_block));
+	montaMapaBlocos(&novo, destino, antigos.size(), indiretosNovos, novos, &presentes);
+	novo.i_blocks += (destino.size() - numDados - indiretosAntigos.size()) * (block_size / 512);
 
-	// Na posição 0 contém a entrada '.'
-	producedEntry = (ext2_dir_entry_2 *)((char *)producedEntry + 0);
-	producedEntry->file_type = 2;
-	producedEntry->name_len = 1;
-	producedEntry->rec_len = 12;
-	memcpy(producedEntry->name, ".\0\0\0", 4);
-	producedEntry->inode = inodeVal; // Referencia o Inode identificado como vazio no bitmap
+	vector<struct CopiaBloco> copias;
 
-	// Na posição 12 contém a entrada '..'
-	producedEntry = (ext2_dir_entry_2 *)((char *)producedEntry + producedEntry->rec_len);
-	producedEntry->file_type = 2;
-	producedEntry->name_len = 2;
-	producedEntry->rec_len = 1012;
-	memcpy(producedEntry->name, "..\0\0", 4);
-	producedEntry->inode = inodeAtual; // Referencia o Inode do diretório pai
+	for (size_t i = 0; i < novos.size(); i++)
+		if (novos[i])
+			copias.push_back({novos[i], antigos[i], NULL});
 
-	blockVal = find_free_block(groupDest) + 1;
+	for (auto &indireto : indiretosNovos)
+		copias.push_back({indireto.bloco, 0, indireto.dados.data()});
 
-	set_block_bitmap(groupDest, (blockVal - 1));
+	sort(copias.begin(), copias.end(), [](const struct CopiaBloco &a, const struct CopiaBloco &b)
+		 { return a.destino < b.destino; });
 
-	// Escreve o bloco producedBlock que contém as entradas '.' e '..' criadas, no primeiro bloco vazio do grupo 0
-	lseek(fd, BLOCK_OFFSET(blockVal), SEEK_SET);
-	write(fd, producedBlock, block_size);
+	// Os blocos de destino podem ter sido liberados por uma transação que ainda tem versões deles no jornal
+	vector<unsigned int> destinos;
 
-	int temp = getLastEntry(inode, group);
+	for (auto &copia : copias)
+		destinos.push_back(copia.destino);
 
-	void *block;
+	preparaEscritaDireta(destinos.data(), destinos.size());
 
-	if (S_ISDIR(inode->i_mode))
+	size_t maxBlocos = d->buffer.size() / block_size;
+
+	for (size_t k = 0; k < copias.size();)
 	{
-		struct ext2_dir_entry_2 *entry;
+		size_t n = 1;
 
-		unsigned int size = 0;
+		while (k + n < copias.size() && n < maxBlocos && copias[k + n].destino == copias[k].destino + n)
+			n++;
 
-		if ((block = malloc(block_size)) == NULL)
+		// Blocos antigos consecutivos são lidos juntos; os blocos de indireção já estão em memória
+		for (size_t j = k; j < k + n;)
 		{
-			fprintf(stderr, "\nmemory insufficient.\n");
-			close(fd);
-			exit(1);
+			char *alvo = d->buffer.data() + (j - k) * block_size;
+			size_t m = 1;
+
+			if (copias[j].conteudo)
+			{
+				memcpy(alvo, copias[j].conteudo, block_size);
+				j++;
+				continue;
+			}
+
+			while (j + m < k + n && !copias[j + m].conteudo && copias[j + m].origem == copias[j].origem + m)
+				m++;
+
+			read_image(alvo, m * block_size, BLOCK_OFFSET(copias[j].origem));
+			j += m;
 		}
 
-		// Lê em block, o bloco 0 do diretório atual com suas entradas
-		lseek(fd, BLOCK_OFFSET(inode->i_block[0]), SEEK_SET);
-		read(fd, block, block_size);
-
-		entry = (struct ext2_dir_entry_2 *)block;
-
-		// Atribui a 'entry' a última posição da lista de entries
-		entry = (ext2_dir_entry_2 *)((char *)entry + temp);
-
-		// Ajusta re_len da última entrada para um valor 'normal'
-		// Agora a última entrada será o diretório novo
-		entry->rec_len = 8 + entry->name_len;
-		entry->rec_len = entry->rec_len + roundLen(entry->rec_len);
-
-		// Criação do Inode do diretório novo
-		inodeTemp->i_block[0] = blockVal;
-		inodeTemp->i_block[1] = 0;
-		inodeTemp->i_block[2] = 0;
-		inodeTemp->i_block[3] = 0;
-		inodeTemp->i_block[4] = 0;
-		inodeTemp->i_block[5] = 0;
-		inodeTemp->i_block[6] = 0;
-		inodeTemp->i_block[7] = 0;
-		inodeTemp->i_block[8] = 0;
-		inodeTemp->i_block[9] = 0;
-		inodeTemp->i_block[10] = 0;
-		inodeTemp->i_block[11] = 0;
-		inodeTemp->i_block[12] = 0;
-		inodeTemp->i_block[13] = 0;
-		inodeTemp->i_block[14] = 0;
-		inodeTemp->i_atime = 1668912196;
-		inodeTemp->i_blocks = 2;
-		inodeTemp->i_ctime = 1668911978;
-		inodeTemp->i_dir_acl = 0;
-		inodeTemp->i_dtime = 0;
-		inodeTemp->i_faddr = 0;
-		inodeTemp->i_file_acl = 0;
-		inodeTemp->i_flags = 0;
-		inodeTemp->i_generation = -1833064728;
-		inodeTemp->i_gid = 0;
-		inodeTemp->i_links_count = 2;
-		inodeTemp->i_mode = 16877;
-		inodeTemp->i_mtime = 1668911978;
-		inodeTemp->i_size = 1024;
-		inodeTemp->i_uid = 0;
-
-		write_inode(inodeVal, groupDest, inodeTemp);
-
-		// Adição da nova entrada no fim lista de entradas
-
-		// Cálculo da nova última posição
-		temp = temp + entry->rec_len;
-
-		// Atribui a 'entry' a nova última posição da lista de entries
-		entry = (ext2_dir_entry_2 *)((char *)entry + entry->rec_len);
-
-		// Definição de valores
-
-		entry->inode = inodeVal;
-		entry->name_len = tamNome;
-		entry->rec_len = 1024 - temp; // Ajusta o valor de rec_len da nova última posição
-
-		memcpy(entry->name, nomeFinal, tamNome * sizeof(char));
-
-		entry->file_type = 2;
-
-		// Sobreescrita do bloco antigo, com o bloco com a nova entrada
-		lseek(fd, BLOCK_OFFSET(inode->i_block[0]), SEEK_SET);
-		write(fd, block, block_size);
-	}
-
-	// Atualização do número de Blocos livres em 'group' e 'super'
-	group->bg_free_blocks_count = group->bg_free_blocks_count - 1;
-	super.s_free_blocks_count = super.s_free_blocks_count - 1;
-
-	// Atualização do número de Inodes livres em 'group' e 'super'
-	group->bg_free_inodes_count = group->bg_free_inodes_count - 1;
-	super.s_free_inodes_count = super.s_free_inodes_count - 1;
+		pwriteContado(fd, d->buffer.data(), n * block_size, BLOCK_OFFSET(copias[k].destino));
+		d->bytesCopiados += n * block_size;
+		k += n;
 
-	// Escrita dos novos valores
-	rewriteSuperAndGroup(group, numGrupo);
+		// Limite de taxa: espera até o instante em que os bytes copiados até aqui estariam dentro do limite
+		if (d->limite)
+			this_thread::sleep_until(d->inicio + chrono::nanoseconds((long long)(d->bytesCopiados * 1e9 / d->limite)));
+	}
+
+	unsigned long blocosTotal, inodesTotal;
+
+	escreveBlocosOrdenados(indiretosNovos);
+	gravaPlano(&d->plano, &blocosTotal, &inodesTotal);
+	write_inode_by_number(numInode, d->plano.grupos, &novo);
+	invalidaExtensoes(numInode);
+
+	antigos.insert(antigos.end(), indiretosAntigos.begin(), indiretosAntigos.end());
+	liberaBlocos(antigos);
 
-	free(inodeTemp);
-	free(entryTmp);
+	// O plano continua válido para o próximo arquivo: as alocações já foram gravadas e os blocos antigos estão livres
+	devolveBlocosPlano(&d->plano, antigos.data(), antigos.size());
+	fill(d->plano.blocosUsados.begin(), d->plano.blocosUsados.end(), 0);
+	read_group_descs(d->plano.grupos);
+
+	confirmaTransacao(); // Cada arquivo realocado é uma transação do jornal
+
+	return faixas;
 }
 
-/* Cria um arquivo com nome 'nome'
+// Arquivo regular encontrado pela desfragmentação
+struct ArquivoDesfragmentado
+{
+	unsigned int numInode;
+	string caminho;
+	struct ext2_inode inode;
+};
 
-grupoAtual: variável global que indica o grupo corrente
+/* Desfragmenta o arquivo 'caminho' ou todos os arquivos regulares da subárvore do diretório 'caminho'
+
+A subárvore é percorrida nível a nível, com os Inodes de cada nível lidos em lote, e os arquivos são processados em
+ordem de Inode. Os arquivos com mais de um fragmento são realocados por realocaArquivo
+limite: taxa máxima de cópia em bytes por segundo (0: sem limite), para não monopolizar o disco
+simulacao: apenas lista os arquivos fragmentados
 */
-void funct_touch(struct ext2_inode *inode, struct ext2_group_desc *group, char *nome, int grupoAtual)
+void funct_defrag(const char *caminho, unsigned long long limite, int simulacao)
 {
-	struct ext2_dir_entry_2 *entryTmp = (struct ext2_dir_entry_2 *)malloc(sizeof(struct ext2_dir_entry_2));
-	struct ext2_inode *inodeTemp = (struct ext2_inode *)malloc(sizeof(struct ext2_inode));
-	struct ext2_group_desc *groupDest = (struct ext2_group_desc *)malloc(sizeof(struct ext2_group_desc)); // Grupo em que será criado o arquivo
-
-	// Lê em groupDest o grupo 0
-	lseek(fd, BASE_OFFSET + block_size + sizeof(struct ext2_group_desc) * 0, SEEK_SET);
-	read(fd, groupDest, sizeof(struct ext2_group_desc));
+	vector<struct ext2_group_desc> grupos;
+	vector<struct ArquivoDesfragmentado> arquivos;
+	vector<pair<unsigned int, string>> nivel;
+	set<unsigned int> vistos;
+	struct ext2_inode inode;
 
-	char *nomeFinal;
-	int tamNome;
-	int arredondamento = 0;
-	int tamanho = 0;
-	int inodeVal = 0;			// Offset do primeiro Inode livre no bitmap de Inodes do grupo 0
-	long existe = 0;			// Variável para validação de 'nome' 
-	int grupoTmp = -1; 
+	read_group_descs(grupos);
 
-	// Verifica se 'nome' é nome de alguma entrada do diretório corrente
-	read_dir(inode, group, &existe, nome);
+	unsigned int raiz = resolveCaminhoCache(caminho, grupos);
 
-	if (existe != -1)
+	if (raiz == 0 || read_inode_by_number(raiz, grupos, &inode) < 0)
 	{
-		printf("\nfile already exists.\n");
+		printf("\nfile not found.\n");
 		return;
 	}
 
-	inodeVal = find_free_inode(group) + 1;
+	if (S_ISREG(inode.i_mode))
+		arquivos.push_back({raiz, caminho, inode});
+	else if (S_ISDIR(inode.i_mode))
+		nivel.push_back({raiz, strcmp(caminho, "/") ? caminho : ""});
 
-	set_inode_bitmap(group, (inodeVal - 1));
+	vistos.insert(raiz);
 
-	// Tratamento do nome do diretório novo
+	while (!nivel.empty())
+	{
+		vector<unsigned int> numeros;
+		vector<struct ext2_inode> inodes;
+		vector<pair<unsigned int, string>> filhos;
 
-	tamNome = strlen(nome);
-	arredondamento = roundLen(8 + tamNome);
-	nomeFinal = (char *)malloc((tamNome + arredondamento) * sizeof(char));
-	strcpy(nomeFinal, nome);
+		for (auto &dir : nivel)
+			numeros.push_back(dir.first);
 
-	for (int i = 0; i < arredondamento; i++)
-	{
-		strcat(nomeFinal, "\0");
-	}
+		leInodesEmLote(numeros, grupos, inodes);
 
-	int temp = getLastEntry(inode, group);
+		for (auto &dir : nivel)
+		{
+			vector<struct EntradaDir> entradas;
 
-	tamNome = strlen(nome);
+			le_entradas_diretorio(&inodes[lower_bound(numeros.begin(), numeros.end(), dir.first) - numeros.begin()], entradas);
 
-	void *block;
+			for (auto &entrada : entradas)
+				if (entrada.nome != "." && entrada.nome != ".." && vistos.insert(entrada.inode).second)
+					filhos.push_back({entrada.inode, dir.second + "/" + entrada.nome});
+		}
 
-	if (S_ISDIR(inode->i_mode))
-	{
-		struct ext2_dir_entry_2 *entry;
+		numeros.clear();
+		nivel.clear();
 
-		unsigned int size = 0;
+		for (auto &filho : filhos)
+			numeros.push_back(filho.first);
 
-		if ((block = malloc(block_size)) == NULL)
-		{ 
-			fprintf(stderr, "\nmemory insufficient.\n");
-			close(fd);
-			exit(1);
-		}
+		leInodesEmLote(numeros, grupos, inodes);
 
-		// Lê em block, o bloco 0 do diretório atual com suas entradas
-		lseek(fd, BLOCK_OFFSET(inode->i_block[0]), SEEK_SET);
-		read(fd, block, block_size);
-
-		entry = (struct ext2_dir_entry_2 *)block;
-
-		// Atribui a 'entry' a última posição da lista de entries
-		entry = (ext2_dir_entry_2 *)((char *)entry + temp);
-
-		// Ajusta re_len da última entrada para um valor 'normal'
-		// Agora a última entrada será o arquivo novo
-		entry->rec_len = 8 + entry->name_len;
-		entry->rec_len = entry->rec_len + roundLen(entry->rec_len);
-
-		// Criação do Inode do arquivo novo
-		inodeTemp->i_block[0] = 0;
-		inodeTemp->i_block[1] = 0;
-		inodeTemp->i_block[2] = 0;
-		inodeTemp->i_block[3] = 0;
-		inodeTemp->i_block[4] = 0;
-		inodeTemp->i_block[5] = 0;
-		inodeTemp->i_block[6] = 0;
-		inodeTemp->i_block[7] = 0;
-		inodeTemp->i_block[8] = 0;
-		inodeTemp->i_block[9] = 0;
-		inodeTemp->i_block[10] = 0;
-		inodeTemp->i_block[11] = 0;
-		inodeTemp->i_block[12] = 0;
-		inodeTemp->i_block[13] = 0;
-		inodeTemp->i_block[14] = 0;
-		inodeTemp->i_atime = 1668911917;
-		inodeTemp->i_blocks = 0;
-		inodeTemp->i_ctime = 1668911917;
-		inodeTemp->i_dir_acl = 0;
-		inodeTemp->i_dtime = 0;
-		inodeTemp->i_faddr = 0;
-		inodeTemp->i_file_acl = 0;
-		inodeTemp->i_flags = 0;
-		inodeTemp->i_generation = -1280917867;
-		inodeTemp->i_gid = 0;
-		inodeTemp->i_links_count = 1;
-		inodeTemp->i_mode = 33188;
-		inodeTemp->i_mtime = 1668911917;
-		inodeTemp->i_size = 0;
-		inodeTemp->i_uid = 0;
-
-		write_inode(inodeVal, groupDest, inodeTemp);
-
-		// Adição da nova entrada no fim lista de entradas
-
-		// Cálculo da nova última posição
-		temp = temp + entry->rec_len;
-
-		// Atribui a 'entry' a nova última posição da lista de entries
-		entry = (ext2_dir_entry_2 *)((char *)entry + entry->rec_len);
-
-		// Definição de valores
-
-		entry->inode = inodeVal;
-		entry->name_len = tamNome;
-		entry->rec_len = 1024 - temp; // Ajusta o valor de rec_len da nova última posição
-
-		memcpy(entry->name, nomeFinal, tamNome * sizeof(char));
-
-		entry->file_type = 1;
-
-		// Sobreescrita do bloco antigo, com o bloco com a nova entrada
-		lseek(fd, BLOCK_OFFSET(inode->i_block[0]), SEEK_SET);
-		write(fd, block, block_size);
-	}
-
-	// Atualização do número de Inodes livres em 'group' e 'super'
-	group->bg_free_inodes_count = group->bg_free_inodes_count - 1;
-	super.s_free_inodes_count = super.s_free_inodes_count - 1;
+		for (auto &filho : filhos)
+		{
+			struct ext2_inode &lido = inodes[lower_bound(numeros.begin(), numeros.end(), filho.first) - numeros.begin()];
 
-	// Escrita dos novos valores
-	rewriteSuperAndGroup(groupDest, 0);
+			if (S_ISDIR(lido.i_mode))
+				nivel.push_back(filho);
+			else if (S_ISREG(lido.i_mode))
+				arquivos.push_back({filho.first, filho.second, lido});
+		}
+	}
 
-	free(inodeTemp);
-	free(entryTmp);
-}
+	sort(arquivos.begin(), arquivos.end(), [](const struct ArquivoDesfragmentado &a, const struct ArquivoDesfragmentado &b)
+		 { return a.numInode < b.numInode; });
 
-// Retorna quantas entradas o diretório de inode 'inode' possui. Desconta as entradas '.' e '..'
-int isLoaded(struct ext2_inode *inode, struct ext2_group_desc *group)
-{
-	int contador = 0;
+	struct Desfragmentacao d;
+	unsigned long fragmentados = 0, realocados = 0, antes = 0, depois = 0;
 
-	void *block;
+	d.planoCarregado = 0;
+	d.limite = limite;
+	d.bytesCopiados = 0;
+	d.inicio = chrono::steady_clock::now();
 
-	if (S_ISDIR(inode->i_mode))
+	for (auto &arquivo : arquivos)
 	{
-		struct ext2_dir_entry_2 *entry;
-		unsigned int size = 0;
+		unsigned long numBlocos;
+		unsigned long fragmentos = contaFragmentos(&arquivo.inode, &numBlocos);
 
-		if ((block = malloc(block_size)) == NULL)
-		{ 
-			fprintf(stderr, "\nmemory insufficient.\n");
-			close(fd);
-			exit(1);
-		}
+		if (fragmentos <= 1)
+			continue;
 
-		lseek(fd, BLOCK_OFFSET(inode->i_block[0]), SEEK_SET);
-		read(fd, block, block_size); 
+		fragmentados++;
+		antes += fragmentos;
 
-		entry = (struct ext2_dir_entry_2 *)block; 
-												  
-		while ((size < inode->i_size) && entry->inode)
+		if (simulacao)
 		{
-			entry = (ext2_dir_entry_2 *)((char *)entry + entry->rec_len);
-			size += entry->rec_len;
-			contador++;
+			printf("%s: %lu fragments, %lu blocks\n", arquivo.caminho.c_str(), fragmentos, numBlocos);
+			continue;
 		}
-		
-		free(block);
-		
-		return (contador - 2);
-	}
-	return -1;
-}
 
-/* Se o bloco passado em 'valor' não pertence ao grupo 'grupoAtual', troca o grupo para o correspondente do bloco
-
-valor: número do bloco
-grupoAtual: variável global que indica o grupo corrente
-*/
-void trocaGrupoBlock(int valor, struct ext2_group_desc *group, int *grupoAtual)
-{
-	// Calcula-se o grupo de um bloco sabendo da quantidade de blocos por grupo
-	unsigned int block_group = (valor - 1) / super.s_blocks_per_group;
+		if (!d.planoCarregado)
+		{
+			carregaPlano(&d.plano, 0);
+			d.buffer.resize(TAM_BUFFER_DESFRAGMENTACAO);
+			d.planoCarregado = 1;
+		}
 
-	if (block_group != (*grupoAtual))
-	{
-		*grupoAtual = block_group;
+		unsigned long resultado = realocaArquivo(&d, arquivo.numInode, &arquivo.inode, fragmentos);
 
-		lseek(fd, BASE_OFFSET + block_size + sizeof(struct ext2_group_desc) * block_group, SEEK_SET);
-		read(fd, group, sizeof(struct ext2_group_desc));
+		realocados += (resultado != 0);
+		depois += resultado ? resultado : fragmentos;
 	}
-}
-
-/* Marca o bloco de número 'bitVal' como desocupado no bitmap de blocos de 'group'
 
-Utilizado nas funções rm e rmdir
-bitVal: número do bloco a ser desmarcado no bitmap de blocos
-*/
-void unset_block_bitmap(struct ext2_group_desc *group, int bitVal)
-{
-	char *bitmap;
+	double segundos = chrono::duration<double>(chrono::steady_clock::now() - d.inicio).count();
 
-	int y = (bitVal) / 8; // Pega o byte em que se encontra o Bloco
-	int x = (bitVal) % 8; // Pega o offset no byte
+	if (simulacao)
+		printf("\n%zu files, %lu fragmented (%lu fragments).\n", arquivos.size(), fragmentados, antes);
+	else
+		printf("\n%zu files, %lu fragmented, %lu relocated, fragments %lu -> %lu, %llu bytes copied in %.3f s.\n",
+			   arquivos.size(), fragmentados, realocados, antes, depois, d.bytesCopiados, segundos);
+}
 
-	// Exemplo:
-	// bitVal = 10110011 = 179
-	// y = 22
-	// x = 3
-	// marcado = 11111110 << 3 = 11110000
-	// marcado = 11110000 | (11111111 >> 5) = 11110000 | 00000111 = 11110111
+#define TAM_REGISTRO_TAR 512 // Tamanho de cada registro de um arquivo tar
+#define TAM_BLOCO_TAR 10240	 // O arquivo tar é completado até um múltiplo deste tamanho
 
-	int marcado = (0xFE << x);
+// Cabeçalho POSIX ustar
+struct CabecalhoTar
+{
+	char name[100];
+	char mode[8];
+	char uid[8];
+	char gid[8];
+	char size[12];
+	char mtime[12];
+	char chksum[8];
+	char typeflag;
+	char linkname[100];
+	char magic[6];
+	char version[2];
+	char uname[32];
+	char gname[32];
+	char devmajor[8];
+	char devminor[8];
+	char prefix[155];
+	char pad[12];
+};
+
+// Fluxo tar de saída com buffer próprio, escrito com escritas grandes
+struct SaidaTar
+{
+	int fd;
+	vector<char> buffer;
+	size_t usado;
+	unsigned long long total; // Bytes emitidos
+	int erro;
+};
+
+// Fluxo tar de entrada com buffer próprio
+struct EntradaTar
+{
+	int fd;
+	vector<char> buffer;
+	size_t inicio;
+	size_t fim;
+};
+
+// Escreve o conteúdo do buffer de 'saida' em seu descritor
+static void descarregaTar(struct SaidaTar *saida)
+{
+	size_t escrito = 0;
 
-	marcado = marcado | (0xFF >> (8 - x));
+	while (escrito < saida->usado)
+	{
+		ssize_t n = write(saida->fd, saida->buffer.data() + escrito, saida->usado - escrito);
 
-	bitmap = (char *)malloc(block_size); 
+		if (n <= 0)
+		{
+			saida->erro = 1;
+			break;
+		}
 
-	// Lê o bitmap do grupo 'group' em bitmap
-	lseek(fd, BLOCK_OFFSET(group->bg_block_bitmap), SEEK_SET);
-	read(fd, bitmap, block_size);
+		escrito += n;
+	}
 
-	char tmp = bitmap[y];
-	
-	tmp = (tmp & marcado);
+	saida->total += saida->usado;
+	saida->usado = 0;
+}
 
-	bitmap[y] = tmp;
+// Retorna um ponteiro para 'n' bytes livres no buffer de 'saida' (n não pode exceder o buffer) e os considera emitidos
+static char *reservaTar(struct SaidaTar *saida, size_t n)
+{
+	if (saida->usado + n > saida->buffer.size())
+		descarregaTar(saida);
 
-	// Reescreve o bitmap com o bloco desmarcado
-	lseek(fd, BLOCK_OFFSET(group->bg_block_bitmap), SEEK_SET);
-	write(fd, bitmap, block_size);
+	char *livre = saida->buffer.data() + saida->usado;
+	saida->usado += n;
 
-	free(bitmap);
+	return livre;
 }
 
-/* Remove a entrada de nome 'nome' da lista de entradas do diretório de inode 'inode'
-
-Utilizada nas funções rm e rmdir
-nome: nome da entrada a ser removida
-*/
-void removeEntry(struct ext2_inode *inode, struct ext2_group_desc *group, char *nome)
+// Emite 'n' bytes de 'dados' em 'saida'; se 'dados' for nulo, emite zeros
+static void escreveTar(struct SaidaTar *saida, const char *dados, unsigned long long n)
 {
-	void *block;
-	void *newBlock;
-	int acc = 0;				// Soma o rec_len de todas as entradas
-	int acc2 = 0;				// Soma o rec_len de todas entradas menos da entrada a ser removida
-	int lastEntry = 0;			// Última posição da lista de entradas
-	int removedSize = 0;		// rec_len da entrada removida
-	int lastEntrySize = 0;		// rec_len da última entrada do diretório corrente
-	int ultimoTam = 0;			// rec_len da última entrada (não removida)
-	int removido = 0;			// Indica que uma entrada foi removida
-
-	lastEntry = getLastEntry(inode, group);
-
-	if (S_ISDIR(inode->i_mode))
+	while (n > 0)
 	{
-		struct ext2_dir_entry_2 *entry;
-		struct ext2_dir_entry_2 *newEntry;
-		unsigned int size = 0;
-
-		if ((block = malloc(block_size)) == NULL)
-		{
-			fprintf(stderr, "\ninsufficient memory.\n");
-			close(fd);
-			exit(1);
-		}
+		size_t parte = (n < saida->buffer.size()) ? n : saida->buffer.size();
+		char *destino = reservaTar(saida, parte);
 
-		if ((newBlock = malloc(block_size)) == NULL)
+		if (dados)
 		{
-			fprintf(stderr, "\ninsufficient memory.\n");
-			close(fd);
-			exit(1);
+			memcpy(destino, dados, parte);
+			dados += parte;
 		}
+		else
+			memset(destino, 0, parte);
 
-		lseek(fd, BLOCK_OFFSET(inode->i_block[0]), SEEK_SET);
-		read(fd, block, block_size); 
-
-		entry = (struct ext2_dir_entry_2 *)block; 
+		n -= parte;
+	}
+}
 
-		newEntry = (struct ext2_dir_entry_2 *)newBlock;
+// Grava 'valor' em octal no campo numérico 'campo' de 'tam' bytes
+static void numeroTar(char *campo, size_t tam, unsigned long long valor)
+{
+	snprintf(campo, tam, "%0*llo", (int)tam - 1, valor);
+}
 
-		while ((size < inode->i_size) && entry->inode)
-		{
-			// Se o acumulador geral se torna diferente do acumulador 2, significa que 'removemos' uma entrada
-			// Não a colocamos em 'newBlock'
-			if (acc != acc2)
-			{
-				removido = 1;
-			}
-			
-			char file_name[EXT2_NAME_LEN + 1];
-			memcpy(file_name, entry->name, entry->name_len);
-			file_name[entry->name_len] = 0; 
+// Lê o campo numérico 'campo' de 'tam' bytes, em octal ou na codificação base-256 do GNU tar
+static unsigned long long leNumeroTar(const char *campo, size_t tam)
+{
+	unsigned long long valor = 0;
 
-			// Se o nome da entrada não é igual a da que desejamos remover, a adicionamos em 'newBlock'
-			if (strcmp(file_name, nome) != 0)
-			{
-				newEntry->file_type = entry->file_type;
-				newEntry->inode = entry->inode;
-				newEntry->name_len = entry->name_len;
-				newEntry->rec_len = entry->rec_len;
+	if ((unsigned char)campo[0] & 0x80)
+	{
+		for (size_t i = 1; i < tam; i++)
+			valor = (valor << 8) | (unsigned char)campo[i];
+		return valor;
+	}
 
-				memcpy(newEntry->name, entry->name, entry->name_len + roundLen(8 + entry->name_len));
+	for (size_t i = 0; i < tam && campo[i]; i++)
+	{
+		if (campo[i] >= '0' && campo[i] <= '7')
+			valor = valor * 8 + (campo[i] - '0');
+	}
 
-				ultimoTam = newEntry->rec_len;
+	return valor;
+}
 
-				acc2 += newEntry->rec_len;
+// Calcula o checksum de 'cab', considerando o próprio campo chksum preenchido com espaços
+static unsigned int checksumTar(struct CabecalhoTar *cab)
+{
+	unsigned int soma = 0;
+	unsigned char *bytes = (unsigned char *)cab;
 
-				newEntry = (ext2_dir_entry_2 *)((char *)newEntry + newEntry->rec_len);
-			}
-			else
-			{
-				removedSize += entry->rec_len;
-			}
+	for (size_t i = 0; i < sizeof(struct CabecalhoTar); i++)
+		soma += (i >= offsetof(struct CabecalhoTar, chksum) && i < offsetof(struct CabecalhoTar, chksum) + 8) ? ' ' : bytes[i];
 
-			acc += entry->rec_len;
+	return soma;
+}
 
-			entry = (ext2_dir_entry_2 *)((char *)entry + entry->rec_len);
-			size += entry->rec_len;
+// Emite um cabeçalho do tipo 'tipo' para 'caminho'. Nomes que não cabem no formato ustar recebem um cabeçalho GNU 'L' antes
+static void emiteCabecalhoTar(struct SaidaTar *saida, const string &caminho, char tipo, struct ext2_inode *inode,
+							  unsigned long long tamanho, const string &alvo)
+{
+	struct CabecalhoTar cab;
+	size_t divisao = string::npos;
 
-			if (acc == lastEntry)
-			{
-				lastEntrySize = entry->rec_len;
-			}
-		}
+	memset(&cab, 0, sizeof(cab));
 
-		// Reescreve o bloco com a lista de entradas com o conteúdo de 'newBlock'
-		lseek(fd, BLOCK_OFFSET(inode->i_block[0]), SEEK_SET);
-		write(fd, newBlock, block_size); 
+	// Tenta dividir o caminho entre 'prefix' e 'name'
+	if (caminho.size() > sizeof(cab.name))
+	{
+		divisao = caminho.rfind('/', sizeof(cab.prefix));
 
-		// Pega a nova posição da última entrada
-		lastEntry = getLastEntry(inode, group);
+		if (divisao != string::npos && caminho.size() - divisao - 1 > sizeof(cab.name))
+			divisao = string::npos;
+	}
 
-		lseek(fd, BLOCK_OFFSET(inode->i_block[0]), SEEK_SET);
-		read(fd, newBlock, block_size);
+	if ((caminho.size() > sizeof(cab.name) && divisao == string::npos) || alvo.size() > sizeof(cab.linkname))
+	{
+		const string &longo = (alvo.size() > sizeof(cab.linkname)) ? alvo : caminho;
+		struct ext2_inode vazio;
 
-		newEntry = (struct ext2_dir_entry_2 *)newBlock;
+		memset(&vazio, 0, sizeof(vazio));
+		emiteCabecalhoTar(saida, "././@LongLink", (alvo.size() > sizeof(cab.linkname)) ? 'K' : 'L', &vazio, longo.size() + 1, "");
+		escreveTar(saida, longo.c_str(), longo.size() + 1);
+		escreveTar(saida, NULL, (TAM_REGISTRO_TAR - (longo.size() + 1) % TAM_REGISTRO_TAR) % TAM_REGISTRO_TAR);
 
-		// Se foi removido uma entrada que não era a última, temos que ajustar o rec_len da nova última entrada, 
-		// fazendo 1024 menos a soma do rec_len das entradas anteriores
-		if (lastEntrySize == removedSize)
-		{
-			newEntry = (ext2_dir_entry_2 *)((char *)newEntry + (acc2 - ultimoTam));
-			newEntry->rec_len = 1024 - acc2 + ultimoTam;
-		}
-		else // Se não, recebe a rec_len da entrada que foi removida
+		if (alvo.size() > sizeof(cab.linkname) && caminho.size() > sizeof(cab.name) && divisao == string::npos)
 		{
-			newEntry = (ext2_dir_entry_2 *)((char *)newEntry + (acc2 - ultimoTam));
-			newEntry->rec_len = newEntry->rec_len + removedSize;
+			emiteCabecalhoTar(saida, "././@LongLink", 'L', &vazio, caminho.size() + 1, "");
+			escreveTar(saida, caminho.c_str(), caminho.size() + 1);
+			escreveTar(saida, NULL, (TAM_REGISTRO_TAR - (caminho.size() + 1) % TAM_REGISTRO_TAR) % TAM_REGISTRO_TAR);
 		}
+	}
 
-		lseek(fd, BLOCK_OFFSET(inode->i_block[0]), SEEK_SET);
-		write(fd, newBlock, block_size);
-		
-		free(block);
+	if (divisao != string::npos)
+	{
+		memcpy(cab.prefix, caminho.data(), divisao);
+		memcpy(cab.name, caminho.data() + divisao + 1, caminho.size() - divisao - 1);
 	}
+	else
+		memcpy(cab.name, caminho.data(), min(caminho.size(), sizeof(cab.name)));
+
+	memcpy(cab.linkname, alvo.data(), min(alvo.size(), sizeof(cab.linkname)));
+	numeroTar(cab.mode, sizeof(cab.mode), inode->i_mode & 07777);
+	numeroTar(cab.uid, sizeof(cab.uid), inode->i_uid);
+	numeroTar(cab.gid, sizeof(cab.gid), inode->i_gid);
+	numeroTar(cab.size, sizeof(cab.size), tamanho);
+	numeroTar(cab.mtime, sizeof(cab.mtime), inode->i_mtime);
+	cab.typeflag = tipo;
+	memcpy(cab.magic, "ustar", 6);
+	memcpy(cab.version, "00", 2);
+	snprintf(cab.chksum, sizeof(cab.chksum), "%06o", checksumTar(&cab));
+	cab.chksum[7] = ' ';
+
+	escreveTar(saida, (char *)&cab, sizeof(cab));
 }
 
-/* Marca o inode de número 'bitVal' como desocupado no bitmap de Inodes de 'group'
+/* Emite no fluxo 'saida' o Inode 'numInode' com o caminho 'caminho' e, se for um diretório, toda a sua subárvore
 
-Utilizado nas funções rm e rmdir
-bitVal: número do inode a ser desmarcado no bitmap de Inodes de 'group'
+Os dados dos arquivos são lidos pelo mapa de blocos diretamente para o buffer de saída, agrupando blocos contíguos;
+buracos são emitidos como zeros
 */
-void unset_inode_bitmap(struct ext2_group_desc *group, int bitVal)
+static void emiteTarNo(struct SaidaTar *saida, unsigned int numInode, const string &caminho, const vector<struct ext2_group_desc> &grupos)
 {
-	char *bitmap;
-
-	int y = (bitVal) / 8; // Pega o byte em que se encontra o Inode
-	int x = (bitVal) % 8; // Pega o offset no byte
-
-	// Exemplo:
-	// bitVal = 10110011 = 179
-	// y = 22
-	// x = 3
-	// marcado = 11111110 << 3 = 11110000
-	// marcado = 11110000 | (11111111 >> 5) = 11110000 | 00000111 = 11110111
+	struct ext2_inode inode;
 
-	int marcado = (0xFE << x);
+	if (read_inode_by_number(numInode, grupos, &inode) < 0)
+		return;
 
-	marcado = marcado | (0xFF >> (8 - x));
+	unsigned long long tamanho = tamanhoInode(&inode);
 
-	bitmap = (char *)malloc(block_size);
+	if (S_ISDIR(inode.i_mode))
+	{
+		vector<struct EntradaDir> entradas;
 
-	lseek(fd, BLOCK_OFFSET(group->bg_inode_bitmap), SEEK_SET);
-	read(fd, bitmap, block_size);
+		emiteCabecalhoTar(saida, caminho + "/", '5', &inode, 0, "");
+		le_entradas_diretorio(&inode, entradas);
 
-	char tmp = bitmap[y];
+		for (auto &entrada : entradas)
+		{
+			if (entrada.nome != "." && entrada.nome != "..")
+				emiteTarNo(saida, entrada.inode, caminho + "/" + entrada.nome, grupos);
+		}
+	}
+	else if (S_ISLNK(inode.i_mode))
+	{
+		string alvo;
 
-	tmp = (tmp & marcado);
+		if (inode.i_blocks == 0)
+			alvo.assign((char *)inode.i_block, tamanho);
+		else
+		{
+			vector<char> bloco(block_size);
+			read_block(inode.i_block[0], bloco.data());
+			alvo.assign(bloco.data(), min(tamanho, (unsigned long long)block_size));
+		}
 
-	bitmap[y] = tmp;
+		emiteCabecalhoTar(saida, caminho, '2', &inode, 0, alvo);
+	}
+	else if (S_ISREG(inode.i_mode))
+	{
+		vector<unsigned int> blocos;
+		unsigned long maxBlocos = saida->buffer.size() / block_size;
 
-	// Reescreve o bitmap com o bitmap no qual foi desmarcado o Inode
-	lseek(fd, BLOCK_OFFSET(group->bg_inode_bitmap), SEEK_SET);
-	write(fd, bitmap, block_size);
+		emiteCabecalhoTar(saida, caminho, '0', &inode, tamanho, "");
+		resolve_block_map(&inode, blocos, NULL);
 
-	// Atualiza o número de Inodes livres
-	group->bg_free_inodes_count = group->bg_free_inodes_count + 1;
-	super.s_free_inodes_count = super.s_free_inodes_count + 1;
+		for (unsigned long i = 0; i < blocos.size();)
+		{
+			unsigned long n = 1;
+			unsigned long long offset = (unsigned long long)i * block_size;
 
-	free(bitmap);
-}
+			// Agrupa blocos físicos contíguos, ou buracos consecutivos
+			while (i + n < blocos.size() && n < maxBlocos &&
+				   (blocos[i] ? blocos[i + n] == blocos[i] + n : blocos[i + n] == 0))
+				n++;
 
-/* Remove o diretório de nome 'nome'
+			size_t bytes = n * block_size;
 
-nome: nome do diretório a ser removido
-grupoAtual: variável global que indica o grupo corrente
-*/
-void funct_rmdir(struct ext2_inode *inode, struct ext2_group_desc *group, char *nome, int grupoAtual)
-{
-	int numGrupo = grupoAtual;
-	int numblocos = 0;
-	long valorInodeTmp;
+			if (offset + bytes > tamanho)
+				bytes = tamanho - offset;
 
-	struct ext2_group_desc *grupoTemp = (struct ext2_group_desc *)malloc(sizeof(struct ext2_group_desc));
-	struct ext2_inode *inodeTemp = (struct ext2_inode *)malloc(sizeof(struct ext2_inode));
-	memcpy(grupoTemp, group, sizeof(struct ext2_group_desc));
-	memcpy(inodeTemp, inode, sizeof(struct ext2_inode));
+			if (blocos[i] == 0)
+				escreveTar(saida, NULL, bytes);
+			else if (read_image(reservaTar(saida, bytes), bytes, BLOCK_OFFSET(blocos[i])) != (ssize_t)bytes)
+				saida->erro = 1;
 
-	read_dir(inodeTemp, grupoTemp, &valorInodeTmp, nome);
+			i += n;
+		}
 
-	trocaGrupo(&valorInodeTmp, grupoTemp, &numGrupo);
+		escreveTar(saida, NULL, (TAM_REGISTRO_TAR - tamanho % TAM_REGISTRO_TAR) % TAM_REGISTRO_TAR);
+	}
+}
 
-	unsigned int index = valorInodeTmp % super.s_inodes_per_group;
+/* Emite a entrada de nome 'nome' do diretório atual, com toda a sua subárvore, como um fluxo tar POSIX
 
-	read_inode(index, grupoTemp, inodeTemp);
+destino: arquivo ou pipe nomeado do host, ou '-' para a saída padrão
+*/
+void funct_tarexport(struct ext2_inode *inode, struct ext2_group_desc *group, char *nome, char *destino)
+{
+	long numInode;
+	vector<struct ext2_group_desc> grupos;
+	struct SaidaTar saida;
+	auto inicio = chrono::steady_clock::now();
 
-	numblocos = inodeTemp->i_blocks;
+	read_dir(inode, group, &numInode, nome);
 
-	if (valorInodeTmp == -1)
+	if (numInode < 0)
 	{
 		printf("\nfile not found.\n");
 		return;
 	}
-	if (S_ISDIR(inodeTemp->i_mode) == 0)
-	{
-		printf("\nnot a directory.\n");
-		return;
-	}
 
-	// Se não há entradas no diretório
-	if (!isLoaded(inodeTemp, grupoTemp))
+	if (!strcmp(destino, "-"))
 	{
-		trocaGrupoBlock(inodeTemp->i_block[0], grupoTemp, &numGrupo); // Localiza e muda para o grupo correspondente do primeiro bloco do diretório
-		unset_block_bitmap(grupoTemp, inodeTemp->i_block[0]); 		  // Marca o bloco como desocupado no bitmap de blocos do grupo correspondente
-		removeEntry(inode, group, nome); 							  // Remove o diretório da lista de entradas do diretório pai
-		unset_inode_bitmap(group, valorInodeTmp); 					  // Marca o Inode do diretório como desocupado no bitmap de Inodes do grupo correspondente
-		rewriteSuperAndGroup(grupoTemp, grupoAtual);				  // Atualiza o número de Blocos e Inodes livres
+		fflush(stdout);
+		saida.fd = STDOUT_FILENO;
 	}
-	else
+	else if ((saida.fd = open(destino, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
 	{
-		printf("\ndirectory not empty.\n");
+		perror(destino);
+		return;
 	}
 
-	free(inodeTemp);
-	free(grupoTemp);
-}
-
-/* Remove o arquivo de nome 'nome'
-
-nome: nome do arquivo a ser removido
-grupoAtual: variável global que indica o grupo corrente
-*/
-void funct_rm(struct ext2_inode *inode, struct ext2_group_desc *group, char *nome, int grupoAtual)
-{
-	int contador = 0;
-	int numGrupo = grupoAtual;
-	int numblocos = 0;
-	int fileSize = 0;
-	long valorInodeTmp;
-
-	struct ext2_group_desc *grupoTemp = (struct ext2_group_desc *)malloc(sizeof(struct ext2_group_desc));
-	struct ext2_inode *inodeTemp = (struct ext2_inode *)malloc(sizeof(struct ext2_inode));
-	memcpy(grupoTemp, group, sizeof(struct ext2_group_desc));
-	memcpy(inodeTemp, inode, sizeof(struct ext2_inode));
-
-	read_dir(inodeTemp, grupoTemp, &valorInodeTmp, nome);
+	saida.buffer.resize(TAM_BUFFER_EXPORTACAO);
+	saida.usado = 0;
+	saida.total = 0;
+	saida.erro = 0;
 
-	if (valorInodeTmp == -1)
-	{
-		printf("\nfile not found.\n");
-		return;
-	}
+	read_group_descs(grupos);
+	emiteTarNo(&saida, numInode, nome, grupos);
 
-	// Localiza o grupo do Inode do arquivo a ser removido
-	unsigned int block_group = ((valorInodeTmp)-1) / super.s_inodes_per_group;
+	// Dois registros zerados encerram o arquivo, que é completado até um múltiplo de TAM_BLOCO_TAR
+	escreveTar(&saida, NULL, 2 * TAM_REGISTRO_TAR);
+	escreveTar(&saida, NULL, (TAM_BLOCO_TAR - (saida.total + saida.usado) % TAM_BLOCO_TAR) % TAM_BLOCO_TAR);
+	descarregaTar(&saida);
 
-	lseek(fd, BASE_OFFSET + block_size + sizeof(struct ext2_group_desc) * block_group, SEEK_SET);
-	read(fd, group, sizeof(struct ext2_group_desc));
+	if (saida.fd != STDOUT_FILENO)
+		close(saida.fd);
 
-	unsigned int index = valorInodeTmp % super.s_inodes_per_group;
+	double segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
 
-	// Obtém a estrutura do Inode do arquivo a ser removido
-	read_inode(index, grupoTemp, inodeTemp);
+	// Com a saída padrão ocupada pelo fluxo, o resumo vai para a saída de erro
+	fprintf(saida.fd == STDOUT_FILENO ? stderr : stdout, "\n%llu bytes written in %.3f s.\n", saida.total, segundos);
 
-	numblocos = inodeTemp->i_blocks;
+	if (saida.erro)
+		fprintf(stderr, "%s: write error.\n", destino);
+}
 
-	if (S_ISDIR(inodeTemp->i_mode))
+// Lê exatamente 'n' bytes do fluxo 'entrada' em 'destino' (ou os descarta, se 'destino' for nulo). Retorna -1 se o fluxo terminar antes
+static int leTar(struct EntradaTar *entrada, char *destino, unsigned long long n)
+{
+	while (n > 0)
 	{
-		printf("\nnot a file.\n");
-		return;
-	}
+		if (entrada->inicio == entrada->fim)
+		{
+			ssize_t lidos = read(entrada->fd, entrada->buffer.data(), entrada->buffer.size());
 
-	// Desmarca todos os blocos do Inode do arquivo e atualiza a contagem de blocos em 'super' e 'group'
+			if (lidos <= 0)
+				return -1;
 
-	unsigned int *singleInd = (unsigned int *)malloc(sizeof(unsigned int) * 256);
-	unsigned int *doubleInd = (unsigned int *)malloc(sizeof(unsigned int) * 256);
-	
-	fileSize = inodeTemp->i_size;
+			entrada->inicio = 0;
+			entrada->fim = lidos;
+		}
 
-	for (int i = 0; i < 12 && fileSize > 0; i++)
-	{
-		trocaGrupoBlock(inodeTemp->i_block[i], grupoTemp, &numGrupo);
-		unset_block_bitmap(grupoTemp, inodeTemp->i_block[i]);
-		rewriteSuperAndGroup(grupoTemp, numGrupo);
+		size_t parte = entrada->fim - entrada->inicio;
+
+		if (parte > n)
+			parte = n;
+
+		if (destino)
+		{
+			memcpy(destino, entrada->buffer.data() + entrada->inicio, parte);
+			destino += parte;
+		}
 
-		fileSize -= block_size;
-		contador++;
+		entrada->inicio += parte;
+		n -= parte;
 	}
 
-	lseek(fd, BLOCK_OFFSET(inodeTemp->i_block[12]), SEEK_SET);
-	read(fd, singleInd, block_size);
+	return 0;
+}
+
+// Normaliza o caminho 'caminho' de uma entrada tar: remove '/' iniciais e componentes '.'. Retorna -1 se houver componentes '..'
+static int normalizaCaminhoTar(string caminho, string &normalizado)
+{
+	size_t inicio = 0;
+
+	normalizado.clear();
 
-	for (int i = 0; i < 256 && fileSize > 0; i++)
+	while (inicio <= caminho.size())
 	{
-		trocaGrupoBlock(singleInd[i], grupoTemp, &numGrupo);
-		unset_block_bitmap(grupoTemp, singleInd[i]);
-		rewriteSuperAndGroup(grupoTemp, numGrupo);
+		size_t fim = caminho.find('/', inicio);
 
-		fileSize -= block_size;
-		contador++;
-	}
+		if (fim == string::npos)
+			fim = caminho.size();
 
-	lseek(fd, BLOCK_OFFSET(inodeTemp->i_block[13]), SEEK_SET);
-	read(fd, doubleInd, block_size);
+		string componente = caminho.substr(inicio, fim - inicio);
 
-	for (int i = 0; i < 256 && fileSize > 0; i++)
-	{
-		lseek(fd, BLOCK_OFFSET(doubleInd[i]), SEEK_SET);
-		read(fd, singleInd, block_size);
+		if (componente == "..")
+			return -1;
 
-		for (int k = 0; k < 256 && fileSize > 0; k++)
-		{
-			trocaGrupoBlock(singleInd[k], grupoTemp, &numGrupo);
-			unset_block_bitmap(grupoTemp, singleInd[k]);
-			rewriteSuperAndGroup(grupoTemp, numGrupo);
+		if (!componente.empty() && componente != ".")
+			normalizado += (normalizado.empty() ? "" : "/") + componente;
 
-			fileSize -= block_size;
-			contador++;
-		}
+		inicio = fim + 1;
 	}
 
-	removeEntry(inode, group, nome); 					// Remove a entrada correspondente ao arquivo removido da lista de entradas
-	trocaGrupo(&valorInodeTmp, grupoTemp, &numGrupo);   // Garante que o Inode do arquivo removido pertence ao grupo corrente
-	unset_inode_bitmap(grupoTemp, valorInodeTmp);	    // Marca o bit do Inode removido como desocupado no bitmap de Inodes do grupo correspondente
-	rewriteSuperAndGroup(grupoTemp, grupoAtual);		// Atualiza o número de Inodes livres em 'super' e 'group'
-	
-	free(inodeTemp);
-	free(grupoTemp);
+	return 0;
 }
 
-/* Copia os dados do arquivo de nome 'nome' para o arquivo de caminho absoluto 'arquivoDest'
+/* Retorna o índice em 'nos' do diretório de caminho 'caminho', criando-o (e seus ancestrais) com permissões padrão se necessário
 
-nome: nome do arquivo a ser copiado
-arquivoDest: caminho absoluto do arquivo a ser escrito a cópia
+Retorna -1 se não há Inodes livres ou se o caminho pertence a algo que não é um diretório
 */
-void funct_cp(struct ext2_inode *inode, struct ext2_group_desc *group, char *nome, int *grupoAtual, char *arquivoDest)
+static int diretorioTar(struct PlanoAlocacao *plano, vector<struct NoImportado> &nos, map<string, int> &indices, const string &caminho)
 {
-	struct ext2_group_desc *grupoTemp = (struct ext2_group_desc *)malloc(sizeof(struct ext2_group_desc));
-	struct ext2_inode *inodeTemp = (struct ext2_inode *)malloc(sizeof(struct ext2_inode));
+	auto existente = indices.find(caminho);
 
-	int retorno = getArquivoPorNome(inode, group, nome, grupoAtual, inodeTemp, grupoTemp);
-	if (retorno == -1)
-	{
-		printf("\nfile not found.\n");
-		return;
-	}
+	if (existente != indices.end())
+		return S_ISDIR(nos[existente->second].info.st_mode) ? existente->second : -1;
 
-	copiaArquivo(inodeTemp, arquivoDest);
+	size_t barra = caminho.rfind('/');
+	int pai = diretorioTar(plano, nos, indices, barra == string::npos ? "" : caminho.substr(0, barra));
+
+	if (pai < 0)
+		return -1;
+
+	struct NoImportado no;
+
+	memset(&no.info, 0, sizeof(no.info));
+	no.nome = (barra == string::npos) ? caminho : caminho.substr(barra + 1);
+	no.pai = pai;
+	no.info.st_mode = S_IFDIR | 0755;
+	no.info.st_mtime = no.info.st_atime = time(NULL);
+
+	if ((no.inode = planejaInodeDiretorio(plano)) == 0)
+		return -1;
+
+	nos.push_back(no);
+	nos[pai].filhos.push_back(nos.size() - 1);
+	indices[caminho] = nos.size() - 1;
 
-	free(grupoTemp);
-	free(inodeTemp);
+	return nos.size() - 1;
 }
 
-/* Exibe o conteúdo do arquivo de nome 'nome'
+/* Extrai o fluxo tar 'origem' para um novo diretório de nome 'nome' no diretório atual
 
-nome: nome do arquivo
+Os Inodes e blocos são planejados sobre os bitmaps em memória conforme as entradas chegam, e os dados são escritos
+diretamente do fluxo nos blocos planejados. Os metadados são escritos em lotes ordenados apenas ao final, de modo
+que um fluxo truncado não altera a imagem
+origem: arquivo ou pipe nomeado do host (a entrada padrão é usada pelos comandos do shell)
 */
-void funct_cat(struct ext2_inode *inode, struct ext2_group_desc *group, char *nome, int *grupoAtual)
+void funct_tarimport(struct ext2_inode *inode, struct ext2_group_desc *group, int *grupoAtual, char *origem, char *nome)
 {
-	struct ext2_group_desc *grupoTemp = (struct ext2_group_desc *)malloc(sizeof(struct ext2_group_desc));
-	struct ext2_inode *inodeTemp = (struct ext2_inode *)malloc(sizeof(struct ext2_inode));
+	struct PlanoAlocacao plano;
+	struct EntradaTar entrada;
+	vector<struct NoImportado> nos;
+	map<string, int> indices;
+	vector<struct BlocoPlanejado> metadados;
+	vector<pair<unsigned int, struct ext2_inode>> inodes;
+	vector<char> dados(TAM_BUFFER_EXPORTACAO);
+	unsigned long long bytesImportados = 0;
+	auto inicio = chrono::steady_clock::now();
+	long existe;
+	long numDirAtual;
+
+	preparaEscritaDireta(NULL, 0); // Os dados são escritos diretamente na imagem, fora do jornal
 
-	int retorno = getArquivoPorNome(inode, group, nome, grupoAtual, inodeTemp, grupoTemp);
+	read_dir(inode, group, &existe, nome);
 
-	if (retorno == -1)
+	if (existe != -1)
 	{
-		printf("\nfile not found.\n");
+		printf("\nfile already exists.\n");
 		return;
 	}
 
-	if (S_ISDIR(inodeTemp->i_mode))
+	if (strlen(nome) > EXT2_NAME_LEN)
 	{
-		printf("\nnot a file.\n");
+		printf("\nname too long.\n");
 		return;
 	}
 
-	printaArquivo(inodeTemp);
-
-	free(grupoTemp);
-	free(inodeTemp);
-}
+	if ((entrada.fd = open(origem, O_RDONLY)) < 0)
+	{
+		perror(origem);
+		return;
+	}
 
-// Exibe informações do disco e do sistema de arquivos
-void funct_info()
-{
-	printf( //"Reading super-block from device " FD_DEVICE ":\n"
-		"Volume name.....: %s\n"
-		"Image size......: %u bytes\n"
-		"Free space......: %u KiB\n"
-		"Free inodes.....: %u\n"
-		"Free blocks.....: %u\n"
-		"Block size......: %u bytes\n"
-		"Inode size......: %u bytes\n"
-		"Groups count....: %u\n"
-		"Groups size.....: %u blocks\n"
-		"Groups inodes...: %u inodes\n"
-		"Inodetable size.: %lu blocks\n",
+	entrada.buffer.resize(TAM_BUFFER_EXPORTACAO);
+	entrada.inicio = entrada.fim = 0;
 
-		super.s_volume_name,
-		(super.s_blocks_count * block_size),
-		((super.s_free_blocks_count - super.s_r_blocks_count) * block_size) / 1024,
-		
-		super.s_free_inodes_count,
-		super.s_free_blocks_count,
-		block_size,
-		super.s_inode_size,
-		(super.s_blocks_count / super.s_blocks_per_group), 
-		
-		super.s_blocks_per_group,
-		super.s_inodes_per_group,
-		(super.s_inodes_per_group / (block_size / sizeof(struct ext2_inode))));
-}
+	read_dir(inode, group, &numDirAtual, (char *)".");
+	carregaPlano(&plano, (numDirAtual - 1) / super.s_inodes_per_group);
 
-// Exibe os atributos do arquivo ou diretório de nome 'nome'
-void funct_attr(struct ext2_inode *inode, struct ext2_group_desc *group, char *nome, int grupoAtual)
-{
-	struct ext2_group_desc *grupoTemp = (struct ext2_group_desc *)malloc(sizeof(struct ext2_group_desc));
-	struct ext2_inode *inodeTemp = (struct ext2_inode *)malloc(sizeof(struct ext2_inode));
+	nos.push_back(NoImportado());
+	nos[0].nome = nome;
+	nos[0].pai = -1;
+	memset(&nos[0].info, 0, sizeof(nos[0].info));
+	nos[0].info.st_mode = S_IFDIR | 0755;
+	nos[0].info.st_mtime = nos[0].info.st_atime = time(NULL);
+	nos[0].inode = planejaInodeDiretorio(&plano);
+	indices[""] = 0;
 
-	int retorno = getArquivoPorNome(inode, group, nome, &grupoAtual, inodeTemp, grupoTemp);
+	const char *erro = nos[0].inode ? NULL : "not enough free inodes";
+	string nomeLongo, alvoLongo;
+	unsigned long long tamanhoPax = 0;
+	int temTamanhoPax = 0;
+	int registrosZerados = 0;
 
-	if (retorno == -1)
+	while (!erro && registrosZerados < 2)
 	{
-		printf("\nfile not found\n");
-		return;
-	}
+		struct CabecalhoTar cab;
 
-	char is_file = '-';
+		if (leTar(&entrada, (char *)&cab, sizeof(cab)) < 0)
+		{
+			erro = "unexpected end of archive";
+			break;
+		}
 
-	char user_read, user_write, user_exec;
-	char group_read, group_write, group_exec;
-	char other_read, other_write, other_exec;
+		if (cab.name[0] == 0 && checksumTar(&cab) == 8 * ' ')
+		{
+			registrosZerados++;
+			continue;
+		}
 
-	if (S_ISDIR(inodeTemp->i_mode))
-		is_file = 'd';
-	else
-		is_file = 'f';
+		registrosZerados = 0;
 
-	if ((inodeTemp->i_mode) & (EXT2_S_IRUSR))
-		user_read = 'r';
-	else
-		user_read = '-';
+		if (leNumeroTar(cab.chksum, sizeof(cab.chksum)) != checksumTar(&cab))
+		{
+			erro = "bad header checksum";
+			break;
+		}
 
-	if ((inodeTemp->i_mode) & (EXT2_S_IWUSR))
-		user_write = 'w';
-	else
-		user_write = '-';
+		unsigned long long tamanho = temTamanhoPax ? tamanhoPax : leNumeroTar(cab.size, sizeof(cab.size));
+		unsigned long long preenchimento = (TAM_REGISTRO_TAR - tamanho % TAM_REGISTRO_TAR) % TAM_REGISTRO_TAR;
 
-	if ((inodeTemp->i_mode) & (EXT2_S_IXUSR))
-		user_exec = 'x';
-	else
-		user_exec = '-';
+		// Extensões de nome longo (GNU) e cabeçalhos estendidos (pax) valem para a entrada seguinte
+		if (cab.typeflag == 'L' || cab.typeflag == 'K' || cab.typeflag == 'x')
+		{
+			string conteudo(tamanho, 0);
 
-	if ((inodeTemp->i_mode) & (EXT2_S_IRGRP))
-		group_read = 'r';
-	else
-		group_read = '-';
+			if (leTar(&entrada, &conteudo[0], tamanho) < 0 || leTar(&entrada, NULL, preenchimento) < 0)
+			{
+				erro = "unexpected end of archive";
+				break;
+			}
 
-	if ((inodeTemp->i_mode) & (EXT2_S_IWGRP))
-		group_write = 'w';
-	else
-		group_write = '-';
+			if (cab.typeflag == 'L')
+				nomeLongo = conteudo.c_str();
+			else if (cab.typeflag == 'K')
+				alvoLongo = conteudo.c_str();
+			else
+			{
+				// Registros pax: "<tamanho> <chave>=<valor>\n"
+				size_t pos = 0;
 
-	if ((inodeTemp->i_mode) & (EXT2_S_IXGRP))
-		group_exec = 'x';
-	else
-		group_exec = '-';
+				while (pos < conteudo.size())
+				{
+					size_t tamRegistro = strtoul(conteudo.c_str() + pos, NULL, 10);
+					size_t espaco = conteudo.find(' ', pos);
+					size_t igual = conteudo.find('=', pos);
 
-	if ((inodeTemp->i_mode) & (EXT2_S_IROTH))
-		other_read = 'r';
-	else
-		other_read = '-';
+					if (tamRegistro == 0 || espaco == string::npos || igual == string::npos || pos + tamRegistro > conteudo.size())
+						break;
 
-	if ((inodeTemp->i_mode) & (EXT2_S_IWOTH))
-		other_write = 'w';
-	else
-		other_write = '-';
+					string chave = conteudo.substr(espaco + 1, igual - espaco - 1);
+					string valor = conteudo.substr(igual + 1, pos + tamRegistro - igual - 2);
 
-	if ((inodeTemp->i_mode) & (EXT2_S_IXOTH))
-		other_exec = 'x';
-	else
-		other_exec = '-';
+					if (chave == "path")
+						nomeLongo = valor;
+					else if (chave == "linkpath")
+						alvoLongo = valor;
+					else if (chave == "size")
+					{
+						tamanhoPax = strtoull(valor.c_str(), NULL, 10);
+						temTamanhoPax = 1;
+					}
 
-	printf("permissões   uid   gid    tamanho    modificado em\n");
-	printf("%c%c%c%c%c%c%c%c%c%c",
-		   is_file,
-		   user_read, user_write, user_exec,
-		   group_read, group_write, group_exec,
-		   other_read, other_write, other_exec);
-	printf("    %d  ", inodeTemp->i_uid);
-	printf("    %d ", inodeTemp->i_gid);
+					pos += tamRegistro;
+				}
+			}
+			continue;
+		}
 
-	if (inodeTemp->i_size > 1024)
-	{
-		printf("   %.1f KiB", (((float)inodeTemp->i_size) / 1024));
-	}
-	else
-		printf("    %d B ", (inodeTemp->i_size));
+		string caminho;
 
-	time_t tempo = (inodeTemp->i_mtime);
+		if (!nomeLongo.empty())
+			caminho = nomeLongo;
+		else if (cab.prefix[0] && !memcmp(cab.magic, "ustar", 5))
+			caminho = string(cab.prefix, strnlen(cab.prefix, sizeof(cab.prefix))) + "/" + string(cab.name, strnlen(cab.name, sizeof(cab.name)));
+		else
+			caminho = string(cab.name, strnlen(cab.name, sizeof(cab.name)));
 
-	struct tm *ptm = localtime(&tempo);
+		string alvo = alvoLongo.empty() ? string(cab.linkname, strnlen(cab.linkname, sizeof(cab.linkname))) : alvoLongo;
 
-	printf("  %d/%d/%d %d:%d",
-		   ptm->tm_mday, ptm->tm_mon + 1, (ptm->tm_year + 1900),
-		   ptm->tm_hour, ptm->tm_min);
-	printf("\n");
+		nomeLongo.clear();
+		alvoLongo.clear();
+		temTamanhoPax = 0;
 
-	free(inodeTemp);
-	free(grupoTemp);
-}
+		struct stat info;
 
-// Altera o diretório corrente para o diretório de nome 'nome'
-void funct_cd(struct ext2_inode *inode, struct ext2_group_desc *group, int *grupoAtual, char *nome)
-{
-	long int inodeTmp = 0;
+		memset(&info, 0, sizeof(info));
+		info.st_mode = leNumeroTar(cab.mode, sizeof(cab.mode)) & 07777;
+		info.st_uid = leNumeroTar(cab.uid, sizeof(cab.uid));
+		info.st_gid = leNumeroTar(cab.gid, sizeof(cab.gid));
+		info.st_mtime = info.st_atime = leNumeroTar(cab.mtime, sizeof(cab.mtime));
 
-	constroiCaminho(inode, group, &inodeTmp, nome);
+		string normalizado;
+		int ignorar = normalizaCaminhoTar(caminho, normalizado) < 0;
+		int tipoValido = cab.typeflag == '0' || cab.typeflag == 0 || cab.typeflag == '7' || cab.typeflag == '5' || cab.typeflag == '2';
+		size_t barra = normalizado.rfind('/');
+		string nomeEntrada = (barra == string::npos) ? normalizado : normalizado.substr(barra + 1);
 
-	trocaGrupo(&inodeTmp, group, grupoAtual);
+		if (ignorar || !tipoValido || nomeEntrada.size() > EXT2_NAME_LEN ||
+			(cab.typeflag != '5' && (normalizado.empty() || indices.count(normalizado))))
+		{
+			fprintf(stderr, "%s: skipped.\n", caminho.c_str());
 
-	unsigned int index = ((int)inodeTmp) % super.s_inodes_per_group;
+			if (leTar(&entrada, NULL, (cab.typeflag == '5' || cab.typeflag == '2') ? 0 : tamanho + preenchimento) < 0)
+				erro = "unexpected end of archive";
+			continue;
+		}
 
-	read_inode(index, group, inode);
-}
+		// Diretórios: cria (ou atualiza os atributos de um diretório implícito já criado)
+		if (cab.typeflag == '5')
+		{
+			int indice = diretorioTar(&plano, nos, indices, normalizado);
 
-// Lista os arquivos e diretórios do diretório corrente
-void funct_ls(struct ext2_inode *inode, struct ext2_group_desc *group)
-{
-	void *block;
-	if (S_ISDIR(inode->i_mode))
-	{
-		struct ext2_dir_entry_2 *entry;
-		unsigned int size = 0;
+			if (indice < 0)
+			{
+				erro = "not enough free inodes";
+				break;
+			}
 
-		if ((block = malloc(block_size)) == NULL)
-		{ 
-			fprintf(stderr, "\ninsufficient memory\n");
-			close(fd);
-			exit(1);
+			info.st_mode |= S_IFDIR;
+			nos[indice].info = info;
+			continue;
 		}
 
-		// Lista de entradas localizadas no primeiro bloco
-		lseek(fd, BLOCK_OFFSET(inode->i_block[0]), SEEK_SET);
-		read(fd, block, block_size); 
+		int pai = diretorioTar(&plano, nos, indices, barra == string::npos ? "" : normalizado.substr(0, barra));
 
-		entry = (struct ext2_dir_entry_2 *)block; 
+		if (pai < 0)
+		{
+			erro = "not enough free inodes";
+			break;
+		}
+
+		struct NoImportado no;
+
+		no.nome = nomeEntrada;
+		no.pai = pai;
+		no.info = info;
+		no.info.st_mode |= (cab.typeflag == '2') ? S_IFLNK : S_IFREG;
+		no.info.st_size = (cab.typeflag == '2') ? 0 : tamanho;
+		no.alvo = alvo;
+
+		if ((no.inode = planejaInode(&plano, (nos[pai].inode - 1) / super.s_inodes_per_group)) == 0)
+		{
+			erro = "not enough free inodes";
+			break;
+		}
+
+		nos.push_back(no);
+		nos[pai].filhos.push_back(nos.size() - 1);
+		indices[normalizado] = nos.size() - 1;
 
-		while ((size < inode->i_size) && entry->inode)
+		if (cab.typeflag == '2')
 		{
-			char file_name[EXT2_NAME_LEN + 1];
-			memcpy(file_name, entry->name, entry->name_len);
-			file_name[entry->name_len] = 0; 
+			vector<unsigned int> blocosLink;
 
-			printf("%s\n", file_name);
-			printf("inode: %u\n", entry->inode);
-			printf("record length: %u\n", entry->rec_len);
-			printf("name length: %u\n", entry->name_len);
-			printf("file type: %u\n", entry->file_type);
-			printf("\n");
-			
-			entry = (ext2_dir_entry_2 *)((char *)entry + entry->rec_len);
-			size += entry->rec_len;
+			if (montaNoImportado(&plano, nos, nos.size() - 1, numDirAtual, metadados, inodes, blocosLink) < 0)
+				erro = "not enough free blocks";
+			continue;
 		}
 
-		free(block);
-	}
-}
+		// Arquivo regular: planeja os blocos e copia os dados do fluxo para os blocos planejados
+		vector<unsigned int> blocosDados;
+
+		if (montaNoImportado(&plano, nos, nos.size() - 1, numDirAtual, metadados, inodes, blocosDados) < 0)
+		{
+			erro = "not enough free blocks";
+			break;
+		}
 
-/* Preenche 'vetorEntradasDir' com as entradas do diretório corrente e localiza a posição do arquivo a ser renomeado
+		unsigned long maxBlocos = dados.size() / block_size;
 
-nomeArquivo: nome do arquivo a ser renomeado
-posArquivo: posição do arquivo a ser renomeado em 'vetorEntradasDir'
-*/
-void constroiListaDiretorios(struct ext2_inode *inode, struct ext2_group_desc *group, char *nomeArquivo, int *posArquivo)
-{
-	void *block;
+		for (unsigned long i = 0; i < blocosDados.size() && !erro;)
+		{
+			unsigned long n = 1;
 
-	struct ext2_dir_entry_2 *entry;
-	unsigned int size = 0;
+			while (i + n < blocosDados.size() && n < maxBlocos && blocosDados[i + n] == blocosDados[i] + n)
+				n++;
 
-	if ((block = malloc(block_size)) == NULL)
-	{ 
-		fprintf(stderr, "\ninsufficient memory.\n");
-		close(fd);
-		exit(1);
-	}
+			unsigned long long offset = (unsigned long long)i * block_size;
+			size_t bytes = n * block_size;
+			size_t lidos = (offset + bytes > tamanho) ? tamanho - offset : bytes;
+
+			memset(dados.data() + lidos, 0, bytes - lidos);
+
+			if (leTar(&entrada, dados.data(), lidos) < 0)
+				erro = "unexpected end of archive";
+			else if (pwriteContado(fd, dados.data(), bytes, BLOCK_OFFSET(blocosDados[i])) != (ssize_t)bytes)
+				erro = "write error";
+
+			i += n;
+		}
 
-	lseek(fd, BLOCK_OFFSET(inode->i_block[0]), SEEK_SET);
-	read(fd, block, block_size); 
+		if (!erro && leTar(&entrada, NULL, preenchimento) < 0)
+			erro = "unexpected end of archive";
 
-	entry = (struct ext2_dir_entry_2 *)block;
+		bytesImportados += tamanho;
+	}
 
-	int contador = 0;
+	close(entrada.fd);
 
-	while ((size < inode->i_size) && entry->inode)
+	// Com todos os filhos conhecidos, monta os blocos dos diretórios
+	for (size_t i = 0; i < nos.size() && !erro; i++)
 	{
-		struct ext2_dir_entry_2 *proxEntry = (struct ext2_dir_entry_2 *)malloc(sizeof(ext2_dir_entry_2));
-		proxEntry = entry;
+		vector<unsigned int> blocosDir;
 
-		char file_name[EXT2_NAME_LEN + 1];
-		memcpy(file_name, entry->name, entry->name_len);
-		file_name[entry->name_len] = 0;
+		if (S_ISDIR(nos[i].info.st_mode) && montaNoImportado(&plano, nos, i, numDirAtual, metadados, inodes, blocosDir) < 0)
+			erro = "not enough free blocks";
+	}
 
-		if (!strcmp(nomeArquivo, file_name))
-		{
-			*posArquivo = contador;
-		}
+	// Nada foi registrado nos bitmaps em disco: em caso de erro, basta abandonar o plano
+	if (erro)
+	{
+		printf("\n%s: %s.\n", origem, erro);
+		return;
+	}
 
-		vetorEntradasDir.push_back(proxEntry);
+	escreveBlocosOrdenados(metadados);
+	escreveInodesOrdenados(inodes, plano.grupos);
 
-		entry = (ext2_dir_entry_2 *)((char *)entry + entry->rec_len);
-		size += entry->rec_len;
-		contador++;
+	if (adicionaEntradaDiretorio(inode, nome, nos[0].inode, tipoEntrada(S_IFDIR)) < 0)
+		printf("\nno space left in current directory: imported tree is unreachable.\n");
+	else
+	{
+		inode->i_links_count++;
+		write_inode_by_number(numDirAtual, plano.grupos, inode);
 	}
 
-	free(block);
+	unsigned long blocosTotal;
+	unsigned long inodesTotal;
+
+	gravaPlano(&plano, &blocosTotal, &inodesTotal);
+	memcpy(group, &plano.grupos[*grupoAtual], sizeof(struct ext2_group_desc));
 
-	return;
+	double segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+
+	printf("\n%lu inodes, %lu blocks, %llu bytes imported in %.3f s.\n", inodesTotal, blocosTotal, bytesImportados, segundos);
 }
 
-/* Faz com que 'tamanho' seja múltiplo de 4, incrementando seu valor para o próximo múltiplo ou deixando-o com seu valor original  
+/* Controla o jornal de metadados
 
-tamanho: comprimento do nome do arquivo
+'on': ativa o jornal; 'off': aplica as transações pendentes e desativa o jornal; 'sync': aguarda o commit e o checkpoint
+de todas as transações; sem argumento: exibe o estado do jornal
 */
-unsigned int converteParaMult4(unsigned int tamanho)
+void funct_journal(const char *opcao)
 {
-	int qtdDe4 = tamanho / 4;
-	int emTermosde4 = qtdDe4 * 4;
+	if (opcao == NULL)
+	{
+		if (fdJornal < 0)
+		{
+			printf("\njournal: off\n");
+			return;
+		}
 
-	return (tamanho - (emTermosde4)) > 0 ? (emTermosde4 + 4) : emTermosde4;
+		lock_guard<mutex> trava(mutexJornal);
+		printf("\njournal: on\ntransactions: %llu (%llu pending)\ngroup commits: %lu\njournal size: %llu bytes\n"
+			   "blocks awaiting checkpoint: %zu\n",
+			   ultimoTid, ultimoTid - tidDuravel, commitsEmGrupo, tamJornal, blocosPendentes.size());
+	}
+	else if (!strcmp(opcao, "on"))
+	{
+		if (ativaJornal() < 0)
+			perror(FD_JOURNAL);
+	}
+	else if (!strcmp(opcao, "off"))
+		desativaJornal(1);
+	else if (!strcmp(opcao, "sync"))
+		sincronizaJornal();
+	else
+		printf("\ninvalid sintax.\n");
 }
 
-/* Remove o arquivo a ser renomeado de 'vetorEntradasDir', ajusta o 'rec_len' do último elemento e do novo último elemento (arquivo renomeado), e o coloca em 'vetorEntradasDir'
+#define FD_STATS "./nEXT2shell.stats.json" // Destino das estatísticas em JSON ao sair do shell
+#define NUM_FAIXAS_LATENCIA 26			   // Faixa i do histograma: latências abaixo de 2^i microssegundos (a última acumula o resto)
 
-novoNomeArquivo: novo nome para o arquivo de nome 'nomeArquivo'
-nomeArquivo: nome do arquivo a ser renomeado
-pos: posição do arquivo a ser renomeado em 'vetorEntradasDir'
-*/
-void removeAtualizaListaDiretorios(struct ext2_inode *inode, struct ext2_group_desc *group, char *novoNomeArquivo, char *nomeArquivo, int pos)
+// Estatísticas acumuladas de um comando
+struct EstatisticaComando
+{
+	unsigned long chamadas;
+	double segundos;
+	unsigned long histograma[NUM_FAIXAS_LATENCIA];
+	unsigned long long contadores[NUM_CONTADORES];
+};
+
+// Estado dos contadores no início de um comando
+struct MedicaoComando
 {
-	struct ext2_dir_entry_2 *entry_dir_modificado = (struct ext2_dir_entry_2 *)malloc(sizeof(struct ext2_dir_entry_2));
+	int ativa;
+	chrono::steady_clock::time_point inicio;
+	unsigned long long contadores[NUM_CONTADORES];
+};
 
-	entry_dir_modificado->inode = vetorEntradasDir[pos]->inode;
-	entry_dir_modificado->file_type = vetorEntradasDir[pos]->file_type;
-	strcpy(entry_dir_modificado->name, novoNomeArquivo);
+static map<string, struct EstatisticaComando> estatisticas;
 
-	int lenNovoNomeArquivo = strlen(novoNomeArquivo);
+// Marca o início de um comando; sem efeito com as estatísticas desativadas
+[[maybe_unused]] static void iniciaMedicao(struct MedicaoComando *medicao)
+{
+	medicao->ativa = estatisticasAtivas;
 
-	entry_dir_modificado->name_len = lenNovoNomeArquivo;
+	if (!medicao->ativa)
+		return;
 
-	unsigned short recLenDirs = 12;
+	amostraContadores(medicao->contadores);
+	medicao->inicio = chrono::steady_clock::now();
+}
 
-	for (auto i = vetorEntradasDir.begin(); i != vetorEntradasDir.end(); ++i)
-	{
-		if (!strcmp((*i)->name, vetorEntradasDir[pos]->name))
-		{
-			vetorEntradasDir.erase(i);
-			break;
-		}
-	}
+// Acumula em 'comando' o tempo e a variação dos contadores desde iniciaMedicao
+[[maybe_unused]] static void registraMedicao(const char *comando, const struct MedicaoComando *medicao)
+{
+	if (!medicao->ativa || !estatisticasAtivas)
+		return;
 
-	vetorEntradasDir[vetorEntradasDir.size() - 1]->rec_len = 8 + converteParaMult4(vetorEntradasDir[vetorEntradasDir.size() - 1]->name_len);
+	double segundos = chrono::duration<double>(chrono::steady_clock::now() - medicao->inicio).count();
+	struct EstatisticaComando &estatistica = estatisticas[comando];
+	unsigned long long atuais[NUM_CONTADORES];
+	int faixa = 0;
 
-	for (int i = 0; i < vetorEntradasDir.size(); i++)
-	{
-		recLenDirs += vetorEntradasDir[i]->rec_len;
-	}
+	amostraContadores(atuais);
 
-	entry_dir_modificado->rec_len = 1024 - recLenDirs;
+	while (faixa < NUM_FAIXAS_LATENCIA - 1 && segundos * 1e6 >= (double)(1UL << faixa))
+		faixa++;
 
-	vetorEntradasDir.push_back(entry_dir_modificado);
+	estatistica.chamadas++;
+	estatistica.segundos += segundos;
+	estatistica.histograma[faixa]++;
 
-	return;
+	for (int i = 0; i < NUM_CONTADORES; i++)
+		estatistica.contadores[i] += atuais[i] - medicao->contadores[i];
 }
 
-// Escreve as entradas em 'vetorEntradasDir' sobre as entradas antigas na lista de entradas do diretório corrente
-void atualizaListaReal(struct ext2_inode *inode, struct ext2_group_desc *group)
+// Limite superior, em microssegundos, da faixa do histograma que contém o quantil 'q' das chamadas
+static unsigned long quantilLatencia(const struct EstatisticaComando &estatistica, double q)
 {
-	void *block;
+	unsigned long acumulado = 0;
 
-	struct ext2_dir_entry_2 *entry;
-	unsigned int size = 0;
+	for (int faixa = 0; faixa < NUM_FAIXAS_LATENCIA; faixa++)
+	{
+		acumulado += estatistica.histograma[faixa];
+
+		if (acumulado >= q * estatistica.chamadas)
+			return 1UL << faixa;
+	}
+
+	return 1UL << (NUM_FAIXAS_LATENCIA - 1);
+}
+
+// Grava as estatísticas de todos os comandos em 'arquivo', em JSON. Retorna 0 em caso de sucesso e -1 em caso de erro
+static int gravaEstatisticas(const char *arquivo)
+{
+	FILE *saida = fopen(arquivo, "w");
+
+	if (!saida)
+		return -1;
+
+	fprintf(saida, "{\n  \"histogram_bucket_us\": \"bucket i counts latencies below 2^i us\",\n  \"commands\": {");
 
-	if ((block = malloc(block_size)) == NULL)
+	int primeiro = 1;
+
+	for (auto &item : estatisticas)
 	{
-		fprintf(stderr, "\ninsufficient memory.\n");
-		close(fd);
-		exit(1);
+		const struct EstatisticaComando &e = item.second;
+
+		fprintf(saida, "%s\n    \"%s\": {\"calls\": %lu, \"seconds\": %.6f, \"p50_us\": %lu, \"p99_us\": %lu, \"histogram\": [",
+				primeiro ? "" : ",", item.first.c_str(), e.chamadas, e.segundos, quantilLatencia(e, 0.5), quantilLatencia(e, 0.99));
+
+		for (int faixa = 0; faixa < NUM_FAIXAS_LATENCIA; faixa++)
+			fprintf(saida, "%s%lu", faixa ? ", " : "", e.histograma[faixa]);
+
+		fprintf(saida, "]");
+
+		for (int i = 0; i < NUM_CONTADORES; i++)
+			fprintf(saida, ", \"%s\": %llu", nomesContadores[i], e.contadores[i]);
+
+		fprintf(saida, "}");
+		primeiro = 0;
 	}
 
-	lseek(fd, BLOCK_OFFSET(inode->i_block[0]), SEEK_SET);
-	read(fd, block, block_size);
+	fprintf(saida, "\n  }\n}\n");
+
+	return fclose(saida) == 0 ? 0 : -1;
+}
+
+/* Estatísticas por comando: chamadas, histograma de latência, E/S, cache e alocador
+
+'on'/'off': ativa/desativa a coleta; 'reset': descarta o que foi coletado; 'json': grava em FD_STATS;
+sem argumento: exibe uma tabela (latências p50/p99 arredondadas para a potência de 2 acima)
+*/
+void funct_stats(const char *opcao)
+{
+	if (opcao == NULL)
+	{
+		printf("\nstats: %s\n", estatisticasAtivas ? "on" : "off");
+
+		if (estatisticas.empty())
+			return;
 
-	entry = (struct ext2_dir_entry_2 *)block;
+		printf("%-10s %7s %10s %8s %8s %10s %10s %8s %8s %7s %7s %7s %9s %9s\n", "command", "calls", "total ms", "p50 us", "p99 us",
+			   "read KB", "write KB", "blk rd", "blk wr", "seeks", "hits", "misses", "probes", "io ms");
 
-	unsigned int offset_entry = 0;
+		for (auto &item : estatisticas)
+		{
+			const struct EstatisticaComando &e = item.second;
+			const unsigned long long *c = e.contadores;
+
+			printf("%-10s %7lu %10.3f %8lu %8lu %10llu %10llu %8llu %8llu %7llu %7llu %7llu %9llu %9.3f\n", item.first.c_str(),
+				   e.chamadas, e.segundos * 1e3, quantilLatencia(e, 0.5), quantilLatencia(e, 0.99), c[CONT_BYTES_LIDOS] >> 10,
+				   c[CONT_BYTES_ESCRITOS] >> 10, c[CONT_BLOCOS_LIDOS], c[CONT_BLOCOS_ESCRITOS], c[CONT_SALTOS], c[CONT_ACERTOS_CACHE],
+				   c[CONT_FALTAS_CACHE], c[CONT_SONDAGENS], c[CONT_NS_ES] / 1e6);
+		}
+	}
+	else if (!strcmp(opcao, "on"))
+		estatisticasAtivas = true;
+	else if (!strcmp(opcao, "off"))
+		estatisticasAtivas = false;
+	else if (!strcmp(opcao, "reset"))
+		estatisticas.clear();
+	else if (!strcmp(opcao, "json"))
+	{
+		if (gravaEstatisticas(FD_STATS) < 0)
+			perror(FD_STATS);
+		else
+			printf("\nstatistics written to %s.\n", FD_STATS);
+	}
+	else
+		printf("\ninvalid sintax.\n");
+}
 
-	vetorEntradasDir[vetorEntradasDir.size() - 2]->rec_len = 8 + converteParaMult4(vetorEntradasDir[vetorEntradasDir.size() - 2]->name_len);
+/* Ativa ('on', opcionalmente com o arquivo de destino) ou desativa ('off') o rastro de E/S; sem argumento, exibe o estado
 
-	for (int i = 0; i < vetorEntradasDir.size(); i++)
+O rastro pode ser reexecutado sobre uma cópia da imagem com o nEXT2replay
+*/
+void funct_trace(const char *opcao, const char *arquivo)
+{
+	if (opcao == NULL)
 	{
-		lseek(fd, BLOCK_OFFSET(inode->i_block[0]) + offset_entry, SEEK_SET);
-		write(fd, vetorEntradasDir[i], vetorEntradasDir[i]->rec_len);
+		lock_guard<mutex> trava(mutexRastro);
 
-		offset_entry += vetorEntradasDir[i]->rec_len;
+		if (arquivoRastro)
+			printf("\ntrace: on\nrecords: %llu\n", registrosRastro);
+		else
+			printf("\ntrace: off\n");
 	}
+	else if (!strcmp(opcao, "on") && !arquivoRastro)
+	{
+		const char *destino = arquivo ? arquivo : FD_TRACE;
+		FILE *novo = fopen(destino, "w");
 
-	vetorEntradasDir.clear();
-	free(block);
-
-	return;
-}
+		if (!novo)
+		{
+			perror(destino);
+			return;
+		}
 
-// Renomeia o arquivo de nome 'nomeArquivo' para 'novoNomeArquivo'
-void funct_rename(struct ext2_inode *inode, struct ext2_group_desc *group, char *nomeArquivo, char *novoNomeArquivo)
-{
-	int posArquivo;
+		fprintf(novo, "# nEXT2shell trace v1 block_size=%d\n", block_size);
 
-	constroiListaDiretorios(inode, group, nomeArquivo, &posArquivo); // Preenche vetor auxiliar com as entradas do diretório e localiza o arquivo a ser renomeado
+		lock_guard<mutex> trava(mutexRastro);
+		arquivoRastro = novo;
+		registrosRastro = 0;
+		inicioRastro = chrono::steady_clock::now();
+		rastreamentoAtivo = true;
+	}
+	else if (!strcmp(opcao, "off") && arquivo == NULL)
+	{
+		aguardaCommits(); // Inclui no rastro as escritas do jornal ainda em andamento
+		rastreamentoAtivo = false;
 
-	removeAtualizaListaDiretorios(inode, group, novoNomeArquivo, nomeArquivo, posArquivo); // Cria uma nova entrada com o novo nome, remove a entrada antiga, e adiciona
-																						   // a nova entrada no fim do vetor
+		lock_guard<mutex> trava(mutexRastro);
 
-	atualizaListaReal(inode, group); // Atualiza as entradas do diretório corrente com as entradas do vetor auxiliar
+		if (arquivoRastro)
+		{
+			fclose(arquivoRastro);
+			arquivoRastro = NULL;
+			printf("\n%llu records traced.\n", registrosRastro);
+		}
+	}
+	else if (strcmp(opcao, "on"))
+		printf("\ninvalid sintax.\n");
 }
 
 // Retorna o caminho armazenado em 'caminhoVetor'
 char *caminhoAtual(vector<string> caminhoVetor)
 {
-	char *caminho = (char *)calloc(100, sizeof(char));
+	size_t tamanho = 2;
+
+	for (auto &nome : caminhoVetor)
+		tamanho += nome.size() + 1;
+
+	char *caminho = (char *)alocaTemporario(tamanho);
+	caminho[0] = 0;
 
 	if (caminhoVetor.empty()) // Não armazenamos 'root' em 'caminhoVetor'
 	{
@@ -1966,9 +8401,16 @@ char *caminhoAtual(vector<string> caminhoVetor)
 
 comandoPrincipal: identificador do comando
 comandoInteiro: sintaxe inteira do comando
+
+Os argumentos que nomeiam entradas da imagem aceitam caminhos absolutos ou relativos ('/a/b/c', '../x'), resolvidos
+por resolveAlvo; o comando recebe o diretório que contém o último componente
 */
 int executarComando(char *comandoPrincipal, int num_argumentos, char **comandoInteiro, struct ext2_inode *inode, struct ext2_group_desc *group)
 {
+	struct AlvoCaminho alvo;
+	vector<struct AlvosDiretorio> alvos;
+
+	alvo.inode = inode;
 	if (!strcmp(comandoPrincipal, "info"))
 	{
 		if (num_argumentos != 1)
@@ -1980,21 +8422,145 @@ int executarComando(char *comandoPrincipal, int num_argumentos, char **comandoIn
 	}
 	else if (!strcmp(comandoPrincipal, "cat"))
 	{
-		if (num_argumentos != 2)
+		if (num_argumentos < 2)
+		{
+			printf("\ninvalid sintax.\n");
+			return 1;
+		}
+		if (num_argumentos > 2 || temCoringa(comandoInteiro[1]))
+		{
+			if (agrupaAlvos(comandoInteiro + 1, num_argumentos - 1, alvos) < 0)
+				return 1;
+			funct_cat_lote(alvos);
+		}
+		else
+		{
+			if (resolveAlvo(comandoInteiro[1], inode, group, &alvo) < 0)
+				return 1;
+			funct_cat(alvo.inode, alvo.group, alvo.nome, &alvo.numGrupo);
+		}
+	}
+	else if (!strcmp(comandoPrincipal, "read"))
+	{
+		char *fimOffset, *fimTamanho;
+
+		if (num_argumentos != 4)
+		{
+			printf("\ninvalid sintax.\n");
+			return 1;
+		}
+
+		unsigned long long offset = strtoull(comandoInteiro[2], &fimOffset, 0);
+		unsigned long long tamanho = strtoull(comandoInteiro[3], &fimTamanho, 0);
+
+		if (*fimOffset || *fimTamanho || comandoInteiro[2][0] == '-' || comandoInteiro[3][0] == '-')
+		{
+			printf("\ninvalid sintax.\n");
+			return 1;
+		}
+
+		if (resolveAlvo(comandoInteiro[1], inode, group, &alvo) < 0)
+			return 1;
+		funct_read(alvo.inode, alvo.group, alvo.nome, offset, tamanho);
+	}
+	else if (!strcmp(comandoPrincipal, "write"))
+	{
+		char *fimOffset;
+
+		if (num_argumentos != 4)
+		{
+			printf("\ninvalid sintax.\n");
+			return 1;
+		}
+
+		unsigned long long offset = strtoull(comandoInteiro[2], &fimOffset, 0);
+
+		if (*fimOffset || comandoInteiro[2][0] == '-')
+		{
+			printf("\ninvalid sintax.\n");
+			return 1;
+		}
+
+		if (resolveAlvo(comandoInteiro[1], inode, group, &alvo) < 0)
+			return 1;
+		funct_write(alvo.inode, alvo.group, alvo.nome, alvo.numGrupo, offset, comandoInteiro[3], 0);
+	}
+	else if (!strcmp(comandoPrincipal, "truncate"))
+	{
+		char *fimTamanho;
+
+		if (num_argumentos != 3)
+		{
+			printf("\ninvalid sintax.\n");
+			return 1;
+		}
+
+		unsigned long long tamanho = strtoull(comandoInteiro[2], &fimTamanho, 0);
+
+		if (*fimTamanho || comandoInteiro[2][0] == '-')
+		{
+			printf("\ninvalid sintax.\n");
+			return 1;
+		}
+
+		if (resolveAlvo(comandoInteiro[1], inode, group, &alvo) < 0)
+			return 1;
+		funct_truncate(alvo.inode, alvo.group, alvo.nome, alvo.numGrupo, tamanho);
+	}
+	else if (!strcmp(comandoPrincipal, "fallocate"))
+	{
+		char *fimOffset, *fimTamanho;
+
+		if (num_argumentos != 4)
 		{
 			printf("\ninvalid sintax.\n");
 			return 1;
 		}
-		funct_cat(inode, group, comandoInteiro[1], &grupoAtual);
+
+		unsigned long long offset = strtoull(comandoInteiro[2], &fimOffset, 0);
+		unsigned long long tamanho = strtoull(comandoInteiro[3], &fimTamanho, 0);
+
+		if (*fimOffset || *fimTamanho || comandoInteiro[2][0] == '-' || comandoInteiro[3][0] == '-')
+		{
+			printf("\ninvalid sintax.\n");
+			return 1;
+		}
+
+		if (resolveAlvo(comandoInteiro[1], inode, group, &alvo) < 0)
+			return 1;
+		funct_fallocate(alvo.inode, alvo.group, alvo.nome, alvo.numGrupo, offset, tamanho);
+	}
+	else if (!strcmp(comandoPrincipal, "append"))
+	{
+		if (num_argumentos != 3)
+		{
+			printf("\ninvalid sintax.\n");
+			return 1;
+		}
+
+		if (resolveAlvo(comandoInteiro[1], inode, group, &alvo) < 0)
+			return 1;
+		funct_write(alvo.inode, alvo.group, alvo.nome, alvo.numGrupo, 0, comandoInteiro[2], 1);
 	}
 	else if (!strcmp(comandoPrincipal, "attr"))
 	{
-		if (num_argumentos != 2)
+		if (num_argumentos < 2)
 		{
 			printf("\ninvalid sintax.\n");
 			return 1;
 		}
-		funct_attr(inode, group, comandoInteiro[1], grupoAtual);
+		if (num_argumentos > 2 || temCoringa(comandoInteiro[1]))
+		{
+			if (agrupaAlvos(comandoInteiro + 1, num_argumentos - 1, alvos) < 0)
+				return 1;
+			funct_attr_lote(alvos);
+		}
+		else
+		{
+			if (resolveAlvo(comandoInteiro[1], inode, group, &alvo) < 0)
+				return 1;
+			funct_attr(alvo.inode, alvo.group, alvo.nome, alvo.numGrupo);
+		}
 	}
 	else if (!strcmp(comandoPrincipal, "cd"))
 	{
@@ -2007,12 +8573,44 @@ int executarComando(char *comandoPrincipal, int num_argumentos, char **comandoIn
 	}
 	else if (!strcmp(comandoPrincipal, "ls"))
 	{
-		if (num_argumentos != 1)
+		int longo = (num_argumentos >= 2 && !strcmp(comandoInteiro[1], "-l"));
+
+		if (num_argumentos - longo > 2)
 		{
 			printf("\ninvalid sintax.\n");
 			return 1;
 		}
-		funct_ls(inode, group);
+
+		// 'ls [-l] caminho' lista outro diretório
+		struct ext2_inode dir;
+
+		if (num_argumentos - longo == 2)
+		{
+			vector<struct ext2_group_desc> grupos;
+
+			read_group_descs(grupos);
+
+			unsigned int numDir = resolveCaminhoCache(comandoInteiro[num_argumentos - 1], grupos);
+
+			if (numDir == 0 || read_inode_by_number(numDir, grupos, &dir) < 0)
+			{
+				printf("\ndirectory not found.\n");
+				return 1;
+			}
+
+			if (!S_ISDIR(dir.i_mode))
+			{
+				printf("\nnot a directory.\n");
+				return 1;
+			}
+		}
+		else
+			memcpy(&dir, inode, sizeof(struct ext2_inode));
+
+		if (longo)
+			funct_ls_longo(&dir, group);
+		else
+			funct_ls(&dir, group);
 	}
 	else if (!strcmp(comandoPrincipal, "pwd"))
 	{
@@ -2033,43 +8631,102 @@ int executarComando(char *comandoPrincipal, int num_argumentos, char **comandoIn
 			printf("\ninvalid sintax.\n");
 			return 1;
 		}
-		funct_rename(inode, group, comandoInteiro[1], comandoInteiro[2]);
+		if (resolveAlvo(comandoInteiro[1], inode, group, &alvo) < 0)
+			return 1;
+		funct_rename(alvo.inode, alvo.group, alvo.nome, comandoInteiro[2]);
 	}
 	else if (!strcmp(comandoPrincipal, "cp"))
 	{
-		if (num_argumentos != 3)
+		if (num_argumentos < 3)
 		{
 			printf("\ninvalid sintax.\n");
 			return 1;
 		}
-		funct_cp(inode, group, comandoInteiro[1], &grupoAtual, comandoInteiro[2]);
+		if (num_argumentos > 3 || temCoringa(comandoInteiro[1]))
+		{
+			// Com vários arquivos, o último argumento é um diretório do host
+			if (agrupaAlvos(comandoInteiro + 1, num_argumentos - 2, alvos) < 0)
+				return 1;
+			funct_cp_lote(alvos, comandoInteiro[num_argumentos - 1]);
+		}
+		else
+		{
+			if (resolveAlvo(comandoInteiro[1], inode, group, &alvo) < 0)
+				return 1;
+			funct_cp(alvo.inode, alvo.group, alvo.nome, &alvo.numGrupo, comandoInteiro[2]);
+		}
 	}
 	else if (!strcmp(comandoPrincipal, "mkdir"))
 	{
-		if (num_argumentos != 2)
+		if (num_argumentos < 2)
 		{
 			printf("\ninvalid sintax.\n");
 			return 1;
 		}
-		funct_mkdir(inode, group, comandoInteiro[1], grupoAtual);
+		if (num_argumentos > 2)
+		{
+			if (agrupaAlvos(comandoInteiro + 1, num_argumentos - 1, alvos) < 0)
+				return 1;
+			funct_cria_lote(alvos, 1);
+			alvo.inode = NULL; // Os diretórios alterados podem incluir o corrente
+		}
+		else
+		{
+			if (resolveAlvo(comandoInteiro[1], inode, group, &alvo) < 0)
+				return 1;
+			funct_mkdir(alvo.inode, alvo.group, alvo.nome, alvo.numGrupo);
+		}
 	}
 	else if (!strcmp(comandoPrincipal, "touch"))
 	{
-		if (num_argumentos != 2)
+		if (num_argumentos < 2)
 		{
 			printf("\ninvalid sintax.\n");
 			return 1;
 		}
-		funct_touch(inode, group, comandoInteiro[1], grupoAtual);
+		if (num_argumentos > 2)
+		{
+			if (agrupaAlvos(comandoInteiro + 1, num_argumentos - 1, alvos) < 0)
+				return 1;
+			funct_cria_lote(alvos, 0);
+			alvo.inode = NULL; // Os diretórios alterados podem incluir o corrente
+		}
+		else
+		{
+			if (resolveAlvo(comandoInteiro[1], inode, group, &alvo) < 0)
+				return 1;
+			funct_touch(alvo.inode, alvo.group, alvo.nome, alvo.numGrupo);
+		}
 	}
 	else if (!strcmp(comandoPrincipal, "rm"))
 	{
-		if (num_argumentos != 2)
+		int recursivo = (num_argumentos >= 2 && !strcmp(comandoInteiro[1], "-r"));
+
+		if (num_argumentos - recursivo < 2)
 		{
 			printf("\ninvalid sintax.\n");
 			return 1;
 		}
-		funct_rm(inode, group, comandoInteiro[1], grupoAtual);
+		if (recursivo)
+		{
+			if (agrupaAlvos(comandoInteiro + 2, num_argumentos - 2, alvos) < 0)
+				return 1;
+			funct_rm_recursivo(alvos);
+			alvo.inode = NULL; // Os diretórios alterados podem incluir o corrente
+		}
+		else if (num_argumentos > 2 || temCoringa(comandoInteiro[1]))
+		{
+			if (agrupaAlvos(comandoInteiro + 1, num_argumentos - 1, alvos) < 0)
+				return 1;
+			funct_rm_lote(alvos);
+			alvo.inode = NULL; // Os diretórios alterados podem incluir o corrente
+		}
+		else
+		{
+			if (resolveAlvo(comandoInteiro[1], inode, group, &alvo) < 0)
+				return 1;
+			funct_rm(alvo.inode, alvo.group, alvo.nome, alvo.numGrupo);
+		}
 	}
 	else if (!strcmp(comandoPrincipal, "rmdir"))
 	{
@@ -2078,92 +8735,274 @@ int executarComando(char *comandoPrincipal, int num_argumentos, char **comandoIn
 			printf("\ninvalid sintax.\n");
 			return 1;
 		}
-		funct_rmdir(inode, group, comandoInteiro[1], grupoAtual);
+		if (resolveAlvo(comandoInteiro[1], inode, group, &alvo) < 0)
+			return 1;
+		funct_rmdir(alvo.inode, alvo.group, alvo.nome, alvo.numGrupo);
+	}
+	else if (!strcmp(comandoPrincipal, "defrag"))
+	{
+		const char *caminho = ".";
+		unsigned long long limite = 0;
+		int simulacao = 0, i;
+
+		// defrag [-n] [-t MB/s] [caminho]
+		for (i = 1; i < num_argumentos && comandoInteiro[i][0] == '-'; i++)
+		{
+			char *fim;
+
+			if (!strcmp(comandoInteiro[i], "-n"))
+				simulacao = 1;
+			else if (!strcmp(comandoInteiro[i], "-t") && i + 1 < num_argumentos)
+			{
+				limite = strtoull(comandoInteiro[++i], &fim, 0) << 20;
+
+				if (*fim || comandoInteiro[i][0] == '-')
+				{
+					printf("\ninvalid sintax.\n");
+					return 1;
+				}
+			}
+			else
+			{
+				printf("\ninvalid sintax.\n");
+				return 1;
+			}
+		}
+
+		if (num_argumentos - i > 1)
+		{
+			printf("\ninvalid sintax.\n");
+			return 1;
+		}
+
+		if (i < num_argumentos)
+			caminho = comandoInteiro[i];
+
+		funct_defrag(caminho, limite, simulacao);
+		alvo.inode = NULL; // As contagens do grupo corrente podem ter mudado
+	}
+	else if (!strcmp(comandoPrincipal, "freefrag"))
+	{
+		if (num_argumentos != 1)
+		{
+			printf("\ninvalid sintax.\n");
+			return 1;
+		}
+		funct_freefrag();
+	}
+	else if (!strcmp(comandoPrincipal, "check"))
+	{
+		if (num_argumentos != 1)
+		{
+			printf("\ninvalid sintax.\n");
+			return 1;
+		}
+		funct_check();
+	}
+	else if (!strcmp(comandoPrincipal, "export"))
+	{
+		if (num_argumentos != 3)
+		{
+			printf("\ninvalid sintax.\n");
+			return 1;
+		}
+		if (resolveAlvo(comandoInteiro[1], inode, group, &alvo) < 0)
+			return 1;
+		funct_export(alvo.inode, alvo.group, alvo.nome, comandoInteiro[2]);
+	}
+	else if (!strcmp(comandoPrincipal, "import"))
+	{
+		if (num_argumentos != 3)
+		{
+			printf("\ninvalid sintax.\n");
+			return 1;
+		}
+		if (resolveAlvo(comandoInteiro[2], inode, group, &alvo) < 0)
+			return 1;
+		funct_import(alvo.inode, alvo.group, &alvo.numGrupo, comandoInteiro[1], alvo.nome);
+	}
+	else if (!strcmp(comandoPrincipal, "clone"))
+	{
+		if (num_argumentos == 2 && comandoInteiro[1][0] != '-')
+			funct_clone(NULL, comandoInteiro[1]);
+		else if (num_argumentos == 4 && !strcmp(comandoInteiro[1], "-d") && strcmp(comandoInteiro[2], comandoInteiro[3]))
+			funct_clone(comandoInteiro[2], comandoInteiro[3]);
+		else if (num_argumentos == 4 && !strcmp(comandoInteiro[1], "-a"))
+			funct_clone_aplica(comandoInteiro[2], comandoInteiro[3]);
+		else
+		{
+			printf("\ninvalid sintax.\n");
+			return 1;
+		}
+	}
+	else if (!strcmp(comandoPrincipal, "tarexport"))
+	{
+		if (num_argumentos != 3)
+		{
+			printf("\ninvalid sintax.\n");
+			return 1;
+		}
+		if (resolveAlvo(comandoInteiro[1], inode, group, &alvo) < 0)
+			return 1;
+		funct_tarexport(alvo.inode, alvo.group, alvo.nome, comandoInteiro[2]);
+	}
+	else if (!strcmp(comandoPrincipal, "tarimport"))
+	{
+		if (num_argumentos != 3)
+		{
+			printf("\ninvalid sintax.\n");
+			return 1;
+		}
+		if (resolveAlvo(comandoInteiro[2], inode, group, &alvo) < 0)
+			return 1;
+		funct_tarimport(alvo.inode, alvo.group, &alvo.numGrupo, comandoInteiro[1], alvo.nome);
+	}
+	else if (!strcmp(comandoPrincipal, "journal"))
+	{
+		if (num_argumentos > 2)
+		{
+			printf("\ninvalid sintax.\n");
+			return 1;
+		}
+		funct_journal(num_argumentos == 2 ? comandoInteiro[1] : NULL);
+	}
+	else if (!strcmp(comandoPrincipal, "stats"))
+	{
+		if (num_argumentos > 2)
+		{
+			printf("\ninvalid sintax.\n");
+			return 1;
+		}
+		funct_stats(num_argumentos == 2 ? comandoInteiro[1] : NULL);
+	}
+	else if (!strcmp(comandoPrincipal, "trace"))
+	{
+		if (num_argumentos > 3)
+		{
+			printf("\ninvalid sintax.\n");
+			return 1;
+		}
+		funct_trace(num_argumentos >= 2 ? comandoInteiro[1] : NULL, num_argumentos == 3 ? comandoInteiro[2] : NULL);
 	}
 	else
 	{
 		printf("\nunsupported command.\n");
+		return 1;
 	}
 
+	// O comando agiu sobre outro diretório: as alocações e contagens podem ter mudado as cópias do diretório corrente
+	if (alvo.inode != inode)
+		recarregaDiretorioCorrente(inode, group);
+
 	return 0;
 }
 
+#ifndef NEXT2SHELL_SEM_MAIN // Definido por quem inclui o shell como biblioteca (ex.: nEXT2bench.cpp)
 int main(void)
 {
 	struct ext2_group_desc group;
 	struct ext2_inode inode;
 
-	char *entrada = (char *)malloc(100 * sizeof(char));		 // Comando enviado pelo terminal
-	char **argumentos = (char **)malloc(3 * sizeof(char *)); // Lista de strings/argumentos do comando
-	char *token;											 // Cada parte do comando;
-	int indexArgumentos = 0;								 // Número de partes do comando
-	int numeroArgumentos = 0;
+	char *entrada;				 // Comando enviado pelo terminal
+	vector<char *> argumentos; // Lista de strings/argumentos do comando, sem limite de partes
+	char *token;				 // Cada parte do comando;
+	unsigned long orfaosVistos = 0; // Órfãos liberados até o início do último comando
 
 	init_super(&group, &inode);
 
-	while (1)
+	// Retoma a liberação de órfãos deixada por uma execução interrompida
+	if (super.s_last_orphan)
 	{
-		indexArgumentos = 0;
-		numeroArgumentos = 0;
-
-		char prompt[100] = "";
-
-		strcat(prompt, "[");
-
-		char *caminhoAbsoluto;
-		caminhoAbsoluto = caminhoAtual(vetorCaminhoAtual);
+		fprintf(stderr, "orphan list: resuming release.\n");
+		lock_guard<mutex> trava(mutexSistemaArquivos);
+		recontaLivres();
+		recarregaDiretorioCorrente(&inode, &group); // A cópia do descritor do grupo corrente tinha as contagens antigas
+		iniciaLiberacaoOrfaos();
+	}
 
-		strcat(prompt, caminhoAbsoluto);
+	// Com a saída padrão redirecionada (ex.: 'tarexport . -'), o prompt vai para a saída de erro
+	if (!isatty(STDOUT_FILENO))
+		rl_outstream = stderr;
 
-		strcat(prompt, "]$> ");
+	while (1)
+	{
+		string prompt = string("[") + caminhoAtual(vetorCaminhoAtual) + "]$> ";
 
-		entrada = readline(prompt);
+		entrada = readline(prompt.c_str());
 
-		free(caminhoAbsoluto);
+		// Fim da entrada (Ctrl-D ou fim de um script): encerra como 'exit'
+		if (entrada)
+		{
+			entrada[strcspn(entrada, "\n")] = 0; // Consome o '\n' que o readline coloca;
 
-		entrada[strcspn(entrada, "\n")] = 0; // Consome o '\n' que o readline coloca;
+			if (!entrada[strspn(entrada, " ")]) // Reinicia o processo de entrada se nenhum comando for digitado;
+			{
+				free(entrada);
+				continue;
+			}
 
-		if (!strcmp(entrada, "")) // Reinicia o processo de entrada se nenhum comando for digitado;
-		{
-			continue;
+			add_history(entrada); // Acrescenta o comando no histórico;
 		}
 
-		add_history(entrada); // Acrescenta o comando no histórico;
+		token = entrada ? strtok(entrada, " ") : NULL;
 
-		token = strtok(entrada, " ");
-		if (!(strcasecmp(token, "exit"))) // Sai quando for digitado exit;
+		if (!entrada || !(strcasecmp(token, "exit"))) // Sai quando for digitado exit;
 		{
+			if (!estatisticas.empty() && gravaEstatisticas(FD_STATS) < 0)
+				perror(FD_STATS);
+
+			encerraLiberacaoOrfaos();
+			desativaJornal(0);
+			funct_trace("off", NULL);
+			liberaTemporarios(0);
+			free(entrada);
 			return 0;
 		}
 
-		argumentos[indexArgumentos] = (char *)malloc(50 * sizeof(char));
-		argumentos[indexArgumentos] = token;
-
-		numeroArgumentos++;
+		argumentos.clear();
 
-		token = strtok(NULL, " ");
+		for (; token != NULL; token = strtok(NULL, " ")) // Identifica argumentos do comando
+			argumentos.push_back(token);
 
-		while (token != NULL) // Identifica argumentos do comando
-		{
-			indexArgumentos++;
-			numeroArgumentos++;
+		int num_argumentos = argumentos.size();
 
-			argumentos[indexArgumentos] = (char *)malloc(50 * sizeof(char));
-			argumentos[indexArgumentos] = token;
+		// Os comandos têm prioridade sobre a liberação de órfãos, que pode ter alterado o grupo corrente desde o último comando
+		comandosAguardando++;
+		unique_lock<mutex> trava(mutexSistemaArquivos);
+		comandosAguardando--;
 
-			token = strtok(NULL, " ");
+		if (orfaosLiberados != orfaosVistos)
+		{
+			read_image(&group, sizeof(struct ext2_group_desc), GDT_OFFSET + sizeof(struct ext2_group_desc) * grupoAtual);
+			orfaosVistos = orfaosLiberados;
 		}
 
-		int num_argumentos = indexArgumentos + 1;
+		struct MedicaoComando medicao;
+		iniciaMedicao(&medicao);
+		snprintf(comandoAtual, sizeof(comandoAtual), "%s", argumentos[0]);
 
-		if (executarComando(argumentos[0], num_argumentos, argumentos, &inode, &group) == -1)
+		int status = executarComando(argumentos[0], num_argumentos, argumentos.data(), &inode, &group);
+
+		if (status == -1)
 		{
 			printf("\nunexpected behavior.\n");
 			exit(1);
 		}
 
-		free(argumentos[0]);
+		if (status == 0) // Comandos inválidos não entram nas estatísticas
+			registraMedicao(argumentos[0], &medicao);
+
+		strcpy(comandoAtual, "-");
+
+		confirmaTransacao(); // Cada comando é uma transação do jornal
+		liberaTemporarios(); // Devolve os buffers temporários do comando à arena
+
+		trava.unlock();
+		condOrfaos.notify_all();
+
+		free(entrada);
 	}
 
 	exit(0);
-}
\ No newline at end of file
+}
+#endif
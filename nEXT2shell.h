@@ -63,8 +63,15 @@ struct ext2_super_block
       */
      __u8 s_prealloc_blocks;     /* Nr of blocks to try to preallocate*/
      __u8 s_prealloc_dir_blocks; /* Nr to preallocate for dirs */
-     __u16 s_padding1;
-     __u32 s_reserved[204]; /* Padding to the end of the block */
+     __u16 s_reserved_gdt_blocks; /* Per group desc for online growth */
+     /*
+      * Journaling support valid if EXT3_FEATURE_COMPAT_HAS_JOURNAL set.
+      */
+     __u8 s_journal_uuid[16]; /* uuid of journal superblock */
+     __u32 s_journal_inum;    /* inode number of journal file */
+     __u32 s_journal_dev;     /* device number of journal file */
+     __u32 s_last_orphan;     /* start of list of inodes to delete */
+     __u32 s_reserved[197];   /* Padding to the end of the block */
 };
 
 struct ext2_group_desc